@@ -0,0 +1,150 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#ifndef BATCHWRITER_H
+#define BATCHWRITER_H
+
+#include "libmidi/config.h"
+#include "libmidi/libmidi.h"
+
+#include <stdint.h>
+#include <cstddef> //for size_t
+#include <vector>
+#include <string>
+
+namespace libmidi
+{
+
+/// <summary>
+/// Saves a large number of melodies to files using multiple threads.
+/// </summary>
+/// <remarks>
+/// Each job is either an existing MidiFile or a function that builds the melody.
+/// Jobs are distributed to worker threads that steal work from each other when their own jobs are completed.
+/// Each worker encodes its melodies in a single reusable buffer which is written to the file at once.
+/// </remarks>
+class LIBMIDI_EXPORT MidiBatchWriter {
+public:
+  /// <summary>Defines the function that builds the melody of a job.</summary>
+  /// <param name="oFile">An empty melody to build.</param>
+  /// <param name="iIndex">The index of the job.</param>
+  /// <param name="iUserData">The user data given with the job.</param>
+  /// <returns>True when the melody is built. False to cancel the job.</returns>
+  typedef bool (*BUILD_FUNCTION)(MidiFile & oFile, size_t iIndex, void * iUserData);
+
+  /// <summary>
+  /// Defines the status of a job
+  /// </summary>
+  enum JOB_STATUS
+  {
+    /// <summary>The job is not processed yet.</summary>
+    JOB_PENDING,
+    /// <summary>The melody is saved.</summary>
+    JOB_SUCCESS,
+    /// <summary>The build function of the job failed.</summary>
+    JOB_BUILD_FAILED,
+    /// <summary>The melody could not be saved.</summary>
+    JOB_SAVE_FAILED,
+  };
+
+  /// <summary>
+  /// Defines the statistics of the last run.
+  /// </summary>
+  struct STATISTICS
+  {
+    size_t numJobs;
+    size_t numSucceeded;
+    size_t numFailed;
+    size_t numThreads;
+    uint64_t numBytes; //bytes written to files
+    double elapsedSeconds;
+    double jobsPerSecond;
+    double bytesPerSecond;
+  };
+
+  /// <summary>
+  /// Construct a new instance of MidiBatchWriter.
+  /// </summary>
+  MidiBatchWriter(void);
+
+  /// <summary>Sets the number of worker threads.</summary>
+  /// <param name="iNumThreads">The number of threads. Set to 0 to use the number of cores of the system.</param>
+  void setThreadCount(size_t iNumThreads);
+
+  /// <summary>Adds a job that saves an existing melody.</summary>
+  /// <remarks>The melody must remain valid and unmodified until run() returns.</remarks>
+  /// <param name="iFile">The melody to save.</param>
+  /// <param name="iPath">The path location where the file is to be saved.</param>
+  /// <returns>The index of the job.</returns>
+  size_t addJob(const MidiFile * iFile, const char * iPath);
+
+  /// <summary>Adds a job that builds a melody and saves it.</summary>
+  /// <remarks>The function is called from a worker thread.</remarks>
+  /// <param name="iFunction">The function that builds the melody.</param>
+  /// <param name="iUserData">The user data given to the function.</param>
+  /// <param name="iPath">The path location where the file is to be saved.</param>
+  /// <returns>The index of the job.</returns>
+  size_t addJob(BUILD_FUNCTION iFunction, void * iUserData, const char * iPath);
+
+  /// <summary>Removes all jobs.</summary>
+  void clear();
+
+  /// <summary>Processes all jobs. Returns when all jobs are completed.</summary>
+  /// <returns>True when all jobs succeed. False otherwise.</returns>
+  bool run();
+
+  /// <summary>Get the number of jobs.</summary>
+  size_t getJobCount() const;
+
+  /// <summary>Get the status of a job.</summary>
+  /// <param name="iIndex">The index of the job.</param>
+  JOB_STATUS getJobStatus(size_t iIndex) const;
+
+  /// <summary>Get the number of bytes written for a job.</summary>
+  /// <param name="iIndex">The index of the job.</param>
+  size_t getJobSize(size_t iIndex) const;
+
+  /// <summary>Get the statistics of the last run.</summary>
+  const STATISTICS & getStatistics() const;
+
+private:
+  //private attributes
+  struct JOB
+  {
+    const MidiFile * file;
+    BUILD_FUNCTION function;
+    void * userData;
+    std::string path;
+    JOB_STATUS status;
+    size_t size;
+  };
+  typedef std::vector<JOB> JobList;
+  JobList mJobs;
+  size_t mNumThreads;
+  STATISTICS mStatistics;
+};
+
+}; //namespace libmidi
+
+#endif //BATCHWRITER_H
@@ -0,0 +1,134 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#ifndef ENCODINGCACHE_H
+#define ENCODINGCACHE_H
+
+#include "libmidi/config.h"
+
+#include <stdint.h>
+#include <cstddef> //for size_t
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+
+namespace libmidi
+{
+
+/// <summary>
+/// Keeps the encoded files of recently saved melodies.
+/// </summary>
+/// <remarks>
+/// Encoded files are identified by the content hash of their melody. See MidiFile::getContentHash().
+/// A melody which uses the cache is encoded once and later saves copy the cached file.
+/// The total size of the cached files is bounded: the least recently used files are removed first.
+/// A cache can be shared by many melodies and used by multiple threads at the same time.
+/// </remarks>
+class LIBMIDI_EXPORT MidiEncodingCache {
+public:
+  /// <summary>
+  /// Defines the usage statistics of the cache.
+  /// </summary>
+  struct STATISTICS
+  {
+    uint64_t numHits; //lookups that found a file
+    uint64_t numMisses; //lookups that did not find a file
+    uint64_t numEvictions; //files removed to make room for newer files
+    size_t numEntries; //files in the cache
+    size_t size; //bytes of the files in the cache
+    size_t maxSize;
+  };
+
+  /// <summary>
+  /// Construct a new instance of MidiEncodingCache.
+  /// </summary>
+  /// <param name="iMaxSize">The maximum number of bytes of the cached files.</param>
+  MidiEncodingCache(size_t iMaxSize = DEFAULT_MAX_SIZE);
+  ~MidiEncodingCache(void);
+
+  /// <summary>Sets the maximum number of bytes of the cached files. Files are removed if the cache is too large.</summary>
+  /// <param name="iMaxSize">The maximum number of bytes.</param>
+  void setMaxSize(size_t iMaxSize);
+
+  /// <summary>Get the maximum number of bytes of the cached files.</summary>
+  size_t getMaxSize() const;
+
+  /// <summary>Finds the encoded file of a melody.</summary>
+  /// <param name="iHash">The content hash of the melody.</param>
+  /// <param name="oBuffer">The encoded file. Unchanged if the file is not found.</param>
+  /// <returns>True when the file is found. False otherwise.</returns>
+  bool find(uint64_t iHash, std::vector<uint8_t> & oBuffer);
+
+  /// <summary>Adds the encoded file of a melody. Replaces the previous file of the melody.</summary>
+  /// <remarks>Files larger than the maximum size are not added.</remarks>
+  /// <param name="iHash">The content hash of the melody.</param>
+  /// <param name="iBuffer">The encoded file.</param>
+  /// <param name="iSize">The size of the file in bytes.</param>
+  void insert(uint64_t iHash, const uint8_t * iBuffer, size_t iSize);
+
+  /// <summary>Removes all files. The statistics are not reset.</summary>
+  void clear();
+
+  /// <summary>Get the usage statistics of the cache.</summary>
+  STATISTICS getStatistics() const;
+
+  /// <summary>Resets the hit, miss and eviction counters.</summary>
+  void resetStatistics();
+
+public:
+  //public values & enums
+  static const size_t DEFAULT_MAX_SIZE = 64*1024*1024;
+
+private:
+  //private methods
+  MidiEncodingCache(const MidiEncodingCache &);
+  MidiEncodingCache & operator=(const MidiEncodingCache &);
+
+  /// <summary>Removes the least recently used files until the cache fits in the given size.</summary>
+  void evict(size_t iMaxSize);
+
+private:
+  //private attributes
+  struct ENTRY
+  {
+    uint64_t hash;
+    std::vector<uint8_t> buffer;
+  };
+  typedef std::list<ENTRY> EntryList;
+  typedef std::unordered_map<uint64_t, EntryList::iterator> EntryIndex;
+
+  mutable std::mutex mLock;
+  EntryList mEntries; //most recently used first
+  EntryIndex mIndex;
+  size_t mMaxSize;
+  size_t mSize;
+  uint64_t mNumHits;
+  uint64_t mNumMisses;
+  uint64_t mNumEvictions;
+};
+
+}; //namespace libmidi
+
+#endif //ENCODINGCACHE_H
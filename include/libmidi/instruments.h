@@ -25,162 +25,58 @@
 #ifndef INSTRUMENTS_H
 #define INSTRUMENTS_H
 
+#include "libmidi/config.h"
+
 #include <stdint.h> //for int8_t
+#include <cstddef> //for size_t
 
 namespace libmidi
 {
 
+typedef int8_t INSTRUMENT;
+static const INSTRUMENT MIN_INSTRUMENT = (INSTRUMENT)0x00;
+static const INSTRUMENT MAX_INSTRUMENT = (INSTRUMENT)0x7F;
+static const INSTRUMENT INVALID_INSTRUMENT = (INSTRUMENT)0xFF;
+static const size_t NUM_INSTRUMENTS = 128;
+
 //
 // Description:
-//  Instrument codes according to https://en.wikipedia.org/wiki/General_MIDI
+//  Instrument names indexed by instrument id according to https://en.wikipedia.org/wiki/General_MIDI
 //
-static const char * gInstruments[] = {
-  "Acoustic Grand Piano",
-  "Bright Acoustic Piano",
-  "Electric Grand Piano",
-  "Honky-tonk Piano",
-  "Electric Piano 1",
-  "Electric Piano 2",
-  "Harpsichord",
-  "Clavinet",
-  "Celesta",
-  "Glockenspiel",
-  "Music Box",
-  "Vibraphone",
-  "Marimba",
-  "Xylophone",
-  "Tubular Bells",
-  "Dulcimer",
-  "Drawbar Organ",
-  "Percussive Organ",
-  "Rock Organ",
-  "Church Organ",
-  "Reed Organ",
-  "Accordion",
-  "Harmonica",
-  "Tango Accordion",
-  "Acoustic Guitar (nylon)",
-  "Acoustic Guitar (steel)",
-  "Electric Guitar (jazz)",
-  "Electric Guitar (clean)",
-  "Electric Guitar (muted)",
-  "Overdriven Guitar",
-  "Distortion Guitar",
-  "Guitar Harmonics",
-  "Acoustic Bass",
-  "Electric Bass (finger)",
-  "Electric Bass (pick)",
-  "Fretless Bass",
-  "Slap Bass 1",
-  "Slap Bass 2",
-  "Synth Bass 1",
-  "Synth Bass 2",
-  "Violin",
-  "Viola",
-  "Cello",
-  "Contrabass",
-  "Tremolo Strings",
-  "Pizzicato Strings",
-  "Orchestral Harp",
-  "Timpani",
-  "String Ensemble 1",
-  "String Ensemble 2",
-  "Synth Strings 1",
-  "Synth Strings 2",
-  "Choir Aahs",
-  "Voice Oohs",
-  "Synth Choir",
-  "Orchestra Hit",
-  "Trumpet",
-  "Trombone",
-  "Tuba",
-  "Muted Trumpet",
-  "French Horn",
-  "Brass Section",
-  "Synth Brass 1",
-  "Synth Brass 2",
-  "Soprano Sax",
-  "Alto Sax",
-  "Tenor Sax",
-  "Baritone Sax",
-  "Oboe",
-  "English Horn",
-  "Bassoon",
-  "Clarinet",
-  "Piccolo",
-  "Flute",
-  "Recorder",
-  "Pan Flute",
-  "Blown bottle",
-  "Shakuhachi",
-  "Whistle",
-  "Ocarina",
-  "Lead 1 (square)",
-  "Lead 2 (sawtooth)",
-  "Lead 3 (calliope)",
-  "Lead 4 chiff",
-  "Lead 5 (charang)",
-  "Lead 6 (voice)",
-  "Lead 7 (fifths)",
-  "Lead 8 (bass + lead)",
-  "Pad 1 (new age)",
-  "Pad 2 (warm)",
-  "Pad 3 (polysynth)",
-  "Pad 4 (choir)",
-  "Pad 5 (bowed)",
-  "Pad 6 (metallic)",
-  "Pad 7 (halo)",
-  "Pad 8 (sweep)",
-  "FX 1 (rain)",
-  "FX 2 (soundtrack)",
-  "FX 3 (crystal)",
-  "FX 4 (atmosphere)",
-  "FX 5 (brightness)",
-  "FX 6 (goblins)",
-  "FX 7 (echoes)",
-  "FX 8 (sci-fi)",
-  "Sitar",
-  "Banjo",
-  "Shamisen",
-  "Koto",
-  "Kalimba",
-  "Bagpipe",
-  "Fiddle",
-  "Shanai",
-  "Tinkle Bell",
-  "Agogo",
-  "Steel Drums",
-  "Woodblock",
-  "Taiko Drum",
-  "Melodic Tom",
-  "Synth Drum",
-  "Reverse Cymbal",
-  "Guitar Fret Noise",
-  "Breath Noise",
-  "Seashore",
-  "Bird Tweet",
-  "Telephone Ring",
-  "Helicopter",
-  "Applause",
-  "Gunshot"
+LIBMIDI_EXPORT extern const char * const gInstruments[NUM_INSTRUMENTS];
+
+/// <summary>
+/// Defines how an instrument name is matched by findInstrument().
+/// </summary>
+enum INSTRUMENT_MATCH
+{
+  /// <summary>The name must match exactly. Default value.</summary>
+  INSTRUMENT_MATCH_EXACT = 0,
+  /// <summary>Upper and lower case letters are considered equal.</summary>
+  INSTRUMENT_MATCH_IGNORE_CASE = 1,
+  /// <summary>The given name is the beginning of the instrument name. The matching instrument with the lowest id is returned.</summary>
+  INSTRUMENT_MATCH_PREFIX = 2,
 };
 
-typedef int8_t INSTRUMENT;
-static const INSTRUMENT MIN_INSTRUMENT = (INSTRUMENT)0x00;
-static const INSTRUMENT MAX_INSTRUMENT = (INSTRUMENT)0x7F;
-static const INSTRUMENT INVALID_INSTRUMENT = (INSTRUMENT)0xFF;
+/// <summary>Finds a MIDI intrument id by name.</summary>
+/// <param name="iName">The given name of the intrument.</param>
+/// <returns>An identifier that matches the given instrument name.
+/// Returns INVALID_INSTRUMENT if the name is unknown, NULL, or empty.
+/// </returns>
+LIBMIDI_EXPORT INSTRUMENT findInstrument(const char * iName);
 
 /// <summary>Finds a MIDI intrument id by name.</summary>
 /// <param name="iName">The given name of the intrument.</param>
+/// <param name="iMatchFlags">A combination of INSTRUMENT_MATCH values.</param>
 /// <returns>An identifier that matches the given instrument name.
 /// Returns INVALID_INSTRUMENT if the name is unknown, NULL, or empty.
 /// </returns>
-INSTRUMENT findInstrument(const char * iName);
+LIBMIDI_EXPORT INSTRUMENT findInstrument(const char * iName, int iMatchFlags);
 
 /// <summary>Get the instrument name that matches the given intrument id.</summary>
 /// <param name="iInstrument">The instrument id to search for.</param>
 /// <returns>Returns the instrument name matching the given id. Returns NULL on invalid intrument id.</returns>
-const char * getInstrumentName(INSTRUMENT iInstrument);
+LIBMIDI_EXPORT const char * getInstrumentName(INSTRUMENT iInstrument);
 
 }; //namespace libmidi
 
@@ -35,6 +35,12 @@
 namespace libmidi
 {
 
+class ByteSink;
+class TrackEncoder;
+class TempoMap;
+class MidiTransform;
+class MidiEncodingCache;
+
 /// <summary>
 /// Defines the MidiFile class.
 /// </summary>
@@ -72,9 +78,10 @@ public:
   /// Supported values are defines by <typeparamref name="MIDI_TYPE">MIDI_TYPE</typeparamref>
   /// </summary>
   /// <remarks>
-  /// The libMIDI library only supports a single track per MIDI file.
+  /// A MidiFile always contains a single track.
   /// Changing the MIDI type does not affect the capabilities of the library
   /// besides changing a single byte in the output file.
+  /// Use MultiTrackMidiFile to save files with multiple tracks.
   /// </remarks>
   /// <param name="iType">The type of MIDI file.</param>
   void setMidiType(MIDI_TYPE iType);
@@ -112,19 +119,222 @@ public:
   /// <param name="iTrackEndingPreference">The prefered track ending method.</param>
   void setTrackEndingPreference(TRACK_ENDING_PREFERENCE iTrackEndingPreference);
 
+  /// <summary>Enables or disables the compact encoding of the melody.</summary>
+  /// <remarks>
+  /// The compact encoding writes note off events as note on events with a velocity of 0
+  /// which allows all the notes of a channel to share the same running status.
+  /// Tempo changes that do not change the tempo are not written.
+  /// The velocity of the note off events is lost. The compact encoding is disabled by default.
+  /// </remarks>
+  /// <param name="iCompact">True to enable the compact encoding.</param>
+  void setCompactEncoding(bool iCompact);
+
   /// <summary>Adds a note to the current melody.</summary>
   /// <param name="iFrequency">The frequency in Hz of the note.</param>
   /// <param name="iDurationMs">The duration of the note in milliseconds.</param>
   void addNote(uint16_t iFrequency, uint16_t iDurationMs);
 
+  /// <summary>Adds a note to the current melody with a microsecond precision.</summary>
+  /// <param name="iFrequency">The frequency in Hz of the note.</param>
+  /// <param name="iDurationUs">The duration of the note in microseconds.</param>
+  void addNoteUs(uint16_t iFrequency, uint32_t iDurationUs);
+
+  /// <summary>Adds multiple notes to the current melody.</summary>
+  /// <remarks>All notes use the current volume. A frequency of 0 adds a delay.</remarks>
+  /// <param name="iFrequencies">The frequencies in Hz of the notes.</param>
+  /// <param name="iDurationsMs">The durations of the notes in milliseconds.</param>
+  /// <param name="iCount">The number of notes to add.</param>
+  void addNotes(const uint16_t * iFrequencies, const uint16_t * iDurationsMs, size_t iCount);
+
+  /// <summary>Preallocates memory for a given number of notes and delays.</summary>
+  /// <param name="iCount">The expected number of notes and delays of the melody.</param>
+  void reserve(size_t iCount);
+
   /// <summary>Adds a delay (silent note) to the current melody.</summary>
   /// <param name="iDurationMs">The delay duration in milliseconds.</param>
   void addDelay(uint16_t iDurationMs);
 
+  /// <summary>Adds a delay (silent note) to the current melody with a microsecond precision.</summary>
+  /// <param name="iDurationUs">The delay duration in microseconds.</param>
+  void addDelayUs(uint32_t iDurationUs);
+
+  /// <summary>Adds a note at a given time of the track.</summary>
+  /// <remarks>
+  /// Unlike addNote(), the note does not start when the previous note ends.
+  /// Notes added with this method can overlap each other and the notes of the melody to play chords on any channel.
+  /// Notes are ordered by start time when the melody is saved. Adding notes in start order is faster.
+  /// </remarks>
+  /// <param name="iStartTicks">The start time of the note in ticks from the beginning of the track.</param>
+  /// <param name="iDurationTicks">The duration of the note in ticks.</param>
+  /// <param name="iPitch">The MIDI pitch of the note. min=0x00 max=0x7f</param>
+  /// <param name="iVelocity">The velocity of the note. min=0x00 max=0x7f</param>
+  /// <param name="iChannel">The MIDI channel of the note. min=0 max=15</param>
+  /// <returns>True when the note is added. False if a value is out of range.</returns>
+  bool addNoteAt(uint32_t iStartTicks, uint32_t iDurationTicks, int8_t iPitch, int8_t iVelocity, uint8_t iChannel);
+
+  /// <summary>Changes the tempo at a given time of the melody.</summary>
+  /// <remarks>
+  /// The time of the change is measured from the beginning of the melody with the durations of the notes.
+  /// A change at time 0 is the same as setTempo(). A change at the time of an existing change replaces it.
+  /// Tempo changes can be added in any order. Adding them in time order is faster.
+  /// Tempo changes are ignored by MultiTrackMidiFile.
+  /// </remarks>
+  /// <param name="iTimeMs">The time of the tempo change in milliseconds.</param>
+  /// <param name="iTempo">The new tempo in usec per quarter note. min=1 max=0xFFFFFF</param>
+  /// <returns>True when the tempo change is added. False if the tempo is out of range.</returns>
+  bool addTempoChange(uint32_t iTimeMs, uint32_t iTempo);
+
   /// <summary>Saves the current melody to a file.</summary>
   /// <param name="iFile">The path location where the file is to be saved.</param>
   /// <returns>True when the file is successfully saved. False otherwise.</returns>
-  bool save(const char * iFile);
+  bool save(const char * iFile) const;
+
+  /// <summary>Saves the current melody to a sink.</summary>
+  /// <remarks>The melody is written to the sink with a single write. The sink is flushed.</remarks>
+  /// <param name="iSink">The destination of the melody.</param>
+  /// <returns>True when the melody is successfully written. False otherwise.</returns>
+  bool save(ByteSink & iSink) const;
+
+  /// <summary>Saves the current melody to a memory buffer.</summary>
+  /// <param name="oBuffer">The output buffer. The buffer is resized to the exact size of the encoded melody.</param>
+  /// <returns>True when the melody is successfully encoded. False otherwise.</returns>
+  bool saveToBuffer(std::vector<uint8_t> & oBuffer) const;
+
+  /// <summary>Saves the current melody to a caller supplied memory buffer.</summary>
+  /// <param name="iBuffer">The output buffer.</param>
+  /// <param name="iBufferSize">The size of the output buffer in bytes.</param>
+  /// <param name="oSize">The size of the encoded melody in bytes. If the buffer is too small, oSize is the required buffer size.</param>
+  /// <returns>True when the melody is successfully encoded. False when the buffer is too small.</returns>
+  bool saveToBuffer(uint8_t * iBuffer, size_t iBufferSize, size_t & oSize) const;
+
+  /// <summary>Saves the current melody to a file by writing only the notes added since the previous call.</summary>
+  /// <remarks>
+  /// The first call writes the whole melody. The melody remembers the state of the encoder before the end of the track.
+  /// The next calls write the new notes and a new end of track over the previous end of the track
+  /// and update the length of the track. The file is identical to the file written by save().
+  /// The whole file is written again if the file is not the one written by the previous call,
+  /// if the settings of the melody changed or if the melody was loaded.
+  /// Melodies with notes added with addNoteAt() or with tempo changes are always written as a whole.
+  /// The file must not be modified between calls.
+  /// </remarks>
+  /// <param name="iFile">The path location where the file is to be saved.</param>
+  /// <returns>True when the file is successfully saved. False otherwise.</returns>
+  bool saveAppend(const char * iFile);
+
+  /// <summary>Computes the size of the current melody once saved.</summary>
+  /// <remarks>Nothing is written and the melody is not modified.</remarks>
+  /// <returns>The exact number of bytes written by save() or saveToBuffer().</returns>
+  size_t computeEncodedSize() const;
+
+  /// <summary>Computes the number of bytes saved by the compact encoding.</summary>
+  /// <remarks>Nothing is written and the melody is not modified.</remarks>
+  /// <returns>The difference between the size of the melody encoded without and with the compact encoding.</returns>
+  size_t computeCompactEncodingSavings() const;
+
+  /// <summary>Computes a hash of the content of the melody.</summary>
+  /// <remarks>
+  /// The hash covers the notes, the notes added with addNoteAt(), the tempo changes and all settings
+  /// of the melody that change the encoded file. Melodies with the same hash are encoded to the same file.
+  /// The hash of the notes is updated as notes are added: computing the hash does not read the notes.
+  /// </remarks>
+  /// <returns>A 64 bits hash of the melody.</returns>
+  uint64_t getContentHash() const;
+
+  /// <summary>Sets the cache of encoded files used by save() and saveToBuffer().</summary>
+  /// <remarks>
+  /// When the cache contains the file of the melody's content hash, the cached file is saved
+  /// without encoding the melody. Otherwise, the encoded melody is added to the cache.
+  /// The cache must remain valid while the melody uses it. The cache can be shared by many melodies.
+  /// </remarks>
+  /// <param name="iCache">The cache of encoded files. NULL to disable the cache.</param>
+  void setEncodingCache(MidiEncodingCache * iCache);
+
+  /// <summary>Get the cache of encoded files. Returns NULL if the melody does not use a cache.</summary>
+  MidiEncodingCache * getEncodingCache() const;
+
+  /// <summary>Loads a melody from a file.</summary>
+  /// <remarks>
+  /// The file is mapped in memory and parsed with loadFromBuffer().
+  /// </remarks>
+  /// <param name="iFile">The path location of the file to load.</param>
+  /// <returns>True when the file is successfully loaded. False otherwise.</returns>
+  bool load(const char * iFile);
+
+  /// <summary>Loads a melody from a memory buffer that contains a Standard MIDI File.</summary>
+  /// <remarks>
+  /// The melody is read from the first track that contains notes. Overlapping notes are truncated
+  /// since the library only supports single tone melodies. The song name, tempo and instrument
+  /// are read from the first matching events of all tracks. Durations are rounded to microseconds.
+  /// The compact encoding is enabled if the melody stops its notes with note on events.
+  /// On failure, the current melody is left unchanged.
+  /// </remarks>
+  /// <param name="iBuffer">The buffer that contains the MIDI file.</param>
+  /// <param name="iBufferSize">The size of the buffer in bytes.</param>
+  /// <returns>True when the melody is successfully loaded. False otherwise.</returns>
+  bool loadFromBuffer(const uint8_t * iBuffer, size_t iBufferSize);
+
+  /// <summary>Get the type of MIDI file.</summary>
+  MIDI_TYPE getMidiType() const;
+
+  /// <summary>Get the melody name.</summary>
+  const char * getName() const;
+
+  /// <summary>Get the current volume.</summary>
+  int8_t getVolume() const;
+
+  /// <summary>Get the current instrument.</summary>
+  int8_t getInstrument() const;
+
+  /// <summary>Get the number of ticks per quarter note.</summary>
+  uint16_t getTicksPerQuarterNote() const;
+
+  /// <summary>Get the tempo in microseconds per quarter note.</summary>
+  uint32_t getTempo() const;
+
+  /// <summary>Get the track ending preference.</summary>
+  TRACK_ENDING_PREFERENCE getTrackEndingPreference() const;
+
+  /// <summary>Returns true if the compact encoding is enabled.</summary>
+  bool isCompactEncoding() const;
+
+  /// <summary>Get the number of notes and delays of the current melody.</summary>
+  size_t getNoteCount() const;
+
+  /// <summary>Get the number of notes added with addNoteAt().</summary>
+  size_t getTimedNoteCount() const;
+
+  /// <summary>Get the number of tempo changes added with addTempoChange().</summary>
+  size_t getTempoChangeCount() const;
+
+  /// <summary>Converts a time of the melody to a number of ticks using the tempo changes of the melody.</summary>
+  /// <param name="iTimeUs">The time to convert in microseconds from the beginning of the melody.</param>
+  /// <returns>A number of ticks from the beginning of the track, rounded down.</returns>
+  uint64_t time2ticks(uint64_t iTimeUs) const;
+
+  /// <summary>Converts a number of ticks to a time of the melody using the tempo changes of the melody.</summary>
+  /// <param name="iTicks">The number of ticks to convert from the beginning of the track.</param>
+  /// <returns>A time in microseconds from the beginning of the melody, rounded down.</returns>
+  uint64_t ticks2time(uint64_t iTicks) const;
+
+  /// <summary>Get the frequency of a note.</summary>
+  /// <param name="iIndex">The index of the note.</param>
+  /// <returns>The frequency in Hz of the note. Returns 0 for delays.</returns>
+  uint16_t getNoteFrequency(size_t iIndex) const;
+
+  /// <summary>Get the duration of a note.</summary>
+  /// <param name="iIndex">The index of the note.</param>
+  /// <returns>The duration of the note in milliseconds, rounded to the nearest millisecond.</returns>
+  uint16_t getNoteDuration(size_t iIndex) const;
+
+  /// <summary>Get the duration of a note with a microsecond precision.</summary>
+  /// <param name="iIndex">The index of the note.</param>
+  /// <returns>The duration of the note in microseconds.</returns>
+  uint32_t getNoteDurationUs(size_t iIndex) const;
+
+  /// <summary>Get the volume of a note.</summary>
+  /// <param name="iIndex">The index of the note.</param>
+  /// <returns>The volume of the note.</returns>
+  int8_t getNoteVolume(size_t iIndex) const;
 
 public:
   //public values & enums
@@ -151,46 +361,160 @@ public:
   /// <param name="iDurationMs">The duration to convert in milliseconds.</param>
   /// <param name="iTicksPerQuarterNote">The given number of ticks per quarter notes.</param>
   /// <param name="iTempo">The given tempo.</param>
-  /// <returns>A number of ticks matching the given duration.</returns>
-  static uint16_t duration2ticks(uint16_t iDurationMs, uint16_t iTicksPerQuarterNote, uint32_t iTempo);
+  /// <returns>A number of ticks matching the given duration, rounded down.</returns>
+  static uint32_t duration2ticks(uint32_t iDurationMs, uint16_t iTicksPerQuarterNote, uint32_t iTempo);
 
   /// <summary>Converts an amount of ticks to a duration.</summary>
   /// <param name="iTicks">The number of ticks to convert.</param>
   /// <param name="iTicksPerQuarterNote">The given number of ticks per quarter notes.</param>
   /// <param name="iTempo">The given tempo.</param>
-  /// <returns>A duration in milliseconds matching the given number of ticks.</returns>
-  static uint16_t ticks2duration(uint16_t iTicks, uint16_t iTicksPerQuarterNote, uint32_t iTempo);
+  /// <returns>A duration in milliseconds matching the given number of ticks, rounded down.</returns>
+  static uint32_t ticks2duration(uint32_t iTicks, uint16_t iTicksPerQuarterNote, uint32_t iTempo);
+
+  /// <summary>Converts an absolute time to an absolute number of ticks.</summary>
+  /// <param name="iTimeUs">The time to convert in microseconds.</param>
+  /// <param name="iTicksPerQuarterNote">The given number of ticks per quarter notes.</param>
+  /// <param name="iTempo">The given tempo.</param>
+  /// <returns>A number of ticks matching the given time, rounded down.</returns>
+  static uint64_t time2ticks(uint64_t iTimeUs, uint16_t iTicksPerQuarterNote, uint32_t iTempo);
+
+  /// <summary>Converts an absolute number of ticks to an absolute time.</summary>
+  /// <param name="iTicks">The number of ticks to convert.</param>
+  /// <param name="iTicksPerQuarterNote">The given number of ticks per quarter notes.</param>
+  /// <param name="iTempo">The given tempo.</param>
+  /// <returns>A time in microseconds matching the given number of ticks, rounded down.</returns>
+  static uint64_t ticks2time(uint64_t iTicks, uint16_t iTicksPerQuarterNote, uint32_t iTempo);
 
 private:
   //private methods
 
-  /// <summary>Converts a note duration to a number of ticks based on the melody's ticks per quarter note and tempo.</summary>
-  /// <param name="iDurationMs">The duration to convert in milliseconds.</param>
-  /// <returns>A number of ticks matching the given duration.</returns>
-  uint16_t duration2ticks(uint16_t iDurationMs);
+  /// <summary>Encodes the events of the melody's track.</summary>
+  /// <param name="w">The writer (or size counter) of the encoded events.</param>
+  /// <param name="iTempoMap">The tempo and the tempo changes of the file.</param>
+  /// <param name="iTempoSetting">True if the tempo and the tempo changes must be written to the track.</param>
+  /// <param name="iChannel">The MIDI channel of the track's events.</param>
+  /// <param name="iCompact">True if the track must use the compact encoding.</param>
+  /// <param name="iTransform">The transform applied to the events.</param>
+  template <typename WRITER>
+  void encodeTrack(WRITER & w, const TempoMap & iTempoMap, bool iTempoSetting, uint8_t iChannel, bool iCompact, const MidiTransform & iTransform) const;
 
-  /// <summary>Converts an amount of ticks to a duration based on the melody's ticks per quarter note and tempo.</summary>
-  /// <param name="iTicks">The number of ticks to convert.</param>
-  /// <returns>A duration in milliseconds matching the given number of ticks.</returns>
-  uint16_t ticks2duration(uint16_t iTicks);
+  /// <summary>Encodes the melody, the notes added with addNoteAt() and the tempo changes as a single ordered stream of events.</summary>
+  /// <param name="w">The writer (or size counter) of the encoded events.</param>
+  /// <param name="ioEncoder">The encoder of the track.</param>
+  /// <param name="iTempoMap">The tempo and the tempo changes of the file.</param>
+  /// <param name="iTempoSetting">True if the tempo changes must be written to the track.</param>
+  /// <param name="iChannel">The MIDI channel of the melody.</param>
+  /// <param name="iTransform">The transform applied to the events. iChannel is already transformed.</param>
+  template <typename WRITER>
+  void encodeTimedNotes(WRITER & w, TrackEncoder & ioEncoder, const TempoMap & iTempoMap, bool iTempoSetting, uint8_t iChannel, const MidiTransform & iTransform) const;
+
+  /// <summary>Adds the tempo changes of the melody to a tempo map.</summary>
+  /// <param name="oTempoMap">The tempo map initialized with the melody's ticks per quarter note and tempo.</param>
+  void initTempoMap(TempoMap & oTempoMap) const;
+
+  /// <summary>Computes the absolute ticks of the tempo changes.</summary>
+  /// <param name="iFirst">The index of the first tempo change to update.</param>
+  void updateTempoChanges(size_t iFirst);
+
+  /// <summary>Encodes the current melody to a memory buffer.</summary>
+  /// <param name="iBuffer">The output buffer.</param>
+  /// <param name="iBufferSize">The size of the output buffer in bytes.</param>
+  /// <param name="iSize">The size of the encoded melody as returned by computeEncodedSize().</param>
+  /// <param name="iTransform">The transform applied to the events.</param>
+  /// <returns>The size of the encoded melody in bytes. A value greater than iBufferSize means that the buffer is too small and nothing is written.</returns>
+  size_t encode(uint8_t * iBuffer, size_t iBufferSize, size_t iSize, const MidiTransform & iTransform) const;
+
+  /// <summary>Computes a hash of the settings, the notes added with addNoteAt() and the tempo changes of the melody.</summary>
+  uint64_t getSettingsHash() const;
+
+  /// <summary>Computes the size of the current melody once saved through a transform.</summary>
+  size_t computeEncodedSize(const MidiTransform & iTransform) const;
+
+  /// <summary>Appends a note read from a MIDI file to the current melody.</summary>
+  /// <param name="iPitch">The MIDI pitch of the note.</param>
+  /// <param name="iVolume">The volume of the note.</param>
+  /// <param name="iDurationUs">The duration of the note in microseconds.</param>
+  void appendLoadedNote(int8_t iPitch, int8_t iVolume, uint64_t iDurationUs);
+
+  /// <summary>Appends a delay read from a MIDI file to the current melody.</summary>
+  /// <param name="iDurationUs">The duration of the delay in microseconds.</param>
+  void appendLoadedDelay(uint64_t iDurationUs);
+
+private:
+  //encodes MidiFile objects as the tracks of a file
+  friend class MultiTrackMidiFile;
+  //renders the notes of the melody
+  friend class MidiRenderer;
+  friend class MidiRealtimeRenderer;
+  //encodes the melody through a transform
+  friend class MidiFileView;
 
 private:
   //private attributes
-  struct NOTE
+  struct NoteList
+  {
+    //notes are stored by columns
+    std::vector<uint16_t> frequencies; //0 for delays
+    std::vector<uint32_t> durations; //in microseconds
+    std::vector<int8_t> volumes;
+    std::vector<int8_t> pitches; //MIDI pitch matching the frequency. Resolved when the note is added.
+    uint64_t hash; //hash of the notes. Updated when notes are added.
+
+    NoteList();
+
+    inline size_t size() const { return frequencies.size(); }
+    inline void push_back(uint16_t iFrequency, uint32_t iDurationUs, int8_t iVolume, int8_t iPitch)
+    {
+      frequencies.push_back(iFrequency);
+      durations.push_back(iDurationUs);
+      volumes.push_back(iVolume);
+      pitches.push_back(iPitch);
+    }
+    void reserve(size_t iSize);
+    void clear();
+    void updateHash(size_t iFirst); //appends the notes from iFirst to the hash
+  };
+  struct TIMED_NOTE
+  {
+    uint32_t startTicks;
+    uint32_t durationTicks;
+    int8_t pitch;
+    int8_t velocity;
+    uint8_t channel;
+  };
+  typedef std::vector<TIMED_NOTE> TimedNoteList;
+  struct TEMPO_CHANGE
   {
-    uint16_t frequency;
-    uint16_t durationMs;
-    int8_t volume;
+    uint64_t timeUs;
+    uint64_t ticks; //computed from the previous tempo changes
+    uint32_t tempo;
   };
-  typedef std::vector<NOTE> NoteList;
+  typedef std::vector<TEMPO_CHANGE> TempoChangeList;
   uint16_t mTicksPerQuarterNote;
   uint32_t mTempo; //usec per quarter note
   std::string mName;
   NoteList mNotes;
+  TimedNoteList mTimedNotes;
+  bool mTimedNotesSorted; //true if mTimedNotes is ordered by start time
+  uint64_t mTimedNotesHash; //hash of mTimedNotes. Updated when notes are added.
+  TempoChangeList mTempoChanges; //ordered by time
   int8_t mVolume; //from 0x00 to 0x7f
   int8_t mInstrument; //from 0x00 to 0x7f
   TRACK_ENDING_PREFERENCE mTrackEndingPreference;
   MIDI_TYPE mType;
+  bool mCompactEncoding;
+  MidiEncodingCache * mEncodingCache;
+  struct APPEND_STATE
+  {
+    std::string path; //file written by saveAppend(). Empty if the whole file must be written again.
+    uint64_t settingsHash; //see getSettingsHash()
+    size_t numNotes; //notes written to the file
+    uint64_t timeUs; //absolute time of the end of the written notes
+    uint64_t ticks; //absolute ticks of the end of the written notes
+    uint64_t tailOffset; //offset of the note off of the last note and of the end of track. Written again by the next call.
+    uint64_t fileSize;
+  };
+  APPEND_STATE mAppendState;
 };
 
 }; //namespace libmidi
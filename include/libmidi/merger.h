@@ -0,0 +1,172 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#ifndef MERGER_H
+#define MERGER_H
+
+#include "libmidi/config.h"
+#include "libmidi/libmidi.h"
+
+#include <stdint.h>
+#include <cstddef> //for size_t
+#include <vector>
+#include <string>
+
+namespace libmidi
+{
+
+class ByteSink;
+
+/// <summary>
+/// Merges the events of multiple melodies or MIDI files into a single Type 0 track.
+/// </summary>
+/// <remarks>
+/// The tracks of all sources are read at the same time and their next events are kept in a min-heap
+/// ordered by absolute ticks. The events are written to the output as they are read:
+/// the merged list of events is never built in memory.
+/// The time of each event is computed with the ticks per quarter note and the tempo changes of its source
+/// and converted to the ticks of the output, which has a constant tempo.
+/// Only the channel events of the sources are merged. Meta events, such as track names and tempo changes, are not copied.
+/// The channels of each source are remapped. By default, all channels of a source are mapped
+/// to the channel given by MultiTrackMidiFile::getDefaultTrackChannel() for the index of the source.
+/// Events at the same ticks are written in the order of the sources.
+/// </remarks>
+class LIBMIDI_EXPORT MidiMerger {
+public:
+  static const size_t INVALID_SOURCE = (size_t)-1;
+
+  /// <summary>
+  /// Construct a new instance of MidiMerger.
+  /// </summary>
+  MidiMerger(void);
+  ~MidiMerger(void);
+
+  /// <summary>Sets the name of the merged track.</summary>
+  /// <param name="iName">The name of the track.</param>
+  void setName(const char * iName);
+
+  /// <summary>Set the number of ticks per quarter note of the merged track.</summary>
+  /// <param name="iTicks">The ticks per quarter note.</param>
+  void setTicksPerQuarterNote(uint16_t iTicks);
+
+  /// <summary>Sets the tempo of the merged track in microseconds per quarter note.</summary>
+  /// <param name="iTempo">The tempo in usec per quarter note.</param>
+  void setTempo(uint32_t iTempo);
+
+  /// <summary>Enables or disables the compact encoding of the merged track. See MidiFile::setCompactEncoding().</summary>
+  /// <param name="iCompact">True to enable the compact encoding.</param>
+  void setCompactEncoding(bool iCompact);
+
+  /// <summary>Get the number of ticks per quarter note of the merged track.</summary>
+  uint16_t getTicksPerQuarterNote() const;
+
+  /// <summary>Get the tempo of the merged track.</summary>
+  uint32_t getTempo() const;
+
+  /// <summary>Adds a melody to merge.</summary>
+  /// <remarks>The melody is encoded when it is added. Later changes to the melody are ignored.</remarks>
+  /// <param name="iFile">The melody.</param>
+  /// <returns>The index of the source. Returns INVALID_SOURCE if the melody cannot be encoded.</returns>
+  size_t addSource(const MidiFile & iFile);
+
+  /// <summary>Adds a MIDI file in memory to merge. All tracks of the file are merged.</summary>
+  /// <remarks>The buffer is not copied and must remain valid until the merger is cleared or deleted.</remarks>
+  /// <param name="iBuffer">The content of the MIDI file.</param>
+  /// <param name="iBufferSize">The size of the buffer in bytes.</param>
+  /// <returns>The index of the source. Returns INVALID_SOURCE if the buffer is not a valid Type 0 or Type 1 MIDI file.</returns>
+  size_t addSource(const uint8_t * iBuffer, size_t iBufferSize);
+
+  /// <summary>Get the number of sources.</summary>
+  size_t getSourceCount() const;
+
+  /// <summary>Maps all channels of a source to a single channel.</summary>
+  /// <param name="iSource">The index of the source.</param>
+  /// <param name="iChannel">The channel of the merged track. min=0 max=15</param>
+  /// <returns>True when the channels are mapped. False on invalid values.</returns>
+  bool setChannel(size_t iSource, uint8_t iChannel);
+
+  /// <summary>Maps a channel of a source to a channel of the merged track.</summary>
+  /// <param name="iSource">The index of the source.</param>
+  /// <param name="iFrom">The channel of the source. min=0 max=15</param>
+  /// <param name="iTo">The channel of the merged track. min=0 max=15</param>
+  /// <returns>True when the channel is mapped. False on invalid values.</returns>
+  bool setChannelMap(size_t iSource, uint8_t iFrom, uint8_t iTo);
+
+  /// <summary>Removes all sources.</summary>
+  void clear();
+
+  /// <summary>Computes the size of the merged file once saved.</summary>
+  /// <returns>The exact number of bytes written by save() or saveToBuffer().</returns>
+  size_t computeEncodedSize() const;
+
+  /// <summary>Saves the merged track to a file.</summary>
+  /// <param name="iFile">The path location where the file is to be saved.</param>
+  /// <returns>True when the file is successfully saved. False otherwise.</returns>
+  bool save(const char * iFile) const;
+
+  /// <summary>Saves the merged track to a sink.</summary>
+  /// <remarks>
+  /// The events are merged twice: once to compute the length of the track and once to write them.
+  /// The events are written to the sink one at a time. Use a sink that buffers small writes such as FileSink.
+  /// </remarks>
+  /// <param name="iSink">The destination of the file.</param>
+  /// <returns>True when the file is successfully written. False otherwise.</returns>
+  bool save(ByteSink & iSink) const;
+
+  /// <summary>Saves the merged track to a memory buffer.</summary>
+  /// <param name="oBuffer">The output buffer. The buffer is resized to the exact size of the encoded file.</param>
+  /// <returns>True when the file is successfully encoded. False otherwise.</returns>
+  bool saveToBuffer(std::vector<uint8_t> & oBuffer) const;
+
+private:
+  struct SOURCE;
+
+  //private methods
+  MidiMerger(const MidiMerger &);
+  MidiMerger & operator=(const MidiMerger &);
+
+
+  /// <summary>Adds a source from a valid MIDI file.</summary>
+  size_t addSource(SOURCE * iSource, const uint8_t * iBuffer, size_t iBufferSize);
+
+  /// <summary>Writes the merged events of all sources.</summary>
+  template <typename WRITER>
+  void encodeTrack(WRITER & w) const;
+
+  /// <summary>Writes the file header, the track header and the merged events.</summary>
+  template <typename WRITER>
+  void encode(WRITER & w, size_t iTrackSize) const;
+
+private:
+  //private attributes
+  std::string mName;
+  uint16_t mTicksPerQuarterNote;
+  uint32_t mTempo; //usec per quarter note
+  bool mCompactEncoding;
+  std::vector<SOURCE*> mSources;
+};
+
+}; //namespace libmidi
+
+#endif //MERGER_H
@@ -0,0 +1,164 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#ifndef MULTITRACK_H
+#define MULTITRACK_H
+
+#include "libmidi/config.h"
+#include "libmidi/libmidi.h"
+
+#include <stdint.h>
+#include <cstddef> //for size_t
+#include <deque>
+#include <vector>
+
+namespace libmidi
+{
+
+class ByteSink;
+
+/// <summary>
+/// Defines a Type 1 MIDI file made of multiple tracks.
+/// </summary>
+/// <remarks>
+/// Each track is a MidiFile with its own notes, name, volume, instrument and track ending preference.
+/// The ticks per quarter note, the tempo and the tempo changes of the tracks are ignored:
+/// all tracks use the values of the MultiTrackMidiFile and the tempo is written to the first track.
+/// By default, the tracks use the 15 melodic channels in turn and the percussion channel (channel 10) is skipped:
+/// from the 16th track on, tracks share channels. setTrackChannel() selects the channel of a track.
+/// Tracks sharing a channel must use the same instrument and the note off and all notes off events
+/// of a track also stop the notes of the other tracks on the same channel.
+/// The tracks are encoded in parallel.
+/// </remarks>
+class LIBMIDI_EXPORT MultiTrackMidiFile {
+public:
+  /// <summary>
+  /// Construct a new instance of MultiTrackMidiFile.
+  /// </summary>
+  MultiTrackMidiFile(void);
+
+  /// <summary>Set the number of ticks per quarter note.</summary>
+  /// <param name="iTicks">The ticks per quarter note.</param>
+  void setTicksPerQuarterNote(uint16_t iTicks);
+
+  /// <summary>Sets the number of beats per minute.</summary>
+  /// <param name="iBpm">The number of beats per minute.</param>
+  void setBeatsPerMinute(uint16_t iBpm);
+
+  /// <summary>Sets the tempo in microseconds per quarter note.</summary>
+  /// <param name="iTempo">The tempo in usec per second.</param>
+  void setTempo(uint32_t iTempo);
+
+  /// <summary>Sets the number of threads used to encode the tracks.</summary>
+  /// <param name="iNumThreads">The number of threads. Set to 0 to use the number of cores of the system.</param>
+  void setThreadCount(size_t iNumThreads);
+
+  /// <summary>Get the number of ticks per quarter note.</summary>
+  uint16_t getTicksPerQuarterNote() const;
+
+  /// <summary>Get the tempo in microseconds per quarter note.</summary>
+  uint32_t getTempo() const;
+
+  /// <summary>Adds an empty track.</summary>
+  /// <remarks>The returned reference remains valid until clear() is called.</remarks>
+  /// <returns>The new track.</returns>
+  MidiFile & addTrack();
+
+  /// <summary>Get the number of tracks.</summary>
+  size_t getTrackCount() const;
+
+  /// <summary>Get a track.</summary>
+  /// <param name="iIndex">The index of the track.</param>
+  MidiFile & getTrack(size_t iIndex);
+  const MidiFile & getTrack(size_t iIndex) const;
+
+  /// <summary>Removes all tracks.</summary>
+  void clear();
+
+  /// <summary>Get the default MIDI channel of a track.</summary>
+  /// <param name="iIndex">The index of the track.</param>
+  /// <returns>The channel of the track from 0 to 15. The percussion channel (9) is skipped.</returns>
+  static uint8_t getDefaultTrackChannel(size_t iIndex);
+
+  /// <summary>Sets the MIDI channel of a track.</summary>
+  /// <param name="iIndex">The index of the track.</param>
+  /// <param name="iChannel">The channel of the track from 0 to 15.</param>
+  /// <returns>True when the channel is set. False if the track or the channel is invalid.</returns>
+  bool setTrackChannel(size_t iIndex, uint8_t iChannel);
+
+  /// <summary>Get the MIDI channel of a track.</summary>
+  /// <param name="iIndex">The index of the track.</param>
+  /// <returns>The channel of the track from 0 to 15.</returns>
+  uint8_t getTrackChannel(size_t iIndex) const;
+
+  /// <summary>Returns true if two tracks with different instruments share a channel.</summary>
+  /// <remarks>The file cannot be saved until the conflict is resolved with setTrackChannel().</remarks>
+  bool hasInstrumentConflict() const;
+
+  /// <summary>Computes the size of the file once saved.</summary>
+  /// <returns>The exact number of bytes written by save() or saveToBuffer().</returns>
+  size_t computeEncodedSize() const;
+
+  /// <summary>Saves all tracks to a file.</summary>
+  /// <param name="iFile">The path location where the file is to be saved.</param>
+  /// <returns>True when the file is successfully saved. False if two tracks with different instruments share a channel or on write error.</returns>
+  bool save(const char * iFile) const;
+
+  /// <summary>Saves all tracks to a sink.</summary>
+  /// <param name="iSink">The destination of the file.</param>
+  /// <returns>True when the file is successfully written. False if two tracks with different instruments share a channel or on write error.</returns>
+  bool save(ByteSink & iSink) const;
+
+  /// <summary>Saves all tracks to a memory buffer.</summary>
+  /// <param name="oBuffer">The output buffer. The buffer is resized to the exact size of the encoded file.</param>
+  /// <returns>True when the file is successfully encoded. False if two tracks with different instruments share a channel.</returns>
+  bool saveToBuffer(std::vector<uint8_t> & oBuffer) const;
+
+private:
+  //private methods
+  typedef std::vector<uint8_t> Buffer;
+  typedef std::vector<Buffer> BufferList;
+
+  /// <summary>Encodes a track (including its header) to a buffer.</summary>
+  void encodeTrack(size_t iIndex, Buffer & oBuffer) const;
+
+  /// <summary>Encodes each track (including its header) to its own buffer.</summary>
+  void encodeTracks(BufferList & oTracks) const;
+
+  /// <summary>Encodes the file header.</summary>
+  void encodeHeader(Buffer & oBuffer) const;
+
+private:
+  //private attributes
+  typedef std::deque<MidiFile> TrackList;
+  uint16_t mTicksPerQuarterNote;
+  uint32_t mTempo; //usec per quarter note
+  size_t mNumThreads;
+  TrackList mTracks;
+  std::vector<uint8_t> mChannels; //channel of each track
+};
+
+}; //namespace libmidi
+
+#endif //MULTITRACK_H
@@ -25,6 +25,8 @@
 #ifndef NOTES_H
 #define NOTES_H
 
+#include <cstddef> //for size_t
+
 namespace libmidi
 {
 
@@ -35,6 +37,14 @@ namespace libmidi
 /// </returns>
 int findNoteFrequency(const char * iName);
 
+/// <summary>Finds a note frequency by name.</summary>
+/// <param name="iName">The given name of the note. The name does not need to be NULL terminated.</param>
+/// <param name="iLength">The length of the given name.</param>
+/// <returns>An identifier that matches the given note name.
+/// Returns -1 if the name is unknown, NULL, or empty.
+/// </returns>
+int findNoteFrequency(const char * iName, size_t iLength);
+
 /// <summary>Get the note name that matches the given frequency.</summary>
 /// <param name="iFreq">The frequency in Hz to search for. The frequency must match an exact note.</param>
 /// <returns>Returns the note name matching the frequency. Returns NULL on invalid frequency.</returns>
@@ -0,0 +1,164 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#ifndef PLAYER_H
+#define PLAYER_H
+
+#include "libmidi/config.h"
+#include "libmidi/libmidi.h"
+
+#include <stdint.h>
+#include <cstddef> //for size_t
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace libmidi
+{
+
+/// <summary>
+/// Plays the events of many melodies at the same time at their wall-clock times.
+/// </summary>
+/// <remarks>
+/// Each melody is a session. The events of a session are the channel events written by MidiFile::save()
+/// placed at their time according to the tempo map of the melody.
+/// A single scheduler thread keeps the next event of each session in a min-heap ordered by deadline
+/// and sleeps until the earliest deadline. Deadlines are absolute times measured from the start of the session,
+/// so the lateness of an event never accumulates over the next events.
+/// The lateness of each delivered event is recorded in a histogram of the session.
+/// </remarks>
+class LIBMIDI_EXPORT MidiPlayer {
+public:
+  /// <summary>
+  /// Defines an event delivered to a session's output.
+  /// </summary>
+  struct EVENT
+  {
+    uint64_t timeUs; //time of the event since the start of the session
+    uint8_t status; //including the channel
+    uint8_t data1; //pitch, controller or program
+    uint8_t data2; //velocity or value. 0 for program change and channel pressure events.
+  };
+
+  /// <summary>Defines the function that receives the events of a session.</summary>
+  /// <remarks>The function is called from the scheduler thread and must return quickly.</remarks>
+  /// <param name="iSession">The index of the session.</param>
+  /// <param name="iEvent">The event.</param>
+  /// <param name="iUserData">The user data given with the session.</param>
+  typedef void (*EVENT_FUNCTION)(size_t iSession, const EVENT & iEvent, void * iUserData);
+
+  /// <summary>
+  /// Defines the lateness statistics of one or all sessions.
+  /// </summary>
+  struct STATISTICS
+  {
+    size_t numSessions;
+    size_t numActiveSessions; //sessions with events not delivered yet
+    uint64_t numEvents; //delivered events
+    uint64_t p50LatenessUs; //median lateness of the events
+    uint64_t p99LatenessUs;
+    uint64_t maxLatenessUs;
+    double averageLatenessUs;
+  };
+
+  static const size_t INVALID_SESSION = (size_t)-1;
+
+  /// <summary>
+  /// Construct a new instance of MidiPlayer.
+  /// </summary>
+  MidiPlayer(void);
+  ~MidiPlayer(void);
+
+  /// <summary>Adds a session that plays a melody.</summary>
+  /// <remarks>
+  /// The melody is copied and can be modified or deleted once the function returns.
+  /// If the player is started, the session starts immediately. Otherwise it starts with start().
+  /// </remarks>
+  /// <param name="iFile">The melody to play.</param>
+  /// <param name="iFunction">The function that receives the events. Set to NULL to use a virtual output that only records the lateness.</param>
+  /// <param name="iUserData">The user data given to the function.</param>
+  /// <returns>The index of the session. Returns INVALID_SESSION if the melody cannot be encoded.</returns>
+  size_t addSession(const MidiFile & iFile, EVENT_FUNCTION iFunction, void * iUserData);
+
+  /// <summary>Removes all sessions and their statistics. Stops the player.</summary>
+  void clear();
+
+  /// <summary>Starts the scheduler thread and the sessions added before.</summary>
+  /// <returns>True when the player is started. False if it is already started.</returns>
+  bool start();
+
+  /// <summary>Stops the scheduler thread. The events not delivered yet are discarded.</summary>
+  void stop();
+
+  /// <summary>Returns true if the scheduler thread is running.</summary>
+  bool isStarted() const;
+
+  /// <summary>Waits until all events of all sessions are delivered.</summary>
+  /// <param name="iTimeoutMs">The maximum waiting time in milliseconds.</param>
+  /// <returns>True when all events are delivered. False on timeout or if the player is not started.</returns>
+  bool wait(uint32_t iTimeoutMs);
+
+  /// <summary>Get the number of sessions.</summary>
+  size_t getSessionCount() const;
+
+  /// <summary>Get the lateness statistics of all sessions.</summary>
+  STATISTICS getStatistics() const;
+
+  /// <summary>Get the lateness statistics of a session.</summary>
+  /// <param name="iSession">The index of the session.</param>
+  /// <returns>The statistics of the session. All values are 0 if the index is invalid.</returns>
+  STATISTICS getSessionStatistics(size_t iSession) const;
+
+  /// <summary>Get the events of a melody with their time.</summary>
+  /// <param name="iFile">The melody.</param>
+  /// <param name="oEvents">The channel events written by MidiFile::save() ordered by time.</param>
+  /// <returns>True when the melody is encoded. False otherwise.</returns>
+  static bool getEvents(const MidiFile & iFile, std::vector<EVENT> & oEvents);
+
+private:
+  struct SESSION;
+  struct DEADLINE
+  {
+    uint64_t timeNs; //absolute time of the next event of the session
+    size_t session;
+  };
+
+  //private methods
+  void run();
+  void schedule(size_t iSession);
+  uint64_t now() const;
+
+  std::vector<SESSION*> mSessions;
+  std::vector<DEADLINE> mDeadlines; //min-heap of the next event of the active sessions
+  mutable std::mutex mLock;
+  std::condition_variable mChanged;
+  std::thread mThread;
+  bool mStarted;
+  bool mStopping;
+};
+
+}; //namespace libmidi
+
+#endif //PLAYER_H
@@ -0,0 +1,246 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#ifndef REALTIMERENDERER_H
+#define REALTIMERENDERER_H
+
+#include "libmidi/config.h"
+#include "libmidi/libmidi.h"
+#include "libmidi/renderer.h"
+#include "libmidi/ringbuffer.h"
+
+#include <stdint.h>
+#include <cstddef> //for size_t
+#include <vector>
+#include <atomic>
+#include <thread>
+
+namespace libmidi
+{
+
+/// <summary>
+/// Renders notes to mono samples in real time for an audio callback.
+/// </summary>
+/// <remarks>
+/// A control thread sends live notes with noteOn(), noteOff() or allNotesOff() and melodies with play()
+/// through two lock-free queues. A render thread applies the live notes at the beginning of the next block
+/// and the notes of the melodies at their sample, renders the playing voices by small blocks
+/// and writes the samples to a lock-free ring buffer. The audio callback calls read() to get the samples.
+/// read() never allocates memory, never locks and never waits. Missing samples are replaced by silence
+/// and reported as underruns. The latency is the size of the ring buffer.
+/// The control methods must be called from a single thread.
+/// </remarks>
+class LIBMIDI_EXPORT MidiRealtimeRenderer {
+public:
+  static const size_t DEFAULT_BUFFER_SIZE = 4096; //samples
+  static const size_t DEFAULT_QUEUE_SIZE = 1024; //notes
+  static const size_t MAX_VOICES = 64;
+
+  /// <summary>
+  /// Defines the statistics of the audio callback since start().
+  /// </summary>
+  struct STATISTICS
+  {
+    uint64_t numCallbacks;
+    uint64_t numUnderruns; //calls to read() that did not get all samples
+    uint64_t numMissingSamples; //samples replaced by silence
+    uint64_t numDroppedEvents; //notes not sent because the queue was full
+    double worstCallbackSeconds;
+    double averageCallbackSeconds;
+  };
+
+  /// <summary>
+  /// Construct a new instance of MidiRealtimeRenderer.
+  /// </summary>
+  /// <param name="iBufferSize">The number of samples of the ring buffer. Rounded up to a power of 2.</param>
+  /// <param name="iQueueSize">The number of events of each queue. Rounded up to a power of 2.</param>
+  MidiRealtimeRenderer(size_t iBufferSize = DEFAULT_BUFFER_SIZE, size_t iQueueSize = DEFAULT_QUEUE_SIZE);
+  ~MidiRealtimeRenderer(void);
+
+  /// <summary>Sets the number of samples per second. Must be called before start().</summary>
+  /// <param name="iSampleRate">The sample rate in Hz. A value of 0 is ignored.</param>
+  void setSampleRate(uint32_t iSampleRate);
+
+  /// <summary>Sets the waveform of the oscillators. Must be called before start().</summary>
+  /// <remarks>WAVEFORM_INSTRUMENT selects the waveform of the instrument of the melodies given to play(). Live notes use a square wave.</remarks>
+  /// <param name="iWaveform">The waveform.</param>
+  void setWaveform(MidiRenderer::WAVEFORM iWaveform);
+
+  /// <summary>Sets the amplitude of a note played at the maximum velocity. Must be called before start().</summary>
+  /// <param name="iGain">The amplitude. Default value is 0.25.</param>
+  void setGain(float iGain);
+
+  /// <summary>Sets the duration of the fade in and fade out of each note. Must be called before start().</summary>
+  /// <param name="iAttackUs">The duration of the fade in in microseconds.</param>
+  /// <param name="iReleaseUs">The duration of the fade out in microseconds. The fade out begins when the note is stopped.</param>
+  void setEnvelope(uint32_t iAttackUs, uint32_t iReleaseUs);
+
+  /// <summary>Get the number of samples per second.</summary>
+  uint32_t getSampleRate() const;
+
+  /// <summary>Starts the render thread.</summary>
+  /// <remarks>Returns once the ring buffer is filled. The statistics are reset.</remarks>
+  /// <returns>True when the render thread is started. False if it is already running.</returns>
+  bool start();
+
+  /// <summary>Stops the render thread. All playing notes are stopped and all pending notes are discarded.</summary>
+  void stop();
+
+  /// <summary>Returns true if the render thread is running.</summary>
+  bool isRunning() const;
+
+  /// <summary>Starts a note as soon as possible.</summary>
+  /// <param name="iPitch">The MIDI pitch of the note. min=0x00 max=0x7f</param>
+  /// <param name="iVelocity">The velocity of the note. min=0x00 max=0x7f</param>
+  /// <param name="iChannel">The channel of the note.</param>
+  /// <returns>True when the note is sent. False if the queue is full.</returns>
+  bool noteOn(int8_t iPitch, int8_t iVelocity, uint8_t iChannel = 0);
+
+  /// <summary>Stops the oldest live note of the given pitch and channel as soon as possible.</summary>
+  /// <remarks>The notes of the melodies are only stopped by their own note off events or by allNotesOff().</remarks>
+  /// <param name="iPitch">The MIDI pitch of the note.</param>
+  /// <param name="iChannel">The channel of the note.</param>
+  /// <returns>True when the event is sent. False if the queue is full.</returns>
+  bool noteOff(int8_t iPitch, uint8_t iChannel = 0);
+
+  /// <summary>Stops all playing notes as soon as possible.</summary>
+  /// <returns>True when the event is sent. False if the queue is full.</returns>
+  bool allNotesOff();
+
+  /// <summary>Plays all notes of a melody from the next rendered sample.</summary>
+  /// <remarks>
+  /// The notes are sent at their exact sample. Waits for the render thread when the queue is full
+  /// and returns once all notes are sent, which may be before they are played.
+  /// Melodies may overlap. Live notes are never delayed by the notes of a melody.
+  /// </remarks>
+  /// <param name="iFile">The melody.</param>
+  /// <returns>True when all notes are sent. False if the render thread is not running or is stopped.</returns>
+  bool play(const MidiFile & iFile);
+
+  /// <summary>Reads the next samples. Called by the audio callback.</summary>
+  /// <remarks>Missing samples are replaced by silence.</remarks>
+  /// <param name="oSamples">The samples.</param>
+  /// <param name="iCount">The number of samples to read.</param>
+  /// <returns>The number of rendered samples read. Less than iCount on an underrun.</returns>
+  size_t read(float * oSamples, size_t iCount);
+
+  /// <summary>Get the number of rendered samples that can be read without an underrun.</summary>
+  size_t getAvailableSamples() const;
+
+  /// <summary>Get the statistics of the audio callback since start().</summary>
+  STATISTICS getStatistics() const;
+
+private:
+  //private attributes
+  enum EVENT_TYPE
+  {
+    EVENT_NOTE_ON,
+    EVENT_NOTE_OFF,
+    EVENT_ALL_NOTES_OFF,
+  };
+  struct EVENT
+  {
+    uint64_t sample; //0 for as soon as possible
+    uint32_t increment; //phase increment per sample
+    float gain;
+    uint8_t type;
+    uint8_t channel;
+    int8_t pitch;
+    uint8_t waveform;
+    uint64_t tag; //0 for a live note. Melody number and note index for the notes of a melody.
+    uint64_t order; //arrival order of a scheduled event, set by the render thread
+  };
+  struct EVENT_LATER
+  {
+    bool operator()(const EVENT & a, const EVENT & b) const
+    {
+      if (a.sample != b.sample)
+        return a.sample > b.sample;
+      return a.order > b.order;
+    }
+  };
+  struct VOICE
+  {
+    bool active;
+    bool releasing;
+    uint8_t channel;
+    int8_t pitch;
+    MidiRenderer::WAVEFORM waveform;
+    uint32_t phase;
+    uint32_t increment;
+    float gain; //current amplitude
+    float sustainGain;
+    float gainStep; //per sample
+    uint32_t rampSamples; //remaining samples of the fade in or fade out
+    uint64_t tag; //tag of the note on event
+    uint64_t age;
+  };
+
+  //private methods
+  bool send(const EVENT & iEvent);
+  void run();
+  void renderBlock(float * oSamples, size_t iCount);
+  void schedule();
+  void apply(const EVENT & iEvent);
+  void renderVoices(float * ioSamples, size_t iCount);
+  void releaseVoice(VOICE & iVoice);
+  uint64_t time2sample(uint64_t iTimeUs) const;
+
+  //settings
+  uint32_t mSampleRate;
+  MidiRenderer::WAVEFORM mWaveform;
+  float mGain;
+  uint32_t mAttackUs;
+  uint32_t mReleaseUs;
+
+  //shared between threads
+  RingBuffer<EVENT> mLiveEvents; //applied as soon as possible
+  RingBuffer<EVENT> mEvents; //events of the melodies sorted by sample within each melody
+  RingBuffer<float> mSamples;
+  std::thread mThread;
+  std::atomic<bool> mRunning;
+  std::atomic<uint64_t> mPosition; //index of the next sample to render
+
+  //owned by the control thread
+  uint32_t mNextMelody;
+
+  //owned by the render thread
+  std::vector<VOICE> mVoices;
+  std::vector<float> mBlock;
+  std::vector<EVENT> mScheduled; //heap of the events of the melodies by sample and arrival order
+  uint64_t mNextOrder;
+  uint64_t mNextAge;
+
+  //statistics
+  std::atomic<uint64_t> mNumCallbacks;
+  std::atomic<uint64_t> mNumUnderruns;
+  std::atomic<uint64_t> mNumMissingSamples;
+  std::atomic<uint64_t> mNumDroppedEvents;
+  std::atomic<uint64_t> mWorstCallbackNs;
+  std::atomic<uint64_t> mTotalCallbackNs;
+};
+
+}; //namespace libmidi
+
+#endif //REALTIMERENDERER_H
@@ -0,0 +1,171 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include "libmidi/config.h"
+#include "libmidi/libmidi.h"
+#include "libmidi/streamwriter.h"
+#include "libmidi/ringbuffer.h"
+
+#include <stdint.h>
+#include <cstddef> //for size_t
+#include <vector>
+#include <atomic>
+#include <thread>
+
+namespace libmidi
+{
+
+/// <summary>
+/// Records live notes to a melody.
+/// </summary>
+/// <remarks>
+/// The notes are timestamped with a monotonic clock when they are captured and pushed
+/// to a preallocated lock-free queue of the input. Capturing a note never allocates memory,
+/// never locks and never waits: when the queue is full the note is dropped.
+/// Each input must be used by a single thread at a time. Use one input per capturing thread.
+/// A drain thread periodically merges the notes of all inputs by time and adds them to the output.
+/// Notes captured at nearly the same time by different inputs are reordered within a window of a few milliseconds.
+/// </remarks>
+class LIBMIDI_EXPORT MidiRecorder {
+public:
+  static const size_t DEFAULT_QUEUE_SIZE = 4096; //events per input
+
+  /// <summary>
+  /// Defines the statistics of the current or last recording.
+  /// </summary>
+  struct STATISTICS
+  {
+    uint64_t numEvents; //captured note on and note off events
+    uint64_t numDroppedEvents; //events not captured because the queue of the input was full
+    uint64_t numNotes; //notes added to the output
+  };
+
+  /// <summary>
+  /// Construct a new instance of MidiRecorder.
+  /// </summary>
+  /// <param name="iNumInputs">The number of inputs. min=1</param>
+  /// <param name="iQueueSize">The number of events of the queue of each input. Rounded up to a power of 2.</param>
+  MidiRecorder(size_t iNumInputs = 1, size_t iQueueSize = DEFAULT_QUEUE_SIZE);
+  ~MidiRecorder(void);
+
+  /// <summary>Starts recording notes to a melody.</summary>
+  /// <remarks>
+  /// The notes are added with MidiFile::addNoteAt() when they end, at the ticks matching their time.
+  /// The melody must not be accessed until stop() returns.
+  /// </remarks>
+  /// <param name="ioFile">The melody.</param>
+  /// <returns>True when the recording is started. False if a recording is in progress.</returns>
+  bool start(MidiFile & ioFile);
+
+  /// <summary>Starts recording notes to a stream writer.</summary>
+  /// <remarks>
+  /// The writer must be opened. The notes are written as a single tone melody:
+  /// a note is stopped when the next note starts. The writer is not closed by stop().
+  /// The writer must not be accessed until stop() returns.
+  /// </remarks>
+  /// <param name="ioWriter">The stream writer.</param>
+  /// <returns>True when the recording is started. False if a recording is in progress or if the writer is not opened.</returns>
+  bool start(MidiStreamWriter & ioWriter);
+
+  /// <summary>Stops recording. All captured notes are added to the output and the playing notes are stopped.</summary>
+  /// <returns>True when all notes are added to the output. False if not recording or if the stream writer failed.</returns>
+  bool stop();
+
+  /// <summary>Returns true if a recording is in progress.</summary>
+  bool isRecording() const;
+
+  /// <summary>Captures the beginning of a note. Wait-free.</summary>
+  /// <param name="iPitch">The MIDI pitch of the note. min=0x00 max=0x7f</param>
+  /// <param name="iVelocity">The velocity of the note. min=0x00 max=0x7f</param>
+  /// <param name="iChannel">The channel of the note. min=0 max=15</param>
+  /// <param name="iInput">The input of the calling thread.</param>
+  /// <returns>True when the event is captured. False if not recording, if the queue is full or on invalid values.</returns>
+  bool noteOn(int8_t iPitch, int8_t iVelocity, uint8_t iChannel = 0, size_t iInput = 0);
+
+  /// <summary>Captures the end of a note. Wait-free.</summary>
+  /// <param name="iPitch">The MIDI pitch of the note. min=0x00 max=0x7f</param>
+  /// <param name="iChannel">The channel of the note. min=0 max=15</param>
+  /// <param name="iInput">The input of the calling thread.</param>
+  /// <returns>True when the event is captured. False if not recording, if the queue is full or on invalid values.</returns>
+  bool noteOff(int8_t iPitch, uint8_t iChannel = 0, size_t iInput = 0);
+
+  /// <summary>Get the number of inputs.</summary>
+  size_t getInputCount() const;
+
+  /// <summary>Get the statistics of the current or last recording.</summary>
+  STATISTICS getStatistics() const;
+
+private:
+  //private attributes
+  struct EVENT
+  {
+    uint64_t timeUs; //since the start of the recording
+    bool noteOn;
+    uint8_t channel;
+    int8_t pitch;
+    int8_t velocity;
+  };
+  struct PLAYING_NOTE
+  {
+    bool playing;
+    int8_t velocity;
+    uint64_t startUs;
+  };
+
+  //private methods
+  bool start(MidiFile * iFile, MidiStreamWriter * iWriter);
+  bool capture(const EVENT & iEvent, size_t iInput);
+  uint64_t getTimeUs() const;
+  void run();
+  void drain(uint64_t iHorizonUs);
+  void write(const EVENT & iEvent);
+  void stopNote(size_t iIndex, uint64_t iEndUs);
+  void writeDelay(uint64_t iEndUs);
+
+  //capture side
+  std::vector<RingBuffer<EVENT>*> mInputs;
+  std::atomic<bool> mRecording;
+  uint64_t mStartNs;
+  std::atomic<uint64_t> mNumEvents;
+  std::atomic<uint64_t> mNumDroppedEvents;
+
+  //drain side
+  std::thread mThread;
+  std::atomic<bool> mStopping;
+  std::vector<EVENT> mPending; //events read from the inputs ordered by time
+  std::vector<PLAYING_NOTE> mPlayingNotes; //indexed by channel and pitch
+  MidiFile * mFile;
+  MidiStreamWriter * mWriter;
+  uint64_t mWriterTimeUs; //end of the melody written to the stream writer
+  size_t mWriterNote; //index of the note playing in the stream writer
+  bool mWriterFailed;
+  std::atomic<uint64_t> mNumNotes;
+};
+
+}; //namespace libmidi
+
+#endif //RECORDER_H
@@ -0,0 +1,232 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include "libmidi/config.h"
+#include "libmidi/libmidi.h"
+
+#include <stdint.h>
+#include <cstddef> //for size_t
+#include <vector>
+
+namespace libmidi
+{
+
+class ByteSink;
+
+/// <summary>
+/// Renders melodies to mono PCM samples with a software synthesizer.
+/// </summary>
+/// <remarks>
+/// Each note is played by its own oscillator and all oscillators are mixed together.
+/// The notes of the melody and the notes added with MidiFile::addNoteAt() are rendered.
+/// The default square wave emulates the output of the Arduino tone() function on a buzzer.
+/// The oscillators are vectorized with SSE2 or NEON when available.
+/// Long melodies can be split in segments rendered in parallel. See setThreadCount().
+/// A MidiRenderer can be used by multiple threads at the same time.
+/// </remarks>
+class LIBMIDI_EXPORT MidiRenderer {
+public:
+  /// <summary>
+  /// Defines the waveform of the oscillators
+  /// </summary>
+  enum WAVEFORM
+  {
+    /// <summary>Square wave. Default value.</summary>
+    WAVEFORM_SQUARE,
+    /// <summary>Sawtooth wave.</summary>
+    WAVEFORM_SAW,
+    /// <summary>Sine wave.</summary>
+    WAVEFORM_SINE,
+    /// <summary>Triangle wave.</summary>
+    WAVEFORM_TRIANGLE,
+    /// <summary>The waveform is selected by the instrument family of the melody. See getInstrumentWaveform().</summary>
+    WAVEFORM_INSTRUMENT,
+  };
+
+  static const uint32_t DEFAULT_SAMPLE_RATE = 44100;
+
+  /// <summary>
+  /// Construct a new instance of MidiRenderer.
+  /// </summary>
+  MidiRenderer(void);
+
+  /// <summary>Sets the number of samples per second.</summary>
+  /// <param name="iSampleRate">The sample rate in Hz. A value of 0 is ignored.</param>
+  void setSampleRate(uint32_t iSampleRate);
+
+  /// <summary>Sets the waveform of the oscillators.</summary>
+  /// <param name="iWaveform">The waveform.</param>
+  void setWaveform(WAVEFORM iWaveform);
+
+  /// <summary>Sets the amplitude of a note played at the maximum volume.</summary>
+  /// <remarks>Overlapping notes are added together. Samples out of [-1, 1] are clipped when converted to 16 bits.</remarks>
+  /// <param name="iGain">The amplitude. Default value is 0.25.</param>
+  void setGain(float iGain);
+
+  /// <summary>Sets the duration of the fade in and fade out of each note.</summary>
+  /// <remarks>Short fades remove the clicks at the beginning and the end of the notes. Fades are disabled by default.</remarks>
+  /// <param name="iAttackUs">The duration of the fade in in microseconds.</param>
+  /// <param name="iReleaseUs">The duration of the fade out in microseconds.</param>
+  void setEnvelope(uint32_t iAttackUs, uint32_t iReleaseUs);
+
+  /// <summary>Sets the number of threads that render a melody.</summary>
+  /// <remarks>
+  /// The samples are split in segments aligned on the internal blocks and each segment is rendered by the next available thread.
+  /// The phase and the envelope of the notes are computed from the sample index so the segments are rendered independently.
+  /// The rendered samples are identical whatever the number of threads.
+  /// </remarks>
+  /// <param name="iNumThreads">The number of threads. Set to 0 to use the number of cores of the system. Default value is 1.</param>
+  void setThreadCount(size_t iNumThreads);
+
+  /// <summary>Get the number of samples per second.</summary>
+  uint32_t getSampleRate() const;
+
+  /// <summary>Get the waveform of the oscillators.</summary>
+  WAVEFORM getWaveform() const;
+
+  /// <summary>Get the amplitude of a note played at the maximum volume.</summary>
+  float getGain() const;
+
+  /// <summary>Get the number of threads that render a melody.</summary>
+  /// <returns>The number of threads. Returns the number of cores of the system if set to 0.</returns>
+  size_t getThreadCount() const;
+
+  /// <summary>Get the waveform that matches the family of an instrument.</summary>
+  /// <param name="iInstrument">The instrument id.</param>
+  /// <returns>Returns the waveform of the instrument family. Never returns WAVEFORM_INSTRUMENT.</returns>
+  static WAVEFORM getInstrumentWaveform(int8_t iInstrument);
+
+  /// <summary>Computes the number of samples of a rendered melody.</summary>
+  /// <param name="iFile">The melody.</param>
+  /// <returns>The number of samples required to play all notes and delays of the melody.</returns>
+  size_t computeSampleCount(const MidiFile & iFile) const;
+
+  /// <summary>Renders a melody to floating point samples.</summary>
+  /// <param name="iFile">The melody.</param>
+  /// <param name="oSamples">The rendered samples.</param>
+  /// <returns>True when the melody is rendered. False otherwise.</returns>
+  bool render(const MidiFile & iFile, std::vector<float> & oSamples) const;
+
+  /// <summary>Renders a melody to 16 bits samples.</summary>
+  /// <param name="iFile">The melody.</param>
+  /// <param name="oSamples">The rendered samples.</param>
+  /// <returns>True when the melody is rendered. False otherwise.</returns>
+  bool render(const MidiFile & iFile, std::vector<int16_t> & oSamples) const;
+
+  /// <summary>Renders a melody to a 16 bits mono WAV file.</summary>
+  /// <param name="iFile">The melody.</param>
+  /// <param name="iPath">The path location where the file is to be saved.</param>
+  /// <returns>True when the file is successfully saved. False otherwise.</returns>
+  bool saveWav(const MidiFile & iFile, const char * iPath) const;
+
+  /// <summary>Renders a melody to a 16 bits mono WAV file written to a sink.</summary>
+  /// <param name="iFile">The melody.</param>
+  /// <param name="iSink">The destination of the WAV file.</param>
+  /// <returns>True when the file is successfully written. False otherwise.</returns>
+  bool saveWav(const MidiFile & iFile, ByteSink & iSink) const;
+
+private:
+  //private attributes
+  struct VOICE
+  {
+    uint64_t startSample;
+    uint64_t endSample;
+    uint32_t increment; //phase increment per sample
+    float gain;
+    WAVEFORM waveform;
+  };
+  typedef std::vector<VOICE> VoiceList;
+  struct VOICES
+  {
+    VoiceList list; //ordered by start time
+    uint64_t maxLength; //number of samples of the longest voice
+  };
+  struct CURSOR
+  {
+    uint64_t position; //index of the next sample to render
+    size_t next; //index of the next voice to start
+    std::vector<size_t> active; //indexes of the playing voices in start order
+  };
+
+  //private methods
+
+  /// <summary>Builds the voices of the notes of a melody ordered by start time.</summary>
+  /// <param name="iFile">The melody.</param>
+  /// <param name="oVoices">The voices of the melody.</param>
+  /// <returns>The number of samples of the melody.</returns>
+  uint64_t buildVoices(const MidiFile & iFile, VOICES & oVoices) const;
+
+  /// <summary>Moves a cursor to a given sample.</summary>
+  /// <remarks>Only the voices starting less than the longest voice before the given sample are visited.</remarks>
+  /// <param name="iVoices">The voices of the melody.</param>
+  /// <param name="iSample">The index of the next sample to render.</param>
+  /// <param name="oCursor">The cursor to move.</param>
+  void seek(const VOICES & iVoices, uint64_t iSample, CURSOR & oCursor) const;
+
+  /// <summary>Renders the next samples of a cursor.</summary>
+  /// <remarks>
+  /// Samples are rendered by blocks aligned on multiples of the block size.
+  /// Rendering a range of samples always computes the same values whatever the first sample of the cursor is.
+  /// </remarks>
+  /// <param name="iVoices">The voices ordered by start time.</param>
+  /// <param name="ioCursor">The cursor of the first sample to render.</param>
+  /// <param name="iCount">The number of samples to render.</param>
+  /// <param name="oSamples">The rendered samples.</param>
+  void renderSamples(const VoiceList & iVoices, CURSOR & ioCursor, size_t iCount, float * oSamples) const;
+
+  /// <summary>Renders the next samples of a cursor to 16 bits samples.</summary>
+  void renderSamples(const VoiceList & iVoices, CURSOR & ioCursor, size_t iCount, int16_t * oSamples) const;
+
+  /// <summary>Renders a range of samples with all threads.</summary>
+  /// <param name="iVoices">The voices of the melody.</param>
+  /// <param name="iFirstSample">The index of the first sample to render.</param>
+  /// <param name="iCount">The number of samples to render.</param>
+  /// <param name="oSamples">The rendered samples.</param>
+  template <typename T>
+  void renderRange(const VOICES & iVoices, uint64_t iFirstSample, size_t iCount, T * oSamples) const;
+
+  /// <summary>Adds a voice to a block of samples.</summary>
+  /// <param name="iVoice">The voice.</param>
+  /// <param name="iFirstSample">The index of the first sample of the block.</param>
+  /// <param name="iCount">The number of samples of the block.</param>
+  /// <param name="ioSamples">The samples of the block.</param>
+  void renderVoice(const VOICE & iVoice, uint64_t iFirstSample, size_t iCount, float * ioSamples) const;
+
+  /// <summary>Converts a time to a sample index.</summary>
+  uint64_t time2sample(uint64_t iTimeUs) const;
+
+  uint32_t mSampleRate;
+  WAVEFORM mWaveform;
+  float mGain;
+  uint32_t mAttackUs;
+  uint32_t mReleaseUs;
+  size_t mNumThreads;
+};
+
+}; //namespace libmidi
+
+#endif //RENDERER_H
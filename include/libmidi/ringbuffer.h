@@ -0,0 +1,158 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <stdint.h>
+#include <cstddef> //for size_t
+#include <vector>
+#include <atomic>
+
+namespace libmidi
+{
+
+/// <summary>
+/// Lock-free queue of values with a single producer thread and a single consumer thread.
+/// </summary>
+/// <remarks>
+/// The values are stored in a buffer allocated by the constructor. Pushing and popping values
+/// never allocates memory, never locks and never waits. Each thread keeps a copy of the index
+/// of the other thread and only reads the shared index when the copy says the queue is full or empty.
+/// The write methods must only be called by the producer thread and the read methods by the consumer thread.
+/// </remarks>
+template <typename T>
+class RingBuffer
+{
+public:
+  /// <summary>
+  /// Construct a new instance of RingBuffer.
+  /// </summary>
+  /// <param name="iCapacity">The minimum number of values of the queue. Rounded up to a power of 2.</param>
+  RingBuffer(size_t iCapacity)
+  {
+    size_t capacity = 1;
+    while(capacity < iCapacity)
+      capacity *= 2;
+    mBuffer.resize(capacity);
+    mMask = capacity - 1;
+    mWriteIndex.store(0);
+    mReadIndex.store(0);
+    mCachedReadIndex = 0;
+    mCachedWriteIndex = 0;
+  }
+
+  /// <summary>Get the maximum number of values of the queue.</summary>
+  inline size_t getCapacity() const { return mBuffer.size(); }
+
+  /// <summary>Get the number of values in the queue. The value may be outdated when read by a third thread.</summary>
+  inline size_t getSize() const
+  {
+    return mWriteIndex.load(std::memory_order_acquire) - mReadIndex.load(std::memory_order_acquire);
+  }
+
+  /// <summary>Adds a value to the queue. Producer thread only.</summary>
+  /// <param name="iValue">The value.</param>
+  /// <returns>True when the value is added. False if the queue is full.</returns>
+  inline bool push(const T & iValue)
+  {
+    return write(&iValue, 1) == 1;
+  }
+
+  /// <summary>Adds values to the queue. Producer thread only.</summary>
+  /// <param name="iValues">The values.</param>
+  /// <param name="iCount">The number of values.</param>
+  /// <returns>The number of values added. Less than iCount if the queue is full.</returns>
+  size_t write(const T * iValues, size_t iCount)
+  {
+    size_t write = mWriteIndex.load(std::memory_order_relaxed);
+    if (write - mCachedReadIndex + iCount > mBuffer.size())
+      mCachedReadIndex = mReadIndex.load(std::memory_order_acquire);
+    size_t space = mBuffer.size() - (write - mCachedReadIndex);
+    size_t count = (iCount < space ? iCount : space);
+    for(size_t i=0; i<count; i++)
+      mBuffer[(write + i) & mMask] = iValues[i];
+    mWriteIndex.store(write + count, std::memory_order_release);
+    return count;
+  }
+
+  /// <summary>Get the next value of the queue without removing it. Consumer thread only.</summary>
+  /// <returns>The next value. NULL if the queue is empty.</returns>
+  inline const T * front()
+  {
+    size_t read = mReadIndex.load(std::memory_order_relaxed);
+    if (read == mCachedWriteIndex)
+    {
+      mCachedWriteIndex = mWriteIndex.load(std::memory_order_acquire);
+      if (read == mCachedWriteIndex)
+        return NULL;
+    }
+    return &mBuffer[read & mMask];
+  }
+
+  /// <summary>Removes the next value of the queue. Consumer thread only.</summary>
+  /// <param name="oValue">The value.</param>
+  /// <returns>True when a value is removed. False if the queue is empty.</returns>
+  inline bool pop(T & oValue)
+  {
+    return read(&oValue, 1) == 1;
+  }
+
+  /// <summary>Removes values from the queue. Consumer thread only.</summary>
+  /// <param name="oValues">The values.</param>
+  /// <param name="iCount">The maximum number of values to remove.</param>
+  /// <returns>The number of values removed. Less than iCount if the queue is empty.</returns>
+  size_t read(T * oValues, size_t iCount)
+  {
+    size_t read = mReadIndex.load(std::memory_order_relaxed);
+    if (mCachedWriteIndex - read < iCount)
+      mCachedWriteIndex = mWriteIndex.load(std::memory_order_acquire);
+    size_t available = mCachedWriteIndex - read;
+    size_t count = (iCount < available ? iCount : available);
+    for(size_t i=0; i<count; i++)
+      oValues[i] = mBuffer[(read + i) & mMask];
+    mReadIndex.store(read + count, std::memory_order_release);
+    return count;
+  }
+
+private:
+  RingBuffer(const RingBuffer &);
+  RingBuffer & operator=(const RingBuffer &);
+
+  std::vector<T> mBuffer;
+  size_t mMask;
+
+  //the indexes of each thread are kept in separate cache lines
+  char mPadding1[64];
+  std::atomic<size_t> mWriteIndex;
+  size_t mCachedReadIndex; //producer's copy of mReadIndex
+  char mPadding2[64];
+  std::atomic<size_t> mReadIndex;
+  size_t mCachedWriteIndex; //consumer's copy of mWriteIndex
+  char mPadding3[64];
+};
+
+}; //namespace libmidi
+
+#endif //RINGBUFFER_H
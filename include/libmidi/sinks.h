@@ -0,0 +1,230 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#ifndef SINKS_H
+#define SINKS_H
+
+#include "libmidi/config.h"
+
+#include <stdint.h>
+#include <cstddef> //for size_t
+#include <vector>
+
+namespace libmidi
+{
+
+/// <summary>
+/// Defines a destination for encoded bytes.
+/// </summary>
+class LIBMIDI_EXPORT ByteSink
+{
+public:
+  virtual ~ByteSink();
+
+  /// <summary>Writes bytes to the sink.</summary>
+  /// <param name="iData">The bytes to write.</param>
+  /// <param name="iSize">The number of bytes to write.</param>
+  /// <returns>True when all bytes are written. False otherwise.</returns>
+  virtual bool write(const void * iData, size_t iSize) = 0;
+
+  /// <summary>Returns true if the sink supports seek().</summary>
+  virtual bool isSeekable() const = 0;
+
+  /// <summary>Moves the write position of the sink.</summary>
+  /// <param name="iOffset">The new write position in bytes from the first byte written to the sink.</param>
+  /// <returns>True when the write position is changed. False otherwise.</returns>
+  virtual bool seek(uint64_t iOffset) = 0;
+
+  /// <summary>Writes the buffered bytes to the destination.</summary>
+  /// <returns>True when the buffered bytes are written. False otherwise.</returns>
+  virtual bool flush() = 0;
+};
+
+/// <summary>
+/// Base class of the sinks that buffer small writes.
+/// </summary>
+/// <remarks>
+/// Bytes are accumulated in a buffer and sent to the destination with a single call to output()
+/// when the buffer is full or when the sink is flushed. Writes bigger than the buffer are sent directly.
+/// Derived classes must call flush() from their destructor.
+/// </remarks>
+class LIBMIDI_EXPORT BufferedSink : public ByteSink
+{
+public:
+  /// <summary>Construct a new BufferedSink.</summary>
+  /// <param name="iBufferSize">The size of the buffer in bytes.</param>
+  BufferedSink(size_t iBufferSize);
+  virtual ~BufferedSink();
+
+  virtual bool write(const void * iData, size_t iSize);
+  virtual bool flush();
+
+public:
+  //public values & enums
+  static const size_t DEFAULT_BUFFER_SIZE = 65536;
+
+protected:
+  /// <summary>Sends bytes to the destination.</summary>
+  /// <param name="iData">The bytes to send.</param>
+  /// <param name="iSize">The number of bytes to send.</param>
+  /// <returns>True when all bytes are sent. False otherwise.</returns>
+  virtual bool output(const void * iData, size_t iSize) = 0;
+
+private:
+  BufferedSink(const BufferedSink &);
+  BufferedSink & operator=(const BufferedSink &);
+
+  std::vector<uint8_t> mBuffer;
+  size_t mSize;
+};
+
+/// <summary>
+/// Writes bytes to a file.
+/// </summary>
+/// <remarks>
+/// The file is accessed with low level file descriptor functions.
+/// </remarks>
+class LIBMIDI_EXPORT FileSink : public BufferedSink
+{
+public:
+  FileSink(size_t iBufferSize = DEFAULT_BUFFER_SIZE);
+  virtual ~FileSink();
+
+  /// <summary>Creates or truncates a file.</summary>
+  /// <param name="iFile">The path location of the file.</param>
+  /// <returns>True when the file is opened. False otherwise.</returns>
+  bool open(const char * iFile);
+
+  /// <summary>Opens an existing file without truncating it. Bytes are written from the beginning of the file.</summary>
+  /// <remarks>Use seek() to update parts of the file.</remarks>
+  /// <param name="iFile">The path location of the file.</param>
+  /// <returns>True when the file is opened. False if the file does not exist or cannot be written.</returns>
+  bool openExisting(const char * iFile);
+
+  /// <summary>Get the size of the opened file, without the bytes not flushed yet.</summary>
+  /// <param name="oSize">The size of the file in bytes.</param>
+  /// <returns>True when the size is found. False otherwise.</returns>
+  bool getFileSize(uint64_t & oSize) const;
+
+  /// <summary>Flushes and closes the file.</summary>
+  /// <returns>True when the file is closed without error. False otherwise.</returns>
+  bool close();
+
+  /// <summary>Returns true if a file is opened.</summary>
+  bool isOpened() const;
+
+  virtual bool isSeekable() const;
+  virtual bool seek(uint64_t iOffset);
+
+protected:
+  virtual bool output(const void * iData, size_t iSize);
+
+private:
+  int mFile;
+};
+
+/// <summary>
+/// Writes bytes to a pipe, a socket or any other file descriptor that cannot seek.
+/// </summary>
+/// <remarks>
+/// The file descriptor is not closed by the sink.
+/// </remarks>
+class LIBMIDI_EXPORT StreamSink : public BufferedSink
+{
+public:
+  /// <summary>Construct a new StreamSink.</summary>
+  /// <param name="iFileDescriptor">The file descriptor of the stream. ie: 1 for the standard output.</param>
+  /// <param name="iBufferSize">The size of the buffer in bytes.</param>
+  StreamSink(int iFileDescriptor, size_t iBufferSize = DEFAULT_BUFFER_SIZE);
+  virtual ~StreamSink();
+
+  virtual bool isSeekable() const;
+  virtual bool seek(uint64_t iOffset);
+
+protected:
+  virtual bool output(const void * iData, size_t iSize);
+
+private:
+  int mFileDescriptor;
+};
+
+/// <summary>
+/// Sends bytes to a user callback function.
+/// </summary>
+class LIBMIDI_EXPORT CallbackSink : public BufferedSink
+{
+public:
+  /// <summary>Defines the function that receives the bytes of the sink.</summary>
+  /// <param name="iData">The bytes written to the sink.</param>
+  /// <param name="iSize">The number of bytes.</param>
+  /// <param name="iUserData">The user data given to the sink.</param>
+  /// <returns>True when the bytes are processed. False to report an error.</returns>
+  typedef bool (*CALLBACK_FUNCTION)(const void * iData, size_t iSize, void * iUserData);
+
+  /// <summary>Construct a new CallbackSink.</summary>
+  /// <param name="iFunction">The function that receives the bytes.</param>
+  /// <param name="iUserData">The user data given to the function.</param>
+  /// <param name="iBufferSize">The size of the buffer in bytes.</param>
+  CallbackSink(CALLBACK_FUNCTION iFunction, void * iUserData, size_t iBufferSize = DEFAULT_BUFFER_SIZE);
+  virtual ~CallbackSink();
+
+  virtual bool isSeekable() const;
+  virtual bool seek(uint64_t iOffset);
+
+protected:
+  virtual bool output(const void * iData, size_t iSize);
+
+private:
+  CALLBACK_FUNCTION mFunction;
+  void * mUserData;
+};
+
+/// <summary>
+/// Writes bytes to a memory buffer.
+/// </summary>
+class LIBMIDI_EXPORT MemorySink : public ByteSink
+{
+public:
+  MemorySink(void);
+  virtual ~MemorySink();
+
+  /// <summary>Get the bytes written to the sink.</summary>
+  const std::vector<uint8_t> & getBuffer() const;
+
+  /// <summary>Removes all bytes from the sink.</summary>
+  void clear();
+
+  virtual bool write(const void * iData, size_t iSize);
+  virtual bool isSeekable() const;
+  virtual bool seek(uint64_t iOffset);
+  virtual bool flush();
+
+private:
+  std::vector<uint8_t> mBuffer;
+  size_t mPosition;
+};
+
+}; //namespace libmidi
+
+#endif //SINKS_H
@@ -0,0 +1,197 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#ifndef STREAMWRITER_H
+#define STREAMWRITER_H
+
+#include "libmidi/config.h"
+#include "libmidi/libmidi.h"
+#include "libmidi/sinks.h"
+#include "libmidi/transform.h"
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+
+namespace libmidi
+{
+
+class TrackEncoder;
+class TickConverter;
+
+/// <summary>
+/// Writes a single tone melody to a sink one note at a time.
+/// </summary>
+/// <remarks>
+/// Notes are encoded as soon as they are added and the encoded bytes are written to the sink
+/// in chunks of a bounded size. With a seekable sink, memory usage does not depend on the length of the melody.
+/// The track length is written when the writer is closed. If the sink is not seekable,
+/// the whole track is kept in memory and written to the sink when the writer is closed.
+/// The output is identical to MidiFile::save() for the same melody.
+/// </remarks>
+class LIBMIDI_EXPORT MidiStreamWriter {
+public:
+  /// <summary>
+  /// Construct a new instance of MidiStreamWriter.
+  /// </summary>
+  MidiStreamWriter(void);
+  ~MidiStreamWriter(void);
+
+  /// <summary>Sets the type of MIDI file. Must be called before open().</summary>
+  /// <param name="iType">The type of MIDI file.</param>
+  void setMidiType(MidiFile::MIDI_TYPE iType);
+
+  /// <summary>Sets the melody name. Must be called before open().</summary>
+  /// <param name="iName">The name of the melody. Set to NULL or EMPTY to disable name.</param>
+  void setName(const char * iName);
+
+  /// <summary>Set current volume for the following notes.</summary>
+  /// <param name="iVolume">The volume value. min=0x00 max=0x7f</param>
+  void setVolume(int8_t iVolume);
+
+  /// <summary>Set current instrument. Must be called before open().</summary>
+  /// <param name="iInstrument">The instrument's id.</param>
+  void setInstrument(int8_t iInstrument);
+
+  /// <summary>Set the number of ticks per quarter note. Must be called before open().</summary>
+  /// <param name="iTicks">The ticks per quarter note.</param>
+  void setTicksPerQuarterNote(uint16_t iTicks);
+
+  /// <summary>Sets the number of beats per minute. Must be called before open().</summary>
+  /// <param name="iBpm">The number of beats per minute.</param>
+  void setBeatsPerMinute(uint16_t iBpm);
+
+  /// <summary>Sets the tempo in microseconds per quarter note. Must be called before open().</summary>
+  /// <param name="iTempo">The tempo in usec per second.</param>
+  void setTempo(uint32_t iTempo);
+
+  /// <summary>Defines how the MIDI track ends. Must be called before open().</summary>
+  /// <param name="iTrackEndingPreference">The prefered track ending method.</param>
+  void setTrackEndingPreference(MidiFile::TRACK_ENDING_PREFERENCE iTrackEndingPreference);
+
+  /// <summary>Enables or disables the compact encoding of the melody. Must be called before open().</summary>
+  /// <remarks>See MidiFile::setCompactEncoding().</remarks>
+  /// <param name="iCompact">True to enable the compact encoding.</param>
+  void setCompactEncoding(bool iCompact);
+
+  /// <summary>Sets the maximum number of bytes written to the sink at once. Must be called before open().</summary>
+  /// <param name="iChunkSize">The size of a chunk in bytes. Values smaller than MIN_CHUNK_SIZE are ignored.</param>
+  void setChunkSize(size_t iChunkSize);
+
+  /// <summary>Sets the transform applied to the notes while they are encoded. Must be called before open().</summary>
+  /// <param name="iTransform">The transform of the melody.</param>
+  void setTransform(const MidiTransform & iTransform);
+
+  /// <summary>Starts a new melody and writes the file header to a sink.</summary>
+  /// <remarks>The sink must remain valid until the writer is closed.</remarks>
+  /// <param name="iSink">The destination of the melody.</param>
+  /// <returns>True when the writer is opened. False otherwise.</returns>
+  bool open(ByteSink & iSink);
+
+  /// <summary>Starts a new melody and writes the file header to a file.</summary>
+  /// <param name="iFile">The path location where the file is to be saved.</param>
+  /// <returns>True when the writer is opened. False otherwise.</returns>
+  bool open(const char * iFile);
+
+  /// <summary>Adds a note to the current melody.</summary>
+  /// <param name="iFrequency">The frequency in Hz of the note.</param>
+  /// <param name="iDurationMs">The duration of the note in milliseconds.</param>
+  /// <returns>True when the note is written. False otherwise.</returns>
+  bool addNote(uint16_t iFrequency, uint16_t iDurationMs);
+
+  /// <summary>Adds a note to the current melody with a microsecond precision.</summary>
+  /// <param name="iFrequency">The frequency in Hz of the note.</param>
+  /// <param name="iDurationUs">The duration of the note in microseconds.</param>
+  /// <returns>True when the note is written. False otherwise.</returns>
+  bool addNoteUs(uint16_t iFrequency, uint32_t iDurationUs);
+
+  /// <summary>Adds a delay (silent note) to the current melody.</summary>
+  /// <param name="iDurationMs">The delay duration in milliseconds.</param>
+  /// <returns>True when the delay is written. False otherwise.</returns>
+  bool addDelay(uint16_t iDurationMs);
+
+  /// <summary>Adds a delay (silent note) to the current melody with a microsecond precision.</summary>
+  /// <param name="iDurationUs">The delay duration in microseconds.</param>
+  /// <returns>True when the delay is written. False otherwise.</returns>
+  bool addDelayUs(uint32_t iDurationUs);
+
+  /// <summary>Ends the melody, writes the track length and flushes the sink.</summary>
+  /// <returns>True when the melody is successfully written. False otherwise.</returns>
+  bool close();
+
+  /// <summary>Returns true if the writer is opened.</summary>
+  bool isOpened() const;
+
+  /// <summary>Get the number of bytes of the melody encoded so far.</summary>
+  uint64_t getSize() const;
+
+public:
+  //public values & enums
+  static const size_t DEFAULT_CHUNK_SIZE = 65536;
+  static const size_t MIN_CHUNK_SIZE = 64;
+
+private:
+  //private methods
+  MidiStreamWriter(const MidiStreamWriter &);
+  MidiStreamWriter & operator=(const MidiStreamWriter &);
+
+  /// <summary>Makes sure that the current chunk can hold the given amount of bytes.</summary>
+  bool reserve(size_t iSize);
+
+  /// <summary>Writes the current chunk to the sink.</summary>
+  bool flushChunk();
+
+  /// <summary>Writes bytes to the sink or to the pending track buffer if the sink is not seekable.</summary>
+  bool output(const uint8_t * iData, size_t iSize);
+
+private:
+  //private attributes
+  uint16_t mTicksPerQuarterNote;
+  uint32_t mTempo; //usec per quarter note
+  std::string mName;
+  int8_t mVolume; //from 0x00 to 0x7f
+  int8_t mInstrument; //from 0x00 to 0x7f
+  MidiFile::TRACK_ENDING_PREFERENCE mTrackEndingPreference;
+  bool mCompactEncoding;
+  MidiFile::MIDI_TYPE mType;
+  size_t mChunkCapacity;
+  MidiTransform mTransform;
+
+  ByteSink * mSink;
+  FileSink mFileSink; //sink used when opening a file
+  TrackEncoder * mEncoder;
+  TickConverter * mConverter;
+  uint64_t mTimeUs; //absolute time of the end of the melody
+  uint64_t mTicks; //absolute ticks of the end of the melody
+  bool mSeekable;
+  bool mError;
+  std::vector<uint8_t> mChunk;
+  size_t mChunkSize;
+  std::vector<uint8_t> mTrack; //whole track when the sink is not seekable
+  uint64_t mSize; //bytes written to the sink or mTrack
+};
+
+}; //namespace libmidi
+
+#endif //STREAMWRITER_H
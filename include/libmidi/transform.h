@@ -0,0 +1,208 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "libmidi/config.h"
+#include "libmidi/libmidi.h"
+
+#include <stdint.h>
+#include <cstddef> //for size_t
+#include <vector>
+
+namespace libmidi
+{
+
+class ByteSink;
+
+/// <summary>
+/// Describes how the notes of a melody are changed when the melody is encoded.
+/// </summary>
+/// <remarks>
+/// A transform transposes the notes, stretches the time, maps the velocities through a curve
+/// and remaps the channels. Transforms are combined: each call is applied after the previous ones.
+/// A transform is a small value which never holds notes. It is applied while a melody is encoded
+/// by a MidiFileView or a MidiStreamWriter. The notes of the melody are not copied nor modified.
+/// Transforms only change the encoded events. They are ignored by the renderers.
+/// </remarks>
+class LIBMIDI_EXPORT MidiTransform {
+public:
+  /// <summary>
+  /// Construct a new instance of MidiTransform which changes nothing.
+  /// </summary>
+  MidiTransform(void);
+
+  /// <summary>Transposes the notes by a number of semitones.</summary>
+  /// <remarks>Transposes are summed. Pitches out of range are clamped to the valid MIDI pitches.</remarks>
+  /// <param name="iSemitones">The number of semitones. Negative values lower the notes. min=-127 max=127</param>
+  /// <returns>True when the transpose is added. False if the value is out of range.</returns>
+  bool transpose(int iSemitones);
+
+  /// <summary>Stretches the time of the melody by a ratio.</summary>
+  /// <remarks>
+  /// The tempo and the tempo changes are multiplied by the ratio, clamped to the valid MIDI tempos.
+  /// The ticks of the events do not change which keeps notes and tempo changes exactly aligned.
+  /// Stretches are multiplied.
+  /// </remarks>
+  /// <param name="iRatio">The ratio of the new duration to the original duration. 2.0 plays twice as slow.</param>
+  /// <returns>True when the stretch is added. False if the ratio is not a positive value.</returns>
+  bool stretch(double iRatio);
+
+  /// <summary>Maps the velocity of the notes through a curve.</summary>
+  /// <remarks>The curve is applied to the velocities given by the previous curves.</remarks>
+  /// <param name="iCurve">The new velocity of each velocity. Must contains 128 values from 0x00 to 0x7f.</param>
+  /// <returns>True when the curve is added. False if the curve is NULL or contains an invalid velocity.</returns>
+  bool applyVelocityCurve(const uint8_t * iCurve);
+
+  /// <summary>Moves the events of a channel to another channel.</summary>
+  /// <remarks>The channel is mapped after the previous mappings. Mapping 0 to 1 then 1 to 2 moves both 0 and 1 to 2.</remarks>
+  /// <param name="iFrom">The channel of the events. min=0 max=15</param>
+  /// <param name="iTo">The new channel of the events. min=0 max=15</param>
+  /// <returns>True when the channel is mapped. False if a channel is out of range.</returns>
+  bool mapChannel(uint8_t iFrom, uint8_t iTo);
+
+  /// <summary>Applies another transform after this one.</summary>
+  /// <param name="iTransform">The transform to apply after this one.</param>
+  void append(const MidiTransform & iTransform);
+
+  /// <summary>Returns true if the transform changes nothing.</summary>
+  bool isIdentity() const;
+
+  /// <summary>Get the number of semitones of the transpose.</summary>
+  int getTranspose() const;
+
+  /// <summary>Get the ratio of the time stretch.</summary>
+  double getStretch() const;
+
+  /// <summary>Transforms a MIDI pitch.</summary>
+  inline int8_t transformPitch(int8_t iPitch) const
+  {
+    int pitch = iPitch + mTranspose;
+    return (int8_t)(pitch < 0 ? 0 : (pitch > 0x7F ? 0x7F : pitch));
+  }
+
+  /// <summary>Transforms a velocity.</summary>
+  inline int8_t transformVelocity(int8_t iVelocity) const
+  {
+    return (int8_t)mVelocities[iVelocity & 0x7F];
+  }
+
+  /// <summary>Transforms a channel.</summary>
+  inline uint8_t transformChannel(uint8_t iChannel) const
+  {
+    return mChannels[iChannel & 0x0F];
+  }
+
+  /// <summary>Transforms a tempo in usec per quarter note.</summary>
+  uint32_t transformTempo(uint32_t iTempo) const;
+
+  /// <summary>Transforms an array of MIDI pitches.</summary>
+  /// <remarks>Vectorized with SSE2 or NEON when available. The input and output arrays may be the same.</remarks>
+  /// <param name="iPitches">The MIDI pitches to transform.</param>
+  /// <param name="oPitches">The transformed pitches.</param>
+  /// <param name="iCount">The number of pitches.</param>
+  void transformPitches(const int8_t * iPitches, int8_t * oPitches, size_t iCount) const;
+
+  /// <summary>Transforms an array of velocities.</summary>
+  /// <remarks>The input and output arrays may be the same.</remarks>
+  /// <param name="iVelocities">The velocities to transform.</param>
+  /// <param name="oVelocities">The transformed velocities.</param>
+  /// <param name="iCount">The number of velocities.</param>
+  void transformVelocities(const int8_t * iVelocities, int8_t * oVelocities, size_t iCount) const;
+
+public:
+  //public values & enums
+  static const size_t NUM_VELOCITIES = 128;
+  static const size_t NUM_CHANNELS = 16;
+  static const uint32_t MAX_TEMPO = 0xFFFFFF;
+
+private:
+  //private attributes
+  int mTranspose; //semitones
+  double mStretch;
+  uint8_t mVelocities[NUM_VELOCITIES];
+  uint8_t mChannels[NUM_CHANNELS];
+};
+
+/// <summary>
+/// Saves a melody through a transform without copying the melody.
+/// </summary>
+/// <remarks>
+/// The view refers to the melody which must remain valid while the view is used.
+/// Changes made to the melody are visible through the view.
+/// The notes are transformed while they are encoded: saving many variants of
+/// the same melody does not copy its notes. A view is created from another view
+/// to apply a transform after the transform of the other view.
+/// </remarks>
+class LIBMIDI_EXPORT MidiFileView {
+public:
+  /// <summary>
+  /// Construct a new instance of MidiFileView.
+  /// </summary>
+  /// <param name="iFile">The melody.</param>
+  /// <param name="iTransform">The transform applied to the melody.</param>
+  MidiFileView(const MidiFile & iFile, const MidiTransform & iTransform);
+
+  /// <summary>
+  /// Construct a view which applies a transform after the transform of another view.
+  /// </summary>
+  /// <param name="iView">The other view.</param>
+  /// <param name="iTransform">The transform applied after the transform of the other view.</param>
+  MidiFileView(const MidiFileView & iView, const MidiTransform & iTransform);
+
+  /// <summary>Get the melody of the view.</summary>
+  const MidiFile & getFile() const;
+
+  /// <summary>Get the transform of the view.</summary>
+  const MidiTransform & getTransform() const;
+
+  /// <summary>Computes the size of the transformed melody once saved.</summary>
+  /// <returns>The exact number of bytes written by save() or saveToBuffer().</returns>
+  size_t computeEncodedSize() const;
+
+  /// <summary>Saves the transformed melody to a file.</summary>
+  /// <param name="iFile">The path location where the file is to be saved.</param>
+  /// <returns>True when the file is successfully saved. False otherwise.</returns>
+  bool save(const char * iFile) const;
+
+  /// <summary>Saves the transformed melody to a sink.</summary>
+  /// <param name="iSink">The destination of the melody.</param>
+  /// <returns>True when the melody is successfully written. False otherwise.</returns>
+  bool save(ByteSink & iSink) const;
+
+  /// <summary>Saves the transformed melody to a memory buffer.</summary>
+  /// <param name="oBuffer">The output buffer. The buffer is resized to the exact size of the encoded melody.</param>
+  /// <returns>True when the melody is successfully encoded. False otherwise.</returns>
+  bool saveToBuffer(std::vector<uint8_t> & oBuffer) const;
+
+private:
+  //private attributes
+  const MidiFile * mFile;
+  MidiTransform mTransform;
+};
+
+}; //namespace libmidi
+
+#endif //TRANSFORM_H
@@ -21,48 +21,55 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
  * SOFTWARE.
  *********************************************************************************/
-
 #ifndef VARIABLE_LENGTH_H
 #define VARIABLE_LENGTH_H
 
-#include <cstring> //for memset()
-#include <cstdio> //for fwrite(), fopen(), ftell(), fclose()
-#include <cstdlib> //for abs()
+#include <stdint.h> //for uint32_t
+#include <cstddef> //for size_t
+#include <cstdio> //for fwrite()
 
 namespace libmidi
 {
 
 /// <summary>
-/// Computes a 32-bits mask for reading the nth block of 7 bits long.
+/// The maximum number of bytes of a Variable Length Quantity. The MIDI specification limits them to 4 bytes.
+/// </summary>
+static const size_t VARIABLE_LENGTH_MAX_SIZE = 4;
+
+/// <summary>
+/// The largest value that can be encoded as a Variable Length Quantity. Larger values are clamped to this value.
 /// </summary>
-/// <param name="iIndex">
-/// The 0-based index of the 7-bits blocks. ie:
-/// index 0 creates a mask for bit  0 to bit  6
-/// index 1 creates a mask for bit  7 to bit 13
-/// index 2 creates a mask for bit 14 to bit 20
-/// </param>
-/// <returns>Returns a 32-bits mask.</returns>
-inline uint32_t getVariableLengthMask(int iIndex)
+static const uint32_t VARIABLE_LENGTH_MAX_VALUE = 0x0FFFFFFF;
+
+/// <summary>
+/// Computes the number of bytes required for encoding a value as a Variable Length Quantity.
+/// </summary>
+/// <param name="iValue">The value to encode.</param>
+/// <returns>Returns the encoded size of the value in bytes. The returned value is between 1 and VARIABLE_LENGTH_MAX_SIZE.</returns>
+inline size_t getVariableLengthSize(uint32_t iValue)
 {
-  //size_t i = 1;
-  //i << ((index+1)*7);
-  //i--;
-
-  static const uint32_t MASK_TIMESTAMP_0 =  ((1<<7)-1);
-  static const uint32_t MASK_TIMESTAMP_1 =  ((1<<14)-1) - MASK_TIMESTAMP_0;
-  static const uint32_t MASK_TIMESTAMP_2 =  ((1<<21)-1) - MASK_TIMESTAMP_1;
-  static const uint32_t MASK_TIMESTAMP_3 =  ((1<<28)-1) - MASK_TIMESTAMP_2;
-  static const uint32_t masks[] = {
-    MASK_TIMESTAMP_0,
-    MASK_TIMESTAMP_1,
-    MASK_TIMESTAMP_2,
-    MASK_TIMESTAMP_3
+  if (iValue > VARIABLE_LENGTH_MAX_VALUE)
+    return VARIABLE_LENGTH_MAX_SIZE;
+
+#if defined(__GNUC__) || defined(__clang__)
+  //number of significant bits, rounded up to blocks of 7 bits
+  int bits = 32 - __builtin_clz(iValue | 1);
+  return (size_t)((bits + 6) / 7);
+#else
+  static const uint32_t thresholds[] = {
+    (1u<<7),
+    (1u<<14),
+    (1u<<21),
   };
-  return masks[iIndex];
+  size_t size = 1;
+  while(size < VARIABLE_LENGTH_MAX_SIZE && iValue >= thresholds[size-1])
+    size++;
+  return size;
+#endif
 }
 
 /// <summary>
-/// Writes a value as a Variable Length Quantity to a file.
+/// Encodes a value as a Variable Length Quantity to a memory buffer.
 /// </summary>
 /// <remarks>
 /// Variable Length Quantity numbers are represented as 7 bits per byte,
@@ -84,96 +91,158 @@ inline uint32_t getVariableLengthMask(int iIndex)
 ///     00200000  81 80 80 00
 ///     08000000  C0 80 80 00
 ///     0FFFFFFF  FF FF FF 7F
+///
+/// Values larger than VARIABLE_LENGTH_MAX_VALUE are encoded as VARIABLE_LENGTH_MAX_VALUE.
 /// </remarks>
-/// <param name="iValue">The value to be written to file</param>
+/// <param name="iValue">The value to encode.</param>
 /// <param name="iMinOutputSize">The minimum output size in byte.
 /// ie: Writing the value 0x00000000 is normaly written as 1 byte 0x00.
 /// Forcing minimum byte to 2 result in the following bytes written:
 /// 0x80 0x00 which is the same value.</param>
-/// <param name="f">The FILE* handle</param>
-/// <returns>Returns the number of bytes written to the file</returns>
-template <typename T>
-size_t fwriteVariableLength(const T & iValue, size_t iMinOutputSize, FILE * f)
+/// <param name="oBuffer">The output buffer. Must be at least VARIABLE_LENGTH_MAX_SIZE bytes long.</param>
+/// <returns>Returns the number of bytes written to the buffer.</returns>
+inline size_t encodeVariableLength(uint32_t iValue, size_t iMinOutputSize, uint8_t * oBuffer)
 {
-  size_t writeSize = 0;
-
-  //copy the input value since we will decrement it
-  T copy = iValue;
+  if (iValue > VARIABLE_LENGTH_MAX_VALUE)
+    iValue = VARIABLE_LENGTH_MAX_VALUE;
 
-  size_t inputSize = sizeof(T);
+  size_t size = getVariableLengthSize(iValue);
 
-  //define output buffer
-  size_t maxOutputSize = inputSize+1;
-  unsigned char * outputBuffer = new unsigned char[maxOutputSize];
-  memset(outputBuffer, 0, maxOutputSize);
-  size_t outputSize = 1; //number of characters to output
+  //deal with forced output size
+  if (size < iMinOutputSize && iMinOutputSize <= VARIABLE_LENGTH_MAX_SIZE)
+    size = iMinOutputSize;
 
-  for(size_t i=0; i<inputSize; i++)
+  //write 7 bits blocks from the last byte to the first byte
+  size_t last = size - 1;
+  oBuffer[last] = (uint8_t)(iValue & 0x7F);
+  for(size_t i=last; i>0; i--)
   {
-    //move the next 7 bits from inputBuffer to outputBuffer
-    uint32_t mask = getVariableLengthMask(i);
-    outputBuffer[i] |= ((copy & mask) >> (i*7));
-    copy &= ~mask;
-
-    //is there some bits left in the input ?
-    if (copy > 0)
-    {
-      //yes, there will be another output character
-      outputSize++;
-    }
-    else
-    {
-      //no, no need to read furthur
-      break;
-    }
+    iValue >>= 7;
+    oBuffer[i-1] = (uint8_t)((iValue & 0x7F) | 0x80);
   }
 
-  //deal with forced output size
-  if (outputSize < iMinOutputSize && iMinOutputSize <= maxOutputSize)
+  return size;
+}
+
+/// <summary>
+/// Encodes a value as a Variable Length Quantity to a memory buffer.
+/// </summary>
+/// <param name="iValue">The value to encode.</param>
+/// <param name="oBuffer">The output buffer. Must be at least VARIABLE_LENGTH_MAX_SIZE bytes long.</param>
+/// <returns>Returns the number of bytes written to the buffer.</returns>
+inline size_t encodeVariableLength(uint32_t iValue, uint8_t * oBuffer)
+{
+  //most delta times fits in a single byte
+  if (iValue < 0x80)
   {
-    outputSize = iMinOutputSize;
+    oBuffer[0] = (uint8_t)iValue;
+    return 1;
   }
+  return encodeVariableLength(iValue, 0, oBuffer);
+}
 
-  //write all output characters
-  for(int i=(int)outputSize-1; i>=0; i--)
+/// <summary>
+/// Decodes a Variable Length Quantity from a memory buffer.
+/// </summary>
+/// <param name="iBuffer">The input buffer.</param>
+/// <param name="iBufferSize">The size of the input buffer in bytes.</param>
+/// <param name="oValue">The decoded value.</param>
+/// <returns>Returns the number of bytes read from the buffer. Returns 0 if the buffer ends before the last byte of the value
+/// or if the value is longer than VARIABLE_LENGTH_MAX_SIZE bytes.</returns>
+inline size_t decodeVariableLength(const uint8_t * iBuffer, size_t iBufferSize, uint32_t & oValue)
+{
+  uint32_t value = 0;
+  size_t maxSize = (iBufferSize < VARIABLE_LENGTH_MAX_SIZE ? iBufferSize : VARIABLE_LENGTH_MAX_SIZE);
+  for(size_t i=0; i<maxSize; i++)
   {
-    bool isLast = (i == 0);
-    unsigned char c = outputBuffer[i];
-    if (!isLast)
+    uint8_t c = iBuffer[i];
+    value = (value << 7) | (c & 0x7F);
+    if ((c & 0x80) == 0)
     {
-      c |= 0x80;
+      oValue = value;
+      return i+1;
     }
-    writeSize += fwrite(&c, 1, 1, f);
   }
+  return 0;
+}
 
-  delete[] outputBuffer;
+/// <summary>
+/// Computes the number of bytes required for encoding an array of values as Variable Length Quantities.
+/// </summary>
+/// <param name="iValues">The values to encode.</param>
+/// <param name="iCount">The number of values in the array.</param>
+/// <returns>Returns the encoded size of all values in bytes.</returns>
+inline size_t getVariableLengthArraySize(const uint32_t * iValues, size_t iCount)
+{
+  size_t size = 0;
+  for(size_t i=0; i<iCount; i++)
+    size += getVariableLengthSize(iValues[i]);
+  return size;
+}
 
-  return writeSize;
+/// <summary>
+/// Encodes an array of values (ie: delta times) as consecutive Variable Length Quantities.
+/// </summary>
+/// <param name="iValues">The values to encode.</param>
+/// <param name="iCount">The number of values in the array.</param>
+/// <param name="oBuffer">The output buffer. Must be at least getVariableLengthArraySize() bytes long.</param>
+/// <returns>Returns the number of bytes written to the buffer.</returns>
+inline size_t encodeVariableLengthArray(const uint32_t * iValues, size_t iCount, uint8_t * oBuffer)
+{
+  size_t size = 0;
+  for(size_t i=0; i<iCount; i++)
+    size += encodeVariableLength(iValues[i], &oBuffer[size]);
+  return size;
+}
+
+/// <summary>
+/// Decodes consecutive Variable Length Quantities to an array of values.
+/// </summary>
+/// <param name="iBuffer">The input buffer.</param>
+/// <param name="iBufferSize">The size of the input buffer in bytes.</param>
+/// <param name="oValues">The output values.</param>
+/// <param name="iCount">The number of values to decode.</param>
+/// <returns>Returns the number of bytes read from the buffer. Returns 0 if iCount values cannot be decoded.</returns>
+inline size_t decodeVariableLengthArray(const uint8_t * iBuffer, size_t iBufferSize, uint32_t * oValues, size_t iCount)
+{
+  size_t offset = 0;
+  for(size_t i=0; i<iCount; i++)
+  {
+    size_t size = decodeVariableLength(&iBuffer[offset], iBufferSize - offset, oValues[i]);
+    if (size == 0)
+      return 0;
+    offset += size;
+  }
+  return offset;
 }
 
 /// <summary>
 /// Writes a value as a Variable Length Quantity to a file.
 /// </summary>
 /// <remarks>
-/// Variable Length Quantity numbers are represented as 7 bits per byte,
-/// most significant bits first. All bytes except the last have bit 7
-/// set, and the last byte has bit 7 clear. If the number is between 0
-/// and 127, it is thus represented exactly as one byte.
-/// For example:
-///
-///     Values    Variable Length Quantity
-///     00000000  00
-///     00000040  40
-///     0000007F  7F
-///     00000080  81 00
-///     00002000  C0 00
-///     00003FFF  FF 7F
-///     00004000  81 80 00
-///     00100000  C0 80 00
-///     001FFFFF  FF FF 7F
-///     00200000  81 80 80 00
-///     08000000  C0 80 80 00
-///     0FFFFFFF  FF FF FF 7F
+/// See encodeVariableLength() for details about the Variable Length Quantity format.
+/// The value is encoded in a local buffer and written with a single fwrite() call.
+/// </remarks>
+/// <param name="iValue">The value to be written to file</param>
+/// <param name="iMinOutputSize">The minimum output size in byte.
+/// ie: Writing the value 0x00000000 is normaly written as 1 byte 0x00.
+/// Forcing minimum byte to 2 result in the following bytes written:
+/// 0x80 0x00 which is the same value.</param>
+/// <param name="f">The FILE* handle</param>
+/// <returns>Returns the number of bytes written to the file</returns>
+template <typename T>
+size_t fwriteVariableLength(const T & iValue, size_t iMinOutputSize, FILE * f)
+{
+  uint8_t buffer[VARIABLE_LENGTH_MAX_SIZE];
+  size_t size = encodeVariableLength((uint32_t)iValue, iMinOutputSize, buffer);
+  return fwrite(buffer, 1, size, f);
+}
+
+/// <summary>
+/// Writes a value as a Variable Length Quantity to a file.
+/// </summary>
+/// <remarks>
+/// See encodeVariableLength() for details about the Variable Length Quantity format.
 /// </remarks>
 /// <param name="iValue">The value to be written to file</param>
 /// <param name="f">The FILE* handle</param>
@@ -186,4 +255,4 @@ size_t fwriteVariableLength(const T & iValue, FILE * f)
 
 }; //namespace libmidi
 
-#endif //VARIABLE_LENGTH_H
\ No newline at end of file
+#endif //VARIABLE_LENGTH_H
@@ -0,0 +1,245 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+//
+// Description:
+//   Saves melodies to files in parallel.
+//
+
+#include "libmidi/batchwriter.h"
+#include "libmidi/sinks.h"
+
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <cstring> //for memset()
+
+namespace libmidi
+{
+
+//range of jobs owned by a worker
+struct WORKER_QUEUE
+{
+  std::mutex lock;
+  size_t begin;
+  size_t end;
+};
+
+//counters of a worker
+struct WORKER_RESULT
+{
+  size_t numSucceeded;
+  size_t numFailed;
+  uint64_t numBytes;
+};
+
+//takes the next job of a worker's own queue
+static bool popJob(WORKER_QUEUE & iQueue, size_t & oIndex)
+{
+  std::lock_guard<std::mutex> guard(iQueue.lock);
+  if (iQueue.begin >= iQueue.end)
+    return false;
+  oIndex = iQueue.begin++;
+  return true;
+}
+
+//moves the last half of the jobs of another worker to the given worker's queue
+static bool stealJobs(std::vector<WORKER_QUEUE> & iQueues, size_t iWorker)
+{
+  size_t numWorkers = iQueues.size();
+  for(size_t i=1; i<numWorkers; i++)
+  {
+    WORKER_QUEUE & victim = iQueues[(iWorker + i) % numWorkers];
+    size_t begin = 0;
+    size_t end = 0;
+    {
+      std::lock_guard<std::mutex> guard(victim.lock);
+      if (victim.begin >= victim.end)
+        continue;
+      size_t remaining = victim.end - victim.begin;
+      end = victim.end;
+      begin = victim.end - (remaining + 1) / 2;
+      victim.end = begin;
+    }
+
+    WORKER_QUEUE & queue = iQueues[iWorker];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    queue.begin = begin;
+    queue.end = end;
+    return true;
+  }
+  return false;
+}
+
+MidiBatchWriter::MidiBatchWriter()
+{
+  mNumThreads = 0;
+  memset(&mStatistics, 0, sizeof(mStatistics));
+}
+
+void MidiBatchWriter::setThreadCount(size_t iNumThreads)
+{
+  mNumThreads = iNumThreads;
+}
+
+size_t MidiBatchWriter::addJob(const MidiFile * iFile, const char * iPath)
+{
+  JOB job;
+  job.file = iFile;
+  job.function = NULL;
+  job.userData = NULL;
+  job.path = (iPath ? iPath : "");
+  job.status = JOB_PENDING;
+  job.size = 0;
+  mJobs.push_back(job);
+  return mJobs.size() - 1;
+}
+
+size_t MidiBatchWriter::addJob(BUILD_FUNCTION iFunction, void * iUserData, const char * iPath)
+{
+  size_t index = addJob((const MidiFile *)NULL, iPath);
+  mJobs[index].function = iFunction;
+  mJobs[index].userData = iUserData;
+  return index;
+}
+
+void MidiBatchWriter::clear()
+{
+  mJobs.clear();
+}
+
+bool MidiBatchWriter::run()
+{
+  memset(&mStatistics, 0, sizeof(mStatistics));
+  mStatistics.numJobs = mJobs.size();
+
+  size_t numThreads = mNumThreads;
+  if (numThreads == 0)
+    numThreads = std::thread::hardware_concurrency();
+  if (numThreads > mJobs.size())
+    numThreads = mJobs.size();
+  if (numThreads == 0)
+    numThreads = 1;
+  mStatistics.numThreads = numThreads;
+
+  //split the jobs in equal ranges
+  std::vector<WORKER_QUEUE> queues(numThreads);
+  for(size_t i=0; i<numThreads; i++)
+  {
+    queues[i].begin = mJobs.size() * i / numThreads;
+    queues[i].end = mJobs.size() * (i+1) / numThreads;
+  }
+  std::vector<WORKER_RESULT> results(numThreads);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> threads;
+  threads.reserve(numThreads);
+  for(size_t i=0; i<numThreads; i++)
+  {
+    threads.push_back(std::thread([this, &queues, &results, i]()
+    {
+      WORKER_RESULT & result = results[i];
+      result.numSucceeded = 0;
+      result.numFailed = 0;
+      result.numBytes = 0;
+
+      std::vector<uint8_t> buffer; //reused for all the jobs of the worker
+      size_t index = 0;
+      while(popJob(queues[i], index) || (stealJobs(queues, i) && popJob(queues[i], index)))
+      {
+        JOB & job = mJobs[index];
+        job.status = JOB_SAVE_FAILED;
+
+        MidiFile built;
+        const MidiFile * file = job.file;
+        if (job.function)
+        {
+          if (!job.function(built, index, job.userData))
+          {
+            job.status = JOB_BUILD_FAILED;
+            result.numFailed++;
+            continue;
+          }
+          file = &built;
+        }
+
+        FileSink sink(0); //the melody is written at once
+        if (file && file->saveToBuffer(buffer) && sink.open(job.path.c_str()) &&
+            sink.write(&buffer[0], buffer.size()) && sink.close())
+        {
+          job.status = JOB_SUCCESS;
+          job.size = buffer.size();
+          result.numSucceeded++;
+          result.numBytes += buffer.size();
+        }
+        else
+          result.numFailed++;
+      }
+    }));
+  }
+  for(size_t i=0; i<threads.size(); i++)
+  {
+    threads[i].join();
+  }
+
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  for(size_t i=0; i<numThreads; i++)
+  {
+    mStatistics.numSucceeded += results[i].numSucceeded;
+    mStatistics.numFailed += results[i].numFailed;
+    mStatistics.numBytes += results[i].numBytes;
+  }
+  mStatistics.elapsedSeconds = elapsed.count();
+  if (mStatistics.elapsedSeconds > 0.0)
+  {
+    mStatistics.jobsPerSecond = mStatistics.numJobs / mStatistics.elapsedSeconds;
+    mStatistics.bytesPerSecond = mStatistics.numBytes / mStatistics.elapsedSeconds;
+  }
+
+  return mStatistics.numFailed == 0;
+}
+
+size_t MidiBatchWriter::getJobCount() const
+{
+  return mJobs.size();
+}
+
+MidiBatchWriter::JOB_STATUS MidiBatchWriter::getJobStatus(size_t iIndex) const
+{
+  return mJobs[iIndex].status;
+}
+
+size_t MidiBatchWriter::getJobSize(size_t iIndex) const
+{
+  return mJobs[iIndex].size;
+}
+
+const MidiBatchWriter::STATISTICS & MidiBatchWriter::getStatistics() const
+{
+  return mStatistics;
+}
+
+}; //namespace libmidi
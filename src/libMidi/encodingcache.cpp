@@ -0,0 +1,145 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+//
+// Description:
+//   Bounded cache of the encoded files of melodies.
+//
+
+#include "libmidi/encodingcache.h"
+
+namespace libmidi
+{
+
+const size_t MidiEncodingCache::DEFAULT_MAX_SIZE;
+
+MidiEncodingCache::MidiEncodingCache(size_t iMaxSize)
+{
+  mMaxSize = iMaxSize;
+  mSize = 0;
+  mNumHits = 0;
+  mNumMisses = 0;
+  mNumEvictions = 0;
+}
+
+MidiEncodingCache::~MidiEncodingCache()
+{
+}
+
+void MidiEncodingCache::setMaxSize(size_t iMaxSize)
+{
+  std::lock_guard<std::mutex> guard(mLock);
+  mMaxSize = iMaxSize;
+  evict(mMaxSize);
+}
+
+size_t MidiEncodingCache::getMaxSize() const
+{
+  std::lock_guard<std::mutex> guard(mLock);
+  return mMaxSize;
+}
+
+bool MidiEncodingCache::find(uint64_t iHash, std::vector<uint8_t> & oBuffer)
+{
+  std::lock_guard<std::mutex> guard(mLock);
+  EntryIndex::iterator it = mIndex.find(iHash);
+  if (it == mIndex.end())
+  {
+    mNumMisses++;
+    return false;
+  }
+  mNumHits++;
+
+  //move to the front of the list
+  mEntries.splice(mEntries.begin(), mEntries, it->second);
+  oBuffer = it->second->buffer;
+  return true;
+}
+
+void MidiEncodingCache::insert(uint64_t iHash, const uint8_t * iBuffer, size_t iSize)
+{
+  std::lock_guard<std::mutex> guard(mLock);
+
+  EntryIndex::iterator it = mIndex.find(iHash);
+  if (it != mIndex.end())
+  {
+    mSize -= it->second->buffer.size();
+    mEntries.erase(it->second);
+    mIndex.erase(it);
+  }
+  if (iSize > mMaxSize)
+    return;
+
+  evict(mMaxSize - iSize);
+
+  ENTRY e;
+  e.hash = iHash;
+  mEntries.push_front(e);
+  mEntries.front().buffer.assign(iBuffer, iBuffer + iSize);
+  mIndex[iHash] = mEntries.begin();
+  mSize += iSize;
+}
+
+void MidiEncodingCache::clear()
+{
+  std::lock_guard<std::mutex> guard(mLock);
+  mEntries.clear();
+  mIndex.clear();
+  mSize = 0;
+}
+
+MidiEncodingCache::STATISTICS MidiEncodingCache::getStatistics() const
+{
+  std::lock_guard<std::mutex> guard(mLock);
+  STATISTICS s;
+  s.numHits = mNumHits;
+  s.numMisses = mNumMisses;
+  s.numEvictions = mNumEvictions;
+  s.numEntries = mEntries.size();
+  s.size = mSize;
+  s.maxSize = mMaxSize;
+  return s;
+}
+
+void MidiEncodingCache::resetStatistics()
+{
+  std::lock_guard<std::mutex> guard(mLock);
+  mNumHits = 0;
+  mNumMisses = 0;
+  mNumEvictions = 0;
+}
+
+void MidiEncodingCache::evict(size_t iMaxSize)
+{
+  while(mSize > iMaxSize && !mEntries.empty())
+  {
+    const ENTRY & e = mEntries.back();
+    mSize -= e.buffer.size();
+    mIndex.erase(e.hash);
+    mEntries.pop_back();
+    mNumEvictions++;
+  }
+}
+
+}; //namespace libmidi
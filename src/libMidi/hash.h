@@ -0,0 +1,78 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#ifndef HASH_H
+#define HASH_H
+
+//
+// Description:
+//   Incremental 64 bits hash of the content of melodies.
+//   Values are mixed one at a time which allows a hash to be
+//   extended when new values are appended. Not a cryptographic hash.
+//
+
+#include <stdint.h>
+#include <cstddef> //for size_t
+
+namespace libmidi
+{
+
+static const uint64_t HASH_SEED = 0xcbf29ce484222325ULL;
+
+/// <summary>Mixes the bits of a value (finalizer of splitmix64).</summary>
+inline uint64_t hashMix(uint64_t iValue)
+{
+  iValue ^= iValue >> 30;
+  iValue *= 0xbf58476d1ce4e5b9ULL;
+  iValue ^= iValue >> 27;
+  iValue *= 0x94d049bb133111ebULL;
+  iValue ^= iValue >> 31;
+  return iValue;
+}
+
+/// <summary>Appends a value to a hash. The order of the values matters.</summary>
+inline uint64_t hashCombine(uint64_t iHash, uint64_t iValue)
+{
+  return (iHash ^ hashMix(iValue)) * 0x9e3779b97f4a7c15ULL;
+}
+
+/// <summary>Appends an array of bytes and its size to a hash.</summary>
+inline uint64_t hashBytes(uint64_t iHash, const void * iData, size_t iSize)
+{
+  const uint8_t * data = (const uint8_t *)iData;
+  uint64_t h = hashCombine(iHash, iSize);
+  for(size_t i=0; i<iSize; i+=sizeof(uint64_t))
+  {
+    //little endian on all platforms
+    uint64_t value = 0;
+    for(size_t j=0; j<sizeof(value) && i+j<iSize; j++)
+      value |= (uint64_t)data[i+j] << (8*j);
+    h = hashCombine(h, value);
+  }
+  return h;
+}
+
+}; //namespace libmidi
+
+#endif //HASH_H
@@ -0,0 +1,137 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+//
+// Description:
+//   Internal histogram of latencies with a bounded relative error.
+//
+
+#include <stdint.h>
+#include <cstddef> //for size_t
+#include <vector>
+
+namespace libmidi
+{
+
+/// <summary>
+/// Counts values in buckets of increasing width to compute percentiles.
+/// </summary>
+/// <remarks>
+/// Values below 64 have their own bucket. Each power of 2 above is split in 32 buckets
+/// so a percentile is within 3% of the exact value. The memory usage is constant.
+/// </remarks>
+class Histogram
+{
+public:
+  Histogram() :
+    mCounts(NUM_BUCKETS, 0),
+    mCount(0),
+    mSum(0),
+    mMax(0)
+  {
+  }
+
+  inline void add(uint64_t iValue)
+  {
+    mCounts[getBucket(iValue)]++;
+    mCount++;
+    mSum += iValue;
+    if (iValue > mMax)
+      mMax = iValue;
+  }
+
+  inline void merge(const Histogram & iHistogram)
+  {
+    for(size_t i=0; i<NUM_BUCKETS; i++)
+      mCounts[i] += iHistogram.mCounts[i];
+    mCount += iHistogram.mCount;
+    mSum += iHistogram.mSum;
+    if (iHistogram.mMax > mMax)
+      mMax = iHistogram.mMax;
+  }
+
+  inline uint64_t getCount() const { return mCount; }
+  inline uint64_t getMax() const { return mMax; }
+  inline double getAverage() const { return (mCount ? (double)mSum / mCount : 0.0); }
+
+  /// <summary>Get the highest value of the bucket that contains the given percentile.</summary>
+  /// <param name="iPercent">The percentile. min=0 max=100</param>
+  inline uint64_t getPercentile(double iPercent) const
+  {
+    if (mCount == 0)
+      return 0;
+    uint64_t rank = (uint64_t)(iPercent / 100.0 * mCount + 0.999999);
+    if (rank == 0)
+      rank = 1;
+
+    uint64_t count = 0;
+    for(size_t i=0; i<NUM_BUCKETS; i++)
+    {
+      count += mCounts[i];
+      if (count >= rank)
+      {
+        uint64_t value = getBucketMax(i);
+        return (value < mMax ? value : mMax);
+      }
+    }
+    return mMax;
+  }
+
+private:
+  static const size_t LINEAR_BUCKETS = 64;
+  static const size_t SUB_BUCKETS = 32; //per power of 2
+  static const size_t NUM_BUCKETS = LINEAR_BUCKETS + (64 - 6) * SUB_BUCKETS;
+
+  static inline size_t getBucket(uint64_t iValue)
+  {
+    if (iValue < LINEAR_BUCKETS)
+      return (size_t)iValue;
+    size_t msb = 6;
+    while((iValue >> (msb + 1)) != 0)
+      msb++;
+    size_t sub = (size_t)(iValue >> (msb - 5)); //from 32 to 63
+    return LINEAR_BUCKETS + (msb - 6) * SUB_BUCKETS + (sub - SUB_BUCKETS);
+  }
+
+  static inline uint64_t getBucketMax(size_t iBucket)
+  {
+    if (iBucket < LINEAR_BUCKETS)
+      return iBucket;
+    size_t msb = 6 + (iBucket - LINEAR_BUCKETS) / SUB_BUCKETS;
+    uint64_t sub = SUB_BUCKETS + (iBucket - LINEAR_BUCKETS) % SUB_BUCKETS;
+    return ((sub + 1) << (msb - 5)) - 1;
+  }
+
+  std::vector<uint64_t> mCounts;
+  uint64_t mCount;
+  uint64_t mSum;
+  uint64_t mMax;
+};
+
+}; //namespace libmidi
+
+#endif //HISTOGRAM_H
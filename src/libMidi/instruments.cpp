@@ -29,21 +29,274 @@
 
 #include "libmidi/instruments.h"
 
-#include <string>   //for NULL
+#include <cstring>   //for strlen(), strcmp(), strncmp()
+#include <algorithm> //for std::sort()
 
 namespace libmidi
 {
 
+//
+// Description:
+//  Instrument codes according to https://en.wikipedia.org/wiki/General_MIDI
+//
+const char * const gInstruments[NUM_INSTRUMENTS] = {
+  "Acoustic Grand Piano",
+  "Bright Acoustic Piano",
+  "Electric Grand Piano",
+  "Honky-tonk Piano",
+  "Electric Piano 1",
+  "Electric Piano 2",
+  "Harpsichord",
+  "Clavinet",
+  "Celesta",
+  "Glockenspiel",
+  "Music Box",
+  "Vibraphone",
+  "Marimba",
+  "Xylophone",
+  "Tubular Bells",
+  "Dulcimer",
+  "Drawbar Organ",
+  "Percussive Organ",
+  "Rock Organ",
+  "Church Organ",
+  "Reed Organ",
+  "Accordion",
+  "Harmonica",
+  "Tango Accordion",
+  "Acoustic Guitar (nylon)",
+  "Acoustic Guitar (steel)",
+  "Electric Guitar (jazz)",
+  "Electric Guitar (clean)",
+  "Electric Guitar (muted)",
+  "Overdriven Guitar",
+  "Distortion Guitar",
+  "Guitar Harmonics",
+  "Acoustic Bass",
+  "Electric Bass (finger)",
+  "Electric Bass (pick)",
+  "Fretless Bass",
+  "Slap Bass 1",
+  "Slap Bass 2",
+  "Synth Bass 1",
+  "Synth Bass 2",
+  "Violin",
+  "Viola",
+  "Cello",
+  "Contrabass",
+  "Tremolo Strings",
+  "Pizzicato Strings",
+  "Orchestral Harp",
+  "Timpani",
+  "String Ensemble 1",
+  "String Ensemble 2",
+  "Synth Strings 1",
+  "Synth Strings 2",
+  "Choir Aahs",
+  "Voice Oohs",
+  "Synth Choir",
+  "Orchestra Hit",
+  "Trumpet",
+  "Trombone",
+  "Tuba",
+  "Muted Trumpet",
+  "French Horn",
+  "Brass Section",
+  "Synth Brass 1",
+  "Synth Brass 2",
+  "Soprano Sax",
+  "Alto Sax",
+  "Tenor Sax",
+  "Baritone Sax",
+  "Oboe",
+  "English Horn",
+  "Bassoon",
+  "Clarinet",
+  "Piccolo",
+  "Flute",
+  "Recorder",
+  "Pan Flute",
+  "Blown bottle",
+  "Shakuhachi",
+  "Whistle",
+  "Ocarina",
+  "Lead 1 (square)",
+  "Lead 2 (sawtooth)",
+  "Lead 3 (calliope)",
+  "Lead 4 chiff",
+  "Lead 5 (charang)",
+  "Lead 6 (voice)",
+  "Lead 7 (fifths)",
+  "Lead 8 (bass + lead)",
+  "Pad 1 (new age)",
+  "Pad 2 (warm)",
+  "Pad 3 (polysynth)",
+  "Pad 4 (choir)",
+  "Pad 5 (bowed)",
+  "Pad 6 (metallic)",
+  "Pad 7 (halo)",
+  "Pad 8 (sweep)",
+  "FX 1 (rain)",
+  "FX 2 (soundtrack)",
+  "FX 3 (crystal)",
+  "FX 4 (atmosphere)",
+  "FX 5 (brightness)",
+  "FX 6 (goblins)",
+  "FX 7 (echoes)",
+  "FX 8 (sci-fi)",
+  "Sitar",
+  "Banjo",
+  "Shamisen",
+  "Koto",
+  "Kalimba",
+  "Bagpipe",
+  "Fiddle",
+  "Shanai",
+  "Tinkle Bell",
+  "Agogo",
+  "Steel Drums",
+  "Woodblock",
+  "Taiko Drum",
+  "Melodic Tom",
+  "Synth Drum",
+  "Reverse Cymbal",
+  "Guitar Fret Noise",
+  "Breath Noise",
+  "Seashore",
+  "Bird Tweet",
+  "Telephone Ring",
+  "Helicopter",
+  "Applause",
+  "Gunshot"
+};
+
+static const size_t INSTRUMENT_INDEX_SIZE = 256; //power of 2 and at least twice NUM_INSTRUMENTS
+static const int16_t EMPTY_SLOT = -1;
+
+inline char toLowerCase(char c)
+{
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A' + 'a';
+  return c;
+}
+
+/// <summary>Computes a case insensitive FNV-1a hash of a name.</summary>
+inline uint32_t getNameHash(const char * iName)
+{
+  uint32_t hash = 2166136261u;
+  for(const char * c = iName; *c != '\0'; c++)
+  {
+    hash ^= (uint8_t)toLowerCase(*c);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/// <summary>Compares two names ignoring case. Only the first iLength characters are compared.</summary>
+/// <returns>Returns a value lower than, equal to or greater than 0 like strncmp().</returns>
+inline int compareIgnoreCase(const char * a, const char * b, size_t iLength)
+{
+  for(size_t i=0; i<iLength; i++)
+  {
+    char ca = toLowerCase(a[i]);
+    char cb = toLowerCase(b[i]);
+    if (ca != cb)
+      return (uint8_t)ca < (uint8_t)cb ? -1 : 1;
+    if (ca == '\0')
+      return 0;
+  }
+  return 0;
+}
+
+inline bool isInstrumentNameLess(INSTRUMENT a, INSTRUMENT b)
+{
+  return compareIgnoreCase(gInstruments[a], gInstruments[b], (size_t)-1) < 0;
+}
+
+/// <summary>
+/// Instrument name indexes built once from gInstruments.
+/// </summary>
+struct INSTRUMENT_INDEX
+{
+  //open addressing hash table of instrument ids indexed by getNameHash().
+  int16_t slots[INSTRUMENT_INDEX_SIZE];
+
+  //instrument ids sorted by name, ignoring case.
+  INSTRUMENT sorted[NUM_INSTRUMENTS];
+
+  INSTRUMENT_INDEX()
+  {
+    for(size_t i=0; i<INSTRUMENT_INDEX_SIZE; i++)
+      slots[i] = EMPTY_SLOT;
+
+    for(size_t i=0; i<NUM_INSTRUMENTS; i++)
+    {
+      size_t slot = getNameHash(gInstruments[i]) & (INSTRUMENT_INDEX_SIZE-1);
+      while(slots[slot] != EMPTY_SLOT)
+        slot = (slot+1) & (INSTRUMENT_INDEX_SIZE-1);
+      slots[slot] = (int16_t)i;
+      sorted[i] = (INSTRUMENT)i;
+    }
+
+    std::sort(&sorted[0], &sorted[0] + NUM_INSTRUMENTS, isInstrumentNameLess);
+  }
+};
+
+static const INSTRUMENT_INDEX & getInstrumentIndex()
+{
+  static const INSTRUMENT_INDEX index;
+  return index;
+}
+
 INSTRUMENT findInstrument(const char * iName)
 {
-  if (iName == NULL)
+  return findInstrument(iName, INSTRUMENT_MATCH_EXACT);
+}
+
+INSTRUMENT findInstrument(const char * iName, int iMatchFlags)
+{
+  if (iName == NULL || iName[0] == '\0')
     return INVALID_INSTRUMENT;
-  std::string name = iName;
-  for(INSTRUMENT i=MIN_INSTRUMENT; i>=MIN_INSTRUMENT && i<=MAX_INSTRUMENT; i++)
+
+  const INSTRUMENT_INDEX & index = getInstrumentIndex();
+  bool ignoreCase = (iMatchFlags & INSTRUMENT_MATCH_IGNORE_CASE) == INSTRUMENT_MATCH_IGNORE_CASE;
+
+  if ((iMatchFlags & INSTRUMENT_MATCH_PREFIX) == INSTRUMENT_MATCH_PREFIX)
+  {
+    //binary search the first name that starts with the prefix
+    size_t length = strlen(iName);
+    size_t first = 0;
+    size_t last = NUM_INSTRUMENTS;
+    while(first < last)
+    {
+      size_t middle = first + (last-first)/2;
+      if (compareIgnoreCase(gInstruments[index.sorted[middle]], iName, length) < 0)
+        first = middle+1;
+      else
+        last = middle;
+    }
+
+    //select the lowest id of all matching names
+    INSTRUMENT best = INVALID_INSTRUMENT;
+    for(size_t i=first; i<NUM_INSTRUMENTS && compareIgnoreCase(gInstruments[index.sorted[i]], iName, length) == 0; i++)
+    {
+      INSTRUMENT id = index.sorted[i];
+      if (!ignoreCase && strncmp(gInstruments[id], iName, length) != 0)
+        continue;
+      if (best == INVALID_INSTRUMENT || id < best)
+        best = id;
+    }
+    return best;
+  }
+
+  size_t slot = getNameHash(iName) & (INSTRUMENT_INDEX_SIZE-1);
+  while(index.slots[slot] != EMPTY_SLOT)
   {
-    const char * currentName = gInstruments[i];
-    if (name == currentName)
-      return i;
+    INSTRUMENT id = (INSTRUMENT)index.slots[slot];
+    const char * name = gInstruments[id];
+    if (ignoreCase ? compareIgnoreCase(name, iName, (size_t)-1) == 0 : strcmp(name, iName) == 0)
+      return id;
+    slot = (slot+1) & (INSTRUMENT_INDEX_SIZE-1);
   }
   return INVALID_INSTRUMENT;
 }
@@ -31,277 +31,85 @@
 #include "libmidi/libmidi.h"
 #include "libmidi/pitches.h"
 #include "libmidi/instruments.h"
+#include "libmidi/sinks.h"
+#include "libmidi/transform.h"
+#include "libmidi/encodingcache.h"
 
-#include "varlength.h"
+#include "midiformat.h"
+#include "trackencoder.h"
+#include "timeline.h"
+#include "hash.h"
+
+#include <cstdlib>   //for abs()
+#include <cmath>     //for floor(), log2()
+#include <queue>     //for std::priority_queue
+#include <algorithm> //for std::stable_sort(), std::min()
 
 namespace libmidi
 {
 
-typedef uint32_t HEADER_ID;
-static const HEADER_ID MIDI_FILE_ID = 0x4d546864; //"MThd"
-static const HEADER_ID MIDI_TRACK_HEADER_ID = 0x4d54726b; //"MTrk"
-
-typedef uint16_t HEADER_MIDI_TYPE;
-
-//events handling
-typedef uint8_t EVENT_STATUS;
-static const EVENT_STATUS NOTE_ON_CHANNEL_0           = (EVENT_STATUS)0x90;
-static const EVENT_STATUS NOTE_OFF_CHANNEL_0          = (EVENT_STATUS)0x80;
-static const EVENT_STATUS AFTER_TOUCH_CHANNEL_0       = (EVENT_STATUS)0xA0;
-static const EVENT_STATUS CONTROL_CHANGE_CHANNEL_0    = (EVENT_STATUS)0xB0;
-static const EVENT_STATUS PROGRAM_CHANGE_CHANNEL_0    = (EVENT_STATUS)0xC0;
-static const EVENT_STATUS CHANNEL_PRESSURE_CHANNEL_0  = (EVENT_STATUS)0xD0;
-static const EVENT_STATUS PITCH_WHEEL_CHANNEL_0       = (EVENT_STATUS)0xE0;
-static const EVENT_STATUS EVENT_META                  = (EVENT_STATUS)0xFF;
-
-typedef int8_t EVENT_PITCH; //note code
-static const EVENT_PITCH ALL_NOTES_OFF = (EVENT_PITCH)0x7B;
-
-typedef int8_t EVENT_VOLUME; //from 0 to 7F
-static const EVENT_VOLUME MIN_VOLUME = (EVENT_VOLUME)0x00;
-static const EVENT_VOLUME MAX_VOLUME = (EVENT_VOLUME)0x7F;
-
-typedef int8_t META_TYPE;
-static const META_TYPE META_SEQUENCE_NUMBER                = (META_TYPE)0x00;
-static const META_TYPE META_TEXT_EVENT                     = (META_TYPE)0x01;
-static const META_TYPE META_COPYRIGHT_NOTICE               = (META_TYPE)0x02;
-static const META_TYPE META_SEQUENCE_OR_TRACK_NAME         = (META_TYPE)0x03;
-static const META_TYPE META_INSTRUMENT_NAME                = (META_TYPE)0x04;
-static const META_TYPE META_LYRIC_TEXT	                   = (META_TYPE)0x05;
-static const META_TYPE META_MARKER_TEXT	                   = (META_TYPE)0x06;
-static const META_TYPE META_CUE_POINT                      = (META_TYPE)0x07;
-static const META_TYPE META_MIDI_CHANNEL_PREFIX_ASSIGNMENT = (META_TYPE)0x20;
-static const META_TYPE META_END_OF_TRACK                   = (META_TYPE)0x2F;
-static const META_TYPE META_TEMPO_SETTING                  = (META_TYPE)0x51;
-static const META_TYPE META_SMPTE_OFFSET                   = (META_TYPE)0x54;
-static const META_TYPE META_TIME_SIGNATURE                 = (META_TYPE)0x58;
-static const META_TYPE META_KEY_SIGNATURE                  = (META_TYPE)0x59;
-static const META_TYPE META_SEQUENCER_SPECIFIC_EVENT       = (META_TYPE)0x7F;
-
-typedef uint32_t VAR_LENGTH;
-
-#pragma pack(push, 1) // exact fit - no padding
-struct MIDI_HEADER
-{
-  HEADER_ID id; //see DEFAULT_FILE_HEADER
-  uint32_t length;
-  HEADER_MIDI_TYPE type;
-  uint16_t numTracks;
-  uint16_t ticksPerQuarterNote;
-};
-struct TRACK_HEADER
-{
-  HEADER_ID id; //see DEFAULT_FILE_HEADER
-  uint32_t length; //including data size & track footer
-};
-struct NOTE_EVENT
-{
-  VAR_LENGTH ticks;
-  EVENT_STATUS status;
-  EVENT_PITCH pitch;
-  EVENT_VOLUME volume;
+//MIDI pitch to frequency table according to General MIDI Lite, v1.0,
+//section 3.1.7
+//available at https://www.midi.org/images/downloads/GML-v1.pdf
+//Pitches lower than MIN_PITCH are not supported.
+static const uint16_t gPitchFrequencies[] = {
+  0,       0,        0,       0,        0,       0,       0,        0,       0,        0,       0,        0,       //0x00
+  NOTE_C0, NOTE_DB0, NOTE_D0, NOTE_EB0, NOTE_E0, NOTE_F0, NOTE_GB0, NOTE_G0, NOTE_AB0, NOTE_A0, NOTE_BB0, NOTE_B0, //0x0C
+  NOTE_C1, NOTE_DB1, NOTE_D1, NOTE_EB1, NOTE_E1, NOTE_F1, NOTE_GB1, NOTE_G1, NOTE_AB1, NOTE_A1, NOTE_BB1, NOTE_B1, //0x18
+  NOTE_C2, NOTE_DB2, NOTE_D2, NOTE_EB2, NOTE_E2, NOTE_F2, NOTE_GB2, NOTE_G2, NOTE_AB2, NOTE_A2, NOTE_BB2, NOTE_B2, //0x24
+  NOTE_C3, NOTE_DB3, NOTE_D3, NOTE_EB3, NOTE_E3, NOTE_F3, NOTE_GB3, NOTE_G3, NOTE_AB3, NOTE_A3, NOTE_BB3, NOTE_B3, //0x30
+  NOTE_C4, NOTE_DB4, NOTE_D4, NOTE_EB4, NOTE_E4, NOTE_F4, NOTE_GB4, NOTE_G4, NOTE_AB4, NOTE_A4, NOTE_BB4, NOTE_B4, //0x3C
+  NOTE_C5, NOTE_DB5, NOTE_D5, NOTE_EB5, NOTE_E5, NOTE_F5, NOTE_GB5, NOTE_G5, NOTE_AB5, NOTE_A5, NOTE_BB5, NOTE_B5, //0x48
+  NOTE_C6, NOTE_DB6, NOTE_D6, NOTE_EB6, NOTE_E6, NOTE_F6, NOTE_GB6, NOTE_G6, NOTE_AB6, NOTE_A6, NOTE_BB6, NOTE_B6, //0x54
+  NOTE_C7, NOTE_DB7, NOTE_D7, NOTE_EB7, NOTE_E7, NOTE_F7, NOTE_GB7, NOTE_G7, NOTE_AB7, NOTE_A7, NOTE_BB7, NOTE_B7, //0x60
+  NOTE_C8, NOTE_DB8, NOTE_D8, NOTE_EB8, NOTE_E8, NOTE_F8, NOTE_GB8, NOTE_G8, NOTE_AB8, NOTE_A8, NOTE_BB8, NOTE_B8, //0x6C
+  NOTE_C9, NOTE_DB9, NOTE_D9, NOTE_EB9, NOTE_E9, NOTE_F9, NOTE_GB9, NOTE_G9,                                       //0x78
 };
-struct META_EVENT
-{
-  VAR_LENGTH ticks;
-  EVENT_STATUS status;
-  META_TYPE type;
-  VAR_LENGTH size;
-};
-#pragma pack(pop) //back to whatever the previous packing mode was
-
 
-EVENT_PITCH findMidiPitchFromFrequency(unsigned short frequency)
+inline int getFrequencyDiff(uint16_t a, uint16_t b)
 {
-  //According to General MIDI Lite, v1.0,
-  //section 3.1.7
-  //available at https://www.midi.org/images/downloads/GML-v1.pdf
+  return abs((int)a - (int)b);
+}
 
+EVENT_PITCH findMidiPitchFromFrequency(uint16_t frequency)
+{
   if (frequency <= NOTE_C0)
-    return 0x0C;
-
-#define DECLARE_PITCH(midiPitchId, note_frequency) {midiPitchId, note_frequency},
-
-  struct PITCH_NOTE_PAIR
+    return MIN_PITCH;
+  if (frequency >= NOTE_G9)
+    return MAX_PITCH;
+
+  //estimate the pitch with equal temperament: A4 (0x45) is 440 Hz
+  //and each semitone is a factor of 2^(1/12).
+  int pitch = (int)floor(0x45 + 12.0*log2(frequency/440.0) + 0.5);
+  if (pitch < MIN_PITCH)
+    pitch = MIN_PITCH;
+  if (pitch > MAX_PITCH)
+    pitch = MAX_PITCH;
+
+  //correct the estimation with the frequency table.
+  //Note frequencies are rounded to the nearest Hz which
+  //makes the closest note in Hz different from the closest note in semitones.
+  //On a tie, the lowest pitch is selected.
+  int diff = getFrequencyDiff(frequency, gPitchFrequencies[pitch]);
+  while(pitch > MIN_PITCH && getFrequencyDiff(frequency, gPitchFrequencies[pitch-1]) <= diff)
   {
-    EVENT_PITCH pitch;
-    int16_t frequency;
-  };
-  static const PITCH_NOTE_PAIR pairs[] = {
-    DECLARE_PITCH(0x7F, NOTE_G9)
-    DECLARE_PITCH(0x7E, NOTE_GB9)
-    DECLARE_PITCH(0x7D, NOTE_F9)
-    DECLARE_PITCH(0x7C, NOTE_E9)
-    DECLARE_PITCH(0x7B, NOTE_EB9)
-    DECLARE_PITCH(0x7A, NOTE_D9)
-    DECLARE_PITCH(0x79, NOTE_DB9)
-    DECLARE_PITCH(0x78, NOTE_C9)
-    DECLARE_PITCH(0x77, NOTE_B8)
-    DECLARE_PITCH(0x76, NOTE_BB8)
-    DECLARE_PITCH(0x75, NOTE_A8)
-    DECLARE_PITCH(0x74, NOTE_AB8)
-    DECLARE_PITCH(0x73, NOTE_G8)
-    DECLARE_PITCH(0x72, NOTE_GB8)
-    DECLARE_PITCH(0x71, NOTE_F8)
-    DECLARE_PITCH(0x70, NOTE_E8)
-    DECLARE_PITCH(0x6F, NOTE_EB8)
-    DECLARE_PITCH(0x6E, NOTE_D8)
-    DECLARE_PITCH(0x6D, NOTE_DB8)
-    DECLARE_PITCH(0x6C, NOTE_C8)
-    DECLARE_PITCH(0x6B, NOTE_B7)
-    DECLARE_PITCH(0x6A, NOTE_BB7)
-    DECLARE_PITCH(0x69, NOTE_A7)
-    DECLARE_PITCH(0x68, NOTE_AB7)
-    DECLARE_PITCH(0x67, NOTE_G7)
-    DECLARE_PITCH(0x66, NOTE_GB7)
-    DECLARE_PITCH(0x65, NOTE_F7)
-    DECLARE_PITCH(0x64, NOTE_E7)
-    DECLARE_PITCH(0x63, NOTE_EB7)
-    DECLARE_PITCH(0x62, NOTE_D7)
-    DECLARE_PITCH(0x61, NOTE_DB7)
-    DECLARE_PITCH(0x60, NOTE_C7)
-    DECLARE_PITCH(0x5F, NOTE_B6)
-    DECLARE_PITCH(0x5E, NOTE_BB6)
-    DECLARE_PITCH(0x5D, NOTE_A6)
-    DECLARE_PITCH(0x5C, NOTE_AB6)
-    DECLARE_PITCH(0x5B, NOTE_G6)
-    DECLARE_PITCH(0x5A, NOTE_GB6)
-    DECLARE_PITCH(0x59, NOTE_F6)
-    DECLARE_PITCH(0x58, NOTE_E6)
-    DECLARE_PITCH(0x57, NOTE_EB6)
-    DECLARE_PITCH(0x56, NOTE_D6)
-    DECLARE_PITCH(0x55, NOTE_DB6)
-    DECLARE_PITCH(0x54, NOTE_C6)
-    DECLARE_PITCH(0x53, NOTE_B5)
-    DECLARE_PITCH(0x52, NOTE_BB5)
-    DECLARE_PITCH(0x51, NOTE_A5)
-    DECLARE_PITCH(0x50, NOTE_AB5)
-    DECLARE_PITCH(0x4F, NOTE_G5)
-    DECLARE_PITCH(0x4E, NOTE_GB5)
-    DECLARE_PITCH(0x4D, NOTE_F5)
-    DECLARE_PITCH(0x4C, NOTE_E5)
-    DECLARE_PITCH(0x4B, NOTE_EB5)
-    DECLARE_PITCH(0x4A, NOTE_D5)
-    DECLARE_PITCH(0x49, NOTE_DB5)
-    DECLARE_PITCH(0x48, NOTE_C5)
-    DECLARE_PITCH(0x47, NOTE_B4)
-    DECLARE_PITCH(0x46, NOTE_BB4)
-    DECLARE_PITCH(0x45, NOTE_A4)
-    DECLARE_PITCH(0x44, NOTE_AB4)
-    DECLARE_PITCH(0x43, NOTE_G4)
-    DECLARE_PITCH(0x42, NOTE_GB4)
-    DECLARE_PITCH(0x41, NOTE_F4)
-    DECLARE_PITCH(0x40, NOTE_E4)
-    DECLARE_PITCH(0x3F, NOTE_EB4)
-    DECLARE_PITCH(0x3E, NOTE_D4)
-    DECLARE_PITCH(0x3D, NOTE_DB4)
-    DECLARE_PITCH(0x3C, NOTE_C4)
-    DECLARE_PITCH(0x3B, NOTE_B3)
-    DECLARE_PITCH(0x3A, NOTE_BB3)
-    DECLARE_PITCH(0x39, NOTE_A3)
-    DECLARE_PITCH(0x38, NOTE_AB3)
-    DECLARE_PITCH(0x37, NOTE_G3)
-    DECLARE_PITCH(0x36, NOTE_GB3)
-    DECLARE_PITCH(0x35, NOTE_F3)
-    DECLARE_PITCH(0x34, NOTE_E3)
-    DECLARE_PITCH(0x33, NOTE_EB3)
-    DECLARE_PITCH(0x32, NOTE_D3)
-    DECLARE_PITCH(0x31, NOTE_DB3)
-    DECLARE_PITCH(0x30, NOTE_C3)
-    DECLARE_PITCH(0x2F, NOTE_B2)
-    DECLARE_PITCH(0x2E, NOTE_BB2)
-    DECLARE_PITCH(0x2D, NOTE_A2)
-    DECLARE_PITCH(0x2C, NOTE_AB2)
-    DECLARE_PITCH(0x2B, NOTE_G2)
-    DECLARE_PITCH(0x2A, NOTE_GB2)
-    DECLARE_PITCH(0x29, NOTE_F2)
-    DECLARE_PITCH(0x28, NOTE_E2)
-    DECLARE_PITCH(0x27, NOTE_EB2)
-    DECLARE_PITCH(0x26, NOTE_D2)
-    DECLARE_PITCH(0x25, NOTE_DB2)
-    DECLARE_PITCH(0x24, NOTE_C2)
-    DECLARE_PITCH(0x23, NOTE_B1)
-    DECLARE_PITCH(0x22, NOTE_BB1)
-    DECLARE_PITCH(0x21, NOTE_A1)
-    DECLARE_PITCH(0x20, NOTE_AB1)
-    DECLARE_PITCH(0x1F, NOTE_G1)
-    DECLARE_PITCH(0x1E, NOTE_GB1)
-    DECLARE_PITCH(0x1D, NOTE_F1)
-    DECLARE_PITCH(0x1C, NOTE_E1)
-    DECLARE_PITCH(0x1B, NOTE_EB1)
-    DECLARE_PITCH(0x1A, NOTE_D1)
-    DECLARE_PITCH(0x19, NOTE_DB1)
-    DECLARE_PITCH(0x18, NOTE_C1)
-    DECLARE_PITCH(0x17, NOTE_B0)
-    DECLARE_PITCH(0x16, NOTE_BB0)
-    DECLARE_PITCH(0x15, NOTE_A0)
-    DECLARE_PITCH(0x14, NOTE_AB0)
-    DECLARE_PITCH(0x13, NOTE_G0)
-    DECLARE_PITCH(0x12, NOTE_GB0)
-    DECLARE_PITCH(0x11, NOTE_F0)
-    DECLARE_PITCH(0x10, NOTE_E0)
-    DECLARE_PITCH(0x0F, NOTE_EB0)
-    DECLARE_PITCH(0x0E, NOTE_D0)
-    DECLARE_PITCH(0x0D, NOTE_DB0)
-    DECLARE_PITCH(0x0C, NOTE_C0)
-    //DECLARE_PITCH(0x0B, NOTE_B)
-    //DECLARE_PITCH(0x0A, NOTE_BB)
-    //DECLARE_PITCH(0x09, NOTE_A)
-    //DECLARE_PITCH(0x08, NOTE_AB)
-    //DECLARE_PITCH(0x07, NOTE_G)
-    //DECLARE_PITCH(0x06, NOTE_GB)
-    //DECLARE_PITCH(0x05, NOTE_F)
-    //DECLARE_PITCH(0x04, NOTE_E)
-    //DECLARE_PITCH(0x03, NOTE_EB)
-    //DECLARE_PITCH(0x02, NOTE_D)
-    //DECLARE_PITCH(0x01, NOTE_DB)
-    //DECLARE_PITCH(0x00, NOTE_C)
-  };
-#undef DECLARE_PITCH
-  static const int16_t numPairs = sizeof(pairs)/sizeof(pairs[0]);
-
-  //search for a perfect match
-  for(int16_t i=0; i<numPairs; i++)
-  {
-    if (frequency == pairs[i].frequency)
-      return pairs[i].pitch;
+    pitch--;
+    diff = getFrequencyDiff(frequency, gPitchFrequencies[pitch]);
   }
-
-  //not found. look for the closer one
-  EVENT_PITCH closerPitch = 0x0C;
-  int16_t minDiff = 0x7FFF;
-  for(int16_t i=0; i<numPairs; i++)
+  while(pitch < MAX_PITCH && getFrequencyDiff(frequency, gPitchFrequencies[pitch+1]) < diff)
   {
-    //calculate frequency diff
-    int16_t diff = abs(frequency - pairs[i].frequency);
-    if (diff <= minDiff)
-    {
-      //closer match found
-      closerPitch = pairs[i].pitch;
-      minDiff = diff;
-    }
+    pitch++;
+    diff = getFrequencyDiff(frequency, gPitchFrequencies[pitch]);
   }
-  return closerPitch;
+
+  return (EVENT_PITCH)pitch;
 }
 
-template <typename T>
-void swap_endian(T& u)
+uint16_t getFrequencyFromMidiPitch(EVENT_PITCH iPitch)
 {
-  if (sizeof(u) == 1)
-    return;
-
-  union
-  {
-    T u;
-    unsigned char u8[sizeof(T)];
-  } source, dest;
-
-  source.u = u;
-
-  for (size_t k = 0; k < sizeof(T); k++)
-    dest.u8[k] = source.u8[sizeof(T) - k - 1];
-
-  u = dest.u;
+  if (iPitch < MIN_PITCH)
+    return 0;
+  return gPitchFrequencies[iPitch];
 }
 
 MidiFile::MidiFile()
@@ -312,16 +120,100 @@ MidiFile::MidiFile()
   mInstrument = DEFAULT_INSTRUMENT;
   mTrackEndingPreference = STOP_PREVIOUS_NOTE;
   mType = MIDI_TYPE_0;
+  mTimedNotesSorted = true;
+  mTimedNotesHash = HASH_SEED;
+  mCompactEncoding = false;
+  mEncodingCache = NULL;
+  mAppendState.settingsHash = 0;
+  mAppendState.numNotes = 0;
+  mAppendState.timeUs = 0;
+  mAppendState.ticks = 0;
+  mAppendState.tailOffset = 0;
+  mAppendState.fileSize = 0;
 }
 
 void MidiFile::addNote(uint16_t iFrequency, uint16_t iDurationMs)
 {
-  NOTE n;
-  n.frequency = iFrequency;
-  n.durationMs = iDurationMs;
-  n.volume = mVolume;
+  addNoteUs(iFrequency, 1000*(uint32_t)iDurationMs);
+}
 
-  mNotes.push_back(n);
+void MidiFile::addNoteUs(uint16_t iFrequency, uint32_t iDurationUs)
+{
+  int8_t pitch = (iFrequency ? findMidiPitchFromFrequency(iFrequency) : 0);
+  mNotes.push_back(iFrequency, iDurationUs, mVolume, pitch);
+  mNotes.updateHash(mNotes.size() - 1);
+}
+
+void MidiFile::addNotes(const uint16_t * iFrequencies, const uint16_t * iDurationsMs, size_t iCount)
+{
+  if (iCount == 0)
+    return;
+
+  size_t offset = mNotes.size();
+  mNotes.frequencies.insert(mNotes.frequencies.end(), iFrequencies, iFrequencies + iCount);
+  mNotes.durations.resize(offset + iCount);
+  mNotes.volumes.resize(offset + iCount, mVolume);
+  mNotes.pitches.resize(offset + iCount);
+
+  uint32_t * durations = &mNotes.durations[offset];
+  for(size_t i=0; i<iCount; i++)
+    durations[i] = 1000*(uint32_t)iDurationsMs[i];
+
+  //melodies often repeat the same frequency
+  int8_t * pitches = &mNotes.pitches[offset];
+  uint16_t previousFrequency = 0;
+  int8_t previousPitch = 0;
+  for(size_t i=0; i<iCount; i++)
+  {
+    uint16_t frequency = iFrequencies[i];
+    if (frequency != previousFrequency)
+    {
+      previousFrequency = frequency;
+      previousPitch = (frequency ? findMidiPitchFromFrequency(frequency) : 0);
+    }
+    pitches[i] = previousPitch;
+  }
+
+  mNotes.updateHash(offset);
+}
+
+void MidiFile::reserve(size_t iCount)
+{
+  mNotes.reserve(iCount);
+}
+
+MidiFile::NoteList::NoteList() :
+  hash(HASH_SEED)
+{
+}
+
+void MidiFile::NoteList::reserve(size_t iSize)
+{
+  frequencies.reserve(iSize);
+  durations.reserve(iSize);
+  volumes.reserve(iSize);
+  pitches.reserve(iSize);
+}
+
+void MidiFile::NoteList::clear()
+{
+  frequencies.clear();
+  durations.clear();
+  volumes.clear();
+  pitches.clear();
+  hash = HASH_SEED;
+}
+
+void MidiFile::NoteList::updateHash(size_t iFirst)
+{
+  //the pitches are resolved from the frequencies
+  uint64_t h = hash;
+  for(size_t i=iFirst; i<frequencies.size(); i++)
+  {
+    uint64_t value = (uint64_t)frequencies[i] | ((uint64_t)(uint8_t)volumes[i] << 16) | ((uint64_t)durations[i] << 24);
+    h = hashCombine(h, value);
+  }
+  hash = h;
 }
 
 void MidiFile::addDelay(uint16_t iDurationMs)
@@ -329,19 +221,102 @@ void MidiFile::addDelay(uint16_t iDurationMs)
   addNote(0, iDurationMs);
 }
 
+void MidiFile::addDelayUs(uint32_t iDurationUs)
+{
+  addNoteUs(0, iDurationUs);
+}
+
+bool MidiFile::addNoteAt(uint32_t iStartTicks, uint32_t iDurationTicks, int8_t iPitch, int8_t iVelocity, uint8_t iChannel)
+{
+  if (iPitch < 0 || iVelocity < 0 || iChannel > 0x0F)
+    return false;
+
+  TIMED_NOTE n;
+  n.startTicks = iStartTicks;
+  n.durationTicks = iDurationTicks;
+  n.pitch = iPitch;
+  n.velocity = iVelocity;
+  n.channel = iChannel;
+
+  if (!mTimedNotes.empty() && iStartTicks < mTimedNotes.back().startTicks)
+    mTimedNotesSorted = false;
+  mTimedNotes.push_back(n);
+  mTimedNotesHash = hashCombine(mTimedNotesHash, (uint64_t)iStartTicks | ((uint64_t)iDurationTicks << 32));
+  mTimedNotesHash = hashCombine(mTimedNotesHash, (uint64_t)(uint8_t)iPitch | ((uint64_t)(uint8_t)iVelocity << 8) | ((uint64_t)iChannel << 16));
+
+  return true;
+}
+
+bool MidiFile::addTempoChange(uint32_t iTimeMs, uint32_t iTempo)
+{
+  if (iTempo == 0 || iTempo > 0xFFFFFF)
+    return false;
+
+  if (iTimeMs == 0)
+  {
+    setTempo(iTempo);
+    return true;
+  }
+
+  TEMPO_CHANGE c;
+  c.timeUs = 1000*(uint64_t)iTimeMs;
+  c.ticks = 0;
+  c.tempo = iTempo;
+
+  //tempo changes are usually added in order
+  TempoChangeList::iterator it = mTempoChanges.end();
+  if (!mTempoChanges.empty() && c.timeUs <= mTempoChanges.back().timeUs)
+  {
+    it = std::lower_bound(mTempoChanges.begin(), mTempoChanges.end(), c, [](const TEMPO_CHANGE & a, const TEMPO_CHANGE & b)
+    {
+      return a.timeUs < b.timeUs;
+    });
+  }
+
+  if (it != mTempoChanges.end() && it->timeUs == c.timeUs)
+    it->tempo = iTempo;
+  else
+    it = mTempoChanges.insert(it, c);
+
+  updateTempoChanges((size_t)(it - mTempoChanges.begin()));
+  return true;
+}
+
+void MidiFile::updateTempoChanges(size_t iFirst)
+{
+  for(size_t i=iFirst; i<mTempoChanges.size(); i++)
+  {
+    uint64_t previousTimeUs = (i ? mTempoChanges[i-1].timeUs : 0);
+    uint64_t previousTicks = (i ? mTempoChanges[i-1].ticks : 0);
+    uint32_t previousTempo = (i ? mTempoChanges[i-1].tempo : mTempo);
+    mTempoChanges[i].ticks = previousTicks + time2ticks(mTempoChanges[i].timeUs - previousTimeUs, mTicksPerQuarterNote, previousTempo);
+  }
+}
+
+void MidiFile::initTempoMap(TempoMap & oTempoMap) const
+{
+  for(size_t i=0; i<mTempoChanges.size(); i++)
+  {
+    const TEMPO_CHANGE & c = mTempoChanges[i];
+    oTempoMap.add(c.timeUs, c.ticks, c.tempo);
+  }
+}
+
 void MidiFile::setTicksPerQuarterNote(uint16_t iTicks)
 {
   mTicksPerQuarterNote = iTicks;
+  updateTempoChanges(0);
 }
 
 void MidiFile::setBeatsPerMinute(uint16_t iBpm)
 {
-  mTempo = bpm2tempo(iBpm);
+  setTempo(bpm2tempo(iBpm));
 }
 
 void MidiFile::setTempo(uint32_t iTempo)
 {
   mTempo = iTempo;
+  updateTempoChanges(0);
 }
 
 void MidiFile::setName(const char * iName)
@@ -375,58 +350,118 @@ void MidiFile::setTrackEndingPreference(TRACK_ENDING_PREFERENCE iTrackEndingPref
   mTrackEndingPreference = iTrackEndingPreference;
 }
 
+void MidiFile::setCompactEncoding(bool iCompact)
+{
+  mCompactEncoding = iCompact;
+}
+
 void MidiFile::setMidiType(MIDI_TYPE iType)
 {
   mType = iType;
 }
 
-size_t fswapwrite(const MIDI_HEADER & iHeader, FILE * f)
+MidiFile::MIDI_TYPE MidiFile::getMidiType() const
+{
+  return mType;
+}
+
+const char * MidiFile::getName() const
+{
+  return mName.c_str();
+}
+
+int8_t MidiFile::getVolume() const
+{
+  return mVolume;
+}
+
+int8_t MidiFile::getInstrument() const
+{
+  return mInstrument;
+}
+
+uint16_t MidiFile::getTicksPerQuarterNote() const
+{
+  return mTicksPerQuarterNote;
+}
+
+uint32_t MidiFile::getTempo() const
+{
+  return mTempo;
+}
+
+MidiFile::TRACK_ENDING_PREFERENCE MidiFile::getTrackEndingPreference() const
+{
+  return mTrackEndingPreference;
+}
+
+bool MidiFile::isCompactEncoding() const
+{
+  return mCompactEncoding;
+}
+
+size_t MidiFile::getTimedNoteCount() const
 {
-  MIDI_HEADER tmp = iHeader;
-  swap_endian(tmp.id);
-  swap_endian(tmp.length);
-  swap_endian(tmp.type);
-  swap_endian(tmp.numTracks);
-  swap_endian(tmp.ticksPerQuarterNote);
-  return fwrite(&tmp, 1, sizeof(tmp), f);
+  return mTimedNotes.size();
 }
-size_t fswapwrite(const TRACK_HEADER & iHeader, FILE * f)
+
+size_t MidiFile::getTempoChangeCount() const
 {
-  TRACK_HEADER tmp = iHeader;
-  swap_endian(tmp.id);
-  swap_endian(tmp.length);
-  return fwrite(&tmp, 1, sizeof(tmp), f);
+  return mTempoChanges.size();
 }
-size_t fwriteevent(const NOTE_EVENT & e, bool isRunningStatus, FILE * f)
+
+uint64_t MidiFile::time2ticks(uint64_t iTimeUs) const
 {
-  size_t writeSize = 0;
+  //find the last tempo change before the given time
+  TempoChangeList::const_iterator it = std::upper_bound(mTempoChanges.begin(), mTempoChanges.end(), iTimeUs, [](uint64_t t, const TEMPO_CHANGE & c)
+  {
+    return t < c.timeUs;
+  });
+  if (it == mTempoChanges.begin())
+    return time2ticks(iTimeUs, mTicksPerQuarterNote, mTempo);
+  --it;
+  return it->ticks + time2ticks(iTimeUs - it->timeUs, mTicksPerQuarterNote, it->tempo);
+}
 
-  writeSize += fwriteVariableLength(e.ticks, 1, f);
-  if (!isRunningStatus)
+uint64_t MidiFile::ticks2time(uint64_t iTicks) const
+{
+  //find the last tempo change before the given ticks
+  TempoChangeList::const_iterator it = std::upper_bound(mTempoChanges.begin(), mTempoChanges.end(), iTicks, [](uint64_t t, const TEMPO_CHANGE & c)
   {
-    writeSize += fwrite(&e.status, 1, sizeof(e.status), f);
-  }
-  writeSize += fwrite(&e.pitch, 1, sizeof(e.pitch), f);
-  writeSize += fwrite(&e.volume, 1, sizeof(e.volume), f);
+    return t < c.ticks;
+  });
+  if (it == mTempoChanges.begin())
+    return ticks2time(iTicks, mTicksPerQuarterNote, mTempo);
+  --it;
+  return it->timeUs + ticks2time(iTicks - it->ticks, mTicksPerQuarterNote, it->tempo);
+}
 
-  return writeSize;
+size_t MidiFile::getNoteCount() const
+{
+  return mNotes.size();
 }
-size_t fswapwrite(const META_EVENT & e, FILE * f)
+
+uint16_t MidiFile::getNoteFrequency(size_t iIndex) const
 {
-  size_t writeSize = 0;
+  return mNotes.frequencies[iIndex];
+}
 
-  writeSize += fwriteVariableLength(e.ticks, 1, f);
-  writeSize += fwrite(&e.status, 1, sizeof(e.status), f);
-  writeSize += fwrite(&e.type, 1, sizeof(e.type), f);
-  writeSize += fwriteVariableLength(e.size, 1, f);
+uint16_t MidiFile::getNoteDuration(size_t iIndex) const
+{
+  uint32_t durationMs = (mNotes.durations[iIndex] + 500)/1000;
+  if (durationMs > 0xFFFF)
+    return 0xFFFF;
+  return (uint16_t)durationMs;
+}
 
-  return writeSize;
+uint32_t MidiFile::getNoteDurationUs(size_t iIndex) const
+{
+  return mNotes.durations[iIndex];
 }
-size_t fswapwrite(const HEADER_ID & id, FILE * f)
+
+int8_t MidiFile::getNoteVolume(size_t iIndex) const
 {
-  HEADER_ID tmp = id;
-  swap_endian(tmp);
-  return fwrite(&tmp, 1, sizeof(tmp), f);
+  return mNotes.volumes[iIndex];
 }
 
 uint32_t MidiFile::bpm2tempo(uint16_t iBpm)
@@ -442,31 +477,330 @@ uint16_t MidiFile::tempo2bpm(uint32_t iTempo)
   return bpm;
 }
 
-uint16_t MidiFile::duration2ticks(uint16_t iDurationMs, uint16_t iTicksPerQuarterNote, uint32_t iTempo)
+uint32_t MidiFile::duration2ticks(uint32_t iDurationMs, uint16_t iTicksPerQuarterNote, uint32_t iTempo)
 {
-  uint32_t noteticks = (1000*iDurationMs*iTicksPerQuarterNote)/iTempo;
-  return (uint16_t)noteticks;
+  uint64_t noteticks = time2ticks(1000*(uint64_t)iDurationMs, iTicksPerQuarterNote, iTempo);
+  if (noteticks > 0xFFFFFFFF)
+    return 0xFFFFFFFF;
+  return (uint32_t)noteticks;
 }
 
-uint16_t MidiFile::ticks2duration(uint16_t iTicks, uint16_t iTicksPerQuarterNote, uint32_t iTempo)
+uint32_t MidiFile::ticks2duration(uint32_t iTicks, uint16_t iTicksPerQuarterNote, uint32_t iTempo)
 {
   //formula: noteticks/mTicksPerQuarterNote*tempo/1000=notedurationMs
-  uint32_t durationMs = (iTicks*iTempo)/(1000*iTicks);
-  return (uint16_t)durationMs;
+  uint64_t durationMs = ticks2time(iTicks, iTicksPerQuarterNote, iTempo)/1000;
+  if (durationMs > 0xFFFFFFFF)
+    return 0xFFFFFFFF;
+  return (uint32_t)durationMs;
 }
 
-uint16_t MidiFile::duration2ticks(uint16_t iDurationMs)
+uint64_t MidiFile::time2ticks(uint64_t iTimeUs, uint16_t iTicksPerQuarterNote, uint32_t iTempo)
 {
-  return duration2ticks(iDurationMs, mTicksPerQuarterNote, mTempo);
+  if (iTempo == 0)
+    return 0;
+  return (iTimeUs*iTicksPerQuarterNote)/iTempo;
 }
 
-uint16_t MidiFile::ticks2duration(uint16_t iTicks)
+uint64_t MidiFile::ticks2time(uint64_t iTicks, uint16_t iTicksPerQuarterNote, uint32_t iTempo)
 {
-  return ticks2duration(iTicks, mTicksPerQuarterNote, mTempo);
+  if (iTicksPerQuarterNote == 0)
+    return 0;
+  return (iTicks*iTempo)/iTicksPerQuarterNote;
 }
 
-bool MidiFile::save(const char * iFile)
+//a note off event waiting to be written
+struct PENDING_NOTE_OFF
+{
+  uint64_t ticks; //absolute time of the event
+  uint32_t order; //notes ending at the same time are released in start order
+  uint8_t channel;
+  int8_t pitch;
+};
+struct PendingNoteOffGreater
+{
+  inline bool operator()(const PENDING_NOTE_OFF & a, const PENDING_NOTE_OFF & b) const
+  {
+    if (a.ticks != b.ticks)
+      return a.ticks > b.ticks;
+    return a.order > b.order;
+  }
+};
+typedef std::priority_queue<PENDING_NOTE_OFF, std::vector<PENDING_NOTE_OFF>, PendingNoteOffGreater> PendingNoteOffQueue;
+
+template <typename WRITER>
+void MidiFile::encodeTimedNotes(WRITER & w, TrackEncoder & ioEncoder, const TempoMap & iTempoMap, bool iTempoSetting, uint8_t iChannel, const MidiTransform & iTransform) const
 {
+  //the timed notes are only sorted if they were not added in order
+  std::vector<uint32_t> order;
+  if (!mTimedNotesSorted)
+  {
+    order.resize(mTimedNotes.size());
+    for(size_t i=0; i<order.size(); i++)
+      order[i] = (uint32_t)i;
+    const TimedNoteList & notes = mTimedNotes;
+    std::stable_sort(order.begin(), order.end(), [&notes](uint32_t a, uint32_t b)
+    {
+      return notes[a].startTicks < notes[b].startTicks;
+    });
+  }
+
+  //merge the note on events of the melody and of the timed notes which are both ordered by start time.
+  //note off events are ordered by a min-heap which only holds the playing notes.
+  PendingNoteOffQueue offs;
+  uint64_t now = 0;
+  uint32_t numNotes = 0;
+  uint64_t lastOff = 0; //end time of the last note
+  uint32_t currentTempo = iTempoMap[0].tempo;
+  uint16_t channels = 0; //bit mask of the channels in use
+  size_t melody = 0;
+  uint64_t melodyTimeUs = 0;
+  uint64_t melodyTicks = 0; //start time of the next note of the melody
+  size_t timed = 0;
+  size_t tempo = (iTempoSetting ? 1 : iTempoMap.size()); //the initial tempo is written with the settings
+
+  //writes the note off and tempo events up to a given time
+  auto writePendingEvents = [&](uint64_t iTicks)
+  {
+    for(;;)
+    {
+      bool hasOff = (!offs.empty() && offs.top().ticks <= iTicks);
+      bool hasTempo = (tempo < iTempoMap.size() && iTempoMap[tempo].ticks <= iTicks);
+      if (hasOff && (!hasTempo || offs.top().ticks <= iTempoMap[tempo].ticks))
+      {
+        const PENDING_NOTE_OFF & o = offs.top();
+        ioEncoder.writeChannelEvent(w, o.ticks - now, NOTE_OFF_CHANNEL_0 | o.channel, o.pitch, mVolume);
+        now = o.ticks;
+        offs.pop();
+      }
+      else if (hasTempo)
+      {
+        //the compact encoding drops the changes to the same tempo
+        if (!ioEncoder.isCompact() || iTempoMap[tempo].tempo != currentTempo)
+        {
+          uint64_t ticks = iTempoMap[tempo].ticks;
+          ioEncoder.writeTempo(w, ticks - now, iTransform.transformTempo(iTempoMap[tempo].tempo));
+          now = ticks;
+          currentTempo = iTempoMap[tempo].tempo;
+        }
+        tempo++;
+      }
+      else
+        break;
+    }
+  };
+
+  for(;;)
+  {
+    //skip silenced delays
+    while(melody < mNotes.size() && mNotes.frequencies[melody] == 0)
+    {
+      melodyTimeUs += mNotes.durations[melody];
+      melodyTicks = iTempoMap.toTicks(melodyTimeUs);
+      melody++;
+    }
+
+    bool hasMelodyNote = (melody < mNotes.size());
+    bool hasTimedNote = (timed < mTimedNotes.size());
+    if (!hasMelodyNote && !hasTimedNote)
+      break;
+
+    const TIMED_NOTE * t = NULL;
+    if (hasTimedNote)
+      t = &mTimedNotes[order.empty() ? timed : order[timed]];
+
+    PENDING_NOTE_OFF off;
+    EVENT_VOLUME velocity = 0;
+    uint64_t start = 0;
+    if (hasMelodyNote && (t == NULL || melodyTicks <= t->startTicks))
+    {
+      start = melodyTicks;
+      melodyTimeUs += mNotes.durations[melody];
+      melodyTicks = iTempoMap.toTicks(melodyTimeUs);
+      off.ticks = melodyTicks;
+      off.channel = iChannel;
+      off.pitch = iTransform.transformPitch(mNotes.pitches[melody]);
+      velocity = iTransform.transformVelocity(mNotes.volumes[melody]);
+      melody++;
+    }
+    else
+    {
+      start = t->startTicks;
+      off.ticks = (uint64_t)t->startTicks + t->durationTicks;
+      off.channel = iTransform.transformChannel(t->channel);
+      off.pitch = iTransform.transformPitch(t->pitch);
+      velocity = iTransform.transformVelocity(t->velocity);
+      timed++;
+    }
+    off.order = numNotes++;
+
+    //stop the notes ending before this one starts
+    writePendingEvents(start);
+
+    ioEncoder.writeChannelEvent(w, start - now, NOTE_ON_CHANNEL_0 | off.channel, off.pitch, velocity);
+    now = start;
+    offs.push(off);
+    channels |= (1 << off.channel);
+    if (off.ticks > lastOff)
+      lastOff = off.ticks;
+  }
+
+  //stop the remaining notes
+  writePendingEvents(lastOff);
+
+  if ((mTrackEndingPreference & STOP_ALL_NOTES) == STOP_ALL_NOTES)
+  {
+    //silence all notes of all used channels
+    for(uint8_t c=0; c<16; c++)
+    {
+      if (channels & (1 << c))
+        ioEncoder.writeChannelEvent(w, 0, CONTROL_CHANGE_CHANNEL_0 | c, ALL_NOTES_OFF, MIN_VOLUME);
+    }
+  }
+
+  //the melody may end with a delay. Tempo changes after the end of the track are ignored.
+  writePendingEvents(melodyTicks);
+  if (melodyTicks > now)
+    ioEncoder.writeDelay(w, melodyTicks - now);
+}
+
+template <typename WRITER>
+void MidiFile::encodeTrack(WRITER & w, const TempoMap & iTempoMap, bool iTempoSetting, uint8_t iChannel, bool iCompact, const MidiTransform & iTransform) const
+{
+  uint8_t channel = iTransform.transformChannel(iChannel);
+  TrackEncoder encoder(mTrackEndingPreference, channel, iCompact);
+  encoder.writeSettings(w, mName, (iTempoSetting ? iTransform.transformTempo(iTempoMap[0].tempo) : DEFAULT_TEMPO), mInstrument);
+
+  if (!mTimedNotes.empty() || (iTempoSetting && iTempoMap.size() > 1))
+  {
+    encodeTimedNotes(w, encoder, iTempoMap, iTempoSetting, channel, iTransform);
+    encoder.writeEndOfTrack(w);
+    return;
+  }
+
+  const uint16_t * frequencies = mNotes.frequencies.data();
+  const uint32_t * durations = mNotes.durations.data();
+  const int8_t * volumes = mNotes.volumes.data();
+  const int8_t * pitches = mNotes.pitches.data();
+
+  //transformed notes are processed by blocks to use the vectorized kernels of the transform
+  static const size_t BLOCK_SIZE = 256;
+  int8_t transformedVolumes[BLOCK_SIZE];
+  int8_t transformedPitches[BLOCK_SIZE];
+  bool identity = iTransform.isIdentity();
+
+  //notes are placed at their absolute time to prevent rounding errors from accumulating
+  uint64_t timeUs = 0;
+  uint64_t previousTicks = 0;
+  for(size_t first=0; first<mNotes.size(); first+=BLOCK_SIZE)
+  {
+    size_t count = std::min(BLOCK_SIZE, mNotes.size() - first);
+    const int8_t * blockVolumes = &volumes[first];
+    const int8_t * blockPitches = &pitches[first];
+    if (!identity)
+    {
+      iTransform.transformVelocities(blockVolumes, transformedVolumes, count);
+      iTransform.transformPitches(blockPitches, transformedPitches, count);
+      blockVolumes = transformedVolumes;
+      blockPitches = transformedPitches;
+    }
+
+    for(size_t i=0; i<count; i++)
+    {
+      timeUs += durations[first+i];
+      uint64_t absoluteTicks = iTempoMap.toTicks(timeUs);
+      uint64_t ticks = absoluteTicks - previousTicks;
+      previousTicks = absoluteTicks;
+
+      if (frequencies[first+i])
+        encoder.writeNote(w, blockPitches[i], blockVolumes[i], mVolume, ticks);
+      else
+        encoder.writeDelay(w, ticks); //silenced delay
+    }
+  }
+
+  //add track footer
+  encoder.writeEndOfTrack(w);
+}
+
+//writers used by the encoders of the library
+template void MidiFile::encodeTrack<BufferWriter>(BufferWriter & w, const TempoMap & iTempoMap, bool iTempoSetting, uint8_t iChannel, bool iCompact, const MidiTransform & iTransform) const;
+template void MidiFile::encodeTrack<SizeCounter>(SizeCounter & w, const TempoMap & iTempoMap, bool iTempoSetting, uint8_t iChannel, bool iCompact, const MidiTransform & iTransform) const;
+
+size_t MidiFile::computeEncodedSize() const
+{
+  return computeEncodedSize(MidiTransform());
+}
+
+size_t MidiFile::computeEncodedSize(const MidiTransform & iTransform) const
+{
+  TempoMap tempoMap(mTicksPerQuarterNote, mTempo);
+  initTempoMap(tempoMap);
+
+  SizeCounter c;
+  encodeTrack(c, tempoMap, true, 0, mCompactEncoding, iTransform);
+  return sizeof(MIDI_HEADER) + sizeof(TRACK_HEADER) + c.size();
+}
+
+size_t MidiFile::computeCompactEncodingSavings() const
+{
+  TempoMap tempoMap(mTicksPerQuarterNote, mTempo);
+  initTempoMap(tempoMap);
+
+  MidiTransform identity;
+  SizeCounter normal;
+  encodeTrack(normal, tempoMap, true, 0, false, identity);
+  SizeCounter compact;
+  encodeTrack(compact, tempoMap, true, 0, true, identity);
+  return normal.size() - compact.size();
+}
+
+uint64_t MidiFile::getContentHash() const
+{
+  uint64_t h = getSettingsHash();
+  h = hashCombine(h, mNotes.hash);
+  h = hashCombine(h, mNotes.size());
+  return h;
+}
+
+uint64_t MidiFile::getSettingsHash() const
+{
+  uint64_t h = HASH_SEED;
+  h = hashCombine(h, mTimedNotesHash);
+  h = hashCombine(h, mTimedNotes.size());
+  h = hashCombine(h, mTempoChanges.size());
+  for(size_t i=0; i<mTempoChanges.size(); i++)
+  {
+    h = hashCombine(h, mTempoChanges[i].timeUs);
+    h = hashCombine(h, mTempoChanges[i].tempo);
+  }
+  h = hashCombine(h, mTicksPerQuarterNote);
+  h = hashCombine(h, mTempo);
+  h = hashCombine(h, (uint8_t)mVolume);
+  h = hashCombine(h, (uint8_t)mInstrument);
+  h = hashCombine(h, mTrackEndingPreference);
+  h = hashCombine(h, mType);
+  h = hashCombine(h, mCompactEncoding);
+  h = hashBytes(h, mName.data(), mName.size());
+  return h;
+}
+
+void MidiFile::setEncodingCache(MidiEncodingCache * iCache)
+{
+  mEncodingCache = iCache;
+}
+
+MidiEncodingCache * MidiFile::getEncodingCache() const
+{
+  return mEncodingCache;
+}
+
+size_t MidiFile::encode(uint8_t * iBuffer, size_t iBufferSize, size_t iSize, const MidiTransform & iTransform) const
+{
+  if (iSize > iBufferSize)
+    return iSize; //buffer too small, nothing is written
+
+  BufferWriter w(iBuffer, iBufferSize);
+
   MIDI_HEADER header;
   header.id = MIDI_FILE_ID;
   header.length = 6;
@@ -476,151 +810,227 @@ bool MidiFile::save(const char * iFile)
 
   TRACK_HEADER track;
   track.id = MIDI_TRACK_HEADER_ID;
-  track.length = 0; //must be computed as we write data. The value will be written again once all the file is generated.
-
-  FILE * fout = fopen(iFile, "wb");
-  if (!fout)
-    return false;
+  track.length = (uint32_t)(iSize - sizeof(MIDI_HEADER) - sizeof(TRACK_HEADER)); //including data size & track footer
 
   //write midi file header
-  fswapwrite(header, fout);
+  writeHeader(header, w);
 
   //write track header
-  long trackFileOffset = ftell(fout);
-  fswapwrite(track, fout);
+  writeHeader(track, w);
+
+  TempoMap tempoMap(mTicksPerQuarterNote, mTempo);
+  initTempoMap(tempoMap);
+  encodeTrack(w, tempoMap, true, 0, mCompactEncoding, iTransform);
+
+  return w.size();
+}
 
-  if (mName != "")
+bool MidiFile::saveToBuffer(uint8_t * iBuffer, size_t iBufferSize, size_t & oSize) const
+{
+  uint64_t hash = 0;
+  if (mEncodingCache)
   {
-    META_EVENT e;
-    e.ticks = 0;
-    e.status = EVENT_META;
-    e.type = META_SEQUENCE_OR_TRACK_NAME;
-    e.size = mName.size();
-
-    //dump
-    track.length += fswapwrite(e, fout);
-    track.length += fwrite(mName.c_str(), 1, e.size, fout);
+    std::vector<uint8_t> cached;
+    hash = getContentHash();
+    if (mEncodingCache->find(hash, cached))
+    {
+      oSize = cached.size();
+      if (oSize > iBufferSize)
+        return false;
+      memcpy(iBuffer, &cached[0], oSize);
+      return true;
+    }
   }
 
-  //set a TEMPO
-  if (mTempo != DEFAULT_TEMPO)
+  MidiTransform identity;
+  oSize = encode(iBuffer, iBufferSize, computeEncodedSize(identity), identity);
+  if (oSize > iBufferSize)
+    return false;
+
+  if (mEncodingCache)
+    mEncodingCache->insert(hash, iBuffer, oSize);
+  return true;
+}
+
+bool MidiFile::saveToBuffer(std::vector<uint8_t> & oBuffer) const
+{
+  uint64_t hash = 0;
+  if (mEncodingCache)
   {
-    META_EVENT e;
-    e.ticks = 0;
-    e.status = EVENT_META;
-    e.type = META_TEMPO_SETTING;
-    e.size = 3;
-
-    //dump
-    track.length += fswapwrite(e, fout);
-
-    //dump value
-    uint32_t tempo = mTempo;
-    swap_endian(tempo);
-    char* tempoOut = (char*)&tempo;
-    track.length += fwrite(&tempoOut[1], 1, 3, fout);
+    hash = getContentHash();
+    if (mEncodingCache->find(hash, oBuffer))
+      return true;
   }
 
-  //set instrument
-  if (mInstrument != DEFAULT_INSTRUMENT)
+  MidiTransform identity;
+  size_t size = computeEncodedSize(identity);
+  oBuffer.resize(size);
+  encode(&oBuffer[0], oBuffer.size(), size, identity);
+
+  if (mEncodingCache)
+    mEncodingCache->insert(hash, &oBuffer[0], oBuffer.size());
+  return true;
+}
+
+bool MidiFile::saveAppend(const char * iFile)
+{
+  if (iFile == NULL)
+    return false;
+
+  //notes added with addNoteAt() and tempo changes are merged with all notes
+  APPEND_STATE & a = mAppendState;
+  if (!mTimedNotes.empty() || !mTempoChanges.empty())
   {
-    //Next to all TEMPO EVENT is the following 3 bytes which are still unknown
-    unsigned char buffer[] = {0x00, 0xC0, (unsigned char)mInstrument};
-    track.length += fwrite(buffer, 1, sizeof(buffer), fout);
+    a.path.clear();
+    return save(iFile);
   }
 
-  uint16_t previousNoteTicks = 0;
-  EVENT_PITCH previousPitch = 0;
-  EVENT_STATUS previousStatus = 0;
-  for(size_t i=0; i<mNotes.size(); i++)
+  TempoMap tempoMap(mTicksPerQuarterNote, mTempo);
+  TrackEncoder encoder(mTrackEndingPreference, 0, mCompactEncoding);
+  uint64_t settingsHash = getSettingsHash();
+
+  FileSink sink(0); //the new events are written at once
+  uint64_t fileSize = 0;
+  bool append = (a.path == iFile && a.settingsHash == settingsHash && a.numNotes <= mNotes.size() &&
+                 sink.openExisting(iFile) && sink.getFileSize(fileSize) && fileSize == a.fileSize);
+  if (append)
   {
-    const NOTE & n = mNotes[i];
-    
-    if (n.frequency)
+    //the note off of the last note and the delay before the end of track are not final.
+    //the encoder is restored by encoding them again without writing them.
+    SizeCounter discard;
+    size_t last = a.numNotes;
+    uint64_t endUs = a.timeUs;
+    while(last > 0 && mNotes.frequencies[last-1] == 0)
     {
-      //build an event for the note
-      {
-        NOTE_EVENT e;
-        e.ticks = previousNoteTicks;
-        e.status = NOTE_ON_CHANNEL_0;
-        e.pitch = findMidiPitchFromFrequency(n.frequency);
-        e.volume = n.volume;
-
-        //dump
-        bool isRunningStatus = (previousStatus == e.status);
-        track.length += fwriteevent(e, isRunningStatus, fout);
-
-        //remember status
-        previousStatus = e.status;
-        previousPitch = e.pitch;
-        previousNoteTicks = duration2ticks(n.durationMs);
-      }
-
-      //if its the last note
-      bool isLastNote = (i == mNotes.size()-1);
-      if (isLastNote && (mTrackEndingPreference & STOP_ALL_NOTES) == STOP_ALL_NOTES)
-      {
-        //silence all notes
-        NOTE_EVENT e;
-        e.ticks = previousNoteTicks;
-        e.status = CONTROL_CHANGE_CHANNEL_0;
-        e.pitch = ALL_NOTES_OFF;
-        e.volume = MIN_VOLUME;
-
-        //dump
-        bool isRunningStatus = (previousStatus == e.status);
-        track.length += fwriteevent(e, isRunningStatus, fout);
-
-        //remember status
-        previousStatus = e.status;
-        previousPitch = e.pitch;
-        previousNoteTicks = 0; //next note shall begins right after this one
-      }
-      else
-      {
-        //more notes to come
-        //now stop the note
-        NOTE_EVENT e;
-        e.ticks = previousNoteTicks;
-        e.status = NOTE_OFF_CHANNEL_0;
-        e.pitch = findMidiPitchFromFrequency(n.frequency);
-        e.volume = mVolume;
-
-        //dump
-        bool isRunningStatus = (previousStatus == e.status);
-        track.length += fwriteevent(e, isRunningStatus, fout);
-
-        //remember status
-        previousStatus = e.status;
-        previousPitch = e.pitch;
-        previousNoteTicks = 0; //next note shall begins right after this one
-      }
+      endUs -= mNotes.durations[last-1];
+      last--;
     }
-    else
+    if (last > 0)
     {
-      //silenced delay
-      previousNoteTicks = duration2ticks(n.durationMs);
+      uint64_t startTicks = tempoMap.toTicks(endUs - mNotes.durations[last-1]);
+      uint64_t endTicks = tempoMap.toTicks(endUs);
+      encoder.writeNote(discard, mNotes.pitches[last-1], mNotes.volumes[last-1], mVolume, endTicks - startTicks);
+      if (last < a.numNotes)
+        encoder.writeDelay(discard, a.ticks - endTicks);
     }
+    else if (a.numNotes > 0)
+      encoder.writeDelay(discard, a.ticks);
+  }
+  else
+  {
+    a.numNotes = 0;
+    a.timeUs = 0;
+    a.ticks = 0;
+    a.tailOffset = 0;
   }
 
-  //add track footer
+  //encode the new notes. The markers of long delta times never exceed the ticks left to write.
+  size_t numNotes = mNotes.size() - a.numNotes;
+  uint64_t endUs = a.timeUs;
+  for(size_t i=a.numNotes; i<mNotes.size(); i++)
+    endUs += mNotes.durations[i];
+  size_t markersSize = TrackEncoder::getMaxMarkersSize(encoder.getUnwrittenTicks() + tempoMap.toTicks(endUs) - a.ticks);
+  std::vector<uint8_t> buffer((append ? 0 : TRACK_DATA_OFFSET + 64 + mName.size()) + numNotes*TrackEncoder::MAX_NOTE_SIZE + TrackEncoder::MAX_END_OF_TRACK_SIZE + markersSize);
+  BufferWriter w(&buffer[0], buffer.size());
+  if (!append)
+  {
+    MIDI_HEADER header;
+    header.id = MIDI_FILE_ID;
+    header.length = 6;
+    header.type = (HEADER_MIDI_TYPE)mType;
+    header.numTracks = 1;
+    header.ticksPerQuarterNote = mTicksPerQuarterNote;
+    writeHeader(header, w);
+
+    TRACK_HEADER track;
+    track.id = MIDI_TRACK_HEADER_ID;
+    track.length = 0; //written when the track is complete
+    writeHeader(track, w);
+
+    encoder.writeSettings(w, mName, mTempo, mInstrument);
+  }
+
+  uint64_t timeUs = a.timeUs;
+  uint64_t previousTicks = a.ticks;
+  for(size_t i=a.numNotes; i<mNotes.size(); i++)
+  {
+    timeUs += mNotes.durations[i];
+    uint64_t absoluteTicks = tempoMap.toTicks(timeUs);
+    uint64_t ticks = absoluteTicks - previousTicks;
+    previousTicks = absoluteTicks;
+
+    if (mNotes.frequencies[i])
+      encoder.writeNote(w, mNotes.pitches[i], mNotes.volumes[i], mVolume, ticks);
+    else
+      encoder.writeDelay(w, ticks);
+  }
+  size_t tailOffset = w.size();
+  encoder.writeEndOfTrack(w);
+
+  uint64_t size = a.tailOffset + w.size();
+  if (append && size < fileSize)
+  {
+    //the file cannot shrink
+    sink.close();
+    a.path.clear();
+    return saveAppend(iFile);
+  }
+
+  //write the new events and the length of the track
+  uint8_t length[sizeof(uint32_t)];
+  BufferWriter::writeBigEndian32(length, (uint32_t)(size - TRACK_DATA_OFFSET));
+  bool saved = false;
+  if (append)
   {
-    META_EVENT e;
-    e.ticks = previousNoteTicks;
-    e.status = EVENT_META;
-    e.type = META_END_OF_TRACK;
-    e.size = 0;
-
-    //dump
-    track.length += fswapwrite(e, fout);
+    saved = sink.seek(a.tailOffset) &&
+            sink.write(&buffer[0], w.size()) &&
+            sink.seek(TRACK_LENGTH_OFFSET) &&
+            sink.write(length, sizeof(length));
   }
+  else
+  {
+    memcpy(&buffer[TRACK_LENGTH_OFFSET], length, sizeof(length));
+    saved = sink.open(iFile) && sink.write(&buffer[0], w.size());
+  }
+  if (!sink.close())
+    saved = false;
 
-  //write TRACK headers again
-  fseek(fout, trackFileOffset, SEEK_SET);
-  fswapwrite(track, fout);
+  if (!saved)
+  {
+    a.path.clear();
+    return false;
+  }
 
-  fclose(fout);
+  a.path = iFile;
+  a.settingsHash = settingsHash;
+  a.numNotes = mNotes.size();
+  a.timeUs = timeUs;
+  a.ticks = previousTicks;
+  a.tailOffset += tailOffset;
+  a.fileSize = size;
   return true;
 }
 
+bool MidiFile::save(const char * iFile) const
+{
+  FileSink sink(0); //the melody is written at once
+  if (!sink.open(iFile))
+    return false;
+
+  bool saved = save(sink);
+  if (!sink.close())
+    saved = false;
+
+  return saved;
+}
+
+bool MidiFile::save(ByteSink & iSink) const
+{
+  std::vector<uint8_t> buffer;
+  if (!saveToBuffer(buffer))
+    return false;
+
+  return iSink.write(&buffer[0], buffer.size()) && iSink.flush();
+}
+
 }; //namespace libmidi
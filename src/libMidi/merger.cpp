@@ -0,0 +1,421 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+//
+// Description:
+//   Merges multiple melodies or MIDI files into a single Type 0 track.
+//
+
+#include "libmidi/merger.h"
+#include "libmidi/multitrack.h"
+#include "libmidi/sinks.h"
+
+#include "midiformat.h"
+#include "trackencoder.h"
+#include "timeline.h"
+
+#include <algorithm> //for std::push_heap(), std::pop_heap(), std::stable_sort()
+
+namespace libmidi
+{
+
+static const size_t NUM_CHANNELS = 16;
+
+struct MidiMerger::SOURCE
+{
+  struct TRACK
+  {
+    const uint8_t * data;
+    size_t size;
+  };
+  struct TEMPO_EVENT
+  {
+    uint64_t ticks;
+    uint32_t tempo;
+  };
+
+  std::vector<uint8_t> buffer; //the encoded melody. Empty when the buffer belongs to the caller.
+  uint16_t ticksPerQuarterNote;
+  std::vector<TEMPO_EVENT> tempoEvents; //ordered by ticks, one per ticks. The first event is the initial tempo at tick 0.
+  std::vector<TRACK> tracks;
+  uint8_t channels[NUM_CHANNELS]; //channel of the merged track of each channel of the source
+};
+
+//the next event of a track of a source
+struct MERGE_CURSOR
+{
+  MERGE_CURSOR(const uint8_t * iBuffer, size_t iSize, size_t iSource, const TempoMap * iTempoMap) :
+    reader(iBuffer, iSize),
+    source(iSource),
+    tempoMap(iTempoMap),
+    sourceTicks(0),
+    ticks(0)
+  {
+  }
+
+  //reads the next channel event. Returns false at the end of the track.
+  inline bool next(const TickConverter & iOutput)
+  {
+    while(reader.readEvent(event))
+    {
+      sourceTicks += event.ticks;
+      if (event.status < EVENT_SYSEX)
+      {
+        ticks = iOutput.toTicks(tempoMap->toTimeUs(sourceTicks));
+        return true;
+      }
+    }
+    return false;
+  }
+
+  TrackReader reader;
+  size_t source;
+  const TempoMap * tempoMap;
+  uint64_t sourceTicks; //absolute ticks of the event in the source
+  uint64_t ticks; //absolute ticks of the event in the merged track
+  TRACK_EVENT event;
+};
+
+//orders the heap by the earliest event, then by source and track
+struct CURSOR_GREATER
+{
+  CURSOR_GREATER(const std::vector<MERGE_CURSOR> & iCursors) :
+    cursors(iCursors)
+  {
+  }
+
+  inline bool operator()(size_t a, size_t b) const
+  {
+    if (cursors[a].ticks != cursors[b].ticks)
+      return cursors[a].ticks > cursors[b].ticks;
+    return a > b;
+  }
+
+  const std::vector<MERGE_CURSOR> & cursors;
+};
+
+const size_t MidiMerger::INVALID_SOURCE;
+
+MidiMerger::MidiMerger()
+{
+  mTicksPerQuarterNote = MidiFile::DEFAULT_TICKS_PER_QUARTER_NOTE;
+  mTempo = MidiFile::DEFAULT_TEMPO;
+  mCompactEncoding = false;
+}
+
+MidiMerger::~MidiMerger()
+{
+  clear();
+}
+
+void MidiMerger::setName(const char * iName)
+{
+  mName = (iName ? iName : "");
+}
+
+void MidiMerger::setTicksPerQuarterNote(uint16_t iTicks)
+{
+  mTicksPerQuarterNote = iTicks;
+}
+
+void MidiMerger::setTempo(uint32_t iTempo)
+{
+  mTempo = iTempo;
+}
+
+void MidiMerger::setCompactEncoding(bool iCompact)
+{
+  mCompactEncoding = iCompact;
+}
+
+uint16_t MidiMerger::getTicksPerQuarterNote() const
+{
+  return mTicksPerQuarterNote;
+}
+
+uint32_t MidiMerger::getTempo() const
+{
+  return mTempo;
+}
+
+size_t MidiMerger::addSource(const MidiFile & iFile)
+{
+  SOURCE * source = new SOURCE();
+  if (!iFile.saveToBuffer(source->buffer))
+  {
+    delete source;
+    return INVALID_SOURCE;
+  }
+  return addSource(source, &source->buffer[0], source->buffer.size());
+}
+
+size_t MidiMerger::addSource(const uint8_t * iBuffer, size_t iBufferSize)
+{
+  if (iBuffer == NULL)
+    return INVALID_SOURCE;
+  return addSource(new SOURCE(), iBuffer, iBufferSize);
+}
+
+size_t MidiMerger::addSource(SOURCE * iSource, const uint8_t * iBuffer, size_t iBufferSize)
+{
+  SOURCE & s = *iSource;
+
+  //validate the header
+  bool valid = (iBufferSize >= MIDI_HEADER_SIZE && readBigEndian32(&iBuffer[0]) == MIDI_FILE_ID);
+  size_t headerLength = (valid ? readBigEndian32(&iBuffer[4]) : 0);
+  uint16_t type = (valid ? readBigEndian16(&iBuffer[8]) : 0);
+  s.ticksPerQuarterNote = (valid ? readBigEndian16(&iBuffer[12]) : 0);
+  valid = valid && headerLength >= 6 && headerLength <= iBufferSize - CHUNK_HEADER_SIZE;
+  valid = valid && (type == MidiFile::MIDI_TYPE_0 || type == MidiFile::MIDI_TYPE_1);
+  valid = valid && s.ticksPerQuarterNote != 0 && (s.ticksPerQuarterNote & 0x8000) == 0;
+
+  //validate the tracks and find the tempo events
+  size_t offset = CHUNK_HEADER_SIZE + headerLength;
+  while(valid && iBufferSize - offset >= CHUNK_HEADER_SIZE)
+  {
+    HEADER_ID id = readBigEndian32(&iBuffer[offset]);
+    uint32_t length = readBigEndian32(&iBuffer[offset+4]);
+    offset += CHUNK_HEADER_SIZE;
+    if (length > iBufferSize - offset)
+    {
+      valid = false;
+      break;
+    }
+
+    if (id == MIDI_TRACK_HEADER_ID)
+    {
+      SOURCE::TRACK track = {&iBuffer[offset], length};
+      s.tracks.push_back(track);
+
+      TrackReader reader(track.data, track.size);
+      TRACK_EVENT e;
+      uint64_t ticks = 0;
+      while(reader.readEvent(e))
+      {
+        ticks += e.ticks;
+        if (e.status == EVENT_META && (META_TYPE)e.data1 == META_TEMPO_SETTING && e.size == 3)
+        {
+          SOURCE::TEMPO_EVENT t;
+          t.ticks = ticks;
+          t.tempo = ((uint32_t)e.data[0] << 16) | ((uint32_t)e.data[1] << 8) | (uint32_t)e.data[2];
+          if (t.tempo != 0)
+            s.tempoEvents.push_back(t);
+        }
+      }
+      valid = !reader.hasError();
+    }
+    offset += length;
+  }
+  if (!valid || s.tracks.empty())
+  {
+    delete iSource;
+    return INVALID_SOURCE;
+  }
+
+  //the tempo events of all tracks make the tempo map
+  std::stable_sort(s.tempoEvents.begin(), s.tempoEvents.end(), [](const SOURCE::TEMPO_EVENT & a, const SOURCE::TEMPO_EVENT & b)
+  {
+    return a.ticks < b.ticks;
+  });
+  if (s.tempoEvents.empty() || s.tempoEvents[0].ticks != 0)
+  {
+    SOURCE::TEMPO_EVENT t = {0, MidiFile::DEFAULT_TEMPO};
+    s.tempoEvents.insert(s.tempoEvents.begin(), t);
+  }
+  size_t numTempoEvents = 1;
+  for(size_t i=1; i<s.tempoEvents.size(); i++)
+  {
+    if (s.tempoEvents[i].ticks == s.tempoEvents[numTempoEvents-1].ticks)
+      s.tempoEvents[numTempoEvents-1].tempo = s.tempoEvents[i].tempo; //the last change at the same time wins
+    else
+      s.tempoEvents[numTempoEvents++] = s.tempoEvents[i];
+  }
+  s.tempoEvents.resize(numTempoEvents);
+
+  size_t index = mSources.size();
+  for(size_t i=0; i<NUM_CHANNELS; i++)
+  {
+    s.channels[i] = MultiTrackMidiFile::getDefaultTrackChannel(index);
+  }
+  mSources.push_back(iSource);
+  return index;
+}
+
+size_t MidiMerger::getSourceCount() const
+{
+  return mSources.size();
+}
+
+bool MidiMerger::setChannel(size_t iSource, uint8_t iChannel)
+{
+  if (iSource >= mSources.size() || iChannel >= NUM_CHANNELS)
+    return false;
+  for(size_t i=0; i<NUM_CHANNELS; i++)
+  {
+    mSources[iSource]->channels[i] = iChannel;
+  }
+  return true;
+}
+
+bool MidiMerger::setChannelMap(size_t iSource, uint8_t iFrom, uint8_t iTo)
+{
+  if (iSource >= mSources.size() || iFrom >= NUM_CHANNELS || iTo >= NUM_CHANNELS)
+    return false;
+  mSources[iSource]->channels[iFrom] = iTo;
+  return true;
+}
+
+void MidiMerger::clear()
+{
+  for(size_t i=0; i<mSources.size(); i++)
+  {
+    delete mSources[i];
+  }
+  mSources.clear();
+}
+
+template <typename WRITER>
+void MidiMerger::encodeTrack(WRITER & w) const
+{
+  TrackEncoder encoder(MidiFile::STOP_PREVIOUS_NOTE, 0, mCompactEncoding);
+  encoder.writeSettings(w, mName, mTempo, (int8_t)MidiFile::DEFAULT_INSTRUMENT);
+
+  //each merge has its own tempo maps since a TempoMap must not be shared between threads
+  std::vector<TempoMap> tempoMaps;
+  tempoMaps.reserve(mSources.size());
+  size_t numTracks = 0;
+  for(size_t i=0; i<mSources.size(); i++)
+  {
+    const SOURCE & s = *mSources[i];
+    TempoMap tempoMap(s.ticksPerQuarterNote, s.tempoEvents[0].tempo);
+    for(size_t j=1; j<s.tempoEvents.size(); j++)
+    {
+      const SOURCE::TEMPO_EVENT & t = s.tempoEvents[j];
+      tempoMap.add(tempoMap.toTimeUs(t.ticks), t.ticks, t.tempo);
+    }
+    tempoMaps.push_back(tempoMap);
+    numTracks += s.tracks.size();
+  }
+
+  //read the first event of each track
+  TickConverter output(mTicksPerQuarterNote, mTempo);
+  std::vector<MERGE_CURSOR> cursors;
+  cursors.reserve(numTracks);
+  std::vector<size_t> heap;
+  heap.reserve(numTracks);
+  CURSOR_GREATER greater(cursors);
+  for(size_t i=0; i<mSources.size(); i++)
+  {
+    const SOURCE & s = *mSources[i];
+    for(size_t j=0; j<s.tracks.size(); j++)
+    {
+      cursors.push_back(MERGE_CURSOR(s.tracks[j].data, s.tracks[j].size, i, &tempoMaps[i]));
+      if (cursors.back().next(output))
+      {
+        heap.push_back(cursors.size() - 1);
+        std::push_heap(heap.begin(), heap.end(), greater);
+      }
+    }
+  }
+
+  //write the earliest event and read the next event of its track
+  uint64_t ticks = 0;
+  while(!heap.empty())
+  {
+    std::pop_heap(heap.begin(), heap.end(), greater);
+    MERGE_CURSOR & c = cursors[heap.back()];
+
+    const TRACK_EVENT & e = c.event;
+    uint8_t channel = mSources[c.source]->channels[e.status & 0x0F];
+    encoder.writeChannelEvent(w, c.ticks - ticks, (EVENT_STATUS)((e.status & 0xF0) | channel), e.data1, e.data2);
+    ticks = c.ticks;
+
+    if (c.next(output))
+      std::push_heap(heap.begin(), heap.end(), greater);
+    else
+      heap.pop_back();
+  }
+
+  encoder.writeEndOfTrack(w);
+}
+
+template <typename WRITER>
+void MidiMerger::encode(WRITER & w, size_t iTrackSize) const
+{
+  MIDI_HEADER header;
+  header.id = MIDI_FILE_ID;
+  header.length = 6;
+  header.type = MidiFile::MIDI_TYPE_0;
+  header.numTracks = 1;
+  header.ticksPerQuarterNote = mTicksPerQuarterNote;
+  writeHeader(header, w);
+
+  TRACK_HEADER track;
+  track.id = MIDI_TRACK_HEADER_ID;
+  track.length = (uint32_t)iTrackSize;
+  writeHeader(track, w);
+
+  encodeTrack(w);
+}
+
+size_t MidiMerger::computeEncodedSize() const
+{
+  SizeCounter c;
+  encodeTrack(c);
+  return MIDI_HEADER_SIZE + CHUNK_HEADER_SIZE + c.size();
+}
+
+bool MidiMerger::save(const char * iFile) const
+{
+  FileSink sink;
+  if (!sink.open(iFile))
+    return false;
+
+  bool saved = save(sink);
+  if (!sink.close())
+    saved = false;
+
+  return saved;
+}
+
+bool MidiMerger::save(ByteSink & iSink) const
+{
+  size_t size = computeEncodedSize();
+
+  ByteSinkWriter w(iSink);
+  encode(w, size - MIDI_HEADER_SIZE - CHUNK_HEADER_SIZE);
+  return !w.hasError() && iSink.flush();
+}
+
+bool MidiMerger::saveToBuffer(std::vector<uint8_t> & oBuffer) const
+{
+  size_t size = computeEncodedSize();
+  oBuffer.resize(size);
+
+  BufferWriter w(&oBuffer[0], oBuffer.size());
+  encode(w, size - MIDI_HEADER_SIZE - CHUNK_HEADER_SIZE);
+  return !w.isOverflow() && w.size() == size;
+}
+
+}; //namespace libmidi
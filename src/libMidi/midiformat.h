@@ -0,0 +1,497 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#ifndef MIDIFORMAT_H
+#define MIDIFORMAT_H
+
+//
+// Description:
+//   Internal definitions of the Standard MIDI File format
+//   shared by the MIDI encoders and decoders of the library.
+//
+
+#include "libmidi/sinks.h"
+#include "varlength.h"
+
+#include <stdint.h>
+#include <cstddef> //for size_t
+#include <cstring> //for memcpy()
+
+namespace libmidi
+{
+
+typedef uint32_t HEADER_ID;
+static const HEADER_ID MIDI_FILE_ID = 0x4d546864; //"MThd"
+static const HEADER_ID MIDI_TRACK_HEADER_ID = 0x4d54726b; //"MTrk"
+static const size_t MIDI_HEADER_SIZE = 14; //id, length, type, numTracks and ticksPerQuarterNote
+static const size_t CHUNK_HEADER_SIZE = 8; //id and length
+
+typedef uint16_t HEADER_MIDI_TYPE;
+
+//events handling
+typedef uint8_t EVENT_STATUS;
+static const EVENT_STATUS NOTE_ON_CHANNEL_0           = (EVENT_STATUS)0x90;
+static const EVENT_STATUS NOTE_OFF_CHANNEL_0          = (EVENT_STATUS)0x80;
+static const EVENT_STATUS AFTER_TOUCH_CHANNEL_0       = (EVENT_STATUS)0xA0;
+static const EVENT_STATUS CONTROL_CHANGE_CHANNEL_0    = (EVENT_STATUS)0xB0;
+static const EVENT_STATUS PROGRAM_CHANGE_CHANNEL_0    = (EVENT_STATUS)0xC0;
+static const EVENT_STATUS CHANNEL_PRESSURE_CHANNEL_0  = (EVENT_STATUS)0xD0;
+static const EVENT_STATUS PITCH_WHEEL_CHANNEL_0       = (EVENT_STATUS)0xE0;
+static const EVENT_STATUS EVENT_SYSEX                 = (EVENT_STATUS)0xF0;
+static const EVENT_STATUS EVENT_SYSEX_ESCAPE          = (EVENT_STATUS)0xF7;
+static const EVENT_STATUS EVENT_META                  = (EVENT_STATUS)0xFF;
+
+typedef int8_t EVENT_PITCH; //note code
+static const EVENT_PITCH ALL_NOTES_OFF = (EVENT_PITCH)0x7B;
+
+typedef int8_t EVENT_VOLUME; //from 0 to 7F
+static const EVENT_VOLUME MIN_VOLUME = (EVENT_VOLUME)0x00;
+static const EVENT_VOLUME MAX_VOLUME = (EVENT_VOLUME)0x7F;
+
+typedef int8_t META_TYPE;
+static const META_TYPE META_SEQUENCE_NUMBER                = (META_TYPE)0x00;
+static const META_TYPE META_TEXT_EVENT                     = (META_TYPE)0x01;
+static const META_TYPE META_COPYRIGHT_NOTICE               = (META_TYPE)0x02;
+static const META_TYPE META_SEQUENCE_OR_TRACK_NAME         = (META_TYPE)0x03;
+static const META_TYPE META_INSTRUMENT_NAME                = (META_TYPE)0x04;
+static const META_TYPE META_LYRIC_TEXT	                   = (META_TYPE)0x05;
+static const META_TYPE META_MARKER_TEXT	                   = (META_TYPE)0x06;
+static const META_TYPE META_CUE_POINT                      = (META_TYPE)0x07;
+static const META_TYPE META_MIDI_CHANNEL_PREFIX_ASSIGNMENT = (META_TYPE)0x20;
+static const META_TYPE META_END_OF_TRACK                   = (META_TYPE)0x2F;
+static const META_TYPE META_TEMPO_SETTING                  = (META_TYPE)0x51;
+static const META_TYPE META_SMPTE_OFFSET                   = (META_TYPE)0x54;
+static const META_TYPE META_TIME_SIGNATURE                 = (META_TYPE)0x58;
+static const META_TYPE META_KEY_SIGNATURE                  = (META_TYPE)0x59;
+static const META_TYPE META_SEQUENCER_SPECIFIC_EVENT       = (META_TYPE)0x7F;
+
+typedef uint32_t VAR_LENGTH;
+
+#pragma pack(push, 1) // exact fit - no padding
+struct MIDI_HEADER
+{
+  HEADER_ID id; //see DEFAULT_FILE_HEADER
+  uint32_t length;
+  HEADER_MIDI_TYPE type;
+  uint16_t numTracks;
+  uint16_t ticksPerQuarterNote;
+};
+struct TRACK_HEADER
+{
+  HEADER_ID id; //see DEFAULT_FILE_HEADER
+  uint32_t length; //including data size & track footer
+};
+struct NOTE_EVENT
+{
+  VAR_LENGTH ticks;
+  EVENT_STATUS status;
+  EVENT_PITCH pitch;
+  EVENT_VOLUME volume;
+};
+struct META_EVENT
+{
+  VAR_LENGTH ticks;
+  EVENT_STATUS status;
+  META_TYPE type;
+  VAR_LENGTH size;
+};
+#pragma pack(pop) //back to whatever the previous packing mode was
+
+//offsets of the track header in a file with a single track
+static const size_t TRACK_LENGTH_OFFSET = sizeof(MIDI_HEADER) + sizeof(HEADER_ID);
+static const size_t TRACK_DATA_OFFSET = sizeof(MIDI_HEADER) + sizeof(TRACK_HEADER);
+
+static const EVENT_PITCH MIN_PITCH = (EVENT_PITCH)0x0C; //NOTE_C0
+static const EVENT_PITCH MAX_PITCH = (EVENT_PITCH)0x7F; //NOTE_G9
+
+/// <summary>Finds the MIDI pitch that is the closest to the given frequency.</summary>
+/// <param name="frequency">The frequency in Hz.</param>
+/// <returns>Returns a MIDI pitch between MIN_PITCH and MAX_PITCH.</returns>
+EVENT_PITCH findMidiPitchFromFrequency(uint16_t frequency);
+
+/// <summary>Get the frequency of the given MIDI pitch.</summary>
+/// <param name="iPitch">The MIDI pitch.</param>
+/// <returns>Returns the frequency in Hz of the pitch. Returns 0 for pitches lower than MIN_PITCH.</returns>
+uint16_t getFrequencyFromMidiPitch(EVENT_PITCH iPitch);
+
+/// <summary>
+/// Writes encoded bytes to a fixed size memory buffer.
+/// </summary>
+/// <remarks>
+/// When the buffer is too small, the writer stops writing but keeps
+/// counting bytes so that the required buffer size can be returned to the caller.
+/// </remarks>
+class BufferWriter
+{
+public:
+  BufferWriter(uint8_t * iBuffer, size_t iBufferSize) :
+    mBuffer(iBuffer),
+    mCapacity(iBufferSize),
+    mSize(0)
+  {
+  }
+
+  inline size_t size() const
+  {
+    return mSize;
+  }
+
+  inline bool isOverflow() const
+  {
+    return mSize > mCapacity;
+  }
+
+  inline void write(const void * iData, size_t iSize)
+  {
+    if (mSize + iSize <= mCapacity)
+      memcpy(&mBuffer[mSize], iData, iSize);
+    mSize += iSize;
+  }
+
+  inline void write(uint8_t iValue)
+  {
+    if (mSize < mCapacity)
+      mBuffer[mSize] = iValue;
+    mSize++;
+  }
+
+  inline void writeVariableLength(uint32_t iValue)
+  {
+    if (mSize + VARIABLE_LENGTH_MAX_SIZE <= mCapacity)
+    {
+      mSize += encodeVariableLength(iValue, &mBuffer[mSize]);
+      return;
+    }
+    uint8_t buffer[VARIABLE_LENGTH_MAX_SIZE];
+    size_t size = encodeVariableLength(iValue, buffer);
+    write(buffer, size);
+  }
+
+  /// <summary>Overwrites a big-endian 32 bits value at the given offset. Does nothing on overflow.</summary>
+  inline void patch32(size_t iOffset, uint32_t iValue)
+  {
+    if (isOverflow())
+      return;
+    writeBigEndian32(&mBuffer[iOffset], iValue);
+  }
+
+  static inline void writeBigEndian16(uint8_t * oBuffer, uint16_t iValue)
+  {
+    oBuffer[0] = (uint8_t)(iValue >> 8);
+    oBuffer[1] = (uint8_t)(iValue);
+  }
+
+  static inline void writeBigEndian32(uint8_t * oBuffer, uint32_t iValue)
+  {
+    oBuffer[0] = (uint8_t)(iValue >> 24);
+    oBuffer[1] = (uint8_t)(iValue >> 16);
+    oBuffer[2] = (uint8_t)(iValue >> 8);
+    oBuffer[3] = (uint8_t)(iValue);
+  }
+
+private:
+  uint8_t * mBuffer;
+  size_t mCapacity;
+  size_t mSize;
+};
+
+/// <summary>
+/// Counts the bytes of an encoding without writing them.
+/// </summary>
+/// <remarks>
+/// Has the same writing interface as BufferWriter.
+/// </remarks>
+class SizeCounter
+{
+public:
+  SizeCounter() :
+    mSize(0)
+  {
+  }
+
+  inline size_t size() const
+  {
+    return mSize;
+  }
+
+  inline void write(const void * /*iData*/, size_t iSize)
+  {
+    mSize += iSize;
+  }
+
+  inline void write(uint8_t /*iValue*/)
+  {
+    mSize++;
+  }
+
+  inline void writeVariableLength(uint32_t iValue)
+  {
+    mSize += getVariableLengthSize(iValue);
+  }
+
+private:
+  size_t mSize;
+};
+
+/// <summary>
+/// Writes the bytes of an encoding to a sink as they are encoded.
+/// </summary>
+/// <remarks>
+/// Has the same writing interface as BufferWriter.
+/// Small writes are not grouped: the sink should buffer them, like the BufferedSink classes.
+/// Writing stops at the first error.
+/// </remarks>
+class ByteSinkWriter
+{
+public:
+  ByteSinkWriter(ByteSink & iSink) :
+    mSink(iSink),
+    mError(false)
+  {
+  }
+
+  inline bool hasError() const
+  {
+    return mError;
+  }
+
+  inline void write(const void * iData, size_t iSize)
+  {
+    if (!mError)
+      mError = !mSink.write(iData, iSize);
+  }
+
+  inline void write(uint8_t iValue)
+  {
+    write(&iValue, 1);
+  }
+
+  inline void writeVariableLength(uint32_t iValue)
+  {
+    uint8_t buffer[VARIABLE_LENGTH_MAX_SIZE];
+    size_t size = encodeVariableLength(iValue, buffer);
+    write(buffer, size);
+  }
+
+private:
+  ByteSink & mSink;
+  bool mError;
+};
+
+template <typename WRITER>
+inline void writeHeader(const MIDI_HEADER & iHeader, WRITER & w)
+{
+  uint8_t buffer[sizeof(MIDI_HEADER)];
+  BufferWriter::writeBigEndian32(&buffer[0], iHeader.id);
+  BufferWriter::writeBigEndian32(&buffer[4], iHeader.length);
+  BufferWriter::writeBigEndian16(&buffer[8], iHeader.type);
+  BufferWriter::writeBigEndian16(&buffer[10], iHeader.numTracks);
+  BufferWriter::writeBigEndian16(&buffer[12], iHeader.ticksPerQuarterNote);
+  w.write(buffer, sizeof(buffer));
+}
+template <typename WRITER>
+inline void writeHeader(const TRACK_HEADER & iHeader, WRITER & w)
+{
+  uint8_t buffer[sizeof(TRACK_HEADER)];
+  BufferWriter::writeBigEndian32(&buffer[0], iHeader.id);
+  BufferWriter::writeBigEndian32(&buffer[4], iHeader.length);
+  w.write(buffer, sizeof(buffer));
+}
+template <typename WRITER>
+inline void writeEvent(const NOTE_EVENT & e, bool isRunningStatus, WRITER & w)
+{
+  w.writeVariableLength(e.ticks);
+  if (!isRunningStatus)
+    w.write(e.status);
+  w.write((uint8_t)e.pitch);
+
+  //program change and channel pressure events have a single data byte
+  EVENT_STATUS type = (e.status & 0xF0);
+  if (type != PROGRAM_CHANGE_CHANNEL_0 && type != CHANNEL_PRESSURE_CHANNEL_0)
+    w.write((uint8_t)e.volume);
+}
+template <typename WRITER>
+inline void writeEvent(const META_EVENT & e, WRITER & w)
+{
+  w.writeVariableLength(e.ticks);
+  w.write(e.status);
+  w.write((uint8_t)e.type);
+  w.writeVariableLength(e.size);
+}
+
+/// <summary>Reads a big-endian 16 bits value from a buffer.</summary>
+inline uint16_t readBigEndian16(const uint8_t * iBuffer)
+{
+  return (uint16_t)((iBuffer[0] << 8) | iBuffer[1]);
+}
+
+/// <summary>Reads a big-endian 32 bits value from a buffer.</summary>
+inline uint32_t readBigEndian32(const uint8_t * iBuffer)
+{
+  return ((uint32_t)iBuffer[0] << 24) | ((uint32_t)iBuffer[1] << 16) | ((uint32_t)iBuffer[2] << 8) | (uint32_t)iBuffer[3];
+}
+
+/// <summary>
+/// Defines an event read from a MIDI track.
+/// </summary>
+struct TRACK_EVENT
+{
+  VAR_LENGTH ticks; //delta time since the previous event
+  EVENT_STATUS status; //including the channel of channel events
+  uint8_t data1; //pitch, controller or program of channel events. Type of meta events.
+  uint8_t data2; //velocity or value of channel events.
+  const uint8_t * data; //data of meta and sysex events. Points inside the track's buffer.
+  VAR_LENGTH size; //size of data in bytes.
+};
+
+/// <summary>
+/// Reads the events of a MIDI track from a memory buffer.
+/// </summary>
+/// <remarks>
+/// The reader does not copy the track's data and supports running status.
+/// Reading stops after the end of track meta event.
+/// </remarks>
+class TrackReader
+{
+public:
+  /// <summary>Creates a reader for the given track data.</summary>
+  /// <param name="iBuffer">The data of the track following the track header.</param>
+  /// <param name="iSize">The size of the track data in bytes.</param>
+  TrackReader(const uint8_t * iBuffer, size_t iSize) :
+    mBuffer(iBuffer),
+    mSize(iSize),
+    mOffset(0),
+    mRunningStatus(0),
+    mEndOfTrack(false),
+    mError(false)
+  {
+  }
+
+  /// <summary>Reads the next event of the track.</summary>
+  /// <param name="e">The event read from the track.</param>
+  /// <returns>Returns true when an event is read. Returns false at the end of the track or on invalid data.</returns>
+  inline bool readEvent(TRACK_EVENT & e)
+  {
+    if (mEndOfTrack || mError || mOffset >= mSize)
+      return false;
+
+    size_t size = decodeVariableLength(&mBuffer[mOffset], mSize - mOffset, e.ticks);
+    if (size == 0 || mOffset + size >= mSize)
+      return setError();
+    mOffset += size;
+
+    EVENT_STATUS status = mBuffer[mOffset];
+    if (status & 0x80)
+      mOffset++;
+    else if (mRunningStatus)
+      status = mRunningStatus;
+    else
+      return setError();
+
+    e.status = status;
+    e.data1 = 0;
+    e.data2 = 0;
+    e.data = NULL;
+    e.size = 0;
+
+    if (status == EVENT_META)
+    {
+      if (mOffset >= mSize)
+        return setError();
+      e.data1 = mBuffer[mOffset++];
+      if (!readData(e))
+        return false;
+      mRunningStatus = 0;
+      if ((META_TYPE)e.data1 == META_END_OF_TRACK)
+        mEndOfTrack = true;
+    }
+    else if (status == EVENT_SYSEX || status == EVENT_SYSEX_ESCAPE)
+    {
+      if (!readData(e))
+        return false;
+      mRunningStatus = 0;
+    }
+    else if (status > EVENT_SYSEX)
+    {
+      //system common and real-time messages are not allowed in MIDI files
+      return setError();
+    }
+    else
+    {
+      EVENT_STATUS type = (status & 0xF0);
+      size_t numDataBytes = (type == PROGRAM_CHANGE_CHANNEL_0 || type == CHANNEL_PRESSURE_CHANNEL_0 ? 1 : 2);
+      if (mOffset + numDataBytes > mSize)
+        return setError();
+      e.data1 = mBuffer[mOffset++];
+      if (numDataBytes == 2)
+        e.data2 = mBuffer[mOffset++];
+      if ((e.data1 | e.data2) & 0x80)
+        return setError();
+      mRunningStatus = status;
+    }
+
+    return true;
+  }
+
+  /// <summary>Returns true if the end of track meta event was read.</summary>
+  inline bool isEndOfTrack() const
+  {
+    return mEndOfTrack;
+  }
+
+  /// <summary>Returns true if the track contains invalid data.</summary>
+  inline bool hasError() const
+  {
+    return mError;
+  }
+
+private:
+  inline bool readData(TRACK_EVENT & e)
+  {
+    size_t size = decodeVariableLength(&mBuffer[mOffset], mSize - mOffset, e.size);
+    if (size == 0 || e.size > mSize - mOffset - size)
+      return setError();
+    mOffset += size;
+    e.data = &mBuffer[mOffset];
+    mOffset += e.size;
+    return true;
+  }
+
+  inline bool setError()
+  {
+    mError = true;
+    return false;
+  }
+
+  const uint8_t * mBuffer;
+  size_t mSize;
+  size_t mOffset;
+  EVENT_STATUS mRunningStatus;
+  bool mEndOfTrack;
+  bool mError;
+};
+
+}; //namespace libmidi
+
+#endif //MIDIFORMAT_H
@@ -0,0 +1,388 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+//
+// Description:
+//   Standard MIDI File reader.
+//
+
+#include "libmidi/libmidi.h"
+#include "libmidi/pitches.h"
+
+#include "midiformat.h"
+#include "timeline.h"
+#include "hash.h"
+
+#include <vector>
+#include <algorithm> //for std::stable_sort()
+
+#ifdef _WIN32
+#   ifndef WIN32_LEAN_AND_MEAN
+#   define WIN32_LEAN_AND_MEAN
+#   endif
+#   include <windows.h>
+#else
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+namespace libmidi
+{
+
+static const uint32_t MAX_DURATION_US = 0xFFFFFFFF;
+
+//a tempo event of any track
+struct TEMPO_EVENT
+{
+  uint64_t ticks; //absolute time of the event
+  uint32_t tempo;
+};
+typedef std::vector<TEMPO_EVENT> TempoEventList;
+
+/// <summary>
+/// Maps a file in memory for reading.
+/// </summary>
+class MappedFile
+{
+public:
+  MappedFile(const char * iPath) :
+    mData(NULL),
+    mSize(0)
+  {
+#ifdef _WIN32
+    mFile = INVALID_HANDLE_VALUE;
+    mMapping = NULL;
+    mFile = CreateFileA(iPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (mFile == INVALID_HANDLE_VALUE)
+      return;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mFile, &size) || size.QuadPart == 0)
+      return;
+    mMapping = CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mMapping == NULL)
+      return;
+    mData = (const uint8_t *)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+    if (mData)
+      mSize = (size_t)size.QuadPart;
+#else
+    int fd = open(iPath, O_RDONLY);
+    if (fd == -1)
+      return;
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+      void * data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED)
+      {
+        mData = (const uint8_t *)data;
+        mSize = (size_t)info.st_size;
+      }
+    }
+    close(fd);
+#endif
+  }
+
+  ~MappedFile()
+  {
+#ifdef _WIN32
+    if (mData)
+      UnmapViewOfFile(mData);
+    if (mMapping)
+      CloseHandle(mMapping);
+    if (mFile != INVALID_HANDLE_VALUE)
+      CloseHandle(mFile);
+#else
+    if (mData)
+      munmap((void *)mData, mSize);
+#endif
+  }
+
+  inline const uint8_t * getData() const
+  {
+    return mData;
+  }
+
+  inline size_t getSize() const
+  {
+    return mSize;
+  }
+
+private:
+  MappedFile(const MappedFile &);
+  MappedFile & operator=(const MappedFile &);
+
+  const uint8_t * mData;
+  size_t mSize;
+#ifdef _WIN32
+  HANDLE mFile;
+  HANDLE mMapping;
+#endif
+};
+
+void MidiFile::appendLoadedNote(int8_t iPitch, int8_t iVolume, uint64_t iDurationUs)
+{
+  uint16_t frequency = getFrequencyFromMidiPitch(iPitch);
+  if (frequency == 0)
+    frequency = NOTE_C0; //a frequency of 0 is a delay. The pitch is kept as is.
+  mNotes.push_back(frequency, (uint32_t)(iDurationUs > MAX_DURATION_US ? MAX_DURATION_US : iDurationUs), iVolume, iPitch);
+  mNotes.updateHash(mNotes.size() - 1);
+}
+
+void MidiFile::appendLoadedDelay(uint64_t iDurationUs)
+{
+  uint64_t durationUs = iDurationUs;
+
+  //split long delays
+  while(durationUs > 0)
+  {
+    uint32_t delayUs = (uint32_t)(durationUs > MAX_DURATION_US ? MAX_DURATION_US : durationUs);
+    mNotes.push_back(0, delayUs, mVolume, 0);
+    mNotes.updateHash(mNotes.size() - 1);
+
+    durationUs -= delayUs;
+  }
+}
+
+bool MidiFile::load(const char * iFile)
+{
+  if (iFile == NULL)
+    return false;
+
+  MappedFile file(iFile);
+  if (file.getData() == NULL)
+    return false;
+
+  return loadFromBuffer(file.getData(), file.getSize());
+}
+
+bool MidiFile::loadFromBuffer(const uint8_t * iBuffer, size_t iBufferSize)
+{
+  if (iBuffer == NULL || iBufferSize < MIDI_HEADER_SIZE)
+    return false;
+
+  MIDI_HEADER header;
+  header.id = readBigEndian32(&iBuffer[0]);
+  header.length = readBigEndian32(&iBuffer[4]);
+  header.type = readBigEndian16(&iBuffer[8]);
+  header.numTracks = readBigEndian16(&iBuffer[10]);
+  header.ticksPerQuarterNote = readBigEndian16(&iBuffer[12]);
+  if (header.id != MIDI_FILE_ID || header.length < 6 || header.length > iBufferSize - CHUNK_HEADER_SIZE)
+    return false;
+  if (header.type != MIDI_TYPE_0 && header.type != MIDI_TYPE_1)
+    return false;
+  if (header.ticksPerQuarterNote == 0 || (header.ticksPerQuarterNote & 0x8000) != 0)
+    return false; //SMPTE time division is not supported
+
+  //first pass: validate all tracks, find the song's settings and the track that contains the melody
+  const uint8_t * name = NULL;
+  size_t nameSize = 0;
+  uint32_t tempo = DEFAULT_TEMPO;
+  TempoEventList tempoEvents;
+  int instrument = -1;
+  const uint8_t * melody = NULL;
+  size_t melodySize = 0;
+  size_t numMelodyNotes = 0;
+  size_t numTracks = 0;
+
+  size_t offset = CHUNK_HEADER_SIZE + header.length;
+  while(iBufferSize - offset >= CHUNK_HEADER_SIZE)
+  {
+    TRACK_HEADER track;
+    track.id = readBigEndian32(&iBuffer[offset]);
+    track.length = readBigEndian32(&iBuffer[offset+4]);
+    offset += CHUNK_HEADER_SIZE;
+    if (track.length > iBufferSize - offset)
+      return false;
+
+    //ignore unknown chunks
+    if (track.id == MIDI_TRACK_HEADER_ID)
+    {
+      TrackReader reader(&iBuffer[offset], track.length);
+      TRACK_EVENT e;
+      size_t numNotes = 0;
+      uint64_t ticks = 0;
+      while(reader.readEvent(e))
+      {
+        ticks += e.ticks;
+        EVENT_STATUS type = (e.status & 0xF0);
+        if (type == NOTE_ON_CHANNEL_0 && e.data2 > 0)
+          numNotes++;
+        else if (type == PROGRAM_CHANGE_CHANNEL_0 && instrument == -1)
+          instrument = e.data1;
+        else if (e.status == EVENT_META && (META_TYPE)e.data1 == META_SEQUENCE_OR_TRACK_NAME && name == NULL)
+        {
+          name = e.data;
+          nameSize = e.size;
+        }
+        else if (e.status == EVENT_META && (META_TYPE)e.data1 == META_TEMPO_SETTING && e.size == 3)
+        {
+          TEMPO_EVENT t;
+          t.ticks = ticks;
+          t.tempo = ((uint32_t)e.data[0] << 16) | ((uint32_t)e.data[1] << 8) | (uint32_t)e.data[2];
+          tempoEvents.push_back(t);
+        }
+      }
+      if (reader.hasError())
+        return false;
+
+      if (numNotes > 0 && melody == NULL)
+      {
+        melody = &iBuffer[offset];
+        melodySize = track.length;
+        numMelodyNotes = numNotes;
+      }
+      numTracks++;
+    }
+
+    offset += track.length;
+  }
+  if (numTracks == 0)
+    return false;
+
+  //the tempo events of all tracks make the tempo map. The first event at time 0 is the initial tempo.
+  std::stable_sort(tempoEvents.begin(), tempoEvents.end(), [](const TEMPO_EVENT & a, const TEMPO_EVENT & b)
+  {
+    return a.ticks < b.ticks;
+  });
+  size_t firstTempoChange = 0;
+  if (!tempoEvents.empty() && tempoEvents[0].ticks == 0)
+  {
+    tempo = tempoEvents[0].tempo;
+    firstTempoChange = 1;
+  }
+  if (tempo == 0)
+    return false;
+
+  //second pass: build the melody
+  mType = (MIDI_TYPE)header.type;
+  mTicksPerQuarterNote = header.ticksPerQuarterNote;
+  mTempo = tempo;
+  mName.assign(name ? (const char *)name : "", nameSize);
+  mInstrument = (instrument == -1 ? DEFAULT_INSTRUMENT : (int8_t)instrument);
+  mVolume = MAX_VOLUME;
+  mTrackEndingPreference = STOP_PREVIOUS_NOTE;
+  mCompactEncoding = false;
+  mNotes.clear();
+  mTimedNotes.clear();
+  mTimedNotesSorted = true;
+  mTimedNotesHash = HASH_SEED;
+  mAppendState.path.clear(); //the notes of the file are replaced
+
+  //the time of a tempo change is rounded up which allows the encoder
+  //to place the tempo change at its original ticks when the file is saved again
+  mTempoChanges.clear();
+  for(size_t i=firstTempoChange; i<tempoEvents.size(); i++)
+  {
+    const TEMPO_EVENT & t = tempoEvents[i];
+    if (t.tempo == 0)
+      continue;
+    uint64_t previousTimeUs = (mTempoChanges.empty() ? 0 : mTempoChanges.back().timeUs);
+    uint64_t previousTicks = (mTempoChanges.empty() ? 0 : mTempoChanges.back().ticks);
+    uint32_t previousTempo = (mTempoChanges.empty() ? mTempo : mTempoChanges.back().tempo);
+
+    TEMPO_CHANGE c;
+    c.timeUs = previousTimeUs + TickConverter(mTicksPerQuarterNote, previousTempo).toTimeUs(t.ticks - previousTicks);
+    c.ticks = t.ticks;
+    c.tempo = t.tempo;
+    if (!mTempoChanges.empty() && mTempoChanges.back().ticks == c.ticks)
+      mTempoChanges.back().tempo = c.tempo; //the last change at the same time wins
+    else
+      mTempoChanges.push_back(c);
+  }
+  updateTempoChanges(0);
+  mNotes.reserve(2*numMelodyNotes + 1); //each note may be preceded by a delay
+
+  if (melody)
+  {
+    //the boundaries of the notes are rounded up which allows the encoder
+    //to place the notes at their original ticks when the file is saved again
+    TempoMap tempoMap(mTicksPerQuarterNote, mTempo);
+    initTempoMap(tempoMap);
+    auto duration = [&tempoMap](uint64_t iStartTicks, uint64_t iEndTicks)
+    {
+      return tempoMap.toTimeUs(iEndTicks) - tempoMap.toTimeUs(iStartTicks);
+    };
+
+    uint64_t ticks = 0; //absolute time of the current event
+    uint64_t cursor = 0; //absolute end time of the melody
+    bool playing = false;
+    uint64_t noteStart = 0;
+    EVENT_PITCH notePitch = 0;
+    EVENT_VOLUME noteVolume = 0;
+
+    TrackReader reader(melody, melodySize);
+    TRACK_EVENT e;
+    while(reader.readEvent(e))
+    {
+      ticks += e.ticks;
+      EVENT_STATUS type = (e.status & 0xF0);
+      bool isNoteOn = (type == NOTE_ON_CHANNEL_0 && e.data2 > 0);
+      bool isNoteOff = (type == NOTE_OFF_CHANNEL_0 || (type == NOTE_ON_CHANNEL_0 && e.data2 == 0));
+      bool isAllNotesOff = (type == CONTROL_CHANGE_CHANNEL_0 && (EVENT_PITCH)e.data1 == ALL_NOTES_OFF);
+
+      if (isNoteOn)
+      {
+        //single tone melody: a new note stops the previous one
+        if (playing)
+        {
+          appendLoadedNote(notePitch, noteVolume, duration(noteStart, ticks));
+          cursor = ticks;
+        }
+        if (ticks > cursor)
+          appendLoadedDelay(duration(cursor, ticks));
+        playing = true;
+        noteStart = ticks;
+        notePitch = (EVENT_PITCH)e.data1;
+        noteVolume = (EVENT_VOLUME)e.data2;
+        cursor = ticks;
+      }
+      else if (playing && ((isNoteOff && (EVENT_PITCH)e.data1 == notePitch) || isAllNotesOff))
+      {
+        appendLoadedNote(notePitch, noteVolume, duration(noteStart, ticks));
+        playing = false;
+        cursor = ticks;
+        if (type == NOTE_OFF_CHANNEL_0)
+          mVolume = (EVENT_VOLUME)e.data2;
+        else if (isNoteOff)
+          mCompactEncoding = true; //note off events are encoded as note on events
+        mTrackEndingPreference = (isAllNotesOff ? STOP_ALL_NOTES : STOP_PREVIOUS_NOTE);
+      }
+    }
+
+    //end of track
+    if (playing)
+    {
+      appendLoadedNote(notePitch, noteVolume, duration(noteStart, ticks));
+      cursor = ticks;
+    }
+    if (ticks > cursor)
+      appendLoadedDelay(duration(cursor, ticks));
+  }
+
+  return true;
+}
+
+}; //namespace libmidi
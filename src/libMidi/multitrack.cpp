@@ -0,0 +1,302 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+//
+// Description:
+//   Encodes Type 1 MIDI files made of multiple tracks.
+//
+
+#include "libmidi/multitrack.h"
+#include "libmidi/sinks.h"
+#include "libmidi/transform.h"
+
+#include "midiformat.h"
+#include "timeline.h"
+
+#include <thread>
+#include <atomic>
+#include <cstring> //for memcpy()
+
+namespace libmidi
+{
+
+//number of usable channels. The percussion channel is skipped.
+static const size_t NUM_MELODIC_CHANNELS = 15;
+static const uint8_t PERCUSSION_CHANNEL = 9;
+static const uint8_t NUM_CHANNELS = 16;
+
+MultiTrackMidiFile::MultiTrackMidiFile()
+{
+  mTicksPerQuarterNote = MidiFile::DEFAULT_TICKS_PER_QUARTER_NOTE;
+  mTempo = MidiFile::DEFAULT_TEMPO;
+  mNumThreads = 0;
+}
+
+void MultiTrackMidiFile::setTicksPerQuarterNote(uint16_t iTicks)
+{
+  mTicksPerQuarterNote = iTicks;
+}
+
+void MultiTrackMidiFile::setBeatsPerMinute(uint16_t iBpm)
+{
+  mTempo = MidiFile::bpm2tempo(iBpm);
+}
+
+void MultiTrackMidiFile::setTempo(uint32_t iTempo)
+{
+  mTempo = iTempo;
+}
+
+void MultiTrackMidiFile::setThreadCount(size_t iNumThreads)
+{
+  mNumThreads = iNumThreads;
+}
+
+uint16_t MultiTrackMidiFile::getTicksPerQuarterNote() const
+{
+  return mTicksPerQuarterNote;
+}
+
+uint32_t MultiTrackMidiFile::getTempo() const
+{
+  return mTempo;
+}
+
+MidiFile & MultiTrackMidiFile::addTrack()
+{
+  mChannels.push_back(getDefaultTrackChannel(mTracks.size()));
+  mTracks.push_back(MidiFile());
+  return mTracks.back();
+}
+
+size_t MultiTrackMidiFile::getTrackCount() const
+{
+  return mTracks.size();
+}
+
+MidiFile & MultiTrackMidiFile::getTrack(size_t iIndex)
+{
+  return mTracks[iIndex];
+}
+
+const MidiFile & MultiTrackMidiFile::getTrack(size_t iIndex) const
+{
+  return mTracks[iIndex];
+}
+
+void MultiTrackMidiFile::clear()
+{
+  mTracks.clear();
+  mChannels.clear();
+}
+
+uint8_t MultiTrackMidiFile::getDefaultTrackChannel(size_t iIndex)
+{
+  uint8_t channel = (uint8_t)(iIndex % NUM_MELODIC_CHANNELS);
+  if (channel >= PERCUSSION_CHANNEL)
+    channel++;
+  return channel;
+}
+
+bool MultiTrackMidiFile::setTrackChannel(size_t iIndex, uint8_t iChannel)
+{
+  if (iIndex >= mTracks.size() || iChannel >= NUM_CHANNELS)
+    return false;
+  mChannels[iIndex] = iChannel;
+  return true;
+}
+
+uint8_t MultiTrackMidiFile::getTrackChannel(size_t iIndex) const
+{
+  return mChannels[iIndex];
+}
+
+bool MultiTrackMidiFile::hasInstrumentConflict() const
+{
+  //instrument of the first track of each channel
+  int instruments[NUM_CHANNELS];
+  for(size_t i=0; i<NUM_CHANNELS; i++)
+    instruments[i] = -1;
+
+  for(size_t i=0; i<mTracks.size(); i++)
+  {
+    int & instrument = instruments[mChannels[i]];
+    if (instrument == -1)
+      instrument = mTracks[i].getInstrument();
+    else if (instrument != mTracks[i].getInstrument())
+      return true;
+  }
+  return false;
+}
+
+size_t MultiTrackMidiFile::computeEncodedSize() const
+{
+  //the tempo changes of the tracks are ignored
+  TempoMap tempoMap(mTicksPerQuarterNote, mTempo);
+  MidiTransform identity;
+
+  size_t size = sizeof(MIDI_HEADER);
+  for(size_t i=0; i<mTracks.size(); i++)
+  {
+    SizeCounter c;
+    mTracks[i].encodeTrack(c, tempoMap, (i == 0), mChannels[i], mTracks[i].mCompactEncoding, identity);
+    size += sizeof(TRACK_HEADER) + c.size();
+  }
+  return size;
+}
+
+bool MultiTrackMidiFile::save(const char * iFile) const
+{
+  if (hasInstrumentConflict())
+    return false;
+
+  FileSink sink;
+  if (!sink.open(iFile))
+    return false;
+
+  bool saved = save(sink);
+  if (!sink.close())
+    saved = false;
+
+  return saved;
+}
+
+bool MultiTrackMidiFile::save(ByteSink & iSink) const
+{
+  if (hasInstrumentConflict())
+    return false;
+
+  Buffer header;
+  encodeHeader(header);
+
+  BufferList tracks;
+  encodeTracks(tracks);
+
+  if (!iSink.write(&header[0], header.size()))
+    return false;
+  for(size_t i=0; i<tracks.size(); i++)
+  {
+    if (!iSink.write(&tracks[i][0], tracks[i].size()))
+      return false;
+  }
+  return iSink.flush();
+}
+
+bool MultiTrackMidiFile::saveToBuffer(std::vector<uint8_t> & oBuffer) const
+{
+  if (hasInstrumentConflict())
+    return false;
+
+  encodeHeader(oBuffer);
+
+  BufferList tracks;
+  encodeTracks(tracks);
+
+  size_t size = oBuffer.size();
+  for(size_t i=0; i<tracks.size(); i++)
+    size += tracks[i].size();
+
+  size_t offset = oBuffer.size();
+  oBuffer.resize(size);
+  for(size_t i=0; i<tracks.size(); i++)
+  {
+    memcpy(&oBuffer[offset], &tracks[i][0], tracks[i].size());
+    offset += tracks[i].size();
+  }
+
+  return true;
+}
+
+void MultiTrackMidiFile::encodeHeader(Buffer & oBuffer) const
+{
+  MIDI_HEADER header;
+  header.id = MIDI_FILE_ID;
+  header.length = 6;
+  header.type = (HEADER_MIDI_TYPE)MidiFile::MIDI_TYPE_1;
+  header.numTracks = (uint16_t)mTracks.size();
+  header.ticksPerQuarterNote = mTicksPerQuarterNote;
+
+  oBuffer.resize(sizeof(MIDI_HEADER));
+  BufferWriter w(&oBuffer[0], oBuffer.size());
+  writeHeader(header, w);
+}
+
+void MultiTrackMidiFile::encodeTrack(size_t iIndex, Buffer & oBuffer) const
+{
+  const MidiFile & f = mTracks[iIndex];
+  bool isFirstTrack = (iIndex == 0);
+  uint8_t channel = mChannels[iIndex];
+  TempoMap tempoMap(mTicksPerQuarterNote, mTempo); //the tempo changes of the tracks are ignored
+  MidiTransform identity;
+
+  SizeCounter c;
+  f.encodeTrack(c, tempoMap, isFirstTrack, channel, f.mCompactEncoding, identity);
+
+  TRACK_HEADER track;
+  track.id = MIDI_TRACK_HEADER_ID;
+  track.length = (uint32_t)c.size();
+
+  oBuffer.resize(sizeof(TRACK_HEADER) + c.size());
+  BufferWriter w(&oBuffer[0], oBuffer.size());
+  writeHeader(track, w);
+  f.encodeTrack(w, tempoMap, isFirstTrack, channel, f.mCompactEncoding, identity);
+}
+
+void MultiTrackMidiFile::encodeTracks(BufferList & oTracks) const
+{
+  oTracks.resize(mTracks.size());
+
+  size_t numThreads = mNumThreads;
+  if (numThreads == 0)
+    numThreads = std::thread::hardware_concurrency();
+  if (numThreads > mTracks.size())
+    numThreads = mTracks.size();
+
+  //tracks are assigned to threads as soon as they are available
+  std::atomic<size_t> next(0);
+  auto worker = [this, &oTracks, &next]()
+  {
+    for(size_t i = next++; i < mTracks.size(); i = next++)
+    {
+      encodeTrack(i, oTracks[i]);
+    }
+  };
+
+  if (numThreads <= 1)
+  {
+    worker();
+    return;
+  }
+
+  //the calling thread is also a worker
+  std::vector<std::thread> threads;
+  threads.reserve(numThreads - 1);
+  for(size_t i=1; i<numThreads; i++)
+    threads.push_back(std::thread(worker));
+  worker();
+  for(size_t i=0; i<threads.size(); i++)
+    threads[i].join();
+}
+
+}; //namespace libmidi
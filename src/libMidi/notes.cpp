@@ -31,7 +31,8 @@
 #include "libmidi/pitches.h"
 
 #include <cstdlib>  //for abs()
-#include <string>   //for NULL
+#include <cstring>  //for strlen(), memcmp()
+#include <cmath>    //for floor(), log2()
 
 namespace libmidi
 {
@@ -240,63 +241,175 @@ static NOTEDEF gNotesDefinition[] = {
 };
 static const size_t gNotesDefinitionCount = sizeof(gNotesDefinition)/sizeof(gNotesDefinition[0]);
 
-int findNoteFrequency(const char * iName)
+static const int NUM_OCTAVES = 10;
+static const int NUM_LETTERS = 7; //from 'A' to 'G'
+static const int NUM_NOTE_KEYS = NUM_LETTERS*2*NUM_OCTAVES;
+static const int NUM_SEMITONES = 12*NUM_OCTAVES;
+static const char * SILENCE_NAME = "SILENCE";
+static const size_t SILENCE_NAME_LENGTH = 7;
+
+/// <summary>
+/// Computes a unique key from a note name. The key is a perfect hash of the name.
+/// </summary>
+/// <remarks>
+/// Note names are made of a letter, an optional 'S' for sharp notes and an octave digit. ie: C4, CS4 or GS9.
+/// </remarks>
+/// <param name="iName">The name of the note. Does not need to be NULL terminated.</param>
+/// <param name="iLength">The length of the name.</param>
+/// <param name="oSemitone">The number of semitones from C0 matching the name.</param>
+/// <returns>Returns the key of the name. Returns -1 if the name is not a valid note name.</returns>
+inline int getNoteKey(const char * iName, size_t iLength, int & oSemitone)
 {
-  if (iName == NULL)
+  //semitone of each letter within an octave, from 'A' to 'G'.
+  static const int semitones[NUM_LETTERS] = { 9, 11, 0, 2, 4, 5, 7 };
+
+  if (iLength < 2 || iLength > 3)
     return -1;
-  std::string name = iName;
-  for(size_t i=0; i<gNotesDefinitionCount; i++)
+
+  int letter = iName[0] - 'A';
+  if (letter < 0 || letter >= NUM_LETTERS)
+    return -1;
+
+  int sharp = 0;
+  if (iLength == 3)
   {
-    const NOTEDEF & note = gNotesDefinition[i];
-    if (name == note.name)
-      return note.freq;
+    if (iName[1] != 'S')
+      return -1;
+    sharp = 1;
   }
-  return -1;
+
+  int octave = iName[iLength-1] - '0';
+  if (octave < 0 || octave >= NUM_OCTAVES)
+    return -1;
+
+  oSemitone = octave*12 + semitones[letter] + sharp;
+  return (letter*2 + sharp)*NUM_OCTAVES + octave;
+}
+
+/// <summary>
+/// Lookup tables built once from gNotesDefinition.
+/// </summary>
+struct NOTE_LOOKUP
+{
+  //frequency of each note indexed by getNoteKey(). -1 for unknown notes.
+  int frequencies[NUM_NOTE_KEYS];
+
+  //known notes sorted by frequency. The first note is SILENCE followed by each semitone from C0.
+  const NOTEDEF * notes[NUM_SEMITONES+1];
+  size_t numNotes;
+
+  NOTE_LOOKUP()
+  {
+    const NOTEDEF * semitones[NUM_SEMITONES];
+    const NOTEDEF * silence = NULL;
+    for(int i=0; i<NUM_NOTE_KEYS; i++)
+      frequencies[i] = -1;
+    for(int i=0; i<NUM_SEMITONES; i++)
+      semitones[i] = NULL;
+
+    for(size_t i=0; i<gNotesDefinitionCount; i++)
+    {
+      const NOTEDEF & note = gNotesDefinition[i];
+      int semitone = 0;
+      int key = getNoteKey(note.name, strlen(note.name), semitone);
+      if (key >= 0)
+      {
+        frequencies[key] = note.freq;
+        if (semitones[semitone] == NULL)
+          semitones[semitone] = &note;
+      }
+      else if (silence == NULL && note.freq == NOTE_SILENCE)
+        silence = &note;
+    }
+
+    numNotes = 0;
+    if (silence)
+      notes[numNotes++] = silence;
+    for(int i=0; i<NUM_SEMITONES; i++)
+    {
+      if (semitones[i])
+        notes[numNotes++] = semitones[i];
+    }
+  }
+};
+
+static const NOTE_LOOKUP & getNoteLookup()
+{
+  static const NOTE_LOOKUP lookup;
+  return lookup;
+}
+
+/// <summary>Find the index of the note closest to the given frequency in NOTE_LOOKUP::notes.</summary>
+/// <remarks>On a tie, the note with the lowest frequency is selected.</remarks>
+/// <param name="iFreq">The frequency in Hz to search for.</param>
+/// <returns>Returns an index in NOTE_LOOKUP::notes.</returns>
+static size_t findClosestNoteIndex(const NOTE_LOOKUP & iLookup, int iFreq)
+{
+  //estimate the number of semitones from C0 with equal temperament.
+  //C0 is 16.3516 Hz and each semitone is a factor of 2^(1/12).
+  int index = 0;
+  if (iFreq >= NOTE_C0)
+    index = 1 + (int)floor(12.0*log2(iFreq/16.3516) + 0.5);
+  if (index >= (int)iLookup.numNotes)
+    index = (int)iLookup.numNotes - 1;
+
+  //correct the estimation with the note frequencies
+  int diff = abs(iLookup.notes[index]->freq - iFreq);
+  while(index > 0 && abs(iLookup.notes[index-1]->freq - iFreq) <= diff)
+  {
+    index--;
+    diff = abs(iLookup.notes[index]->freq - iFreq);
+  }
+  while(index+1 < (int)iLookup.numNotes && abs(iLookup.notes[index+1]->freq - iFreq) < diff)
+  {
+    index++;
+    diff = abs(iLookup.notes[index]->freq - iFreq);
+  }
+  return (size_t)index;
+}
+
+int findNoteFrequency(const char * iName)
+{
+  if (iName == NULL)
+    return -1;
+  return findNoteFrequency(iName, strlen(iName));
+}
+
+int findNoteFrequency(const char * iName, size_t iLength)
+{
+  if (iName == NULL)
+    return -1;
+  if (iLength == SILENCE_NAME_LENGTH && memcmp(iName, SILENCE_NAME, SILENCE_NAME_LENGTH) == 0)
+    return NOTE_SILENCE;
+
+  int semitone = 0;
+  int key = getNoteKey(iName, iLength, semitone);
+  if (key < 0)
+    return -1;
+  return getNoteLookup().frequencies[key];
 }
 
 const char * getNoteName(int iFreq)
 {
   if (iFreq < 0)
     return NULL;
-  for(size_t i=0; i<gNotesDefinitionCount; i++)
-  {
-    const NOTEDEF & note = gNotesDefinition[i];
-    if (iFreq == note.freq)
-      return note.name;
-  }
+  const NOTE_LOOKUP & lookup = getNoteLookup();
+  const NOTEDEF * note = lookup.notes[findClosestNoteIndex(lookup, iFreq)];
+  if (note->freq == iFreq)
+    return note->name;
   return NULL;
 }
 
 const char * getNoteName(int iFreq, int iEpsilon)
 {
-  const char * best_name = NULL;
-  int best_frequency = -1;
-  int best_diff = -1;
-
   if (iFreq < 0)
     return NULL;
-  for(size_t i=0; i<gNotesDefinitionCount; i++)
-  {
-    const NOTEDEF & note = gNotesDefinition[i];
-    int diff = abs(note.freq - iFreq);
-    if (diff <= iEpsilon)
-    {
-      //that is a good candidate
-
-      if (best_name == NULL || best_diff > diff)
-      {
-        //that is a better candidate that previous 'best'.
-        best_name = note.name;
-        best_diff = diff;
-        best_frequency = note.freq;
-      }
-    }
-
-    //if a perfect match
-    if (iFreq == note.freq)
-      return note.name;
-  }
-  return best_name;
+  const NOTE_LOOKUP & lookup = getNoteLookup();
+  const NOTEDEF * note = lookup.notes[findClosestNoteIndex(lookup, iFreq)];
+  int diff = abs(note->freq - iFreq);
+  if (diff <= iEpsilon)
+    return note->name;
+  return NULL;
 }
 
 }; //namespace libmidi
@@ -0,0 +1,262 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#ifndef OSCILLATORS_H
+#define OSCILLATORS_H
+
+//
+// Description:
+//   Internal oscillators and sample conversions of the software synthesizer.
+//   The kernels process 4 samples at a time with SSE2 or NEON when available
+//   and fall back to scalar code otherwise. All versions use the same formulas.
+//
+
+#include "libmidi/renderer.h"
+
+#include "simd.h"
+
+#include <stdint.h>
+#include <cstddef> //for size_t
+#include <cmath>   //for fabsf(), lrintf(), pow(), fmod()
+
+namespace libmidi
+{
+
+//the phase of an oscillator is a 32 bits fixed-point fraction of a period
+static const float PHASE_TO_FLOAT = 1.0f / 2147483648.0f;
+static const float SINE_CORRECTION = 0.225f;
+
+/// <summary>Computes the phase increment per sample of a frequency.</summary>
+inline uint32_t getPhaseIncrement(double iFrequency, uint32_t iSampleRate)
+{
+  double periods = fmod(iFrequency / iSampleRate, 1.0);
+  return (uint32_t)(periods * 4294967296.0);
+}
+
+/// <summary>Get the frequency of a MIDI pitch.</summary>
+inline double getPitchFrequency(int8_t iPitch)
+{
+  //A4 is 440 Hz
+  return 440.0 * pow(2.0, (iPitch - 69) / 12.0);
+}
+
+/// <summary>Computes the value of a waveform at a given phase.</summary>
+/// <remarks>The sine is a parabolic approximation with an error below 0.1%.</remarks>
+template <MidiRenderer::WAVEFORM W>
+inline float oscillate(uint32_t iPhase)
+{
+  float saw = (float)(int32_t)iPhase * PHASE_TO_FLOAT;
+  switch(W)
+  {
+  case MidiRenderer::WAVEFORM_SQUARE:
+    return ((int32_t)iPhase < 0 ? -1.0f : 1.0f);
+  case MidiRenderer::WAVEFORM_TRIANGLE:
+    return 2.0f * fabsf(saw) - 1.0f;
+  case MidiRenderer::WAVEFORM_SINE:
+    {
+      float y = 4.0f * saw * (1.0f - fabsf(saw));
+      return SINE_CORRECTION * (y * fabsf(y) - y) + y;
+    }
+  default:
+    return saw;
+  };
+}
+
+#if defined(LIBMIDI_SSE2)
+
+template <MidiRenderer::WAVEFORM W>
+inline __m128 oscillate4(__m128i iPhase)
+{
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 signMask = _mm_set1_ps(-0.0f);
+  __m128 saw = _mm_mul_ps(_mm_cvtepi32_ps(iPhase), _mm_set1_ps(PHASE_TO_FLOAT));
+  switch(W)
+  {
+  case MidiRenderer::WAVEFORM_SQUARE:
+    return _mm_cvtepi32_ps(_mm_or_si128(_mm_srai_epi32(iPhase, 31), _mm_set1_epi32(1)));
+  case MidiRenderer::WAVEFORM_TRIANGLE:
+    return _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(2.0f), _mm_andnot_ps(signMask, saw)), one);
+  case MidiRenderer::WAVEFORM_SINE:
+    {
+      __m128 y = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(4.0f), saw), _mm_sub_ps(one, _mm_andnot_ps(signMask, saw)));
+      __m128 c = _mm_sub_ps(_mm_mul_ps(y, _mm_andnot_ps(signMask, y)), y);
+      return _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SINE_CORRECTION), c), y);
+    }
+  default:
+    return saw;
+  };
+}
+
+#elif defined(LIBMIDI_NEON)
+
+template <MidiRenderer::WAVEFORM W>
+inline float32x4_t oscillate4(uint32x4_t iPhase)
+{
+  const float32x4_t one = vdupq_n_f32(1.0f);
+  int32x4_t phase = vreinterpretq_s32_u32(iPhase);
+  float32x4_t saw = vmulq_f32(vcvtq_f32_s32(phase), vdupq_n_f32(PHASE_TO_FLOAT));
+  switch(W)
+  {
+  case MidiRenderer::WAVEFORM_SQUARE:
+    return vcvtq_f32_s32(vorrq_s32(vshrq_n_s32(phase, 31), vdupq_n_s32(1)));
+  case MidiRenderer::WAVEFORM_TRIANGLE:
+    return vsubq_f32(vmulq_f32(vdupq_n_f32(2.0f), vabsq_f32(saw)), one);
+  case MidiRenderer::WAVEFORM_SINE:
+    {
+      float32x4_t y = vmulq_f32(vmulq_f32(vdupq_n_f32(4.0f), saw), vsubq_f32(one, vabsq_f32(saw)));
+      float32x4_t c = vsubq_f32(vmulq_f32(y, vabsq_f32(y)), y);
+      return vaddq_f32(vmulq_f32(vdupq_n_f32(SINE_CORRECTION), c), y);
+    }
+  default:
+    return saw;
+  };
+}
+
+#endif
+
+/// <summary>Adds an oscillator to a mix buffer.</summary>
+/// <param name="ioMix">The mix buffer.</param>
+/// <param name="iCount">The number of samples to add.</param>
+/// <param name="iPhase">The phase of the first sample.</param>
+/// <param name="iIncrement">The phase increment between two samples.</param>
+/// <param name="iGain">The gain of the first sample.</param>
+/// <param name="iGainStep">The gain increment between two samples. The gain of sample i is iGain + i*iGainStep.</param>
+template <MidiRenderer::WAVEFORM W>
+inline void addOscillator(float * ioMix, size_t iCount, uint32_t iPhase, uint32_t iIncrement, float iGain, float iGainStep)
+{
+  size_t i = 0;
+
+#if defined(LIBMIDI_SSE2)
+  __m128i phase = _mm_setr_epi32((int)iPhase, (int)(iPhase + iIncrement), (int)(iPhase + 2*iIncrement), (int)(iPhase + 3*iIncrement));
+  const __m128i phaseStep = _mm_set1_epi32((int)(4*iIncrement));
+  __m128 index = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+  const __m128 four = _mm_set1_ps(4.0f);
+  const __m128 gain = _mm_set1_ps(iGain);
+  const __m128 gainStep = _mm_set1_ps(iGainStep);
+  for(; i + 4 <= iCount; i += 4)
+  {
+    __m128 g = _mm_add_ps(gain, _mm_mul_ps(index, gainStep));
+    __m128 mix = _mm_loadu_ps(&ioMix[i]);
+    _mm_storeu_ps(&ioMix[i], _mm_add_ps(mix, _mm_mul_ps(g, oscillate4<W>(phase))));
+    phase = _mm_add_epi32(phase, phaseStep);
+    index = _mm_add_ps(index, four);
+  }
+#elif defined(LIBMIDI_NEON)
+  const uint32_t phases[4] = {iPhase, iPhase + iIncrement, iPhase + 2*iIncrement, iPhase + 3*iIncrement};
+  const float indexes[4] = {0.0f, 1.0f, 2.0f, 3.0f};
+  uint32x4_t phase = vld1q_u32(phases);
+  const uint32x4_t phaseStep = vdupq_n_u32(4*iIncrement);
+  float32x4_t index = vld1q_f32(indexes);
+  const float32x4_t four = vdupq_n_f32(4.0f);
+  const float32x4_t gain = vdupq_n_f32(iGain);
+  const float32x4_t gainStep = vdupq_n_f32(iGainStep);
+  for(; i + 4 <= iCount; i += 4)
+  {
+    float32x4_t g = vaddq_f32(gain, vmulq_f32(index, gainStep));
+    float32x4_t mix = vld1q_f32(&ioMix[i]);
+    vst1q_f32(&ioMix[i], vaddq_f32(mix, vmulq_f32(g, oscillate4<W>(phase))));
+    phase = vaddq_u32(phase, phaseStep);
+    index = vaddq_f32(index, four);
+  }
+#endif
+
+  //remaining samples
+  uint32_t phase32 = iPhase + (uint32_t)i*iIncrement;
+  for(; i < iCount; i++)
+  {
+    float g = iGain + (float)i * iGainStep;
+    ioMix[i] += g * oscillate<W>(phase32);
+    phase32 += iIncrement;
+  }
+}
+
+/// <summary>Adds an oscillator of any waveform to a mix buffer. See addOscillator().</summary>
+inline void addOscillator(MidiRenderer::WAVEFORM iWaveform, float * ioMix, size_t iCount, uint32_t iPhase, uint32_t iIncrement, float iGain, float iGainStep)
+{
+  switch(iWaveform)
+  {
+  case MidiRenderer::WAVEFORM_SAW:
+    addOscillator<MidiRenderer::WAVEFORM_SAW>(ioMix, iCount, iPhase, iIncrement, iGain, iGainStep);
+    break;
+  case MidiRenderer::WAVEFORM_SINE:
+    addOscillator<MidiRenderer::WAVEFORM_SINE>(ioMix, iCount, iPhase, iIncrement, iGain, iGainStep);
+    break;
+  case MidiRenderer::WAVEFORM_TRIANGLE:
+    addOscillator<MidiRenderer::WAVEFORM_TRIANGLE>(ioMix, iCount, iPhase, iIncrement, iGain, iGainStep);
+    break;
+  default:
+    addOscillator<MidiRenderer::WAVEFORM_SQUARE>(ioMix, iCount, iPhase, iIncrement, iGain, iGainStep);
+    break;
+  };
+}
+
+/// <summary>Converts floating point samples to 16 bits samples.</summary>
+/// <remarks>Samples are clipped to [-1, 1] and rounded to the nearest value, half to even like lrintf().</remarks>
+inline void convertToPcm16(const float * iSamples, int16_t * oSamples, size_t iCount)
+{
+  size_t i = 0;
+
+#if defined(LIBMIDI_SSE2)
+  const __m128 scale = _mm_set1_ps(32767.0f);
+  const __m128 minValue = _mm_set1_ps(-32767.0f);
+  for(; i + 8 <= iCount; i += 8)
+  {
+    __m128 a = _mm_max_ps(minValue, _mm_min_ps(scale, _mm_mul_ps(_mm_loadu_ps(&iSamples[i]), scale)));
+    __m128 b = _mm_max_ps(minValue, _mm_min_ps(scale, _mm_mul_ps(_mm_loadu_ps(&iSamples[i+4]), scale)));
+    __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+    _mm_storeu_si128((__m128i *)&oSamples[i], packed);
+  }
+#elif defined(LIBMIDI_NEON)
+  const float32x4_t scale = vdupq_n_f32(32767.0f);
+  const float32x4_t minValue = vdupq_n_f32(-32767.0f);
+  for(; i + 4 <= iCount; i += 4)
+  {
+    float32x4_t v = vmaxq_f32(minValue, vminq_f32(scale, vmulq_f32(vld1q_f32(&iSamples[i]), scale)));
+    //round half to even like lrintf()
+#if defined(__aarch64__) || defined(_M_ARM64)
+    int32x4_t rounded = vcvtnq_s32_f32(v);
+#else
+    //adding and subtracting 1.5*2^23 drops the fraction with the rounding mode of the vector unit
+    const float32x4_t magic = vdupq_n_f32(12582912.0f);
+    int32x4_t rounded = vcvtq_s32_f32(vsubq_f32(vaddq_f32(v, magic), magic));
+#endif
+    vst1_s16(&oSamples[i], vqmovn_s32(rounded));
+  }
+#endif
+
+  //remaining samples
+  for(; i < iCount; i++)
+  {
+    float v = iSamples[i] * 32767.0f;
+    if (v > 32767.0f)
+      v = 32767.0f;
+    else if (v < -32767.0f)
+      v = -32767.0f;
+    oSamples[i] = (int16_t)lrintf(v);
+  }
+}
+
+}; //namespace libmidi
+
+#endif //OSCILLATORS_H
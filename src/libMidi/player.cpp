@@ -0,0 +1,378 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+//
+// Description:
+//   Plays many melodies at the same time at their wall-clock times.
+//
+
+#include "libmidi/player.h"
+
+#include "midiformat.h"
+#include "histogram.h"
+
+#include <algorithm> //for std::push_heap(), std::pop_heap(), std::stable_sort()
+#include <chrono>
+
+namespace libmidi
+{
+
+//the scheduler spins instead of sleeping when the next deadline is closer than this
+static const uint64_t SPIN_NS = 200000;
+
+struct MidiPlayer::SESSION
+{
+  std::vector<EVENT> events;
+  size_t next; //index of the next event to deliver
+  EVENT_FUNCTION function;
+  void * userData;
+  uint64_t startNs; //0 if the session is not started
+  Histogram lateness; //in microseconds
+};
+
+//orders the heap by the earliest deadline
+struct DEADLINE_GREATER
+{
+  template <typename T>
+  inline bool operator()(const T & a, const T & b) const
+  {
+    if (a.timeNs != b.timeNs)
+      return a.timeNs > b.timeNs;
+    return a.session > b.session;
+  }
+};
+
+//an event of any track
+struct TIMED_EVENT
+{
+  uint64_t ticks; //absolute time of the event
+  MidiPlayer::EVENT event;
+};
+
+MidiPlayer::MidiPlayer()
+{
+  mStarted = false;
+  mStopping = false;
+}
+
+MidiPlayer::~MidiPlayer()
+{
+  clear();
+}
+
+bool MidiPlayer::getEvents(const MidiFile & iFile, std::vector<EVENT> & oEvents)
+{
+  oEvents.clear();
+  std::vector<uint8_t> buffer;
+  if (!iFile.saveToBuffer(buffer) || buffer.size() < MIDI_HEADER_SIZE)
+    return false;
+
+  //read the channel events of all tracks
+  std::vector<TIMED_EVENT> events;
+  size_t offset = CHUNK_HEADER_SIZE + readBigEndian32(&buffer[4]);
+  while(offset <= buffer.size() && buffer.size() - offset >= CHUNK_HEADER_SIZE)
+  {
+    HEADER_ID id = readBigEndian32(&buffer[offset]);
+    uint32_t length = readBigEndian32(&buffer[offset+4]);
+    offset += CHUNK_HEADER_SIZE;
+    if (length > buffer.size() - offset)
+      return false;
+
+    if (id == MIDI_TRACK_HEADER_ID)
+    {
+      TrackReader reader(&buffer[offset], length);
+      TRACK_EVENT e;
+      uint64_t ticks = 0;
+      while(reader.readEvent(e))
+      {
+        ticks += e.ticks;
+        if (e.status >= EVENT_SYSEX)
+          continue;
+        TIMED_EVENT t;
+        t.ticks = ticks;
+        t.event.timeUs = 0;
+        t.event.status = e.status;
+        t.event.data1 = e.data1;
+        t.event.data2 = e.data2;
+        events.push_back(t);
+      }
+      if (reader.hasError())
+        return false;
+    }
+    offset += length;
+  }
+
+  //merge the tracks. Events at the same time keep the order of the tracks.
+  std::stable_sort(events.begin(), events.end(), [](const TIMED_EVENT & a, const TIMED_EVENT & b)
+  {
+    return a.ticks < b.ticks;
+  });
+
+  oEvents.reserve(events.size());
+  for(size_t i=0; i<events.size(); i++)
+  {
+    EVENT e = events[i].event;
+    e.timeUs = iFile.ticks2time(events[i].ticks);
+    oEvents.push_back(e);
+  }
+  return true;
+}
+
+size_t MidiPlayer::addSession(const MidiFile & iFile, EVENT_FUNCTION iFunction, void * iUserData)
+{
+  SESSION * s = new SESSION();
+  if (!getEvents(iFile, s->events))
+  {
+    delete s;
+    return INVALID_SESSION;
+  }
+  s->next = 0;
+  s->function = iFunction;
+  s->userData = iUserData;
+  s->startNs = 0;
+
+  std::lock_guard<std::mutex> guard(mLock);
+  mSessions.push_back(s);
+  size_t index = mSessions.size() - 1;
+  if (mStarted)
+  {
+    s->startNs = now();
+    schedule(index);
+    mChanged.notify_all();
+  }
+  return index;
+}
+
+void MidiPlayer::clear()
+{
+  stop();
+
+  std::lock_guard<std::mutex> guard(mLock);
+  for(size_t i=0; i<mSessions.size(); i++)
+  {
+    delete mSessions[i];
+  }
+  mSessions.clear();
+}
+
+bool MidiPlayer::start()
+{
+  std::lock_guard<std::mutex> guard(mLock);
+  if (mStarted)
+    return false;
+
+  mStarted = true;
+  mStopping = false;
+  uint64_t startNs = now();
+  for(size_t i=0; i<mSessions.size(); i++)
+  {
+    if (mSessions[i]->startNs == 0)
+    {
+      mSessions[i]->startNs = startNs;
+      schedule(i);
+    }
+  }
+  mThread = std::thread(&MidiPlayer::run, this);
+  return true;
+}
+
+void MidiPlayer::stop()
+{
+  {
+    std::lock_guard<std::mutex> guard(mLock);
+    if (!mStarted)
+      return;
+    mStopping = true;
+    mChanged.notify_all();
+  }
+  mThread.join();
+
+  //discard the events not delivered
+  std::lock_guard<std::mutex> guard(mLock);
+  mStarted = false;
+  mDeadlines.clear();
+  for(size_t i=0; i<mSessions.size(); i++)
+  {
+    SESSION & s = *mSessions[i];
+    if (s.startNs)
+      s.next = s.events.size();
+  }
+  mChanged.notify_all();
+}
+
+bool MidiPlayer::isStarted() const
+{
+  std::lock_guard<std::mutex> guard(mLock);
+  return mStarted;
+}
+
+bool MidiPlayer::wait(uint32_t iTimeoutMs)
+{
+  std::unique_lock<std::mutex> lock(mLock);
+  return mChanged.wait_for(lock, std::chrono::milliseconds(iTimeoutMs), [this]()
+  {
+    if (!mStarted)
+      return true;
+    for(size_t i=0; i<mSessions.size(); i++)
+    {
+      if (mSessions[i]->next < mSessions[i]->events.size())
+        return false;
+    }
+    return true;
+  }) && mStarted;
+}
+
+size_t MidiPlayer::getSessionCount() const
+{
+  std::lock_guard<std::mutex> guard(mLock);
+  return mSessions.size();
+}
+
+MidiPlayer::STATISTICS MidiPlayer::getStatistics() const
+{
+  std::lock_guard<std::mutex> guard(mLock);
+  Histogram lateness;
+  size_t numActiveSessions = 0;
+  for(size_t i=0; i<mSessions.size(); i++)
+  {
+    const SESSION & s = *mSessions[i];
+    lateness.merge(s.lateness);
+    if (s.next < s.events.size())
+      numActiveSessions++;
+  }
+
+  STATISTICS stats;
+  stats.numSessions = mSessions.size();
+  stats.numActiveSessions = numActiveSessions;
+  stats.numEvents = lateness.getCount();
+  stats.p50LatenessUs = lateness.getPercentile(50.0);
+  stats.p99LatenessUs = lateness.getPercentile(99.0);
+  stats.maxLatenessUs = lateness.getMax();
+  stats.averageLatenessUs = lateness.getAverage();
+  return stats;
+}
+
+MidiPlayer::STATISTICS MidiPlayer::getSessionStatistics(size_t iSession) const
+{
+  STATISTICS stats = {0};
+
+  std::lock_guard<std::mutex> guard(mLock);
+  if (iSession >= mSessions.size())
+    return stats;
+
+  const SESSION & s = *mSessions[iSession];
+  stats.numSessions = 1;
+  stats.numActiveSessions = (s.next < s.events.size() ? 1 : 0);
+  stats.numEvents = s.lateness.getCount();
+  stats.p50LatenessUs = s.lateness.getPercentile(50.0);
+  stats.p99LatenessUs = s.lateness.getPercentile(99.0);
+  stats.maxLatenessUs = s.lateness.getMax();
+  stats.averageLatenessUs = s.lateness.getAverage();
+  return stats;
+}
+
+void MidiPlayer::schedule(size_t iSession)
+{
+  const SESSION & s = *mSessions[iSession];
+  if (s.next >= s.events.size())
+    return;
+
+  DEADLINE d;
+  d.timeNs = s.startNs + s.events[s.next].timeUs * 1000;
+  d.session = iSession;
+  mDeadlines.push_back(d);
+  std::push_heap(mDeadlines.begin(), mDeadlines.end(), DEADLINE_GREATER());
+}
+
+uint64_t MidiPlayer::now() const
+{
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void MidiPlayer::run()
+{
+  std::vector<uint64_t> lateness; //of the events delivered at once, in microseconds
+
+  std::unique_lock<std::mutex> lock(mLock);
+  while(!mStopping)
+  {
+    if (mDeadlines.empty())
+    {
+      mChanged.wait(lock);
+      continue;
+    }
+
+    //sleep until the earliest deadline. A new session may have an earlier deadline.
+    uint64_t deadline = mDeadlines.front().timeNs;
+    uint64_t time = now();
+    if (time + SPIN_NS < deadline)
+    {
+      std::chrono::steady_clock::time_point wakeup(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(deadline - SPIN_NS)));
+      mChanged.wait_until(lock, wakeup);
+      continue;
+    }
+    if (time < deadline)
+    {
+      //sleeping is not precise enough for the last microseconds
+      lock.unlock();
+      while(now() < deadline)
+        std::this_thread::yield();
+      lock.lock();
+      continue;
+    }
+
+    std::pop_heap(mDeadlines.begin(), mDeadlines.end(), DEADLINE_GREATER());
+    size_t index = mDeadlines.back().session;
+    mDeadlines.pop_back();
+    SESSION & s = *mSessions[index];
+    size_t next = s.next;
+    lock.unlock();
+
+    //deliver all the events of the session that are due
+    lateness.clear();
+    const std::vector<EVENT> & events = s.events;
+    while(next < events.size())
+    {
+      uint64_t eventNs = s.startNs + events[next].timeUs * 1000;
+      time = now();
+      if (eventNs > time)
+        break;
+      lateness.push_back((time - eventNs) / 1000);
+      if (s.function)
+        s.function(index, events[next], s.userData);
+      next++;
+    }
+
+    lock.lock();
+    for(size_t i=0; i<lateness.size(); i++)
+    {
+      s.lateness.add(lateness[i]);
+    }
+    s.next = next;
+    schedule(index);
+    mChanged.notify_all();
+  }
+}
+
+}; //namespace libmidi
@@ -0,0 +1,511 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+//
+// Description:
+//   Renders notes in real time for an audio callback.
+//
+
+#include "libmidi/realtimerenderer.h"
+
+#include "midiformat.h"
+#include "oscillators.h"
+
+#include <algorithm> //for std::stable_sort(), std::fill(), std::push_heap(), std::pop_heap()
+#include <chrono>
+
+namespace libmidi
+{
+
+static const size_t BLOCK_SIZE = 256; //samples rendered at once
+
+MidiRealtimeRenderer::MidiRealtimeRenderer(size_t iBufferSize, size_t iQueueSize) :
+  mLiveEvents(iQueueSize),
+  mEvents(iQueueSize),
+  mSamples(iBufferSize < 2*BLOCK_SIZE ? 2*BLOCK_SIZE : iBufferSize)
+{
+  mSampleRate = MidiRenderer::DEFAULT_SAMPLE_RATE;
+  mWaveform = MidiRenderer::WAVEFORM_SQUARE;
+  mGain = 0.25f;
+  mAttackUs = 0;
+  mReleaseUs = 0;
+  mRunning.store(false);
+  mPosition.store(0);
+  mVoices.resize(MAX_VOICES);
+  mBlock.resize(BLOCK_SIZE);
+  mScheduled.reserve(mEvents.getCapacity());
+  mNextMelody = 0;
+  mNextOrder = 0;
+  mNextAge = 0;
+  mNumCallbacks.store(0);
+  mNumUnderruns.store(0);
+  mNumMissingSamples.store(0);
+  mNumDroppedEvents.store(0);
+  mWorstCallbackNs.store(0);
+  mTotalCallbackNs.store(0);
+}
+
+MidiRealtimeRenderer::~MidiRealtimeRenderer()
+{
+  stop();
+}
+
+void MidiRealtimeRenderer::setSampleRate(uint32_t iSampleRate)
+{
+  if (iSampleRate)
+    mSampleRate = iSampleRate;
+}
+
+void MidiRealtimeRenderer::setWaveform(MidiRenderer::WAVEFORM iWaveform)
+{
+  mWaveform = iWaveform;
+}
+
+void MidiRealtimeRenderer::setGain(float iGain)
+{
+  mGain = iGain;
+}
+
+void MidiRealtimeRenderer::setEnvelope(uint32_t iAttackUs, uint32_t iReleaseUs)
+{
+  mAttackUs = iAttackUs;
+  mReleaseUs = iReleaseUs;
+}
+
+uint32_t MidiRealtimeRenderer::getSampleRate() const
+{
+  return mSampleRate;
+}
+
+bool MidiRealtimeRenderer::start()
+{
+  if (isRunning())
+    return false;
+
+  for(size_t i=0; i<mVoices.size(); i++)
+  {
+    mVoices[i].active = false;
+  }
+  mNumCallbacks.store(0);
+  mNumUnderruns.store(0);
+  mNumMissingSamples.store(0);
+  mNumDroppedEvents.store(0);
+  mWorstCallbackNs.store(0);
+  mTotalCallbackNs.store(0);
+
+  mRunning.store(true);
+  mThread = std::thread(&MidiRealtimeRenderer::run, this);
+
+  //wait for the ring buffer to be filled
+  while(mSamples.getCapacity() - mSamples.getSize() >= BLOCK_SIZE)
+  {
+    std::this_thread::yield();
+  }
+
+  return true;
+}
+
+void MidiRealtimeRenderer::stop()
+{
+  if (!isRunning())
+    return;
+
+  mRunning.store(false);
+  mThread.join();
+
+  //discard the pending events. The render thread is stopped so this thread can consume the queues.
+  EVENT e;
+  while(mLiveEvents.pop(e))
+  {
+  }
+  while(mEvents.pop(e))
+  {
+  }
+  mScheduled.clear();
+}
+
+bool MidiRealtimeRenderer::isRunning() const
+{
+  return mRunning.load();
+}
+
+bool MidiRealtimeRenderer::send(const EVENT & iEvent)
+{
+  if (mLiveEvents.push(iEvent))
+    return true;
+  mNumDroppedEvents.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+bool MidiRealtimeRenderer::noteOn(int8_t iPitch, int8_t iVelocity, uint8_t iChannel)
+{
+  EVENT e;
+  e.sample = 0;
+  e.increment = getPhaseIncrement(getPitchFrequency(iPitch), mSampleRate);
+  e.gain = mGain * iVelocity / MAX_VOLUME;
+  e.type = EVENT_NOTE_ON;
+  e.channel = iChannel;
+  e.pitch = iPitch;
+  e.waveform = (uint8_t)(mWaveform == MidiRenderer::WAVEFORM_INSTRUMENT ? MidiRenderer::WAVEFORM_SQUARE : mWaveform);
+  e.tag = 0;
+  return send(e);
+}
+
+bool MidiRealtimeRenderer::noteOff(int8_t iPitch, uint8_t iChannel)
+{
+  EVENT e = {0};
+  e.type = EVENT_NOTE_OFF;
+  e.channel = iChannel;
+  e.pitch = iPitch;
+  return send(e);
+}
+
+bool MidiRealtimeRenderer::allNotesOff()
+{
+  EVENT e = {0};
+  e.type = EVENT_ALL_NOTES_OFF;
+  return send(e);
+}
+
+bool MidiRealtimeRenderer::play(const MidiFile & iFile)
+{
+  if (!isRunning())
+    return false;
+
+  MidiRenderer::WAVEFORM waveform = mWaveform;
+  if (waveform == MidiRenderer::WAVEFORM_INSTRUMENT)
+    waveform = MidiRenderer::getInstrumentWaveform(iFile.getInstrument());
+
+  //build the events of the notes relative to the beginning of the melody
+  std::vector<EVENT> events;
+  const MidiFile::NoteList & notes = iFile.mNotes;
+  const MidiFile::TimedNoteList & timedNotes = iFile.mTimedNotes;
+  events.reserve(2*(notes.size() + timedNotes.size()));
+
+  EVENT on = {0};
+  on.type = EVENT_NOTE_ON;
+  on.waveform = (uint8_t)waveform;
+  EVENT off = {0};
+  off.type = EVENT_NOTE_OFF;
+
+  //the note off events of a melody only stop the notes of the melody.
+  //Tags are never 0 which is reserved for the live notes.
+  mNextMelody++;
+  if (mNextMelody == 0)
+    mNextMelody++;
+  const uint64_t melodyTag = (uint64_t)mNextMelody << 32;
+
+  uint64_t timeUs = 0;
+  for(size_t i=0; i<notes.size(); i++)
+  {
+    on.sample = time2sample(timeUs);
+    timeUs += notes.durations[i];
+    off.sample = time2sample(timeUs);
+    if (notes.frequencies[i] == 0 || off.sample == on.sample)
+      continue;
+
+    on.increment = getPhaseIncrement(notes.frequencies[i], mSampleRate);
+    on.gain = mGain * notes.volumes[i] / MAX_VOLUME;
+    on.pitch = off.pitch = notes.pitches[i];
+    on.channel = off.channel = 0;
+    on.tag = off.tag = melodyTag | i;
+    events.push_back(on);
+    events.push_back(off);
+  }
+  for(size_t i=0; i<timedNotes.size(); i++)
+  {
+    const MidiFile::TIMED_NOTE & n = timedNotes[i];
+    on.sample = time2sample(iFile.ticks2time(n.startTicks));
+    off.sample = time2sample(iFile.ticks2time((uint64_t)n.startTicks + n.durationTicks));
+    if (off.sample == on.sample)
+      continue;
+
+    on.increment = getPhaseIncrement(getPitchFrequency(n.pitch), mSampleRate);
+    on.gain = mGain * n.velocity / MAX_VOLUME;
+    on.pitch = off.pitch = n.pitch;
+    on.channel = off.channel = n.channel;
+    on.tag = off.tag = melodyTag | (notes.size() + i);
+    events.push_back(on);
+    events.push_back(off);
+  }
+
+  //notes are stopped before the notes starting at the same sample
+  std::stable_sort(events.begin(), events.end(), [](const EVENT & a, const EVENT & b)
+  {
+    if (a.sample != b.sample)
+      return a.sample < b.sample;
+    return a.type == EVENT_NOTE_OFF && b.type != EVENT_NOTE_OFF;
+  });
+
+  //start from the next rendered sample
+  uint64_t start = mPosition.load();
+  for(size_t i=0; i<events.size(); i++)
+  {
+    EVENT & e = events[i];
+    e.sample += start;
+    while(!mEvents.push(e))
+    {
+      if (!isRunning())
+        return false;
+      std::this_thread::yield();
+    }
+  }
+  return true;
+}
+
+size_t MidiRealtimeRenderer::read(float * oSamples, size_t iCount)
+{
+  std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+  size_t count = mSamples.read(oSamples, iCount);
+  if (count < iCount)
+  {
+    std::fill(oSamples + count, oSamples + iCount, 0.0f);
+    mNumUnderruns.fetch_add(1, std::memory_order_relaxed);
+    mNumMissingSamples.fetch_add(iCount - count, std::memory_order_relaxed);
+  }
+
+  uint64_t elapsedNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+  mNumCallbacks.fetch_add(1, std::memory_order_relaxed);
+  mTotalCallbackNs.fetch_add(elapsedNs, std::memory_order_relaxed);
+  if (elapsedNs > mWorstCallbackNs.load(std::memory_order_relaxed))
+    mWorstCallbackNs.store(elapsedNs, std::memory_order_relaxed);
+
+  return count;
+}
+
+size_t MidiRealtimeRenderer::getAvailableSamples() const
+{
+  return mSamples.getSize();
+}
+
+MidiRealtimeRenderer::STATISTICS MidiRealtimeRenderer::getStatistics() const
+{
+  STATISTICS s;
+  s.numCallbacks = mNumCallbacks.load();
+  s.numUnderruns = mNumUnderruns.load();
+  s.numMissingSamples = mNumMissingSamples.load();
+  s.numDroppedEvents = mNumDroppedEvents.load();
+  s.worstCallbackSeconds = mWorstCallbackNs.load() / 1e9;
+  s.averageCallbackSeconds = (s.numCallbacks ? mTotalCallbackNs.load() / 1e9 / s.numCallbacks : 0.0);
+  return s;
+}
+
+void MidiRealtimeRenderer::run()
+{
+  //wait a quarter of a block when the ring buffer is full
+  std::chrono::microseconds idle((uint64_t)BLOCK_SIZE * 1000000 / mSampleRate / 4);
+
+  while(mRunning.load())
+  {
+    if (mSamples.getCapacity() - mSamples.getSize() < BLOCK_SIZE)
+    {
+      std::this_thread::sleep_for(idle);
+      continue;
+    }
+
+    renderBlock(&mBlock[0], BLOCK_SIZE);
+    mSamples.write(&mBlock[0], BLOCK_SIZE);
+  }
+
+  //stop the playing notes
+  for(size_t i=0; i<mVoices.size(); i++)
+  {
+    mVoices[i].active = false;
+  }
+}
+
+void MidiRealtimeRenderer::renderBlock(float * oSamples, size_t iCount)
+{
+  std::fill(oSamples, oSamples + iCount, 0.0f);
+
+  //live events do not wait for the events of the melodies
+  EVENT live;
+  while(mLiveEvents.pop(live))
+  {
+    apply(live);
+  }
+
+  schedule();
+
+  uint64_t position = mPosition.load(std::memory_order_relaxed);
+  size_t offset = 0;
+  while(offset < iCount)
+  {
+    //apply the events of the current sample
+    while(!mScheduled.empty() && mScheduled.front().sample <= position + offset)
+    {
+      apply(mScheduled.front());
+      std::pop_heap(mScheduled.begin(), mScheduled.end(), EVENT_LATER());
+      mScheduled.pop_back();
+    }
+
+    //render up to the next event
+    size_t count = iCount - offset;
+    if (!mScheduled.empty() && mScheduled.front().sample < position + iCount)
+      count = (size_t)(mScheduled.front().sample - position - offset);
+    renderVoices(&oSamples[offset], count);
+    offset += count;
+  }
+
+  mPosition.store(position + iCount, std::memory_order_release);
+}
+
+void MidiRealtimeRenderer::schedule()
+{
+  //move the events of the melodies to the heap so that a melody does not wait for the end of the previous one.
+  //the heap is reserved by the constructor and never grows beyond the capacity of the queue.
+  EVENT e;
+  while(mScheduled.size() < mScheduled.capacity() && mEvents.pop(e))
+  {
+    e.order = mNextOrder++;
+    mScheduled.push_back(e);
+    std::push_heap(mScheduled.begin(), mScheduled.end(), EVENT_LATER());
+  }
+}
+
+void MidiRealtimeRenderer::apply(const EVENT & iEvent)
+{
+  switch(iEvent.type)
+  {
+  case EVENT_NOTE_ON:
+    {
+      //use a free voice or steal the oldest one
+      VOICE * voice = &mVoices[0];
+      for(size_t i=0; i<mVoices.size(); i++)
+      {
+        if (!mVoices[i].active)
+        {
+          voice = &mVoices[i];
+          break;
+        }
+        if (mVoices[i].age < voice->age)
+          voice = &mVoices[i];
+      }
+
+      VOICE & v = *voice;
+      v.active = true;
+      v.releasing = false;
+      v.channel = iEvent.channel;
+      v.pitch = iEvent.pitch;
+      v.tag = iEvent.tag;
+      v.waveform = (MidiRenderer::WAVEFORM)iEvent.waveform;
+      v.phase = 0;
+      v.increment = iEvent.increment;
+      v.sustainGain = iEvent.gain;
+      v.age = mNextAge++;
+      v.rampSamples = (uint32_t)time2sample(mAttackUs);
+      if (v.rampSamples)
+      {
+        v.gain = 0.0f;
+        v.gainStep = v.sustainGain / v.rampSamples;
+      }
+      else
+      {
+        v.gain = v.sustainGain;
+        v.gainStep = 0.0f;
+      }
+    }
+    break;
+  case EVENT_NOTE_OFF:
+    {
+      //stop the note of the melody with the same tag or the oldest matching live note.
+      //A stolen voice has the tag of its new note.
+      VOICE * voice = NULL;
+      for(size_t i=0; i<mVoices.size(); i++)
+      {
+        VOICE & v = mVoices[i];
+        if (!v.active || v.releasing || v.tag != iEvent.tag)
+          continue;
+        if (iEvent.tag != 0)
+        {
+          voice = &v;
+          break;
+        }
+        if (v.channel == iEvent.channel && v.pitch == iEvent.pitch && (voice == NULL || v.age < voice->age))
+          voice = &v;
+      }
+      if (voice)
+        releaseVoice(*voice);
+    }
+    break;
+  case EVENT_ALL_NOTES_OFF:
+    for(size_t i=0; i<mVoices.size(); i++)
+    {
+      if (mVoices[i].active && !mVoices[i].releasing)
+        releaseVoice(mVoices[i]);
+    }
+    break;
+  };
+}
+
+void MidiRealtimeRenderer::releaseVoice(VOICE & iVoice)
+{
+  iVoice.releasing = true;
+  iVoice.rampSamples = (uint32_t)time2sample(mReleaseUs);
+  if (iVoice.rampSamples == 0)
+    iVoice.active = false;
+  else
+    iVoice.gainStep = -iVoice.gain / iVoice.rampSamples;
+}
+
+void MidiRealtimeRenderer::renderVoices(float * ioSamples, size_t iCount)
+{
+  for(size_t i=0; i<mVoices.size(); i++)
+  {
+    VOICE & v = mVoices[i];
+    size_t offset = 0;
+    while(v.active && offset < iCount)
+    {
+      //render up to the end of the fade in or fade out
+      size_t count = iCount - offset;
+      if (v.rampSamples && v.rampSamples < count)
+        count = v.rampSamples;
+
+      addOscillator(v.waveform, &ioSamples[offset], count, v.phase, v.increment, v.gain, v.gainStep);
+      v.phase += (uint32_t)(count * (uint64_t)v.increment);
+      v.gain += v.gainStep * count;
+      offset += count;
+
+      if (v.rampSamples)
+      {
+        v.rampSamples -= (uint32_t)count;
+        if (v.rampSamples == 0)
+        {
+          if (v.releasing)
+            v.active = false;
+          v.gain = v.sustainGain;
+          v.gainStep = 0.0f;
+        }
+      }
+    }
+  }
+}
+
+uint64_t MidiRealtimeRenderer::time2sample(uint64_t iTimeUs) const
+{
+  return iTimeUs * mSampleRate / 1000000;
+}
+
+}; //namespace libmidi
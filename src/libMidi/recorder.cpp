@@ -0,0 +1,325 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+//
+// Description:
+//   Records live notes to a melody.
+//
+
+#include "libmidi/recorder.h"
+
+#include "midiformat.h"
+
+#include <algorithm> //for std::stable_sort()
+#include <chrono>
+
+namespace libmidi
+{
+
+static const uint32_t DRAIN_INTERVAL_MS = 5;
+static const uint64_t REORDER_WINDOW_US = 10000; //events older than this are added to the output
+static const size_t NUM_CHANNELS = 16;
+static const size_t NUM_PITCHES = 128;
+static const size_t NO_NOTE = (size_t)-1;
+static const uint64_t MAX_DURATION_US = 0xFFFFFFFF;
+
+static uint64_t getClockNs()
+{
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+MidiRecorder::MidiRecorder(size_t iNumInputs, size_t iQueueSize)
+{
+  if (iNumInputs == 0)
+    iNumInputs = 1;
+  for(size_t i=0; i<iNumInputs; i++)
+  {
+    mInputs.push_back(new RingBuffer<EVENT>(iQueueSize));
+  }
+  mRecording.store(false);
+  mStartNs = 0;
+  mNumEvents.store(0);
+  mNumDroppedEvents.store(0);
+  mStopping.store(false);
+  mPlayingNotes.resize(NUM_CHANNELS*NUM_PITCHES);
+  mFile = NULL;
+  mWriter = NULL;
+  mWriterTimeUs = 0;
+  mWriterNote = NO_NOTE;
+  mWriterFailed = false;
+  mNumNotes.store(0);
+}
+
+MidiRecorder::~MidiRecorder()
+{
+  stop();
+  for(size_t i=0; i<mInputs.size(); i++)
+  {
+    delete mInputs[i];
+  }
+}
+
+bool MidiRecorder::start(MidiFile & ioFile)
+{
+  return start(&ioFile, NULL);
+}
+
+bool MidiRecorder::start(MidiStreamWriter & ioWriter)
+{
+  if (!ioWriter.isOpened())
+    return false;
+  return start(NULL, &ioWriter);
+}
+
+bool MidiRecorder::start(MidiFile * iFile, MidiStreamWriter * iWriter)
+{
+  if (isRecording())
+    return false;
+
+  //discard the events captured after the end of the previous recording
+  EVENT e;
+  for(size_t i=0; i<mInputs.size(); i++)
+  {
+    while(mInputs[i]->pop(e))
+    {
+    }
+  }
+
+  mFile = iFile;
+  mWriter = iWriter;
+  mWriterTimeUs = 0;
+  mWriterNote = NO_NOTE;
+  mWriterFailed = false;
+  mPending.clear();
+  for(size_t i=0; i<mPlayingNotes.size(); i++)
+  {
+    mPlayingNotes[i].playing = false;
+  }
+  mNumEvents.store(0);
+  mNumDroppedEvents.store(0);
+  mNumNotes.store(0);
+
+  mStartNs = getClockNs();
+  mStopping.store(false);
+  mRecording.store(true, std::memory_order_release);
+  mThread = std::thread(&MidiRecorder::run, this);
+  return true;
+}
+
+bool MidiRecorder::stop()
+{
+  if (!isRecording())
+    return false;
+
+  uint64_t endUs = getTimeUs();
+  mRecording.store(false);
+  mStopping.store(true);
+  mThread.join();
+
+  //the drain thread is stopped, this thread consumes the remaining events
+  drain((uint64_t)-1);
+  for(size_t i=0; i<mPlayingNotes.size(); i++)
+  {
+    if (mPlayingNotes[i].playing)
+      stopNote(i, (endUs > mPlayingNotes[i].startUs ? endUs : mPlayingNotes[i].startUs));
+  }
+
+  mFile = NULL;
+  mWriter = NULL;
+  return !mWriterFailed;
+}
+
+bool MidiRecorder::isRecording() const
+{
+  return mRecording.load();
+}
+
+bool MidiRecorder::noteOn(int8_t iPitch, int8_t iVelocity, uint8_t iChannel, size_t iInput)
+{
+  if (iVelocity < 0)
+    return false;
+
+  EVENT e;
+  e.noteOn = true;
+  e.channel = iChannel;
+  e.pitch = iPitch;
+  e.velocity = iVelocity;
+  return capture(e, iInput);
+}
+
+bool MidiRecorder::noteOff(int8_t iPitch, uint8_t iChannel, size_t iInput)
+{
+  EVENT e;
+  e.noteOn = false;
+  e.channel = iChannel;
+  e.pitch = iPitch;
+  e.velocity = 0;
+  return capture(e, iInput);
+}
+
+bool MidiRecorder::capture(const EVENT & iEvent, size_t iInput)
+{
+  if (!mRecording.load(std::memory_order_acquire) || iInput >= mInputs.size() || iEvent.pitch < 0 || iEvent.channel >= NUM_CHANNELS)
+    return false;
+
+  EVENT e = iEvent;
+  e.timeUs = getTimeUs();
+  if (!mInputs[iInput]->push(e))
+  {
+    mNumDroppedEvents.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  mNumEvents.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+size_t MidiRecorder::getInputCount() const
+{
+  return mInputs.size();
+}
+
+MidiRecorder::STATISTICS MidiRecorder::getStatistics() const
+{
+  STATISTICS s;
+  s.numEvents = mNumEvents.load();
+  s.numDroppedEvents = mNumDroppedEvents.load();
+  s.numNotes = mNumNotes.load();
+  return s;
+}
+
+uint64_t MidiRecorder::getTimeUs() const
+{
+  return (getClockNs() - mStartNs) / 1000;
+}
+
+void MidiRecorder::run()
+{
+  while(!mStopping.load())
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(DRAIN_INTERVAL_MS));
+    uint64_t timeUs = getTimeUs();
+    if (timeUs > REORDER_WINDOW_US)
+      drain(timeUs - REORDER_WINDOW_US);
+  }
+}
+
+void MidiRecorder::drain(uint64_t iHorizonUs)
+{
+  //read the events of all inputs. The events of each input are already ordered by time.
+  size_t numPending = mPending.size();
+  EVENT e;
+  for(size_t i=0; i<mInputs.size(); i++)
+  {
+    while(mInputs[i]->pop(e))
+      mPending.push_back(e);
+  }
+  if (mPending.size() > numPending)
+  {
+    std::stable_sort(mPending.begin(), mPending.end(), [](const EVENT & a, const EVENT & b)
+    {
+      return a.timeUs < b.timeUs;
+    });
+  }
+
+  //add the events older than the horizon to the output
+  size_t count = 0;
+  while(count < mPending.size() && mPending[count].timeUs <= iHorizonUs)
+  {
+    write(mPending[count]);
+    count++;
+  }
+  mPending.erase(mPending.begin(), mPending.begin() + count);
+}
+
+void MidiRecorder::write(const EVENT & iEvent)
+{
+  size_t index = iEvent.channel*NUM_PITCHES + iEvent.pitch;
+  PLAYING_NOTE & n = mPlayingNotes[index];
+
+  if (!iEvent.noteOn)
+  {
+    if (n.playing)
+      stopNote(index, iEvent.timeUs);
+    return;
+  }
+
+  //a stream writer plays one note at a time
+  if (mWriter && mWriterNote != NO_NOTE)
+    stopNote(mWriterNote, iEvent.timeUs);
+  else if (n.playing)
+    stopNote(index, iEvent.timeUs);
+  if (mWriter)
+  {
+    writeDelay(iEvent.timeUs);
+    mWriterNote = index;
+  }
+
+  n.playing = true;
+  n.velocity = iEvent.velocity;
+  n.startUs = iEvent.timeUs;
+}
+
+void MidiRecorder::stopNote(size_t iIndex, uint64_t iEndUs)
+{
+  PLAYING_NOTE & n = mPlayingNotes[iIndex];
+  n.playing = false;
+  uint8_t channel = (uint8_t)(iIndex / NUM_PITCHES);
+  int8_t pitch = (int8_t)(iIndex % NUM_PITCHES);
+
+  if (mFile)
+  {
+    uint64_t startTicks = mFile->time2ticks(n.startUs);
+    uint64_t endTicks = mFile->time2ticks(iEndUs);
+    mFile->addNoteAt((uint32_t)startTicks, (uint32_t)(endTicks - startTicks), pitch, n.velocity, channel);
+  }
+  else if (mWriter)
+  {
+    //events captured out of the reorder window are played immediately
+    uint64_t durationUs = (iEndUs > mWriterTimeUs ? iEndUs - mWriterTimeUs : 0);
+    if (durationUs > MAX_DURATION_US)
+      durationUs = MAX_DURATION_US;
+    uint16_t frequency = getFrequencyFromMidiPitch(pitch);
+    mWriter->setVolume(n.velocity);
+    if (!(frequency ? mWriter->addNoteUs(frequency, (uint32_t)durationUs) : mWriter->addDelayUs((uint32_t)durationUs)))
+      mWriterFailed = true;
+    mWriterTimeUs += durationUs;
+    mWriterNote = NO_NOTE;
+  }
+  mNumNotes.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MidiRecorder::writeDelay(uint64_t iEndUs)
+{
+  while(mWriterTimeUs < iEndUs)
+  {
+    uint64_t durationUs = iEndUs - mWriterTimeUs;
+    if (durationUs > MAX_DURATION_US)
+      durationUs = MAX_DURATION_US;
+    if (!mWriter->addDelayUs((uint32_t)durationUs))
+      mWriterFailed = true;
+    mWriterTimeUs += durationUs;
+  }
+}
+
+}; //namespace libmidi
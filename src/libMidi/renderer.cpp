@@ -0,0 +1,490 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+//
+// Description:
+//   Software synthesizer that renders melodies to PCM samples.
+//
+
+#include "libmidi/renderer.h"
+#include "libmidi/sinks.h"
+
+#include "midiformat.h"
+#include "oscillators.h"
+
+#include <algorithm> //for std::stable_sort(), std::fill(), std::lower_bound()
+#include <cstring>   //for memcpy()
+#include <thread>
+#include <atomic>
+
+namespace libmidi
+{
+
+static const size_t BLOCK_SIZE = 1024; //samples rendered at once
+static const size_t CHUNK_SIZE = 16*BLOCK_SIZE; //samples converted and written at once
+static const size_t MIN_SEGMENT_SIZE = CHUNK_SIZE; //samples rendered by a thread at once
+static const size_t SEGMENTS_PER_THREAD = 4;
+static const size_t WAV_HEADER_SIZE = 44;
+static const uint32_t MAX_WAV_DATA_SIZE = 0xFFFFFFFF - (WAV_HEADER_SIZE - 8);
+
+inline void writeLittleEndian16(uint8_t * oBuffer, uint16_t iValue)
+{
+  oBuffer[0] = (uint8_t)(iValue);
+  oBuffer[1] = (uint8_t)(iValue >> 8);
+}
+
+inline void writeLittleEndian32(uint8_t * oBuffer, uint32_t iValue)
+{
+  writeLittleEndian16(&oBuffer[0], (uint16_t)(iValue));
+  writeLittleEndian16(&oBuffer[2], (uint16_t)(iValue >> 16));
+}
+
+MidiRenderer::MidiRenderer()
+{
+  mSampleRate = DEFAULT_SAMPLE_RATE;
+  mWaveform = WAVEFORM_SQUARE;
+  mGain = 0.25f;
+  mAttackUs = 0;
+  mReleaseUs = 0;
+  mNumThreads = 1;
+}
+
+void MidiRenderer::setSampleRate(uint32_t iSampleRate)
+{
+  if (iSampleRate)
+    mSampleRate = iSampleRate;
+}
+
+void MidiRenderer::setWaveform(WAVEFORM iWaveform)
+{
+  mWaveform = iWaveform;
+}
+
+void MidiRenderer::setGain(float iGain)
+{
+  mGain = iGain;
+}
+
+void MidiRenderer::setEnvelope(uint32_t iAttackUs, uint32_t iReleaseUs)
+{
+  mAttackUs = iAttackUs;
+  mReleaseUs = iReleaseUs;
+}
+
+void MidiRenderer::setThreadCount(size_t iNumThreads)
+{
+  mNumThreads = iNumThreads;
+}
+
+uint32_t MidiRenderer::getSampleRate() const
+{
+  return mSampleRate;
+}
+
+MidiRenderer::WAVEFORM MidiRenderer::getWaveform() const
+{
+  return mWaveform;
+}
+
+float MidiRenderer::getGain() const
+{
+  return mGain;
+}
+
+size_t MidiRenderer::getThreadCount() const
+{
+  if (mNumThreads)
+    return mNumThreads;
+  size_t numCores = std::thread::hardware_concurrency();
+  return (numCores ? numCores : 1);
+}
+
+MidiRenderer::WAVEFORM MidiRenderer::getInstrumentWaveform(int8_t iInstrument)
+{
+  //waveforms of the 16 instrument families of General MIDI
+  static const WAVEFORM families[] = {
+    WAVEFORM_TRIANGLE, //piano
+    WAVEFORM_SINE,     //chromatic percussion
+    WAVEFORM_SINE,     //organ
+    WAVEFORM_SAW,      //guitar
+    WAVEFORM_TRIANGLE, //bass
+    WAVEFORM_SAW,      //strings
+    WAVEFORM_SAW,      //ensemble
+    WAVEFORM_SAW,      //brass
+    WAVEFORM_SQUARE,   //reed
+    WAVEFORM_SINE,     //pipe
+    WAVEFORM_SQUARE,   //synth lead
+    WAVEFORM_TRIANGLE, //synth pad
+    WAVEFORM_SAW,      //synth effects
+    WAVEFORM_TRIANGLE, //ethnic
+    WAVEFORM_SQUARE,   //percussive
+    WAVEFORM_SQUARE,   //sound effects
+  };
+  if (iInstrument < 0)
+    return WAVEFORM_SQUARE;
+  return families[iInstrument / 8];
+}
+
+uint64_t MidiRenderer::time2sample(uint64_t iTimeUs) const
+{
+  return iTimeUs * mSampleRate / 1000000;
+}
+
+uint64_t MidiRenderer::buildVoices(const MidiFile & iFile, VOICES & oVoices) const
+{
+  WAVEFORM waveform = (mWaveform == WAVEFORM_INSTRUMENT ? getInstrumentWaveform(iFile.getInstrument()) : mWaveform);
+
+  const MidiFile::NoteList & notes = iFile.mNotes;
+  const MidiFile::TimedNoteList & timedNotes = iFile.mTimedNotes;
+  VoiceList & voices = oVoices.list;
+  voices.clear();
+  voices.reserve(notes.size() + timedNotes.size());
+  oVoices.maxLength = 0;
+
+  //the notes of the melody are played one after the other
+  uint64_t timeUs = 0;
+  uint64_t numSamples = 0;
+  for(size_t i=0; i<notes.size(); i++)
+  {
+    VOICE v;
+    v.startSample = time2sample(timeUs);
+    timeUs += notes.durations[i];
+    v.endSample = time2sample(timeUs);
+    numSamples = v.endSample;
+    if (notes.frequencies[i] == 0 || v.endSample == v.startSample)
+      continue;
+
+    v.increment = getPhaseIncrement(notes.frequencies[i], mSampleRate);
+    v.gain = mGain * notes.volumes[i] / MAX_VOLUME;
+    v.waveform = waveform;
+    voices.push_back(v);
+    if (v.endSample - v.startSample > oVoices.maxLength)
+      oVoices.maxLength = v.endSample - v.startSample;
+  }
+
+  if (timedNotes.empty())
+    return numSamples;
+
+  for(size_t i=0; i<timedNotes.size(); i++)
+  {
+    const MidiFile::TIMED_NOTE & n = timedNotes[i];
+    VOICE v;
+    v.startSample = time2sample(iFile.ticks2time(n.startTicks));
+    v.endSample = time2sample(iFile.ticks2time((uint64_t)n.startTicks + n.durationTicks));
+    if (v.endSample > numSamples)
+      numSamples = v.endSample;
+    if (v.endSample == v.startSample)
+      continue;
+
+    v.increment = getPhaseIncrement(getPitchFrequency(n.pitch), mSampleRate);
+    v.gain = mGain * n.velocity / MAX_VOLUME;
+    v.waveform = waveform;
+    voices.push_back(v);
+    if (v.endSample - v.startSample > oVoices.maxLength)
+      oVoices.maxLength = v.endSample - v.startSample;
+  }
+
+  std::stable_sort(voices.begin(), voices.end(), [](const VOICE & a, const VOICE & b)
+  {
+    return a.startSample < b.startSample;
+  });
+  return numSamples;
+}
+
+void MidiRenderer::seek(const VOICES & iVoices, uint64_t iSample, CURSOR & oCursor) const
+{
+  oCursor.position = iSample;
+  oCursor.active.clear();
+
+  //a voice playing at the given sample started less than the longest voice before it
+  const VoiceList & voices = iVoices.list;
+  auto isStartLess = [](const VOICE & a, uint64_t iStart) { return a.startSample < iStart; };
+  uint64_t earliest = (iSample > iVoices.maxLength ? iSample - iVoices.maxLength : 0);
+  VoiceList::const_iterator first = std::lower_bound(voices.begin(), voices.end(), earliest, isStartLess);
+  VoiceList::const_iterator next = std::lower_bound(first, voices.end(), iSample, isStartLess);
+  oCursor.next = (size_t)(next - voices.begin());
+
+  //find the voices playing at the given sample
+  for(size_t i=(size_t)(first - voices.begin()); i<oCursor.next; i++)
+  {
+    if (voices[i].endSample > iSample)
+      oCursor.active.push_back(i);
+  }
+}
+
+void MidiRenderer::renderSamples(const VoiceList & iVoices, CURSOR & ioCursor, size_t iCount, float * oSamples) const
+{
+  std::fill(oSamples, oSamples + iCount, 0.0f);
+
+  size_t offset = 0;
+  while(offset < iCount)
+  {
+    //blocks are aligned on multiples of the block size
+    uint64_t blockStart = ioCursor.position;
+    size_t blockSize = BLOCK_SIZE - (size_t)(blockStart % BLOCK_SIZE);
+    if (blockSize > iCount - offset)
+      blockSize = iCount - offset;
+    uint64_t blockEnd = blockStart + blockSize;
+
+    //start the new voices
+    while(ioCursor.next < iVoices.size() && iVoices[ioCursor.next].startSample < blockEnd)
+    {
+      ioCursor.active.push_back(ioCursor.next);
+      ioCursor.next++;
+    }
+
+    //mix the playing voices and remove the voices that ended
+    std::vector<size_t> & active = ioCursor.active;
+    size_t numActive = 0;
+    for(size_t i=0; i<active.size(); i++)
+    {
+      const VOICE & v = iVoices[active[i]];
+      renderVoice(v, blockStart, blockSize, &oSamples[offset]);
+      if (v.endSample > blockEnd)
+        active[numActive++] = active[i];
+    }
+    active.resize(numActive);
+
+    ioCursor.position = blockEnd;
+    offset += blockSize;
+  }
+}
+
+void MidiRenderer::renderVoice(const VOICE & iVoice, uint64_t iFirstSample, size_t iCount, float * ioSamples) const
+{
+  uint64_t begin = (iVoice.startSample > iFirstSample ? iVoice.startSample : iFirstSample);
+  uint64_t end = iFirstSample + iCount;
+  if (iVoice.endSample < end)
+    end = iVoice.endSample;
+  if (begin >= end)
+    return;
+
+  //envelope of the voice
+  uint64_t length = iVoice.endSample - iVoice.startSample;
+  uint64_t attack = time2sample(mAttackUs);
+  if (attack > length/2)
+    attack = length/2;
+  uint64_t release = time2sample(mReleaseUs);
+  if (release > length - attack)
+    release = length - attack;
+  uint64_t sustainEnd = length - release;
+
+  //samples of the block in the time of the voice
+  uint64_t k = begin - iVoice.startSample;
+  uint64_t kEnd = end - iVoice.startSample;
+  float * samples = &ioSamples[begin - iFirstSample];
+  while(k < kEnd)
+  {
+    uint64_t pieceEnd = kEnd;
+    float gain = iVoice.gain;
+    float gainStep = 0.0f;
+    if (k < attack)
+    {
+      //fade in
+      if (pieceEnd > attack)
+        pieceEnd = attack;
+      gainStep = iVoice.gain / attack;
+      gain = (float)k * gainStep;
+    }
+    else if (k < sustainEnd)
+    {
+      if (pieceEnd > sustainEnd)
+        pieceEnd = sustainEnd;
+    }
+    else
+    {
+      //fade out
+      gainStep = -iVoice.gain / release;
+      gain = (float)(length - k) * -gainStep;
+    }
+
+    size_t count = (size_t)(pieceEnd - k);
+    uint32_t phase = (uint32_t)(k * iVoice.increment);
+    addOscillator(iVoice.waveform, samples, count, phase, iVoice.increment, gain, gainStep);
+    samples += count;
+    k = pieceEnd;
+  }
+}
+
+void MidiRenderer::renderSamples(const VoiceList & iVoices, CURSOR & ioCursor, size_t iCount, int16_t * oSamples) const
+{
+  //render by chunks to limit memory usage
+  std::vector<float> chunk(iCount < CHUNK_SIZE ? iCount : CHUNK_SIZE);
+  for(size_t offset=0; offset<iCount; offset += CHUNK_SIZE)
+  {
+    size_t count = (iCount - offset < CHUNK_SIZE ? iCount - offset : CHUNK_SIZE);
+    renderSamples(iVoices, ioCursor, count, &chunk[0]);
+    convertToPcm16(&chunk[0], &oSamples[offset], count);
+  }
+}
+
+template <typename T>
+void MidiRenderer::renderRange(const VOICES & iVoices, uint64_t iFirstSample, size_t iCount, T * oSamples) const
+{
+  if (iCount == 0)
+    return;
+
+  //split the range in more segments than threads to balance the load.
+  //segments start on multiples of the segment size which is a multiple of the block size.
+  size_t numThreads = getThreadCount();
+  size_t segmentSize = iCount / (numThreads*SEGMENTS_PER_THREAD);
+  segmentSize = (segmentSize + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+  if (segmentSize < MIN_SEGMENT_SIZE)
+    segmentSize = MIN_SEGMENT_SIZE;
+  uint64_t firstSegment = iFirstSample / segmentSize;
+  uint64_t end = iFirstSample + iCount;
+  size_t numSegments = (size_t)((end - 1) / segmentSize - firstSegment + 1);
+  if (numThreads > numSegments)
+    numThreads = numSegments;
+
+  if (numThreads <= 1)
+  {
+    CURSOR cursor;
+    seek(iVoices, iFirstSample, cursor);
+    renderSamples(iVoices.list, cursor, iCount, oSamples);
+    return;
+  }
+
+  std::atomic<size_t> nextSegment(0);
+  std::vector<std::thread> threads;
+  threads.reserve(numThreads);
+  for(size_t i=0; i<numThreads; i++)
+  {
+    threads.push_back(std::thread([this, &iVoices, &nextSegment, iFirstSample, oSamples, firstSegment, segmentSize, numSegments, end]()
+    {
+      CURSOR cursor;
+      size_t segment = 0;
+      while((segment = nextSegment++) < numSegments)
+      {
+        uint64_t segmentBegin = (firstSegment + segment) * segmentSize;
+        uint64_t segmentEnd = segmentBegin + segmentSize;
+        if (segmentBegin < iFirstSample)
+          segmentBegin = iFirstSample;
+        if (segmentEnd > end)
+          segmentEnd = end;
+
+        seek(iVoices, segmentBegin, cursor);
+        renderSamples(iVoices.list, cursor, (size_t)(segmentEnd - segmentBegin), &oSamples[segmentBegin - iFirstSample]);
+      }
+    }));
+  }
+  for(size_t i=0; i<threads.size(); i++)
+  {
+    threads[i].join();
+  }
+}
+
+size_t MidiRenderer::computeSampleCount(const MidiFile & iFile) const
+{
+  VOICES voices;
+  return (size_t)buildVoices(iFile, voices);
+}
+
+bool MidiRenderer::render(const MidiFile & iFile, std::vector<float> & oSamples) const
+{
+  VOICES voices;
+  uint64_t numSamples = buildVoices(iFile, voices);
+  if (numSamples > oSamples.max_size())
+    return false;
+
+  oSamples.resize((size_t)numSamples);
+  if (numSamples == 0)
+    return true;
+
+  renderRange(voices, 0, oSamples.size(), &oSamples[0]);
+  return true;
+}
+
+bool MidiRenderer::render(const MidiFile & iFile, std::vector<int16_t> & oSamples) const
+{
+  VOICES voices;
+  uint64_t numSamples = buildVoices(iFile, voices);
+  if (numSamples > oSamples.max_size())
+    return false;
+
+  oSamples.resize((size_t)numSamples);
+  if (numSamples == 0)
+    return true;
+
+  renderRange(voices, 0, oSamples.size(), &oSamples[0]);
+  return true;
+}
+
+bool MidiRenderer::saveWav(const MidiFile & iFile, const char * iPath) const
+{
+  FileSink sink;
+  if (!sink.open(iPath))
+    return false;
+
+  bool saved = saveWav(iFile, sink);
+  if (!sink.close())
+    saved = false;
+
+  return saved;
+}
+
+bool MidiRenderer::saveWav(const MidiFile & iFile, ByteSink & iSink) const
+{
+  VOICES voices;
+  uint64_t numSamples = buildVoices(iFile, voices);
+  if (numSamples > MAX_WAV_DATA_SIZE/sizeof(int16_t))
+    return false;
+  uint32_t dataSize = (uint32_t)(numSamples*sizeof(int16_t));
+
+  //RIFF header of a 16 bits mono PCM file
+  uint8_t header[WAV_HEADER_SIZE];
+  memcpy(&header[0], "RIFF", 4);
+  writeLittleEndian32(&header[4], (uint32_t)(WAV_HEADER_SIZE - 8) + dataSize);
+  memcpy(&header[8], "WAVE", 4);
+  memcpy(&header[12], "fmt ", 4);
+  writeLittleEndian32(&header[16], 16); //size of the format chunk
+  writeLittleEndian16(&header[20], 1); //PCM
+  writeLittleEndian16(&header[22], 1); //mono
+  writeLittleEndian32(&header[24], mSampleRate);
+  writeLittleEndian32(&header[28], mSampleRate*(uint32_t)sizeof(int16_t)); //bytes per second
+  writeLittleEndian16(&header[32], (uint16_t)sizeof(int16_t)); //bytes per sample of all channels
+  writeLittleEndian16(&header[34], 16); //bits per sample
+  memcpy(&header[36], "data", 4);
+  writeLittleEndian32(&header[40], dataSize);
+  if (!iSink.write(header, sizeof(header)))
+    return false;
+
+  //render by windows to limit memory usage. All threads render each window.
+  size_t windowSize = CHUNK_SIZE * SEGMENTS_PER_THREAD * getThreadCount();
+  std::vector<int16_t> pcm(windowSize);
+  std::vector<uint8_t> bytes(windowSize*sizeof(int16_t));
+  for(uint64_t offset=0; offset<numSamples; offset += windowSize)
+  {
+    size_t count = (numSamples - offset < windowSize ? (size_t)(numSamples - offset) : windowSize);
+    renderRange(voices, offset, count, &pcm[0]);
+    for(size_t i=0; i<count; i++)
+      writeLittleEndian16(&bytes[2*i], (uint16_t)pcm[i]);
+    if (!iSink.write(&bytes[0], count*sizeof(int16_t)))
+      return false;
+  }
+
+  return iSink.flush();
+}
+
+}; //namespace libmidi
@@ -0,0 +1,320 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+//
+// Description:
+//   Destinations for the bytes written by the MIDI encoders.
+//
+
+#include "libmidi/sinks.h"
+
+#include <cstring> //for memcpy()
+
+#ifdef _WIN32
+#   include <io.h>
+#   include <fcntl.h>
+#   include <sys/stat.h>
+#else
+#   include <sys/stat.h>
+#   include <fcntl.h>
+#   include <unistd.h>
+#   include <errno.h>
+#endif
+
+namespace libmidi
+{
+
+static const int INVALID_FILE_DESCRIPTOR = -1;
+
+//writes all bytes to a file descriptor
+static bool writeFileDescriptor(int iFileDescriptor, const void * iData, size_t iSize)
+{
+  const uint8_t * data = (const uint8_t *)iData;
+  while(iSize > 0)
+  {
+#ifdef _WIN32
+    unsigned int count = (iSize > 0x40000000 ? 0x40000000 : (unsigned int)iSize);
+    int written = _write(iFileDescriptor, data, count);
+    if (written <= 0)
+      return false;
+#else
+    ssize_t written = ::write(iFileDescriptor, data, iSize);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return false;
+#endif
+    data += written;
+    iSize -= (size_t)written;
+  }
+  return true;
+}
+
+ByteSink::~ByteSink()
+{
+}
+
+BufferedSink::BufferedSink(size_t iBufferSize) :
+  mBuffer(iBufferSize),
+  mSize(0)
+{
+}
+
+BufferedSink::~BufferedSink()
+{
+}
+
+bool BufferedSink::write(const void * iData, size_t iSize)
+{
+  if (mSize + iSize <= mBuffer.size())
+  {
+    if (iSize)
+      memcpy(&mBuffer[mSize], iData, iSize);
+    mSize += iSize;
+    return true;
+  }
+
+  if (!flush())
+    return false;
+
+  //big writes are not buffered
+  if (iSize >= mBuffer.size())
+    return output(iData, iSize);
+
+  memcpy(&mBuffer[0], iData, iSize);
+  mSize = iSize;
+  return true;
+}
+
+bool BufferedSink::flush()
+{
+  if (mSize == 0)
+    return true;
+  size_t size = mSize;
+  mSize = 0;
+  return output(&mBuffer[0], size);
+}
+
+FileSink::FileSink(size_t iBufferSize) : BufferedSink(iBufferSize),
+  mFile(INVALID_FILE_DESCRIPTOR)
+{
+}
+
+FileSink::~FileSink()
+{
+  close();
+}
+
+bool FileSink::open(const char * iFile)
+{
+  close();
+  if (iFile == NULL)
+    return false;
+#ifdef _WIN32
+  mFile = _open(iFile, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+  mFile = ::open(iFile, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+#endif
+  return isOpened();
+}
+
+bool FileSink::openExisting(const char * iFile)
+{
+  close();
+  if (iFile == NULL)
+    return false;
+#ifdef _WIN32
+  mFile = _open(iFile, _O_WRONLY | _O_BINARY);
+#else
+  mFile = ::open(iFile, O_WRONLY);
+#endif
+  return isOpened();
+}
+
+bool FileSink::getFileSize(uint64_t & oSize) const
+{
+  if (!isOpened())
+    return false;
+#ifdef _WIN32
+  struct _stat64 s;
+  if (_fstat64(mFile, &s) != 0)
+    return false;
+#else
+  struct stat s;
+  if (fstat(mFile, &s) != 0)
+    return false;
+#endif
+  oSize = (uint64_t)s.st_size;
+  return true;
+}
+
+bool FileSink::close()
+{
+  if (!isOpened())
+    return true;
+  bool success = flush();
+#ifdef _WIN32
+  if (_close(mFile) != 0)
+    success = false;
+#else
+  if (::close(mFile) != 0)
+    success = false;
+#endif
+  mFile = INVALID_FILE_DESCRIPTOR;
+  return success;
+}
+
+bool FileSink::isOpened() const
+{
+  return (mFile != INVALID_FILE_DESCRIPTOR);
+}
+
+bool FileSink::isSeekable() const
+{
+  return isOpened();
+}
+
+bool FileSink::seek(uint64_t iOffset)
+{
+  if (!isOpened() || !flush())
+    return false;
+#ifdef _WIN32
+  return (_lseeki64(mFile, (__int64)iOffset, SEEK_SET) != -1);
+#else
+  return (lseek(mFile, (off_t)iOffset, SEEK_SET) != (off_t)-1);
+#endif
+}
+
+bool FileSink::output(const void * iData, size_t iSize)
+{
+  if (!isOpened())
+    return false;
+  return writeFileDescriptor(mFile, iData, iSize);
+}
+
+StreamSink::StreamSink(int iFileDescriptor, size_t iBufferSize) : BufferedSink(iBufferSize),
+  mFileDescriptor(iFileDescriptor)
+{
+}
+
+StreamSink::~StreamSink()
+{
+  flush();
+}
+
+bool StreamSink::isSeekable() const
+{
+  return false;
+}
+
+bool StreamSink::seek(uint64_t /*iOffset*/)
+{
+  return false;
+}
+
+bool StreamSink::output(const void * iData, size_t iSize)
+{
+  if (mFileDescriptor < 0)
+    return false;
+  return writeFileDescriptor(mFileDescriptor, iData, iSize);
+}
+
+CallbackSink::CallbackSink(CALLBACK_FUNCTION iFunction, void * iUserData, size_t iBufferSize) : BufferedSink(iBufferSize),
+  mFunction(iFunction),
+  mUserData(iUserData)
+{
+}
+
+CallbackSink::~CallbackSink()
+{
+  flush();
+}
+
+bool CallbackSink::isSeekable() const
+{
+  return false;
+}
+
+bool CallbackSink::seek(uint64_t /*iOffset*/)
+{
+  return false;
+}
+
+bool CallbackSink::output(const void * iData, size_t iSize)
+{
+  if (mFunction == NULL)
+    return false;
+  return mFunction(iData, iSize, mUserData);
+}
+
+MemorySink::MemorySink(void) :
+  mPosition(0)
+{
+}
+
+MemorySink::~MemorySink()
+{
+}
+
+const std::vector<uint8_t> & MemorySink::getBuffer() const
+{
+  return mBuffer;
+}
+
+void MemorySink::clear()
+{
+  mBuffer.clear();
+  mPosition = 0;
+}
+
+bool MemorySink::write(const void * iData, size_t iSize)
+{
+  if (iSize == 0)
+    return true;
+  if (mPosition + iSize > mBuffer.size())
+    mBuffer.resize(mPosition + iSize);
+  memcpy(&mBuffer[mPosition], iData, iSize);
+  mPosition += iSize;
+  return true;
+}
+
+bool MemorySink::isSeekable() const
+{
+  return true;
+}
+
+bool MemorySink::seek(uint64_t iOffset)
+{
+  if (iOffset > mBuffer.size())
+    return false;
+  mPosition = (size_t)iOffset;
+  return true;
+}
+
+bool MemorySink::flush()
+{
+  return true;
+}
+
+}; //namespace libmidi
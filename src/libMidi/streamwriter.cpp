@@ -0,0 +1,323 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+//
+// Description:
+//   Encodes a single tone melody while notes are added.
+//
+
+#include "libmidi/streamwriter.h"
+#include "libmidi/instruments.h"
+
+#include "midiformat.h"
+#include "trackencoder.h"
+#include "timeline.h"
+
+namespace libmidi
+{
+
+MidiStreamWriter::MidiStreamWriter()
+{
+  mTicksPerQuarterNote = MidiFile::DEFAULT_TICKS_PER_QUARTER_NOTE;
+  mTempo = MidiFile::DEFAULT_TEMPO;
+  mVolume = MAX_VOLUME;
+  mInstrument = MidiFile::DEFAULT_INSTRUMENT;
+  mTrackEndingPreference = MidiFile::STOP_PREVIOUS_NOTE;
+  mCompactEncoding = false;
+  mType = MidiFile::MIDI_TYPE_0;
+  mChunkCapacity = DEFAULT_CHUNK_SIZE;
+
+  mSink = NULL;
+  mEncoder = NULL;
+  mConverter = NULL;
+  mTimeUs = 0;
+  mTicks = 0;
+  mSeekable = false;
+  mError = false;
+  mChunkSize = 0;
+  mSize = 0;
+}
+
+MidiStreamWriter::~MidiStreamWriter()
+{
+  close();
+}
+
+void MidiStreamWriter::setMidiType(MidiFile::MIDI_TYPE iType)
+{
+  mType = iType;
+}
+
+void MidiStreamWriter::setName(const char * iName)
+{
+  if (iName == NULL)
+    mName = "";
+  else
+    mName = iName;
+}
+
+void MidiStreamWriter::setVolume(int8_t iVolume)
+{
+  mVolume = iVolume;
+  if (mVolume < MIN_VOLUME)
+    mVolume = MIN_VOLUME;
+  if (mVolume > MAX_VOLUME)
+    mVolume = MAX_VOLUME;
+}
+
+void MidiStreamWriter::setInstrument(int8_t iInstrument)
+{
+  mInstrument = iInstrument;
+  if (mInstrument < MIN_INSTRUMENT)
+    mInstrument = MIN_INSTRUMENT;
+  if (mInstrument > MAX_INSTRUMENT)
+    mInstrument = MAX_INSTRUMENT;
+}
+
+void MidiStreamWriter::setTicksPerQuarterNote(uint16_t iTicks)
+{
+  mTicksPerQuarterNote = iTicks;
+}
+
+void MidiStreamWriter::setBeatsPerMinute(uint16_t iBpm)
+{
+  mTempo = MidiFile::bpm2tempo(iBpm);
+}
+
+void MidiStreamWriter::setTempo(uint32_t iTempo)
+{
+  mTempo = iTempo;
+}
+
+void MidiStreamWriter::setTrackEndingPreference(MidiFile::TRACK_ENDING_PREFERENCE iTrackEndingPreference)
+{
+  mTrackEndingPreference = iTrackEndingPreference;
+}
+
+void MidiStreamWriter::setCompactEncoding(bool iCompact)
+{
+  mCompactEncoding = iCompact;
+}
+
+void MidiStreamWriter::setChunkSize(size_t iChunkSize)
+{
+  if (iChunkSize >= MIN_CHUNK_SIZE)
+    mChunkCapacity = iChunkSize;
+}
+
+void MidiStreamWriter::setTransform(const MidiTransform & iTransform)
+{
+  mTransform = iTransform;
+}
+
+bool MidiStreamWriter::open(ByteSink & iSink)
+{
+  close();
+
+  mSink = &iSink;
+  mSeekable = iSink.isSeekable();
+  mError = false;
+  mEncoder = new TrackEncoder(mTrackEndingPreference, mTransform.transformChannel(0), mCompactEncoding);
+  mConverter = new TickConverter(mTicksPerQuarterNote, mTempo);
+  mTimeUs = 0;
+  mTicks = 0;
+  mChunk.resize(mChunkCapacity);
+  mChunkSize = 0;
+  mTrack.clear();
+  mSize = 0;
+
+  MIDI_HEADER header;
+  header.id = MIDI_FILE_ID;
+  header.length = 6;
+  header.type = (HEADER_MIDI_TYPE)mType;
+  header.numTracks = 1;
+  header.ticksPerQuarterNote = mTicksPerQuarterNote;
+
+  TRACK_HEADER track;
+  track.id = MIDI_TRACK_HEADER_ID;
+  track.length = 0; //written again when the writer is closed
+
+  //the name of the melody may not fit in a chunk
+  std::vector<uint8_t> buffer(TRACK_DATA_OFFSET + 64 + mName.size());
+  BufferWriter w(&buffer[0], buffer.size());
+  writeHeader(header, w);
+  writeHeader(track, w);
+  mEncoder->writeSettings(w, mName, mTransform.transformTempo(mTempo), mInstrument);
+
+  if (!output(&buffer[0], w.size()))
+  {
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool MidiStreamWriter::open(const char * iFile)
+{
+  close();
+
+  if (!mFileSink.open(iFile))
+    return false;
+  if (!open(mFileSink))
+  {
+    mFileSink.close();
+    return false;
+  }
+  return true;
+}
+
+bool MidiStreamWriter::addNote(uint16_t iFrequency, uint16_t iDurationMs)
+{
+  return addNoteUs(iFrequency, 1000*(uint32_t)iDurationMs);
+}
+
+bool MidiStreamWriter::addNoteUs(uint16_t iFrequency, uint32_t iDurationUs)
+{
+  if (!isOpened() || !reserve(mEncoder->getMaxNextSize()))
+    return false;
+
+  //notes are placed at their absolute time to prevent rounding errors from accumulating
+  mTimeUs += iDurationUs;
+  uint64_t absoluteTicks = mConverter->toTicks(mTimeUs);
+  uint64_t ticks = absoluteTicks - mTicks;
+  mTicks = absoluteTicks;
+
+  BufferWriter w(&mChunk[mChunkSize], mChunk.size() - mChunkSize);
+  if (iFrequency)
+    mEncoder->writeNote(w, mTransform.transformPitch(findMidiPitchFromFrequency(iFrequency)), mTransform.transformVelocity(mVolume), mVolume, ticks);
+  else
+    mEncoder->writeDelay(w, ticks);
+  mChunkSize += w.size();
+
+  return true;
+}
+
+bool MidiStreamWriter::addDelay(uint16_t iDurationMs)
+{
+  return addNote(0, iDurationMs);
+}
+
+bool MidiStreamWriter::addDelayUs(uint32_t iDurationUs)
+{
+  return addNoteUs(0, iDurationUs);
+}
+
+bool MidiStreamWriter::close()
+{
+  if (!isOpened())
+    return false;
+
+  //add track footer
+  if (reserve(mEncoder->getMaxNextSize()))
+  {
+    BufferWriter w(&mChunk[mChunkSize], mChunk.size() - mChunkSize);
+    mEncoder->writeEndOfTrack(w);
+    mChunkSize += w.size();
+  }
+  flushChunk();
+
+  //write TRACK length
+  uint8_t length[sizeof(uint32_t)];
+  BufferWriter::writeBigEndian32(length, (uint32_t)(mSize - TRACK_DATA_OFFSET));
+  if (mError)
+  {
+    //nothing more to write
+  }
+  else if (mSeekable)
+  {
+    mError = !(mSink->seek(TRACK_LENGTH_OFFSET) &&
+               mSink->write(length, sizeof(length)) &&
+               mSink->seek(mSize));
+  }
+  else
+  {
+    memcpy(&mTrack[TRACK_LENGTH_OFFSET], length, sizeof(length));
+    mError = !mSink->write(&mTrack[0], mTrack.size());
+    std::vector<uint8_t>().swap(mTrack);
+  }
+  if (!mError)
+    mError = !mSink->flush();
+
+  bool success = !mError;
+
+  delete mEncoder;
+  mEncoder = NULL;
+  delete mConverter;
+  mConverter = NULL;
+  mSink = NULL;
+  std::vector<uint8_t>().swap(mChunk);
+  mChunkSize = 0;
+  if (!mFileSink.close())
+    success = false;
+
+  return success;
+}
+
+bool MidiStreamWriter::isOpened() const
+{
+  return (mSink != NULL);
+}
+
+uint64_t MidiStreamWriter::getSize() const
+{
+  return mSize + mChunkSize;
+}
+
+bool MidiStreamWriter::reserve(size_t iSize)
+{
+  if (!isOpened() || mError)
+    return false;
+  if (mChunk.size() - mChunkSize >= iSize)
+    return true;
+  if (!flushChunk())
+    return false;
+
+  //the markers of long delta times may not fit in a chunk
+  if (mChunk.size() < iSize)
+    mChunk.resize(iSize);
+  return true;
+}
+
+bool MidiStreamWriter::flushChunk()
+{
+  if (mChunkSize == 0)
+    return !mError;
+  bool success = output(&mChunk[0], mChunkSize);
+  mChunkSize = 0;
+  return success;
+}
+
+bool MidiStreamWriter::output(const uint8_t * iData, size_t iSize)
+{
+  if (mError)
+    return false;
+  if (mSeekable)
+    mError = !mSink->write(iData, iSize);
+  else
+    mTrack.insert(mTrack.end(), iData, iData + iSize);
+  mSize += iSize;
+  return !mError;
+}
+
+}; //namespace libmidi
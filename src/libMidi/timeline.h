@@ -0,0 +1,194 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+//
+// Description:
+//   Internal conversions between absolute times and absolute ticks.
+//
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
+namespace libmidi
+{
+
+/// <summary>
+/// Converts absolute times in microseconds to absolute ticks for a given tick resolution and tempo.
+/// </summary>
+/// <remarks>
+/// Events are placed at their absolute time rounded down to a tick.
+/// The rounding error of an event is always less than a tick and does not accumulate over the track.
+/// The conversion factor is computed once as a 32.32 fixed-point multiplier
+/// and the estimated number of ticks is corrected with multiplications only.
+/// Times must be lower than 2^48 microseconds (about 8 years).
+/// </remarks>
+class TickConverter
+{
+public:
+  TickConverter(uint16_t iTicksPerQuarterNote, uint32_t iTempo) :
+    mTicksPerQuarterNote(iTicksPerQuarterNote),
+    mTempo(iTempo ? iTempo : 1)
+  {
+    mMultiplier = ((uint64_t)mTicksPerQuarterNote << 32) / mTempo;
+  }
+
+  /// <summary>Converts a time to a number of ticks, rounded down.</summary>
+  /// <param name="iTimeUs">The time in microseconds.</param>
+  /// <returns>Returns floor(iTimeUs * ticksPerQuarterNote / tempo).</returns>
+  inline uint64_t toTicks(uint64_t iTimeUs) const
+  {
+    if (mMultiplier >> 32)
+    {
+      //more than one tick per microsecond
+      return iTimeUs * mTicksPerQuarterNote / mTempo;
+    }
+
+    //the multiplier is rounded down, the estimate is never too high
+    uint64_t ticks = (iTimeUs >> 32) * mMultiplier + (((iTimeUs & 0xFFFFFFFF) * mMultiplier) >> 32);
+    uint64_t remainder = iTimeUs * mTicksPerQuarterNote - ticks * mTempo;
+    while(remainder >= mTempo)
+    {
+      ticks++;
+      remainder -= mTempo;
+    }
+    return ticks;
+  }
+
+  /// <summary>Converts a number of ticks to a time, rounded up.</summary>
+  /// <remarks>The result is the earliest time that converts back to iTicks with toTicks().</remarks>
+  /// <param name="iTicks">The number of ticks.</param>
+  /// <returns>Returns ceil(iTicks * tempo / ticksPerQuarterNote).</returns>
+  inline uint64_t toTimeUs(uint64_t iTicks) const
+  {
+    if (mTicksPerQuarterNote == 0)
+      return 0;
+    return (iTicks * mTempo + mTicksPerQuarterNote - 1) / mTicksPerQuarterNote;
+  }
+
+private:
+  uint64_t mTicksPerQuarterNote;
+  uint64_t mTempo;
+  uint64_t mMultiplier; //ticks per microsecond as a 32.32 fixed-point value
+};
+
+/// <summary>
+/// Converts absolute times in microseconds to absolute ticks for a track with tempo changes.
+/// </summary>
+/// <remarks>
+/// The track is split into segments of constant tempo. Each segment knows its
+/// absolute time and ticks and converts the time elapsed since its beginning with its own TickConverter.
+/// The segment of a time or ticks is found with a binary search. Since events are usually
+/// converted in order, the segment of the previous conversion is checked first.
+/// A TempoMap must not be shared between threads.
+/// </remarks>
+class TempoMap
+{
+public:
+  struct SEGMENT
+  {
+    uint64_t timeUs; //absolute time of the tempo change
+    uint64_t ticks; //absolute ticks of the tempo change
+    uint32_t tempo;
+    TickConverter converter;
+  };
+
+  TempoMap(uint16_t iTicksPerQuarterNote, uint32_t iTempo) :
+    mTicksPerQuarterNote(iTicksPerQuarterNote),
+    mLast(0)
+  {
+    add(0, 0, iTempo);
+  }
+
+  /// <summary>Adds a tempo change. Tempo changes must be added in order.</summary>
+  /// <param name="iTimeUs">The absolute time of the tempo change in microseconds.</param>
+  /// <param name="iTicks">The absolute ticks of the tempo change.</param>
+  /// <param name="iTempo">The new tempo.</param>
+  inline void add(uint64_t iTimeUs, uint64_t iTicks, uint32_t iTempo)
+  {
+    SEGMENT s = {iTimeUs, iTicks, iTempo, TickConverter(mTicksPerQuarterNote, iTempo)};
+    mSegments.push_back(s);
+  }
+
+  /// <summary>Get the number of segments including the initial tempo.</summary>
+  inline size_t size() const { return mSegments.size(); }
+
+  inline const SEGMENT & operator[](size_t iIndex) const { return mSegments[iIndex]; }
+
+  /// <summary>Converts a time to a number of ticks, rounded down.</summary>
+  inline uint64_t toTicks(uint64_t iTimeUs) const
+  {
+    const SEGMENT & s = findByTime(iTimeUs);
+    return s.ticks + s.converter.toTicks(iTimeUs - s.timeUs);
+  }
+
+  /// <summary>Converts a number of ticks to a time, rounded up.</summary>
+  inline uint64_t toTimeUs(uint64_t iTicks) const
+  {
+    const SEGMENT & s = findByTicks(iTicks);
+    return s.timeUs + s.converter.toTimeUs(iTicks - s.ticks);
+  }
+
+private:
+  inline const SEGMENT & findByTime(uint64_t iTimeUs) const
+  {
+    if (!contains(mLast, iTimeUs, &SEGMENT::timeUs))
+    {
+      std::vector<SEGMENT>::const_iterator it = std::upper_bound(mSegments.begin(), mSegments.end(), iTimeUs,
+        [](uint64_t t, const SEGMENT & s) { return t < s.timeUs; });
+      mLast = (size_t)(it - mSegments.begin()) - 1;
+    }
+    return mSegments[mLast];
+  }
+
+  inline const SEGMENT & findByTicks(uint64_t iTicks) const
+  {
+    if (!contains(mLast, iTicks, &SEGMENT::ticks))
+    {
+      std::vector<SEGMENT>::const_iterator it = std::upper_bound(mSegments.begin(), mSegments.end(), iTicks,
+        [](uint64_t t, const SEGMENT & s) { return t < s.ticks; });
+      mLast = (size_t)(it - mSegments.begin()) - 1;
+    }
+    return mSegments[mLast];
+  }
+
+  //returns true if iValue is within the segment at iIndex
+  inline bool contains(size_t iIndex, uint64_t iValue, uint64_t SEGMENT::* iField) const
+  {
+    if (iValue < mSegments[iIndex].*iField)
+      return false;
+    return (iIndex + 1 == mSegments.size() || iValue < mSegments[iIndex + 1].*iField);
+  }
+
+  uint16_t mTicksPerQuarterNote;
+  std::vector<SEGMENT> mSegments;
+  mutable size_t mLast; //segment of the previous conversion
+};
+
+}; //namespace libmidi
+
+#endif //TIMELINE_H
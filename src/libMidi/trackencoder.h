@@ -0,0 +1,304 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#ifndef TRACKENCODER_H
+#define TRACKENCODER_H
+
+//
+// Description:
+//   Internal encoder of single tone melody tracks
+//   shared by MidiFile::save() and MidiStreamWriter.
+//
+
+#include "midiformat.h"
+#include "libmidi/libmidi.h"
+
+#include <string>
+
+namespace libmidi
+{
+
+/// <summary>
+/// Encodes the events of a single tone melody track.
+/// </summary>
+/// <remarks>
+/// The note off event of a note is only written when the next note, delay or the end of the track is known.
+/// This allows a track to be encoded one note at a time and still end with the
+/// <typeparamref name="STOP_ALL_NOTES">STOP_ALL_NOTES</typeparamref> message if required.
+/// Consecutive delays are accumulated. Delta times longer than a Variable Length Quantity
+/// are split with empty marker events so that the following events keep their exact time.
+/// The compact encoding writes note off events as note on events with a velocity of 0 to maximize the use of running status.
+/// The events are written to a BufferWriter or counted with a SizeCounter.
+/// </remarks>
+class TrackEncoder
+{
+public:
+  /// <summary>Maximum number of bytes written by writeNote() or writeDelay() without the markers of long delta times.</summary>
+  static const size_t MAX_NOTE_SIZE = 2*(VARIABLE_LENGTH_MAX_SIZE + 3);
+
+  /// <summary>Maximum number of bytes written by writeEndOfTrack() without the markers of long delta times.</summary>
+  static const size_t MAX_END_OF_TRACK_SIZE = 2*(VARIABLE_LENGTH_MAX_SIZE + 3);
+
+  /// <summary>Number of bytes of an empty marker event that splits a long delta time.</summary>
+  static const size_t MARKER_SIZE = VARIABLE_LENGTH_MAX_SIZE + 3;
+
+  TrackEncoder(MidiFile::TRACK_ENDING_PREFERENCE iTrackEndingPreference, uint8_t iChannel = 0, bool iCompact = false) :
+    mTrackEndingPreference(iTrackEndingPreference),
+    mChannel(iChannel & 0x0F),
+    mCompact(iCompact),
+    mPreviousStatus(0),
+    mDelayTicks(0),
+    mNotePending(false),
+    mPendingPitch(0),
+    mPendingReleaseVolume(0),
+    mPendingTicks(0)
+  {
+  }
+
+  /// <summary>Returns true if the encoder uses the compact encoding.</summary>
+  inline bool isCompact() const { return mCompact; }
+
+  /// <summary>Get the maximum number of bytes of the markers that split the delta times of a duration.</summary>
+  /// <param name="iTicks">The sum of the delta times in ticks.</param>
+  static inline size_t getMaxMarkersSize(uint64_t iTicks)
+  {
+    return (size_t)(iTicks / VARIABLE_LENGTH_MAX_VALUE) * MARKER_SIZE;
+  }
+
+  /// <summary>Get the ticks of the pending note and delay that are not written yet.</summary>
+  inline uint64_t getUnwrittenTicks() const
+  {
+    return mDelayTicks + (mNotePending ? mPendingTicks : 0);
+  }
+
+  /// <summary>Get the maximum number of bytes written by the next call to writeNote(), writeDelay() or writeEndOfTrack().</summary>
+  inline size_t getMaxNextSize() const
+  {
+    return MAX_NOTE_SIZE + getMaxMarkersSize(getUnwrittenTicks());
+  }
+
+  /// <summary>Writes the name, tempo and instrument events of the track. Default values are not written.</summary>
+  template <typename WRITER>
+  inline void writeSettings(WRITER & w, const std::string & iName, uint32_t iTempo, int8_t iInstrument)
+  {
+    if (!iName.empty())
+    {
+      META_EVENT e;
+      e.ticks = 0;
+      e.status = EVENT_META;
+      e.type = META_SEQUENCE_OR_TRACK_NAME;
+      e.size = (VAR_LENGTH)iName.size();
+
+      //dump
+      writeEvent(e, w);
+      w.write(iName.c_str(), e.size);
+    }
+
+    //set a TEMPO
+    if (iTempo != MidiFile::DEFAULT_TEMPO)
+      writeTempo(w, 0, iTempo);
+
+    //set instrument
+    if (iInstrument != MidiFile::DEFAULT_INSTRUMENT)
+    {
+      //Next to all TEMPO EVENT is the following 3 bytes which are still unknown
+      unsigned char buffer[] = {0x00, (unsigned char)(PROGRAM_CHANGE_CHANNEL_0 | mChannel), (unsigned char)iInstrument};
+      w.write(buffer, sizeof(buffer));
+    }
+  }
+
+  /// <summary>Writes a note.</summary>
+  /// <param name="iPitch">The MIDI pitch of the note.</param>
+  /// <param name="iVolume">The volume of the note.</param>
+  /// <param name="iReleaseVolume">The volume of the note off event.</param>
+  /// <param name="iTicks">The duration of the note in ticks.</param>
+  template <typename WRITER>
+  inline void writeNote(WRITER & w, EVENT_PITCH iPitch, EVENT_VOLUME iVolume, EVENT_VOLUME iReleaseVolume, uint64_t iTicks)
+  {
+    releasePendingNote(w, false);
+
+    NOTE_EVENT e;
+    e.ticks = writeMarkers(w, mDelayTicks);
+    e.status = NOTE_ON_CHANNEL_0 | mChannel;
+    e.pitch = iPitch;
+    e.volume = iVolume;
+    writeNoteEvent(e, w);
+
+    mDelayTicks = 0;
+    mNotePending = true;
+    mPendingPitch = iPitch;
+    mPendingReleaseVolume = iReleaseVolume;
+    mPendingTicks = iTicks;
+  }
+
+  /// <summary>Writes a delay (silent note).</summary>
+  /// <param name="iTicks">The duration of the delay in ticks.</param>
+  template <typename WRITER>
+  inline void writeDelay(WRITER & w, uint64_t iTicks)
+  {
+    releasePendingNote(w, false);
+    mDelayTicks += iTicks;
+  }
+
+  /// <summary>Writes a channel event such as a note on, note off or control change event.</summary>
+  /// <remarks>Must not be mixed with writeNote() since the note off event of the last note may not be written yet.</remarks>
+  /// <param name="iTicks">The delta time of the event.</param>
+  /// <param name="iStatus">The status of the event including the channel.</param>
+  /// <param name="iData1">The first data byte of the event.</param>
+  /// <param name="iData2">The second data byte of the event. Ignored for program change and channel pressure events.</param>
+  template <typename WRITER>
+  inline void writeChannelEvent(WRITER & w, uint64_t iTicks, EVENT_STATUS iStatus, uint8_t iData1, uint8_t iData2)
+  {
+    NOTE_EVENT e;
+    e.ticks = writeMarkers(w, iTicks);
+    e.status = iStatus;
+    e.pitch = (EVENT_PITCH)iData1;
+    e.volume = (EVENT_VOLUME)iData2;
+    writeNoteEvent(e, w);
+  }
+
+  /// <summary>Writes a tempo change.</summary>
+  /// <remarks>Must not be mixed with writeNote() since the note off event of the last note may not be written yet.</remarks>
+  /// <param name="iTicks">The delta time of the event.</param>
+  /// <param name="iTempo">The new tempo.</param>
+  template <typename WRITER>
+  inline void writeTempo(WRITER & w, uint64_t iTicks, uint32_t iTempo)
+  {
+    META_EVENT e;
+    e.ticks = writeMarkers(w, iTicks);
+    e.status = EVENT_META;
+    e.type = META_TEMPO_SETTING;
+    e.size = 3;
+
+    //dump
+    writeEvent(e, w);
+
+    //dump value as 24 bits big-endian
+    uint8_t tempo[4];
+    BufferWriter::writeBigEndian32(tempo, iTempo);
+    w.write(&tempo[1], 3);
+
+    //meta events cancel the running status
+    mPreviousStatus = 0;
+  }
+
+  /// <summary>Writes the end of the track.</summary>
+  template <typename WRITER>
+  inline void writeEndOfTrack(WRITER & w)
+  {
+    releasePendingNote(w, (mTrackEndingPreference & MidiFile::STOP_ALL_NOTES) == MidiFile::STOP_ALL_NOTES);
+
+    META_EVENT e;
+    e.ticks = writeMarkers(w, mDelayTicks);
+    e.status = EVENT_META;
+    e.type = META_END_OF_TRACK;
+    e.size = 0;
+
+    //dump
+    writeEvent(e, w);
+
+    mDelayTicks = 0;
+  }
+
+private:
+  /// <summary>Writes empty marker events until the remaining delta time fits in a Variable Length Quantity.</summary>
+  /// <returns>The remaining delta time of the next event.</returns>
+  template <typename WRITER>
+  inline VAR_LENGTH writeMarkers(WRITER & w, uint64_t iTicks)
+  {
+    while(iTicks > VARIABLE_LENGTH_MAX_VALUE)
+    {
+      META_EVENT e;
+      e.ticks = VARIABLE_LENGTH_MAX_VALUE;
+      e.status = EVENT_META;
+      e.type = META_MARKER_TEXT;
+      e.size = 0;
+      writeEvent(e, w);
+      iTicks -= VARIABLE_LENGTH_MAX_VALUE;
+
+      //meta events cancel the running status
+      mPreviousStatus = 0;
+    }
+    return (VAR_LENGTH)iTicks;
+  }
+
+  template <typename WRITER>
+  inline void writeNoteEvent(const NOTE_EVENT & iEvent, WRITER & w)
+  {
+    NOTE_EVENT e = iEvent;
+    if (mCompact && (e.status & 0xF0) == NOTE_OFF_CHANNEL_0)
+    {
+      //a note on with a velocity of 0 stops the note
+      e.status = NOTE_ON_CHANNEL_0 | (e.status & 0x0F);
+      e.volume = 0;
+    }
+
+    bool isRunningStatus = (mPreviousStatus == e.status);
+    writeEvent(e, isRunningStatus, w);
+
+    //remember status
+    mPreviousStatus = e.status;
+  }
+
+  template <typename WRITER>
+  inline void releasePendingNote(WRITER & w, bool iStopAllNotes)
+  {
+    if (!mNotePending)
+      return;
+
+    NOTE_EVENT e;
+    e.ticks = writeMarkers(w, mPendingTicks);
+    if (iStopAllNotes)
+    {
+      //silence all notes
+      e.status = CONTROL_CHANGE_CHANNEL_0 | mChannel;
+      e.pitch = ALL_NOTES_OFF;
+      e.volume = MIN_VOLUME;
+    }
+    else
+    {
+      //stop the note
+      e.status = NOTE_OFF_CHANNEL_0 | mChannel;
+      e.pitch = mPendingPitch;
+      e.volume = mPendingReleaseVolume;
+    }
+    writeNoteEvent(e, w);
+
+    mNotePending = false; //next note shall begins right after this one
+  }
+
+  MidiFile::TRACK_ENDING_PREFERENCE mTrackEndingPreference;
+  uint8_t mChannel; //channel of all the events of the track
+  bool mCompact; //note off events are written as note on events
+  EVENT_STATUS mPreviousStatus;
+  uint64_t mDelayTicks; //silence before the next event
+  bool mNotePending; //a note is playing and its note off event is not written yet
+  EVENT_PITCH mPendingPitch;
+  EVENT_VOLUME mPendingReleaseVolume;
+  uint64_t mPendingTicks;
+};
+
+}; //namespace libmidi
+
+#endif //TRACKENCODER_H
@@ -0,0 +1,278 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+//
+// Description:
+//   Transforms applied to the notes of a melody while it is encoded.
+//
+
+#include "libmidi/transform.h"
+#include "libmidi/sinks.h"
+
+#include "simd.h"
+
+#include <cmath> //for floor(), std::isfinite()
+
+namespace libmidi
+{
+
+static const int MAX_TRANSPOSE = 0x7F;
+
+const size_t MidiTransform::NUM_VELOCITIES;
+const size_t MidiTransform::NUM_CHANNELS;
+const uint32_t MidiTransform::MAX_TEMPO;
+
+MidiTransform::MidiTransform()
+{
+  mTranspose = 0;
+  mStretch = 1.0;
+  for(size_t i=0; i<NUM_VELOCITIES; i++)
+  {
+    mVelocities[i] = (uint8_t)i;
+  }
+  for(size_t i=0; i<NUM_CHANNELS; i++)
+  {
+    mChannels[i] = (uint8_t)i;
+  }
+}
+
+bool MidiTransform::transpose(int iSemitones)
+{
+  if (iSemitones < -MAX_TRANSPOSE || iSemitones > MAX_TRANSPOSE)
+    return false;
+
+  //a larger transpose clamps all pitches to the same value
+  mTranspose += iSemitones;
+  if (mTranspose < -MAX_TRANSPOSE)
+    mTranspose = -MAX_TRANSPOSE;
+  if (mTranspose > MAX_TRANSPOSE)
+    mTranspose = MAX_TRANSPOSE;
+  return true;
+}
+
+bool MidiTransform::stretch(double iRatio)
+{
+  if (!std::isfinite(iRatio) || iRatio <= 0.0)
+    return false;
+  mStretch *= iRatio;
+  return true;
+}
+
+bool MidiTransform::applyVelocityCurve(const uint8_t * iCurve)
+{
+  if (iCurve == NULL)
+    return false;
+  for(size_t i=0; i<NUM_VELOCITIES; i++)
+  {
+    if (iCurve[i] >= NUM_VELOCITIES)
+      return false;
+  }
+
+  for(size_t i=0; i<NUM_VELOCITIES; i++)
+  {
+    mVelocities[i] = iCurve[mVelocities[i]];
+  }
+  return true;
+}
+
+bool MidiTransform::mapChannel(uint8_t iFrom, uint8_t iTo)
+{
+  if (iFrom >= NUM_CHANNELS || iTo >= NUM_CHANNELS)
+    return false;
+
+  for(size_t i=0; i<NUM_CHANNELS; i++)
+  {
+    if (mChannels[i] == iFrom)
+      mChannels[i] = iTo;
+  }
+  return true;
+}
+
+void MidiTransform::append(const MidiTransform & iTransform)
+{
+  transpose(iTransform.mTranspose);
+  mStretch *= iTransform.mStretch;
+  for(size_t i=0; i<NUM_VELOCITIES; i++)
+  {
+    mVelocities[i] = iTransform.mVelocities[mVelocities[i]];
+  }
+  for(size_t i=0; i<NUM_CHANNELS; i++)
+  {
+    mChannels[i] = iTransform.mChannels[mChannels[i]];
+  }
+}
+
+bool MidiTransform::isIdentity() const
+{
+  if (mTranspose != 0 || mStretch != 1.0)
+    return false;
+  for(size_t i=0; i<NUM_VELOCITIES; i++)
+  {
+    if (mVelocities[i] != i)
+      return false;
+  }
+  for(size_t i=0; i<NUM_CHANNELS; i++)
+  {
+    if (mChannels[i] != i)
+      return false;
+  }
+  return true;
+}
+
+int MidiTransform::getTranspose() const
+{
+  return mTranspose;
+}
+
+double MidiTransform::getStretch() const
+{
+  return mStretch;
+}
+
+uint32_t MidiTransform::transformTempo(uint32_t iTempo) const
+{
+  if (mStretch == 1.0)
+    return iTempo;
+  double tempo = floor(iTempo * mStretch + 0.5);
+  if (tempo < 1.0)
+    return 1;
+  if (tempo > MAX_TEMPO)
+    return MAX_TEMPO;
+  return (uint32_t)tempo;
+}
+
+void MidiTransform::transformPitches(const int8_t * iPitches, int8_t * oPitches, size_t iCount) const
+{
+  size_t i = 0;
+
+  //pitches are from 0x00 to 0x7f and the transpose from -0x7f to 0x7f which makes
+  //a saturated 8 bits addition followed by a clamp to 0 exact
+#if defined(LIBMIDI_SSE2)
+  const __m128i transpose = _mm_set1_epi8((char)mTranspose);
+  const __m128i zero = _mm_setzero_si128();
+  for(; i+16<=iCount; i+=16)
+  {
+    __m128i pitches = _mm_loadu_si128((const __m128i *)&iPitches[i]);
+    pitches = _mm_adds_epi8(pitches, transpose);
+    pitches = _mm_andnot_si128(_mm_cmpgt_epi8(zero, pitches), pitches);
+    _mm_storeu_si128((__m128i *)&oPitches[i], pitches);
+  }
+#elif defined(LIBMIDI_NEON)
+  const int8x16_t transpose = vdupq_n_s8((int8_t)mTranspose);
+  const int8x16_t zero = vdupq_n_s8(0);
+  for(; i+16<=iCount; i+=16)
+  {
+    int8x16_t pitches = vld1q_s8(&iPitches[i]);
+    pitches = vmaxq_s8(vqaddq_s8(pitches, transpose), zero);
+    vst1q_s8(&oPitches[i], pitches);
+  }
+#endif
+
+  for(; i<iCount; i++)
+  {
+    oPitches[i] = transformPitch(iPitches[i]);
+  }
+}
+
+void MidiTransform::transformVelocities(const int8_t * iVelocities, int8_t * oVelocities, size_t iCount) const
+{
+  //a table lookup of 128 entries has no efficient SSE2 or NEON equivalent.
+  //the loop is unrolled to hide the latency of the loads.
+  size_t i = 0;
+  for(; i+4<=iCount; i+=4)
+  {
+    int8_t v0 = (int8_t)mVelocities[iVelocities[i+0] & 0x7F];
+    int8_t v1 = (int8_t)mVelocities[iVelocities[i+1] & 0x7F];
+    int8_t v2 = (int8_t)mVelocities[iVelocities[i+2] & 0x7F];
+    int8_t v3 = (int8_t)mVelocities[iVelocities[i+3] & 0x7F];
+    oVelocities[i+0] = v0;
+    oVelocities[i+1] = v1;
+    oVelocities[i+2] = v2;
+    oVelocities[i+3] = v3;
+  }
+  for(; i<iCount; i++)
+  {
+    oVelocities[i] = transformVelocity(iVelocities[i]);
+  }
+}
+
+MidiFileView::MidiFileView(const MidiFile & iFile, const MidiTransform & iTransform) :
+  mFile(&iFile),
+  mTransform(iTransform)
+{
+}
+
+MidiFileView::MidiFileView(const MidiFileView & iView, const MidiTransform & iTransform) :
+  mFile(iView.mFile),
+  mTransform(iView.mTransform)
+{
+  mTransform.append(iTransform);
+}
+
+const MidiFile & MidiFileView::getFile() const
+{
+  return *mFile;
+}
+
+const MidiTransform & MidiFileView::getTransform() const
+{
+  return mTransform;
+}
+
+size_t MidiFileView::computeEncodedSize() const
+{
+  return mFile->computeEncodedSize(mTransform);
+}
+
+bool MidiFileView::save(const char * iFile) const
+{
+  FileSink sink(0); //the melody is written at once
+  if (!sink.open(iFile))
+    return false;
+
+  bool saved = save(sink);
+  if (!sink.close())
+    saved = false;
+
+  return saved;
+}
+
+bool MidiFileView::save(ByteSink & iSink) const
+{
+  std::vector<uint8_t> buffer;
+  if (!saveToBuffer(buffer))
+    return false;
+
+  return iSink.write(&buffer[0], buffer.size()) && iSink.flush();
+}
+
+bool MidiFileView::saveToBuffer(std::vector<uint8_t> & oBuffer) const
+{
+  size_t size = computeEncodedSize();
+  oBuffer.resize(size);
+  mFile->encode(&oBuffer[0], oBuffer.size(), size, mTransform);
+  return true;
+}
+
+}; //namespace libmidi
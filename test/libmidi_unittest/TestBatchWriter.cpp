@@ -0,0 +1,162 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#include "libmidi/libmidi.h"
+#include "libmidi/batchwriter.h"
+
+#include "TestBatchWriter.h"
+
+#include <cstdio> //for sprintf()
+
+using namespace libmidi;
+
+typedef std::vector<unsigned char> CharSequence;
+
+extern std::string getTestInputFilePath(const char * name);
+extern std::string getTestOutputFilePath(const char * name);
+extern CharSequence readFileContentAsArray(const char * iFilePath);
+
+static bool buildBuzzer(MidiFile & oFile, size_t iIndex, void * /*iUserData*/)
+{
+  //odd jobs are canceled
+  if (iIndex % 2 == 1)
+    return false;
+
+  oFile.setInstrument(0x51);
+  oFile.setTempo(0x051615);
+  oFile.setName("buzzer");
+  oFile.setVolume(0x64);
+  for(int i=0; i<10; i++)
+  {
+    oFile.addNote(131, 125);
+    oFile.addDelay(125);
+  }
+
+  return true;
+}
+
+static std::string getJobOutputFilePath(size_t iIndex)
+{
+  char name[64];
+  sprintf(name, "testBatchWriter.%03d.output.mid", (int)iIndex);
+  return getTestOutputFilePath(name);
+}
+
+void TestBatchWriter::SetUp()
+{
+}
+
+void TestBatchWriter::TearDown()
+{
+}
+
+TEST_F(TestBatchWriter, testRun)
+{
+  MidiFile mario;
+  ASSERT_TRUE( mario.load(getTestInputFilePath("mario1up.mid").c_str()) );
+
+  static const size_t numJobs = 200;
+
+  MidiBatchWriter w;
+  w.setThreadCount(4);
+  for(size_t i=0; i<numJobs; i++)
+  {
+    std::string path = getJobOutputFilePath(i);
+    size_t index = 0;
+    if (i % 4 < 2)
+      index = w.addJob(&mario, path.c_str());
+    else
+      index = w.addJob(&buildBuzzer, NULL, path.c_str());
+    ASSERT_EQ(i, index);
+    ASSERT_EQ(MidiBatchWriter::JOB_PENDING, w.getJobStatus(i));
+  }
+  ASSERT_EQ(numJobs, w.getJobCount());
+
+  //some builds are canceled
+  ASSERT_FALSE( w.run() );
+
+  CharSequence marioContent = readFileContentAsArray(getTestInputFilePath("mario1up.mid").c_str());
+  CharSequence buzzerContent = readFileContentAsArray(getTestInputFilePath("buzzer.mid").c_str());
+
+  size_t numSucceeded = 0;
+  size_t numBytes = 0;
+  for(size_t i=0; i<numJobs; i++)
+  {
+    std::string path = getJobOutputFilePath(i);
+    if (i % 4 < 2)
+    {
+      ASSERT_EQ(MidiBatchWriter::JOB_SUCCESS, w.getJobStatus(i));
+      ASSERT_EQ(marioContent.size(), w.getJobSize(i));
+      ASSERT_TRUE( marioContent == readFileContentAsArray(path.c_str()) ) << path;
+    }
+    else if (i % 2 == 0)
+    {
+      ASSERT_EQ(MidiBatchWriter::JOB_SUCCESS, w.getJobStatus(i));
+      ASSERT_EQ(buzzerContent.size(), w.getJobSize(i));
+      ASSERT_TRUE( buzzerContent == readFileContentAsArray(path.c_str()) ) << path;
+    }
+    else
+    {
+      ASSERT_EQ(MidiBatchWriter::JOB_BUILD_FAILED, w.getJobStatus(i));
+      ASSERT_EQ(0, w.getJobSize(i));
+    }
+    if (w.getJobStatus(i) == MidiBatchWriter::JOB_SUCCESS)
+    {
+      numSucceeded++;
+      numBytes += w.getJobSize(i);
+    }
+  }
+
+  const MidiBatchWriter::STATISTICS & s = w.getStatistics();
+  ASSERT_EQ(numJobs, s.numJobs);
+  ASSERT_EQ(numSucceeded, s.numSucceeded);
+  ASSERT_EQ(numJobs - numSucceeded, s.numFailed);
+  ASSERT_EQ(numBytes, s.numBytes);
+  ASSERT_EQ(4, s.numThreads);
+}
+
+TEST_F(TestBatchWriter, testSaveFailed)
+{
+  MidiFile mario;
+  ASSERT_TRUE( mario.load(getTestInputFilePath("mario1up.mid").c_str()) );
+
+  MidiBatchWriter w;
+  w.addJob(&mario, getJobOutputFilePath(0).c_str());
+  w.addJob(&mario, getTestOutputFilePath("missing/directory/file.mid").c_str());
+  w.addJob((const MidiFile *)NULL, getJobOutputFilePath(2).c_str());
+
+  ASSERT_FALSE( w.run() );
+  ASSERT_EQ(MidiBatchWriter::JOB_SUCCESS, w.getJobStatus(0));
+  ASSERT_EQ(MidiBatchWriter::JOB_SAVE_FAILED, w.getJobStatus(1));
+  ASSERT_EQ(MidiBatchWriter::JOB_SAVE_FAILED, w.getJobStatus(2));
+  ASSERT_EQ(1, w.getStatistics().numSucceeded);
+  ASSERT_EQ(2, w.getStatistics().numFailed);
+  ASSERT_GE(w.getStatistics().numThreads, 1);
+
+  //no jobs
+  w.clear();
+  ASSERT_EQ(0, w.getJobCount());
+  ASSERT_TRUE( w.run() );
+  ASSERT_EQ(0, w.getStatistics().numJobs);
+}
@@ -0,0 +1,241 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#include "libmidi/libmidi.h"
+#include "libmidi/encodingcache.h"
+#include "libmidi/sinks.h"
+
+#include "TestEncodingCache.h"
+
+using namespace libmidi;
+
+//builds a melody of a given length
+static void buildMelody(MidiFile & oFile, size_t iNumNotes, uint16_t iFirstFrequency)
+{
+  for(size_t i=0; i<iNumNotes; i++)
+  {
+    oFile.addNote((uint16_t)(iFirstFrequency + 10*(i%24)), (uint16_t)(100 + i%5));
+  }
+}
+
+void TestEncodingCache::SetUp()
+{
+}
+
+void TestEncodingCache::TearDown()
+{
+}
+
+TEST_F(TestEncodingCache, testContentHash)
+{
+  static const uint16_t frequencies[] = {440, 0, 880, 220};
+  static const uint16_t durations[] = {100, 50, 200, 100};
+
+  //the same melody built in different ways
+  MidiFile a;
+  for(size_t i=0; i<4; i++)
+    a.addNote(frequencies[i], durations[i]);
+  MidiFile b;
+  b.addNotes(frequencies, durations, 2);
+  b.addNotes(&frequencies[2], &durations[2], 2);
+  ASSERT_EQ(a.getContentHash(), b.getContentHash());
+
+  //the hash is updated as notes are added
+  uint64_t hash = a.getContentHash();
+  a.addNote(440, 100);
+  ASSERT_NE(hash, a.getContentHash());
+  b.addNote(440, 100);
+  ASSERT_EQ(a.getContentHash(), b.getContentHash());
+
+  //each setting changes the hash
+  hash = a.getContentHash();
+  b.setName("name");
+  ASSERT_NE(hash, b.getContentHash());
+  b.setName("");
+  ASSERT_EQ(hash, b.getContentHash());
+  b.setTempo(400000);
+  ASSERT_NE(hash, b.getContentHash());
+  b.setTempo(MidiFile::DEFAULT_TEMPO);
+  b.setTicksPerQuarterNote(960);
+  ASSERT_NE(hash, b.getContentHash());
+  b.setTicksPerQuarterNote(MidiFile::DEFAULT_TICKS_PER_QUARTER_NOTE);
+  b.setInstrument(40);
+  ASSERT_NE(hash, b.getContentHash());
+  b.setInstrument(MidiFile::DEFAULT_INSTRUMENT);
+  b.setTrackEndingPreference(MidiFile::STOP_ALL_NOTES);
+  ASSERT_NE(hash, b.getContentHash());
+  b.setTrackEndingPreference(MidiFile::STOP_PREVIOUS_NOTE);
+  ASSERT_EQ(hash, b.getContentHash());
+
+  //timed notes and tempo changes
+  b.addNoteAt(0, 480, 60, 100, 1);
+  ASSERT_NE(hash, b.getContentHash());
+  a.addNoteAt(0, 480, 60, 100, 1);
+  ASSERT_EQ(a.getContentHash(), b.getContentHash());
+  hash = a.getContentHash();
+  a.addTempoChange(100, 250000);
+  ASSERT_NE(hash, a.getContentHash());
+
+  //loading a melody resets the hash
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( a.saveToBuffer(buffer) );
+  MidiFile c;
+  MidiFile d;
+  c.addNote(440, 100);
+  ASSERT_TRUE( c.loadFromBuffer(&buffer[0], buffer.size()) );
+  ASSERT_TRUE( d.loadFromBuffer(&buffer[0], buffer.size()) );
+  ASSERT_EQ(c.getContentHash(), d.getContentHash());
+}
+
+TEST_F(TestEncodingCache, testSaveToBuffer)
+{
+  MidiEncodingCache cache;
+  ASSERT_EQ(MidiEncodingCache::DEFAULT_MAX_SIZE, cache.getMaxSize());
+
+  MidiFile f;
+  buildMelody(f, 1000, 220);
+  std::vector<uint8_t> expected;
+  ASSERT_TRUE( f.saveToBuffer(expected) );
+
+  f.setEncodingCache(&cache);
+  ASSERT_EQ(&cache, f.getEncodingCache());
+
+  //encoded once
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( f.saveToBuffer(buffer) );
+  ASSERT_TRUE( buffer == expected );
+  MidiEncodingCache::STATISTICS s = cache.getStatistics();
+  ASSERT_EQ(0, (int)s.numHits);
+  ASSERT_EQ(1, (int)s.numMisses);
+  ASSERT_EQ(1, (int)s.numEntries);
+  ASSERT_EQ(expected.size(), s.size);
+
+  //saved from the cache
+  buffer.clear();
+  ASSERT_TRUE( f.saveToBuffer(buffer) );
+  ASSERT_TRUE( buffer == expected );
+  MemorySink sink;
+  ASSERT_TRUE( f.save(sink) );
+  ASSERT_TRUE( sink.getBuffer() == expected );
+  s = cache.getStatistics();
+  ASSERT_EQ(2, (int)s.numHits);
+  ASSERT_EQ(1, (int)s.numMisses);
+
+  //another melody with the same content
+  MidiFile g;
+  buildMelody(g, 1000, 220);
+  g.setEncodingCache(&cache);
+  ASSERT_TRUE( g.saveToBuffer(buffer) );
+  ASSERT_TRUE( buffer == expected );
+  ASSERT_EQ(3, (int)cache.getStatistics().numHits);
+
+  //a modified melody is encoded again
+  f.addNote(440, 100);
+  ASSERT_TRUE( f.saveToBuffer(buffer) );
+  ASSERT_FALSE( buffer == expected );
+  s = cache.getStatistics();
+  ASSERT_EQ(3, (int)s.numHits);
+  ASSERT_EQ(2, (int)s.numMisses);
+  ASSERT_EQ(2, (int)s.numEntries);
+
+  cache.resetStatistics();
+  cache.clear();
+  s = cache.getStatistics();
+  ASSERT_EQ(0, (int)s.numHits);
+  ASSERT_EQ(0, (int)s.numMisses);
+  ASSERT_EQ(0, (int)s.numEntries);
+  ASSERT_EQ(0, (int)s.size);
+}
+
+TEST_F(TestEncodingCache, testCallerBuffer)
+{
+  MidiEncodingCache cache;
+  MidiFile f;
+  buildMelody(f, 100, 440);
+  f.setEncodingCache(&cache);
+
+  std::vector<uint8_t> expected;
+  ASSERT_TRUE( f.saveToBuffer(expected) );
+
+  //buffer too small, from the cache
+  std::vector<uint8_t> buffer(expected.size());
+  size_t size = 0;
+  ASSERT_FALSE( f.saveToBuffer(&buffer[0], 10, size) );
+  ASSERT_EQ(expected.size(), size);
+
+  ASSERT_TRUE( f.saveToBuffer(&buffer[0], buffer.size(), size) );
+  ASSERT_EQ(expected.size(), size);
+  ASSERT_TRUE( buffer == expected );
+  ASSERT_EQ(2, (int)cache.getStatistics().numHits);
+}
+
+TEST_F(TestEncodingCache, testEviction)
+{
+  MidiFile a;
+  MidiFile b;
+  MidiFile c;
+  buildMelody(a, 100, 220);
+  buildMelody(b, 100, 330);
+  buildMelody(c, 100, 440);
+  size_t size = a.computeEncodedSize();
+  ASSERT_EQ(size, b.computeEncodedSize());
+  ASSERT_EQ(size, c.computeEncodedSize());
+
+  //room for 2 melodies
+  MidiEncodingCache cache(2*size + size/2);
+  a.setEncodingCache(&cache);
+  b.setEncodingCache(&cache);
+  c.setEncodingCache(&cache);
+
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( a.saveToBuffer(buffer) );
+  ASSERT_TRUE( b.saveToBuffer(buffer) );
+  ASSERT_TRUE( a.saveToBuffer(buffer) ); //hit: b is now the least recently used
+  ASSERT_TRUE( c.saveToBuffer(buffer) ); //evicts b
+
+  MidiEncodingCache::STATISTICS s = cache.getStatistics();
+  ASSERT_EQ(1, (int)s.numHits);
+  ASSERT_EQ(3, (int)s.numMisses);
+  ASSERT_EQ(1, (int)s.numEvictions);
+  ASSERT_EQ(2, (int)s.numEntries);
+  ASSERT_EQ(2*size, s.size);
+
+  ASSERT_TRUE( cache.find(a.getContentHash(), buffer) );
+  ASSERT_FALSE( cache.find(b.getContentHash(), buffer) );
+  ASSERT_TRUE( cache.find(c.getContentHash(), buffer) );
+
+  //shrinking the cache removes the least recently used melodies
+  cache.setMaxSize(size);
+  s = cache.getStatistics();
+  ASSERT_EQ(1, (int)s.numEntries);
+  ASSERT_TRUE( cache.find(c.getContentHash(), buffer) );
+
+  //melodies larger than the cache are not added
+  MidiFile large;
+  buildMelody(large, 1000, 220);
+  large.setEncodingCache(&cache);
+  ASSERT_TRUE( large.saveToBuffer(buffer) );
+  ASSERT_EQ(large.computeEncodedSize(), buffer.size());
+  ASSERT_FALSE( cache.find(large.getContentHash(), buffer) );
+}
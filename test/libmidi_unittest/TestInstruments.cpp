@@ -66,3 +66,37 @@ TEST_F(TestInstruments, testGetInstrumentName)
   ASSERT_TRUE( std::string("Bright Acoustic Piano") == getInstrumentName(0x01) );
   ASSERT_TRUE( std::string("Gunshot") == getInstrumentName(0x7f) );
 }
+
+TEST_F(TestInstruments, testFindAllInstruments)
+{
+  for(INSTRUMENT i=MIN_INSTRUMENT; i>=MIN_INSTRUMENT && i<=MAX_INSTRUMENT; i++)
+  {
+    const char * name = getInstrumentName(i);
+    ASSERT_EQ(i, findInstrument(name) ) << name;
+  }
+}
+
+TEST_F(TestInstruments, testFindInstrumentIgnoreCase)
+{
+  ASSERT_EQ(INVALID_INSTRUMENT, findInstrument("", INSTRUMENT_MATCH_IGNORE_CASE) );     //invalid
+  ASSERT_EQ(INVALID_INSTRUMENT, findInstrument(NULL, INSTRUMENT_MATCH_IGNORE_CASE) );   //invalid
+  ASSERT_EQ(INVALID_INSTRUMENT, findInstrument("acoustic grand piano") );  //case sensitive by default
+  ASSERT_EQ(0x00, findInstrument("acoustic grand piano", INSTRUMENT_MATCH_IGNORE_CASE) );
+  ASSERT_EQ(0x51, findInstrument("LEAD 2 (SAWTOOTH)", INSTRUMENT_MATCH_IGNORE_CASE) );
+  ASSERT_EQ(0x7f, findInstrument("gUNSHOT", INSTRUMENT_MATCH_IGNORE_CASE) );
+  ASSERT_EQ(INVALID_INSTRUMENT, findInstrument("gunshots", INSTRUMENT_MATCH_IGNORE_CASE) );
+}
+
+TEST_F(TestInstruments, testFindInstrumentPrefix)
+{
+  ASSERT_EQ(INVALID_INSTRUMENT, findInstrument("", INSTRUMENT_MATCH_PREFIX) );     //invalid
+  ASSERT_EQ(INVALID_INSTRUMENT, findInstrument(NULL, INSTRUMENT_MATCH_PREFIX) );   //invalid
+  ASSERT_EQ(INVALID_INSTRUMENT, findInstrument("Foobar", INSTRUMENT_MATCH_PREFIX) );
+  ASSERT_EQ(0x00, findInstrument("Acoustic", INSTRUMENT_MATCH_PREFIX) );  //lowest id of all acoustic instruments
+  ASSERT_EQ(0x02, findInstrument("Electric", INSTRUMENT_MATCH_PREFIX) );
+  ASSERT_EQ(0x1b, findInstrument("Electric Guitar (c", INSTRUMENT_MATCH_PREFIX) );
+  ASSERT_EQ(0x7f, findInstrument("Gunshot", INSTRUMENT_MATCH_PREFIX) );
+  ASSERT_EQ(INVALID_INSTRUMENT, findInstrument("electric", INSTRUMENT_MATCH_PREFIX) );  //case sensitive
+  ASSERT_EQ(0x02, findInstrument("electric", INSTRUMENT_MATCH_PREFIX | INSTRUMENT_MATCH_IGNORE_CASE) );
+  ASSERT_EQ(0x50, findInstrument("LEAD", INSTRUMENT_MATCH_PREFIX | INSTRUMENT_MATCH_IGNORE_CASE) );
+}
@@ -0,0 +1,327 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#include "libmidi/libmidi.h"
+#include "libmidi/merger.h"
+#include "libmidi/multitrack.h"
+#include "libmidi/player.h"
+#include "libmidi/sinks.h"
+
+#include "TestMerger.h"
+
+using namespace libmidi;
+
+extern std::string getTestOutputFilePath(const char * iFilename);
+
+struct MERGED_EVENT
+{
+  uint64_t ticks; //absolute ticks of the event
+  uint8_t status;
+  uint8_t data1;
+  uint8_t data2;
+};
+
+//get the channel events of the track of a merged file
+static bool getMergedEvents(const std::vector<uint8_t> & iBuffer, std::vector<MERGED_EVENT> & oEvents)
+{
+  oEvents.clear();
+  static const size_t TRACK_OFFSET = 22; //file header and track header
+  if (iBuffer.size() < TRACK_OFFSET)
+    return false;
+
+  size_t offset = TRACK_OFFSET;
+  uint64_t ticks = 0;
+  uint8_t runningStatus = 0;
+  while(offset < iBuffer.size())
+  {
+    uint32_t delta = 0;
+    uint8_t b = 0;
+    do
+    {
+      b = iBuffer[offset++];
+      delta = (delta << 7) | (b & 0x7F);
+    } while((b & 0x80) && offset < iBuffer.size());
+    ticks += delta;
+
+    uint8_t status = iBuffer[offset];
+    if (status & 0x80)
+      offset++;
+    else
+      status = runningStatus;
+
+    if (status == 0xFF)
+    {
+      //meta event
+      uint8_t type = iBuffer[offset];
+      uint8_t size = iBuffer[offset+1];
+      offset += 2 + size;
+      if (type == 0x2F)
+        return offset == iBuffer.size();
+      continue;
+    }
+
+    runningStatus = status;
+    MERGED_EVENT e;
+    e.ticks = ticks;
+    e.status = status;
+    e.data1 = iBuffer[offset++];
+    e.data2 = 0;
+    if ((status & 0xF0) != 0xC0 && (status & 0xF0) != 0xD0)
+      e.data2 = iBuffer[offset++];
+    oEvents.push_back(e);
+  }
+  return false;
+}
+
+void TestMerger::SetUp()
+{
+}
+
+void TestMerger::TearDown()
+{
+}
+
+TEST_F(TestMerger, testMergeMelodies)
+{
+  MidiFile a;
+  a.addNote(440, 100);
+  a.addNote(880, 100);
+
+  MidiFile b;
+  b.addDelay(50);
+  b.addNote(220, 100);
+
+  MidiMerger merger;
+  ASSERT_EQ(0, (int)merger.addSource(a));
+  ASSERT_EQ(1, (int)merger.addSource(b));
+  ASSERT_EQ(2, (int)merger.getSourceCount());
+
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( merger.saveToBuffer(buffer) );
+  ASSERT_EQ(merger.computeEncodedSize(), buffer.size());
+
+  //a single track in a Type 0 file
+  ASSERT_EQ(0x00, buffer[9]);
+  ASSERT_EQ(0x01, buffer[11]);
+
+  std::vector<MERGED_EVENT> events;
+  ASSERT_TRUE( getMergedEvents(buffer, events) );
+  ASSERT_EQ(6, (int)events.size());
+
+  //the events of both melodies are interleaved in time order on their own channel
+  static const uint64_t expectedTimes[] = {0, 50000, 100000, 100000, 150000, 200000};
+  static const uint8_t expectedStatus[] = {0x90, 0x91, 0x80, 0x90, 0x81, 0x80};
+  static const uint8_t expectedPitches[] = {69, 57, 69, 81, 57, 81};
+  for(size_t i=0; i<events.size(); i++)
+  {
+    uint64_t timeUs = MidiFile::ticks2time(events[i].ticks, MidiFile::DEFAULT_TICKS_PER_QUARTER_NOTE, MidiFile::DEFAULT_TEMPO);
+    ASSERT_NEAR((double)expectedTimes[i], (double)timeUs, 1100.0) << "at event " << i;
+    ASSERT_EQ(expectedStatus[i], events[i].status) << "at event " << i;
+    ASSERT_EQ(expectedPitches[i], events[i].data1) << "at event " << i;
+  }
+}
+
+TEST_F(TestMerger, testRescaleTime)
+{
+  //a source with a different resolution and tempo changes
+  MidiFile a;
+  a.setTicksPerQuarterNote(960);
+  a.setTempo(250000);
+  a.addTempoChange(1000, 1000000);
+  a.addNote(440, 1500);
+  a.addNote(880, 500);
+
+  std::vector<MidiPlayer::EVENT> expected;
+  ASSERT_TRUE( MidiPlayer::getEvents(a, expected) );
+
+  MidiMerger merger;
+  merger.setTicksPerQuarterNote(480);
+  merger.setTempo(500000);
+  ASSERT_EQ(480, (int)merger.getTicksPerQuarterNote());
+  ASSERT_EQ(500000, (int)merger.getTempo());
+  ASSERT_EQ(0, (int)merger.addSource(a));
+  merger.setChannel(0, 0);
+
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( merger.saveToBuffer(buffer) );
+
+  std::vector<MERGED_EVENT> events;
+  ASSERT_TRUE( getMergedEvents(buffer, events) );
+  ASSERT_EQ(expected.size(), events.size());
+  for(size_t i=0; i<events.size(); i++)
+  {
+    //the output has a lower resolution of about 1 ms per tick
+    uint64_t timeUs = MidiFile::ticks2time(events[i].ticks, 480, 500000);
+    ASSERT_NEAR((double)expected[i].timeUs, (double)timeUs, 1100.0) << "at event " << i;
+    ASSERT_EQ(expected[i].status, events[i].status) << "at event " << i;
+    ASSERT_EQ(expected[i].data1, events[i].data1) << "at event " << i;
+  }
+}
+
+TEST_F(TestMerger, testChannelMap)
+{
+  MidiFile a;
+  a.addNoteAt(0, 100, 60, 100, 2);
+  a.addNoteAt(0, 100, 64, 100, 3);
+
+  MidiMerger merger;
+  ASSERT_EQ(0, (int)merger.addSource(a));
+  ASSERT_FALSE( merger.setChannel(1, 0) );
+  ASSERT_FALSE( merger.setChannel(0, 16) );
+  ASSERT_FALSE( merger.setChannelMap(0, 16, 0) );
+
+  //all channels to channel 5, then channel 3 to channel 7
+  ASSERT_TRUE( merger.setChannel(0, 5) );
+  ASSERT_TRUE( merger.setChannelMap(0, 3, 7) );
+
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( merger.saveToBuffer(buffer) );
+
+  std::vector<MERGED_EVENT> events;
+  ASSERT_TRUE( getMergedEvents(buffer, events) );
+  ASSERT_EQ(4, (int)events.size());
+  for(size_t i=0; i<events.size(); i++)
+  {
+    uint8_t expectedChannel = (events[i].data1 == 60 ? 5 : 7);
+    ASSERT_EQ(expectedChannel, events[i].status & 0x0F) << "at event " << i;
+  }
+}
+
+TEST_F(TestMerger, testMergeInstrument)
+{
+  MidiFile a;
+  a.setInstrument(40);
+  a.addNote(440, 100);
+  a.addNote(880, 100);
+
+  MidiMerger merger;
+  ASSERT_EQ(0, (int)merger.addSource(a));
+
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( merger.saveToBuffer(buffer) );
+  ASSERT_EQ(merger.computeEncodedSize(), buffer.size());
+
+  //the program change event has a single data byte
+  std::vector<MERGED_EVENT> events;
+  ASSERT_TRUE( getMergedEvents(buffer, events) );
+  ASSERT_EQ(5, (int)events.size());
+  static const uint8_t expectedStatus[] = {0xC0, 0x90, 0x80, 0x90, 0x80};
+  static const uint8_t expectedData1[] = {40, 69, 69, 81, 81};
+  for(size_t i=0; i<events.size(); i++)
+  {
+    ASSERT_EQ(expectedStatus[i], events[i].status) << "at event " << i;
+    ASSERT_EQ(expectedData1[i], events[i].data1) << "at event " << i;
+  }
+  ASSERT_EQ(0, (int)events[0].ticks);
+  ASSERT_EQ(0, (int)events[1].ticks);
+
+  //the merged file can be merged again
+  MidiMerger remerger;
+  ASSERT_EQ(0, (int)remerger.addSource(&buffer[0], buffer.size()));
+  std::vector<uint8_t> remerged;
+  ASSERT_TRUE( remerger.saveToBuffer(remerged) );
+  ASSERT_EQ(buffer, remerged);
+}
+
+TEST_F(TestMerger, testMergeBuffers)
+{
+  //a Type 1 file with 2 tracks
+  MultiTrackMidiFile m;
+  m.addTrack().addNote(440, 100);
+  m.addTrack().addNote(880, 200);
+  std::vector<uint8_t> multitrack;
+  ASSERT_TRUE( m.saveToBuffer(multitrack) );
+
+  MidiFile a;
+  a.addNote(220, 300);
+
+  MidiMerger merger;
+  ASSERT_EQ(0, (int)merger.addSource(&multitrack[0], multitrack.size()));
+  ASSERT_EQ(1, (int)merger.addSource(a));
+
+  //invalid sources
+  static const uint8_t invalid[] = {'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1, 0, 0};
+  ASSERT_EQ(MidiMerger::INVALID_SOURCE, merger.addSource(invalid, sizeof(invalid)));
+  ASSERT_EQ(MidiMerger::INVALID_SOURCE, merger.addSource(&multitrack[0], multitrack.size() - 1));
+  ASSERT_EQ(MidiMerger::INVALID_SOURCE, merger.addSource(NULL, 0));
+  ASSERT_EQ(2, (int)merger.getSourceCount());
+
+  //the channels of the tracks of the first source are all mapped to channel 0
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( merger.saveToBuffer(buffer) );
+  std::vector<MERGED_EVENT> events;
+  ASSERT_TRUE( getMergedEvents(buffer, events) );
+  ASSERT_EQ(6, (int)events.size());
+  size_t numEvents[2] = {0, 0};
+  for(size_t i=0; i<events.size(); i++)
+  {
+    ASSERT_LT(events[i].status & 0x0F, 2);
+    numEvents[events[i].status & 0x0F]++;
+  }
+  ASSERT_EQ(4, (int)numEvents[0]);
+  ASSERT_EQ(2, (int)numEvents[1]);
+
+  merger.clear();
+  ASSERT_EQ(0, (int)merger.getSourceCount());
+}
+
+//a CallbackSink function that rejects all bytes
+static bool rejectBytes(const void * /*iData*/, size_t /*iSize*/, void * /*iUserData*/)
+{
+  return false;
+}
+
+TEST_F(TestMerger, testSaveToSink)
+{
+  MidiMerger merger;
+  merger.setName("merged");
+  merger.setCompactEncoding(true);
+  for(size_t i=0; i<4; i++)
+  {
+    MidiFile f;
+    for(uint16_t j=0; j<5000; j++)
+    {
+      f.addNote((uint16_t)(220 + 110*i + j%12), (uint16_t)(50 + 10*i));
+    }
+    ASSERT_EQ(i, merger.addSource(f));
+  }
+
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( merger.saveToBuffer(buffer) );
+  ASSERT_EQ(merger.computeEncodedSize(), buffer.size());
+
+  MemorySink sink;
+  ASSERT_TRUE( merger.save(sink) );
+  ASSERT_TRUE( sink.getBuffer() == buffer );
+
+  std::string path = getTestOutputFilePath("testMergerSaveToSink.mid");
+  ASSERT_TRUE( merger.save(path.c_str()) );
+  MidiFile loaded;
+  ASSERT_TRUE( loaded.load(path.c_str()) );
+  ASSERT_EQ(std::string("merged"), std::string(loaded.getName()));
+
+  //a write error stops the encoding
+  CallbackSink failing(&rejectBytes, NULL, 16);
+  ASSERT_FALSE( merger.save(failing) );
+}
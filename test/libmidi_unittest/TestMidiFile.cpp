@@ -27,6 +27,8 @@
 
 #include "libmidi/libmidi.h"
 #include "libmidi/pitches.h"
+#include "libmidi/sinks.h"
+#include "libmidi/streamwriter.h"
 #include "varlength.h"
 
 #include "rapidassist/gtesthelp.h"
@@ -409,3 +411,838 @@ TEST_F(TestMidiFile, testVariableLength)
     ASSERT_EQ(0x00, sequence[2]);
   }
 }
+
+TEST_F(TestMidiFile, testSaveToBuffer)
+{
+  MidiFile f;
+  f.setInstrument(0x51);
+  f.setMidiType(MidiFile::MIDI_TYPE_0);
+  f.setTempo(0x051615);
+  f.setName("buzzer");
+  f.setVolume(0x64);
+  for(int i=0; i<10; i++)
+  {
+    f.addNote(131, 125); // C3 instead of C4 which is 262
+    f.addDelay(125);
+  }
+
+  std::vector<uint8_t> buffer;
+  bool saved = f.saveToBuffer(buffer);
+  ASSERT_TRUE(saved);
+
+  //ASSERT content is identical
+  CharSequence expectedFileContent = readFileContentAsArray(getTestInputFilePath("buzzer.mid").c_str());
+  ASSERT_EQ(expectedFileContent.size(), buffer.size());
+  for(size_t i=0; i<expectedFileContent.size(); i++)
+  {
+    ASSERT_EQ(expectedFileContent[i], buffer[i]) << "at offset " << i;
+  }
+}
+
+TEST_F(TestMidiFile, testSaveToBufferCapacity)
+{
+  MidiFile f;
+  f.setTempo(0x051615);
+  f.setName("mario1up");
+  f.addNote(659 , 125);
+  f.addNote(784 , 125);
+  f.addNote(1319, 125);
+
+  std::vector<uint8_t> expected;
+  ASSERT_TRUE( f.saveToBuffer(expected) );
+
+  //buffer too small
+  uint8_t small[16];
+  memset(small, 0xFF, sizeof(small));
+  size_t size = 0;
+  ASSERT_FALSE( f.saveToBuffer(small, sizeof(small)-1, size) );
+  ASSERT_EQ(expected.size(), size);
+  ASSERT_EQ(0xFF, small[sizeof(small)-1]); //nothing written past the given size
+
+  //exact size
+  std::vector<uint8_t> exact(expected.size());
+  ASSERT_TRUE( f.saveToBuffer(&exact[0], exact.size(), size) );
+  ASSERT_EQ(expected.size(), size);
+  ASSERT_TRUE( expected == exact );
+}
+
+TEST_F(TestMidiFile, testComputeEncodedSize)
+{
+  //files generated by the library
+  static const char * files[] = {
+    "mario1up.mid",
+    "buzzer.mid",
+    "1second.mid",
+    "250ms.mid",
+  };
+  static const size_t numFiles = sizeof(files)/sizeof(files[0]);
+
+  for(size_t i=0; i<numFiles; i++)
+  {
+    const std::string path = getTestInputFilePath(files[i]);
+
+    MidiFile f;
+    ASSERT_TRUE( f.load(path.c_str()) ) << path;
+
+    CharSequence expectedFileContent = readFileContentAsArray(path.c_str());
+    ASSERT_EQ(expectedFileContent.size(), f.computeEncodedSize()) << path;
+  }
+
+  MidiFile f;
+  ASSERT_EQ(22 + 4, f.computeEncodedSize()); //headers and end of track
+
+  f.setName("abc");
+  ASSERT_EQ(22 + 4 + 7, f.computeEncodedSize());
+
+  f.addNote(440, 1000); //960 ticks
+  ASSERT_EQ(22 + 4 + 7 + 4 + 5, f.computeEncodedSize());
+
+  f.addNote(440, 1000); //no running status
+  ASSERT_EQ(22 + 4 + 7 + 4 + 5 + 4 + 5, f.computeEncodedSize());
+
+  f.setTrackEndingPreference(MidiFile::STOP_ALL_NOTES);
+  f.addDelay(10);
+  f.addDelay(1000); //consecutive delays
+  ASSERT_EQ(22 + 4 + 7 + 4 + 5 + 4 + 5 + 1, f.computeEncodedSize());
+
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( f.saveToBuffer(buffer) );
+  ASSERT_EQ(buffer.size(), f.computeEncodedSize());
+}
+
+//counts the note on and note off events of a single track file and validates their order
+static bool countNoteEvents(const std::vector<uint8_t> & iBuffer, size_t & oNumNoteOn, size_t & oNumNoteOff)
+{
+  oNumNoteOn = 0;
+  oNumNoteOff = 0;
+  size_t offset = 22;
+  uint8_t status = 0;
+  while(offset < iBuffer.size())
+  {
+    //skip delta time
+    while(iBuffer[offset] & 0x80)
+      offset++;
+    offset++;
+
+    if (iBuffer[offset] & 0x80)
+      status = iBuffer[offset++];
+    if (status == 0xFF)
+    {
+      uint8_t type = iBuffer[offset++];
+      uint8_t size = iBuffer[offset++];
+      offset += size;
+      if (type == 0x2F)
+        return offset == iBuffer.size();
+      continue;
+    }
+    if ((status & 0xF0) == 0x90 && iBuffer[offset+1] > 0)
+      oNumNoteOn++;
+    else if ((status & 0xF0) == 0x80 || (status & 0xF0) == 0x90)
+      oNumNoteOff++;
+    offset += 2;
+  }
+  return false;
+}
+
+TEST_F(TestMidiFile, testChord)
+{
+  MidiFile f;
+  ASSERT_TRUE( f.addNoteAt(0, 480, 0x3C, 0x64, 0) );
+  ASSERT_TRUE( f.addNoteAt(0, 480, 0x40, 0x64, 0) );
+  ASSERT_TRUE( f.addNoteAt(0, 960, 0x43, 0x64, 1) );
+  ASSERT_EQ(3, f.getTimedNoteCount());
+
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( f.saveToBuffer(buffer) );
+  ASSERT_EQ(buffer.size(), f.computeEncodedSize());
+
+  static const uint8_t expected[] = {
+    'M', 'T', 'r', 'k', 0, 0, 0, 28,
+    0x00, 0x90, 0x3C, 0x64,
+    0x00, 0x40, 0x64, //running status
+    0x00, 0x91, 0x43, 0x64,
+    0x83, 0x60, 0x80, 0x3C, 0x7F,
+    0x00, 0x40, 0x7F,
+    0x83, 0x60, 0x81, 0x43, 0x7F,
+    0x00, 0xFF, 0x2F, 0x00,
+  };
+  ASSERT_EQ(14 + sizeof(expected), buffer.size());
+  for(size_t i=0; i<sizeof(expected); i++)
+  {
+    ASSERT_EQ(expected[i], buffer[14+i]) << "at offset " << i;
+  }
+
+  //out of range values
+  ASSERT_FALSE( f.addNoteAt(0, 480, -1, 0x64, 0) );
+  ASSERT_FALSE( f.addNoteAt(0, 480, 0x3C, -1, 0) );
+  ASSERT_FALSE( f.addNoteAt(0, 480, 0x3C, 0x64, 16) );
+  ASSERT_EQ(3, f.getTimedNoteCount());
+}
+
+TEST_F(TestMidiFile, testOverlappingNotes)
+{
+  //a melody with a note added in the middle of the second note, out of order
+  MidiFile f;
+  f.setTrackEndingPreference(MidiFile::STOP_ALL_NOTES);
+  f.addNote(262, 500); //C4, 480 ticks
+  f.addNote(294, 500); //D4
+  f.addDelay(500);
+  ASSERT_TRUE( f.addNoteAt(1440, 240, 0x48, 0x40, 2) );
+  ASSERT_TRUE( f.addNoteAt(720, 480, 0x43, 0x40, 2) );
+
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( f.saveToBuffer(buffer) );
+  ASSERT_EQ(buffer.size(), f.computeEncodedSize());
+
+  static const uint8_t expected[] = {
+    0x00, 0x90, 0x3C, 0x7F,       //C4 on at 0
+    0x83, 0x60, 0x80, 0x3C, 0x7F, //C4 off at 480
+    0x00, 0x90, 0x3E, 0x7F,       //D4 on at 480
+    0x81, 0x70, 0x92, 0x43, 0x40, //G4 on at 720
+    0x81, 0x70, 0x80, 0x3E, 0x7F, //D4 off at 960
+    0x81, 0x70, 0x82, 0x43, 0x7F, //G4 off at 1200
+    0x81, 0x70, 0x92, 0x48, 0x40, //C5 on at 1440
+    0x81, 0x70, 0x82, 0x48, 0x7F, //C5 off at 1680
+    0x00, 0xB0, 0x7B, 0x00,       //all notes off
+    0x00, 0xB2, 0x7B, 0x00,
+    0x00, 0xFF, 0x2F, 0x00,       //end of track. The delay of the melody ends at 1440.
+  };
+  ASSERT_EQ(22 + sizeof(expected), buffer.size());
+  for(size_t i=0; i<sizeof(expected); i++)
+  {
+    ASSERT_EQ(expected[i], buffer[22+i]) << "at offset " << i;
+  }
+}
+
+TEST_F(TestMidiFile, testManyTimedNotes)
+{
+  MidiFile f;
+  static const size_t numNotes = 50000;
+  for(size_t i=0; i<numNotes; i++)
+  {
+    //overlapping notes of various durations on all channels
+    uint32_t start = (uint32_t)((i * 7919) % 100000);
+    uint32_t duration = (uint32_t)(1 + (i * 31) % 2000);
+    ASSERT_TRUE( f.addNoteAt(start, duration, (int8_t)(i % 128), 0x64, (uint8_t)(i % 16)) );
+  }
+
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( f.saveToBuffer(buffer) );
+  ASSERT_EQ(buffer.size(), f.computeEncodedSize());
+
+  size_t numNoteOn = 0;
+  size_t numNoteOff = 0;
+  ASSERT_TRUE( countNoteEvents(buffer, numNoteOn, numNoteOff) );
+  ASSERT_EQ(numNotes, numNoteOn);
+  ASSERT_EQ(numNotes, numNoteOff);
+}
+
+TEST_F(TestMidiFile, testAddNotes)
+{
+  static const uint16_t frequencies[] = {659, 784, 0, 1319, 1319, 1047, 0, 0, 1175, 1568};
+  static const uint16_t durations[]   = {125, 125, 50, 125, 250, 125, 10, 20, 125, 1000};
+  static const size_t numNotes = sizeof(frequencies)/sizeof(frequencies[0]);
+
+  MidiFile expected;
+  expected.setVolume(0x64);
+  for(size_t i=0; i<numNotes; i++)
+  {
+    if (frequencies[i])
+      expected.addNote(frequencies[i], durations[i]);
+    else
+      expected.addDelay(durations[i]);
+  }
+
+  MidiFile f;
+  f.reserve(2*numNotes);
+  f.setVolume(0x64);
+  f.addNotes(frequencies, durations, 0);
+  f.addNotes(frequencies, durations, 4);
+  f.addNotes(&frequencies[4], &durations[4], numNotes-4);
+
+  ASSERT_EQ(numNotes, f.getNoteCount());
+  for(size_t i=0; i<numNotes; i++)
+  {
+    ASSERT_EQ(frequencies[i], f.getNoteFrequency(i));
+    ASSERT_EQ(durations[i], f.getNoteDuration(i));
+    ASSERT_EQ(0x64, f.getNoteVolume(i));
+  }
+
+  std::vector<uint8_t> expectedBuffer;
+  std::vector<uint8_t> actualBuffer;
+  ASSERT_TRUE( expected.saveToBuffer(expectedBuffer) );
+  ASSERT_TRUE( f.saveToBuffer(actualBuffer) );
+  ASSERT_TRUE( expectedBuffer == actualBuffer );
+}
+
+TEST_F(TestMidiFile, testConversions)
+{
+  ASSERT_EQ(960, MidiFile::duration2ticks(1000, 480, 500000));
+  ASSERT_EQ(960, MidiFile::duration2ticks(1001, 480, 500000)); //rounded down
+  ASSERT_EQ(1000, MidiFile::ticks2duration(960, 480, 500000));
+  ASSERT_EQ(125, MidiFile::ticks2duration(120, 480, 500000));
+
+  //long notes do not overflow
+  ASSERT_EQ(629136, MidiFile::duration2ticks(65535, 960, 100000));
+  ASSERT_EQ(65535, MidiFile::ticks2duration(629136, 960, 100000));
+
+  //10 hours
+  static const uint64_t tenHoursUs = 10ull*3600*1000*1000;
+  ASSERT_EQ(34560000ull, MidiFile::time2ticks(tenHoursUs, 480, 500000));
+  ASSERT_EQ(tenHoursUs, MidiFile::ticks2time(34560000ull, 480, 500000));
+}
+
+TEST_F(TestMidiFile, testMicroseconds)
+{
+  MidiFile f;
+  f.addNoteUs(262, 1500);
+  f.addDelayUs(499);
+  f.addNote(294, 250);
+
+  ASSERT_EQ(3, f.getNoteCount());
+  ASSERT_EQ(1500, f.getNoteDurationUs(0));
+  ASSERT_EQ(2, f.getNoteDuration(0));
+  ASSERT_EQ(499, f.getNoteDurationUs(1));
+  ASSERT_EQ(0, f.getNoteDuration(1));
+  ASSERT_EQ(0, f.getNoteFrequency(1));
+  ASSERT_EQ(250000, f.getNoteDurationUs(2));
+  ASSERT_EQ(250, f.getNoteDuration(2));
+
+  //loaded notes are placed at their original ticks when saved again
+  MidiFile g;
+  g.setTicksPerQuarterNote(960);
+  for(uint32_t i=0; i<100; i++)
+  {
+    g.addNoteUs(440, 125000 + i*1000);
+    g.addDelayUs(25000);
+  }
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( g.saveToBuffer(buffer) );
+
+  MidiFile loaded;
+  ASSERT_TRUE( loaded.loadFromBuffer(&buffer[0], buffer.size()) );
+  ASSERT_EQ(g.getNoteCount(), loaded.getNoteCount());
+  static const uint32_t tickUs = 521;
+  for(size_t i=0; i<g.getNoteCount(); i++)
+  {
+    ASSERT_LT(abs((int)g.getNoteDurationUs(i) - (int)loaded.getNoteDurationUs(i)), (int)tickUs) << "i=" << i;
+  }
+
+  std::vector<uint8_t> saved;
+  ASSERT_TRUE( loaded.saveToBuffer(saved) );
+  ASSERT_TRUE( buffer == saved );
+}
+
+TEST_F(TestMidiFile, testNoDrift)
+{
+  //1001 ms is 960.96 ticks. Rounding each note would lose 0.96 ticks per note.
+  static const uint32_t numNotes = 3600;
+  MidiFile f;
+  f.reserve(numNotes);
+  for(uint32_t i=0; i<numNotes; i++)
+    f.addNote(i%2 ? 262 : 0, 1001);
+
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( f.saveToBuffer(buffer) );
+
+  MidiFile loaded;
+  ASSERT_TRUE( loaded.loadFromBuffer(&buffer[0], buffer.size()) );
+  uint64_t totalUs = 0;
+  for(size_t i=0; i<loaded.getNoteCount(); i++)
+    totalUs += loaded.getNoteDurationUs(i);
+  ASSERT_EQ(1001ull*1000*numNotes, totalUs);
+}
+
+TEST_F(TestMidiFile, testTempoChanges)
+{
+  MidiFile f;
+  for(int i=0; i<4; i++)
+    f.addNote(262, 1000);
+  ASSERT_TRUE( f.addTempoChange(2000, 250000) );
+  ASSERT_FALSE( f.addTempoChange(1000, 0) );
+  ASSERT_FALSE( f.addTempoChange(1000, 0x1000000) );
+  ASSERT_EQ(1, f.getTempoChangeCount());
+
+  //960 ticks per second, then 1920 ticks per second
+  ASSERT_EQ(960, f.time2ticks(1000000));
+  ASSERT_EQ(1920, f.time2ticks(2000000));
+  ASSERT_EQ(3840, f.time2ticks(3000000));
+  ASSERT_EQ(1000000, f.ticks2time(960));
+  ASSERT_EQ(3000000, f.ticks2time(3840));
+
+  //a change at time 0 sets the initial tempo
+  ASSERT_TRUE( f.addTempoChange(0, 400000) );
+  ASSERT_EQ(400000, f.getTempo());
+  ASSERT_EQ(1, f.getTempoChangeCount());
+  ASSERT_EQ(2400, f.time2ticks(2000000));
+  ASSERT_TRUE( f.addTempoChange(0, 500000) );
+
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( f.saveToBuffer(buffer) );
+
+  MidiFile loaded;
+  ASSERT_TRUE( loaded.loadFromBuffer(&buffer[0], buffer.size()) );
+  ASSERT_EQ((uint32_t)MidiFile::DEFAULT_TEMPO, loaded.getTempo());
+  ASSERT_EQ(1, loaded.getTempoChangeCount());
+  ASSERT_EQ(4, loaded.getNoteCount());
+  for(size_t i=0; i<loaded.getNoteCount(); i++)
+  {
+    ASSERT_EQ(1000, loaded.getNoteDuration(i));
+  }
+
+  std::vector<uint8_t> saved;
+  ASSERT_TRUE( loaded.saveToBuffer(saved) );
+  ASSERT_TRUE( buffer == saved );
+}
+
+TEST_F(TestMidiFile, testTempoChangesOrder)
+{
+  MidiFile expected;
+  MidiFile f;
+  for(int i=0; i<10; i++)
+  {
+    expected.addNote(262 + i, 250);
+    f.addNote(262 + i, 250);
+  }
+  ASSERT_TRUE( expected.addTempoChange(500, 400000) );
+  ASSERT_TRUE( expected.addTempoChange(1000, 300000) );
+  ASSERT_TRUE( expected.addTempoChange(1500, 200000) );
+
+  ASSERT_TRUE( f.addTempoChange(1500, 100000) );
+  ASSERT_TRUE( f.addTempoChange(500, 400000) );
+  ASSERT_TRUE( f.addTempoChange(1000, 300000) );
+  ASSERT_TRUE( f.addTempoChange(1500, 200000) ); //replaced
+  ASSERT_EQ(3, f.getTempoChangeCount());
+
+  std::vector<uint8_t> expectedBuffer;
+  std::vector<uint8_t> actualBuffer;
+  ASSERT_TRUE( expected.saveToBuffer(expectedBuffer) );
+  ASSERT_TRUE( f.saveToBuffer(actualBuffer) );
+  ASSERT_TRUE( expectedBuffer == actualBuffer );
+
+  //the ticks of the tempo changes follow the changes of the settings
+  f.setTicksPerQuarterNote(960);
+  expected.setTicksPerQuarterNote(960);
+  for(uint64_t t=0; t<3000000; t+=12345)
+  {
+    ASSERT_EQ(expected.time2ticks(t), f.time2ticks(t));
+  }
+  ASSERT_EQ(960*2*500/1000 + 960*500/400, f.time2ticks(1000000));
+}
+
+TEST_F(TestMidiFile, testAccelerando)
+{
+  //a tempo change every 10 ms
+  static const uint32_t numChanges = 5000;
+  MidiFile f;
+  f.setTicksPerQuarterNote(960);
+  f.reserve(numChanges);
+  for(uint32_t i=1; i<=numChanges; i++)
+  {
+    f.addNote(440, 10);
+    ASSERT_TRUE( f.addTempoChange(10*i, 500000 - 50*i) );
+  }
+  ASSERT_EQ(numChanges, f.getTempoChangeCount());
+
+  //tempo changes are placed on a tick. Conversions are exact within a tick.
+  static const int64_t tickUs = 500000/960 + 1;
+  uint64_t previousTicks = 0;
+  for(uint64_t t=0; t<10*numChanges*1000; t+=777)
+  {
+    uint64_t ticks = f.time2ticks(t);
+    ASSERT_GE(ticks, previousTicks);
+    ASSERT_LT(llabs((int64_t)f.ticks2time(ticks) - (int64_t)t), tickUs);
+    previousTicks = ticks;
+  }
+
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( f.saveToBuffer(buffer) );
+  ASSERT_EQ(buffer.size(), f.computeEncodedSize());
+
+  MidiFile loaded;
+  ASSERT_TRUE( loaded.loadFromBuffer(&buffer[0], buffer.size()) );
+  ASSERT_EQ(numChanges, loaded.getTempoChangeCount());
+
+  std::vector<uint8_t> saved;
+  ASSERT_TRUE( loaded.saveToBuffer(saved) );
+  ASSERT_TRUE( buffer == saved );
+}
+
+TEST_F(TestMidiFile, testCompactEncoding)
+{
+  MidiFile f;
+  f.addNote(262, 250);
+  f.addDelay(100);
+  f.addDelay(150);
+  f.addNote(262, 250);
+  ASSERT_FALSE( f.isCompactEncoding() );
+
+  std::vector<uint8_t> normal;
+  ASSERT_TRUE( f.saveToBuffer(normal) );
+  size_t savings = f.computeCompactEncodingSavings();
+
+  f.setCompactEncoding(true);
+  ASSERT_TRUE( f.isCompactEncoding() );
+  std::vector<uint8_t> compact;
+  ASSERT_TRUE( f.saveToBuffer(compact) );
+  ASSERT_EQ(compact.size(), f.computeEncodedSize());
+  ASSERT_EQ(savings, f.computeCompactEncodingSavings());
+  ASSERT_EQ(normal.size() - compact.size(), savings);
+
+  //note off events are note on events with a velocity of 0 and all events share the same running status
+  static const uint8_t expectedTrack[] = {
+    0x00, 0x90, 0x3C, 0x7F,
+    0x81, 0x70, 0x3C, 0x00,
+    0x81, 0x70, 0x3C, 0x7F, //the delays are merged
+    0x81, 0x70, 0x3C, 0x00,
+    0x00, 0xFF, 0x2F, 0x00,
+  };
+  ASSERT_EQ(22 + sizeof(expectedTrack), compact.size());
+  ASSERT_EQ(0, memcmp(expectedTrack, &compact[22], sizeof(expectedTrack)));
+
+  //the compact encoding is detected when loading
+  MidiFile loaded;
+  ASSERT_TRUE( loaded.loadFromBuffer(&compact[0], compact.size()) );
+  ASSERT_TRUE( loaded.isCompactEncoding() );
+  ASSERT_EQ(3, loaded.getNoteCount());
+  ASSERT_EQ(250, loaded.getNoteDuration(0));
+  ASSERT_EQ(250, loaded.getNoteDuration(1));
+  ASSERT_EQ(250, loaded.getNoteDuration(2));
+  std::vector<uint8_t> saved;
+  ASSERT_TRUE( loaded.saveToBuffer(saved) );
+  ASSERT_TRUE( compact == saved );
+
+  ASSERT_TRUE( loaded.loadFromBuffer(&normal[0], normal.size()) );
+  ASSERT_FALSE( loaded.isCompactEncoding() );
+}
+
+TEST_F(TestMidiFile, testCompactEncodingSavings)
+{
+  MidiFile f;
+  f.setVolume(0x64);
+  for(uint16_t i=0; i<1000; i++)
+  {
+    f.addNote(200 + i%500, 100 + i%20);
+    if (i%10 == 0)
+      f.addDelay(50);
+  }
+  //changes to the same tempo are dropped
+  ASSERT_TRUE( f.addTempoChange(1000, 400000) );
+  ASSERT_TRUE( f.addTempoChange(2000, 400000) );
+  ASSERT_TRUE( f.addTempoChange(3000, 400000) );
+
+  size_t normalSize = f.computeEncodedSize();
+  f.setCompactEncoding(true);
+  size_t compactSize = f.computeEncodedSize();
+  ASSERT_EQ(normalSize - compactSize, f.computeCompactEncodingSavings());
+  ASSERT_GE(100*(normalSize - compactSize), 20*normalSize);
+
+  //chords use running status on each channel
+  MidiFile chords;
+  for(uint32_t i=0; i<100; i++)
+  {
+    ASSERT_TRUE( chords.addNoteAt(i*480, 480, 60, 0x50, 1) );
+    ASSERT_TRUE( chords.addNoteAt(i*480, 480, 64, 0x50, 1) );
+    ASSERT_TRUE( chords.addNoteAt(i*480, 480, 67, 0x50, 1) );
+  }
+  chords.setCompactEncoding(true);
+  ASSERT_GT(chords.computeCompactEncodingSavings(), (size_t)0);
+
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( chords.saveToBuffer(buffer) );
+  size_t numNoteOn = 0;
+  size_t numNoteOff = 0;
+  ASSERT_TRUE( countNoteEvents(buffer, numNoteOn, numNoteOff) );
+  ASSERT_EQ(300, numNoteOn);
+  ASSERT_EQ(300, numNoteOff);
+}
+
+TEST_F(TestMidiFile, testVariableLengthMinOutputSize)
+{
+  //0 forced to 2 bytes
+  {
+    static const std::string outputFile = getTestOutputFilePath("0.min2.output.bin");
+    FILE * f = fopen(outputFile.c_str(), "wb");
+    unsigned int value = 0;
+    size_t writeSize = fwriteVariableLength(value, 2, f);
+    fclose(f);
+    ASSERT_EQ(2, writeSize);
+    CharSequence sequence = readFileContentAsArray(outputFile.c_str());
+    ASSERT_EQ(2, sequence.size());
+    ASSERT_EQ(0x80, sequence[0]);
+    ASSERT_EQ(0x00, sequence[1]);
+  }
+
+  //255 forced to 1 byte (ignored)
+  {
+    uint8_t buffer[VARIABLE_LENGTH_MAX_SIZE];
+    ASSERT_EQ(2, encodeVariableLength(255, 1, buffer));
+    ASSERT_EQ(0x81, buffer[0]);
+    ASSERT_EQ(0x7f, buffer[1]);
+  }
+
+  //127 forced to 4 bytes
+  {
+    uint8_t buffer[VARIABLE_LENGTH_MAX_SIZE];
+    ASSERT_EQ(4, encodeVariableLength(127, 4, buffer));
+    ASSERT_EQ(0x80, buffer[0]);
+    ASSERT_EQ(0x80, buffer[1]);
+    ASSERT_EQ(0x80, buffer[2]);
+    ASSERT_EQ(0x7f, buffer[3]);
+
+    uint32_t value = 0;
+    ASSERT_EQ(4, decodeVariableLength(buffer, sizeof(buffer), value));
+    ASSERT_EQ(127, value);
+  }
+
+  //minimum size too big (ignored)
+  {
+    uint8_t buffer[VARIABLE_LENGTH_MAX_SIZE];
+    ASSERT_EQ(1, encodeVariableLength(0, VARIABLE_LENGTH_MAX_SIZE+1, buffer));
+  }
+}
+
+TEST_F(TestMidiFile, testVariableLengthCodec)
+{
+  struct VLQ_SAMPLE
+  {
+    uint32_t value;
+    size_t size;
+    uint8_t bytes[VARIABLE_LENGTH_MAX_SIZE];
+  };
+  static const VLQ_SAMPLE samples[] = {
+    {0x00000000, 1, {0x00}},
+    {0x00000040, 1, {0x40}},
+    {0x0000007F, 1, {0x7F}},
+    {0x00000080, 2, {0x81, 0x00}},
+    {0x00002000, 2, {0xC0, 0x00}},
+    {0x00003FFF, 2, {0xFF, 0x7F}},
+    {0x00004000, 3, {0x81, 0x80, 0x00}},
+    {0x00100000, 3, {0xC0, 0x80, 0x00}},
+    {0x001FFFFF, 3, {0xFF, 0xFF, 0x7F}},
+    {0x00200000, 4, {0x81, 0x80, 0x80, 0x00}},
+    {0x08000000, 4, {0xC0, 0x80, 0x80, 0x00}},
+    {0x0FFFFFFF, 4, {0xFF, 0xFF, 0xFF, 0x7F}},
+  };
+  static const size_t numSamples = sizeof(samples)/sizeof(samples[0]);
+
+  for(size_t i=0; i<numSamples; i++)
+  {
+    const VLQ_SAMPLE & s = samples[i];
+
+    ASSERT_EQ(s.size, getVariableLengthSize(s.value));
+
+    uint8_t buffer[VARIABLE_LENGTH_MAX_SIZE];
+    ASSERT_EQ(s.size, encodeVariableLength(s.value, buffer));
+    for(size_t j=0; j<s.size; j++)
+    {
+      ASSERT_EQ(s.bytes[j], buffer[j]) << "value " << s.value << " at byte " << j;
+    }
+
+    uint32_t value = 0;
+    ASSERT_EQ(s.size, decodeVariableLength(buffer, s.size, value));
+    ASSERT_EQ(s.value, value);
+
+    //truncated input
+    ASSERT_EQ(0, decodeVariableLength(buffer, s.size-1, value));
+  }
+
+  //bulk encoding and decoding
+  std::vector<uint32_t> values;
+  for(size_t i=0; i<numSamples; i++)
+    values.push_back(samples[i].value);
+  size_t expectedSize = getVariableLengthArraySize(&values[0], values.size());
+  std::vector<uint8_t> buffer(expectedSize);
+  ASSERT_EQ(expectedSize, encodeVariableLengthArray(&values[0], values.size(), &buffer[0]));
+
+  std::vector<uint32_t> decoded(values.size());
+  ASSERT_EQ(expectedSize, decodeVariableLengthArray(&buffer[0], buffer.size(), &decoded[0], decoded.size()));
+  ASSERT_TRUE(values == decoded);
+
+  //not enough values in buffer
+  decoded.push_back(0);
+  ASSERT_EQ(0, decodeVariableLengthArray(&buffer[0], buffer.size(), &decoded[0], decoded.size()));
+}
+
+TEST_F(TestMidiFile, testVariableLengthLimit)
+{
+  //values larger than 4 bytes are clamped
+  static const uint32_t values[] = {0x10000000, 0x7FFFFFFF, 0xFFFFFFFF};
+  for(size_t i=0; i<sizeof(values)/sizeof(values[0]); i++)
+  {
+    ASSERT_EQ(VARIABLE_LENGTH_MAX_SIZE, getVariableLengthSize(values[i]));
+
+    uint8_t buffer[VARIABLE_LENGTH_MAX_SIZE];
+    ASSERT_EQ(VARIABLE_LENGTH_MAX_SIZE, encodeVariableLength(values[i], buffer));
+    ASSERT_EQ(VARIABLE_LENGTH_MAX_SIZE, encodeVariableLength(values[i], VARIABLE_LENGTH_MAX_SIZE, buffer));
+
+    uint32_t value = 0;
+    ASSERT_EQ(VARIABLE_LENGTH_MAX_SIZE, decodeVariableLength(buffer, sizeof(buffer), value));
+    ASSERT_EQ(VARIABLE_LENGTH_MAX_VALUE, value);
+  }
+
+  //values longer than 4 bytes are rejected
+  static const uint8_t tooLong[] = {0x8F, 0xFF, 0xFF, 0xFF, 0x7F};
+  uint32_t value = 0;
+  ASSERT_EQ(0, decodeVariableLength(tooLong, sizeof(tooLong), value));
+  static const uint8_t padded[] = {0x80, 0x80, 0x80, 0x80, 0x00};
+  ASSERT_EQ(0, decodeVariableLength(padded, sizeof(padded), value));
+}
+
+TEST_F(TestMidiFile, testLongDelay)
+{
+  static const std::string outputFile = getTestOutputFilePath("testLongDelay.mid");
+  static const uint32_t DELAY_US = 15*60*1000000; //longer than a Variable Length Quantity at this resolution
+
+  MidiFile f;
+  f.setTicksPerQuarterNote(32000);
+  f.setTempo(100000);
+  f.addNote(440, 100);
+  f.addDelayUs(DELAY_US);
+  f.addNote(880, 100);
+  ASSERT_GT(f.time2ticks(DELAY_US), (uint64_t)VARIABLE_LENGTH_MAX_VALUE);
+
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( f.saveToBuffer(buffer) );
+  ASSERT_EQ(f.computeEncodedSize(), buffer.size());
+
+  //the delay is not shortened
+  MidiFile loaded;
+  ASSERT_TRUE( loaded.loadFromBuffer(&buffer[0], buffer.size()) );
+  ASSERT_EQ(3, loaded.getNoteCount());
+  ASSERT_EQ(440, loaded.getNoteFrequency(0));
+  ASSERT_EQ(0, loaded.getNoteFrequency(1));
+  ASSERT_EQ(DELAY_US, loaded.getNoteDurationUs(1));
+  ASSERT_EQ(880, loaded.getNoteFrequency(2));
+  ASSERT_EQ(100000, loaded.getNoteDurationUs(2));
+
+  //the stream writer and the append save write the same file
+  MemorySink sink;
+  MidiStreamWriter writer;
+  writer.setTicksPerQuarterNote(32000);
+  writer.setTempo(100000);
+  writer.setChunkSize(16);
+  ASSERT_TRUE( writer.open(sink) );
+  ASSERT_TRUE( writer.addNote(440, 100) );
+  ASSERT_TRUE( writer.addDelayUs(DELAY_US) );
+  ASSERT_TRUE( writer.addNote(880, 100) );
+  ASSERT_TRUE( writer.close() );
+  ASSERT_TRUE( sink.getBuffer() == buffer );
+
+  MidiFile appended;
+  appended.setTicksPerQuarterNote(32000);
+  appended.setTempo(100000);
+  appended.addNote(440, 100);
+  ASSERT_TRUE( appended.saveAppend(outputFile.c_str()) );
+  appended.addDelayUs(DELAY_US);
+  ASSERT_TRUE( appended.saveAppend(outputFile.c_str()) );
+  appended.addNote(880, 100);
+  ASSERT_TRUE( appended.saveAppend(outputFile.c_str()) );
+  CharSequence actual = readFileContentAsArray(outputFile.c_str());
+  ASSERT_TRUE( actual == buffer );
+
+  //notes added at their tick are not moved either
+  MidiFile timed;
+  timed.setTicksPerQuarterNote(32000);
+  timed.setTempo(100000);
+  ASSERT_TRUE( timed.addNoteAt(0, 320, 69, 0x7f, 0) );
+  ASSERT_TRUE( timed.addNoteAt(320 + 288000000, 320, 81, 0x7f, 0) );
+  ASSERT_TRUE( timed.saveToBuffer(buffer) );
+  ASSERT_EQ(timed.computeEncodedSize(), buffer.size());
+  ASSERT_TRUE( loaded.loadFromBuffer(&buffer[0], buffer.size()) );
+  ASSERT_EQ(3, loaded.getNoteCount());
+  ASSERT_EQ(DELAY_US, loaded.getNoteDurationUs(1));
+}
+
+TEST_F(TestMidiFile, testSaveAppend)
+{
+  static const std::string outputFile = getTestOutputFilePath("testSaveAppend.mid");
+  static const uint16_t frequencies[] = {440, 0, 494, 523, 0, 0, 587, 659};
+
+  MidiFile::TRACK_ENDING_PREFERENCE preferences[] = {MidiFile::STOP_PREVIOUS_NOTE, MidiFile::STOP_ALL_NOTES};
+  for(size_t p=0; p<2; p++)
+  {
+    for(int compact=0; compact<2; compact++)
+    {
+      MidiFile f;
+      f.setName("append");
+      f.setTrackEndingPreference(preferences[p]);
+      f.setCompactEncoding(compact != 0);
+      f.setTempo(400000);
+
+      //the file matches save() after each call
+      for(size_t i=0; i<24; i++)
+      {
+        for(size_t j=0; j<=i%3; j++)
+        {
+          size_t index = (i + j) % (sizeof(frequencies)/sizeof(frequencies[0]));
+          f.addNote(frequencies[index], (uint16_t)(100 + 7*i + j));
+        }
+        ASSERT_TRUE( f.saveAppend(outputFile.c_str()) );
+
+        std::vector<uint8_t> expected;
+        ASSERT_TRUE( f.saveToBuffer(expected) );
+        CharSequence actual = readFileContentAsArray(outputFile.c_str());
+        ASSERT_TRUE( actual == expected ) << "at step " << i << " preference " << p << " compact " << compact;
+      }
+    }
+  }
+}
+
+TEST_F(TestMidiFile, testSaveAppendWritesTail)
+{
+  static const std::string outputFile = getTestOutputFilePath("testSaveAppendWritesTail.mid");
+
+  MidiFile f;
+  f.setName("abcd");
+  f.addNote(440, 100);
+  f.addNote(880, 100);
+  ASSERT_TRUE( f.saveAppend(outputFile.c_str()) );
+
+  //change the name in the file without changing its size
+  CharSequence content = readFileContentAsArray(outputFile.c_str());
+  size_t nameOffset = 22 + 4; //delta, meta, type and size
+  ASSERT_EQ('a', content[nameOffset]);
+  FILE * file = fopen(outputFile.c_str(), "r+b");
+  ASSERT_TRUE( file != NULL );
+  fseek(file, (long)nameOffset, SEEK_SET);
+  fputc('z', file);
+  fclose(file);
+
+  //only the end of the track is written again
+  f.addNote(660, 100);
+  ASSERT_TRUE( f.saveAppend(outputFile.c_str()) );
+  std::vector<uint8_t> expected;
+  ASSERT_TRUE( f.saveToBuffer(expected) );
+  content = readFileContentAsArray(outputFile.c_str());
+  ASSERT_EQ(expected.size(), content.size());
+  ASSERT_EQ('z', content[nameOffset]);
+  content[nameOffset] = 'a';
+  ASSERT_TRUE( content == expected );
+
+  //the whole file is written again when the settings change
+  f.setInstrument(40);
+  f.addNote(440, 100);
+  ASSERT_TRUE( f.saveAppend(outputFile.c_str()) );
+  ASSERT_TRUE( f.saveToBuffer(expected) );
+  content = readFileContentAsArray(outputFile.c_str());
+  ASSERT_TRUE( content == expected );
+
+  //or when the file is not the one written by the previous call
+  std::string otherFile = getTestOutputFilePath("testSaveAppendWritesTail.other.mid");
+  f.addNote(220, 100);
+  ASSERT_TRUE( f.saveAppend(otherFile.c_str()) );
+  ASSERT_TRUE( f.saveToBuffer(expected) );
+  content = readFileContentAsArray(otherFile.c_str());
+  ASSERT_TRUE( content == expected );
+
+  //or when the melody has tempo changes
+  f.addTempoChange(200, 250000);
+  f.addNote(440, 100);
+  ASSERT_TRUE( f.saveAppend(otherFile.c_str()) );
+  ASSERT_TRUE( f.saveToBuffer(expected) );
+  content = readFileContentAsArray(otherFile.c_str());
+  ASSERT_TRUE( content == expected );
+
+  ASSERT_FALSE( f.saveAppend(NULL) );
+}
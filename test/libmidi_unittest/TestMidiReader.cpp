@@ -0,0 +1,193 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#include "libmidi/libmidi.h"
+#include "libmidi/pitches.h"
+
+#include "TestMidiReader.h"
+
+using namespace libmidi;
+
+typedef std::vector<unsigned char> CharSequence;
+
+extern std::string getTestInputFilePath(const char * name);
+extern CharSequence readFileContentAsArray(const char * iFilePath);
+
+void TestMidiReader::SetUp()
+{
+}
+
+void TestMidiReader::TearDown()
+{
+}
+
+TEST_F(TestMidiReader, testLoadRoundTrip)
+{
+  //files generated by the library
+  static const char * files[] = {
+    "mario1up.mid",
+    "buzzer.mid",
+    "1second.mid",
+    "250ms.mid",
+  };
+  static const size_t numFiles = sizeof(files)/sizeof(files[0]);
+
+  for(size_t i=0; i<numFiles; i++)
+  {
+    const std::string path = getTestInputFilePath(files[i]);
+
+    MidiFile f;
+    ASSERT_TRUE( f.load(path.c_str()) ) << path;
+
+    std::vector<uint8_t> buffer;
+    ASSERT_TRUE( f.saveToBuffer(buffer) );
+
+    //ASSERT content is identical
+    CharSequence expectedFileContent = readFileContentAsArray(path.c_str());
+    ASSERT_TRUE( expectedFileContent == buffer ) << path;
+  }
+}
+
+TEST_F(TestMidiReader, testLoadMario1Up)
+{
+  MidiFile f;
+  ASSERT_TRUE( f.load(getTestInputFilePath("mario1up.mid").c_str()) );
+
+  ASSERT_EQ(MidiFile::MIDI_TYPE_0, f.getMidiType());
+  ASSERT_STREQ("mario1up", f.getName());
+  ASSERT_EQ(0x051615, f.getTempo());
+  ASSERT_EQ(480, f.getTicksPerQuarterNote());
+  ASSERT_EQ(0x51, f.getInstrument());
+  ASSERT_EQ(0x64, f.getVolume());
+  ASSERT_EQ(MidiFile::STOP_PREVIOUS_NOTE, f.getTrackEndingPreference());
+
+  static const uint16_t frequencies[] = {659, 784, 1319, 1047, 1175, 1568};
+  ASSERT_EQ(6, f.getNoteCount());
+  for(size_t i=0; i<f.getNoteCount(); i++)
+  {
+    ASSERT_EQ(frequencies[i], f.getNoteFrequency(i));
+    ASSERT_EQ(125, f.getNoteDuration(i));
+    ASSERT_EQ(0x64, f.getNoteVolume(i));
+  }
+}
+
+TEST_F(TestMidiReader, testLoadDelays)
+{
+  MidiFile f;
+  ASSERT_TRUE( f.load(getTestInputFilePath("buzzer.mid").c_str()) );
+
+  ASSERT_EQ(20, f.getNoteCount());
+  for(size_t i=0; i<f.getNoteCount(); i+=2)
+  {
+    ASSERT_EQ(131, f.getNoteFrequency(i));
+    ASSERT_EQ(125, f.getNoteDuration(i));
+    ASSERT_EQ(0, f.getNoteFrequency(i+1)); //delay
+    ASSERT_EQ(125, f.getNoteDuration(i+1));
+  }
+}
+
+TEST_F(TestMidiReader, testLoadRunningStatus)
+{
+  //notes are not stopped, running status and track ends with 'all notes off'
+  MidiFile f;
+  ASSERT_TRUE( f.load(getTestInputFilePath("cde1.mid").c_str()) );
+
+  ASSERT_EQ(MidiFile::MIDI_TYPE_1, f.getMidiType());
+  ASSERT_STREQ("", f.getName());
+  ASSERT_EQ((uint32_t)MidiFile::DEFAULT_TEMPO, f.getTempo());
+  ASSERT_EQ(0x80, f.getTicksPerQuarterNote());
+  ASSERT_EQ(MidiFile::STOP_ALL_NOTES, f.getTrackEndingPreference());
+
+  ASSERT_EQ(3, f.getNoteCount());
+  ASSERT_EQ(NOTE_C4, f.getNoteFrequency(0));
+  ASSERT_EQ(NOTE_D4, f.getNoteFrequency(1));
+  ASSERT_EQ(NOTE_E4, f.getNoteFrequency(2));
+  for(size_t i=0; i<f.getNoteCount(); i++)
+  {
+    ASSERT_EQ(500, f.getNoteDuration(i));
+    ASSERT_EQ(0x60, f.getNoteVolume(i));
+  }
+}
+
+TEST_F(TestMidiReader, testLoadNoteOnZeroVelocity)
+{
+  //notes are stopped with a 'note on' event of velocity 0
+  MidiFile f;
+  ASSERT_TRUE( f.load(getTestInputFilePath("cde2.mid").c_str()) );
+
+  ASSERT_EQ(MidiFile::STOP_PREVIOUS_NOTE, f.getTrackEndingPreference());
+  ASSERT_EQ(3, f.getNoteCount());
+  ASSERT_EQ(NOTE_C4, f.getNoteFrequency(0));
+  ASSERT_EQ(NOTE_D4, f.getNoteFrequency(1));
+  ASSERT_EQ(NOTE_E4, f.getNoteFrequency(2));
+  for(size_t i=0; i<f.getNoteCount(); i++)
+  {
+    ASSERT_EQ(500, f.getNoteDuration(i));
+  }
+}
+
+TEST_F(TestMidiReader, testLoadInvalid)
+{
+  MidiFile f;
+  f.setName("unchanged");
+
+  ASSERT_FALSE( f.load(NULL) );
+  ASSERT_FALSE( f.load(getTestInputFilePath("missing.mid").c_str()) );
+  ASSERT_FALSE( f.load(getTestInputFilePath("mario1up.rtttl.txt").c_str()) );
+  ASSERT_FALSE( f.loadFromBuffer(NULL, 0) );
+
+  CharSequence content = readFileContentAsArray(getTestInputFilePath("mario1up.mid").c_str());
+  ASSERT_TRUE( f.loadFromBuffer(&content[0], content.size()) );
+  ASSERT_STREQ("mario1up", f.getName());
+  f.setName("unchanged");
+
+  //truncated header
+  ASSERT_FALSE( f.loadFromBuffer(&content[0], 10) );
+
+  //truncated track
+  ASSERT_FALSE( f.loadFromBuffer(&content[0], content.size()-1) );
+
+  //unknown status byte
+  {
+    CharSequence invalid = content;
+    invalid[invalid.size()-3] = 0xF4;
+    ASSERT_FALSE( f.loadFromBuffer(&invalid[0], invalid.size()) );
+  }
+
+  //running status without a previous status
+  {
+    CharSequence invalid = content;
+    invalid[23] = 0x03;
+    ASSERT_FALSE( f.loadFromBuffer(&invalid[0], invalid.size()) );
+  }
+
+  //SMPTE time division
+  {
+    CharSequence invalid = content;
+    invalid[12] = 0xE7;
+    ASSERT_FALSE( f.loadFromBuffer(&invalid[0], invalid.size()) );
+  }
+
+  ASSERT_STREQ("unchanged", f.getName());
+}
@@ -0,0 +1,222 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#include "libmidi/libmidi.h"
+#include "libmidi/multitrack.h"
+#include "libmidi/pitches.h"
+#include "libmidi/sinks.h"
+
+#include "TestMultiTrack.h"
+
+#include <cstring> //for memcmp()
+
+using namespace libmidi;
+
+typedef std::vector<unsigned char> CharSequence;
+
+extern std::string getTestInputFilePath(const char * name);
+extern std::string getTestOutputFilePath(const char * name);
+extern CharSequence readFileContentAsArray(const char * iFilePath);
+
+static uint32_t readBigEndian32(const uint8_t * iBuffer)
+{
+  return ((uint32_t)iBuffer[0] << 24) | ((uint32_t)iBuffer[1] << 16) | ((uint32_t)iBuffer[2] << 8) | (uint32_t)iBuffer[3];
+}
+
+//returns the offset of each track chunk of a file
+static std::vector<size_t> findTracks(const std::vector<uint8_t> & iBuffer)
+{
+  std::vector<size_t> offsets;
+  size_t offset = 14;
+  while(offset + 8 <= iBuffer.size() && memcmp(&iBuffer[offset], "MTrk", 4) == 0)
+  {
+    offsets.push_back(offset);
+    offset += 8 + readBigEndian32(&iBuffer[offset+4]);
+  }
+  return offsets;
+}
+
+static void buildTrack(MidiFile & oFile, size_t iSeed)
+{
+  oFile.setInstrument((int8_t)(iSeed % 128));
+  for(size_t i=0; i<200 + iSeed; i++)
+  {
+    oFile.addNote((uint16_t)(100 + (i*37 + iSeed*11) % 2000), (uint16_t)(50 + (i*13) % 400));
+    if (i % 5 == iSeed % 5)
+      oFile.addDelay(100);
+  }
+}
+
+void TestMultiTrack::SetUp()
+{
+}
+
+void TestMultiTrack::TearDown()
+{
+}
+
+TEST_F(TestMultiTrack, testTracks)
+{
+  MidiFile mario;
+  ASSERT_TRUE( mario.load(getTestInputFilePath("mario1up.mid").c_str()) );
+
+  MultiTrackMidiFile m;
+  m.setTempo(mario.getTempo());
+  m.setTicksPerQuarterNote(mario.getTicksPerQuarterNote());
+  m.addTrack() = mario;
+  MidiFile & second = m.addTrack();
+  second.addNote(NOTE_C4, 500);
+  ASSERT_EQ(2, m.getTrackCount());
+
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( m.saveToBuffer(buffer) );
+  ASSERT_EQ(buffer.size(), m.computeEncodedSize());
+
+  //file header
+  static const uint8_t header[] = {'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 1, 0, 2, 0x01, 0xE0};
+  ASSERT_EQ(0, memcmp(&buffer[0], header, sizeof(header)));
+
+  std::vector<size_t> tracks = findTracks(buffer);
+  ASSERT_EQ(2, tracks.size());
+
+  //first track is identical to the single track file
+  std::vector<uint8_t> expected;
+  ASSERT_TRUE( mario.saveToBuffer(expected) );
+  ASSERT_EQ(tracks[1] - tracks[0], expected.size() - 14);
+  ASSERT_EQ(0, memcmp(&buffer[tracks[0]], &expected[14], expected.size() - 14));
+
+  //second track is played on channel 1 without tempo. 500ms is 720 ticks.
+  static const uint8_t second_track[] = {'M', 'T', 'r', 'k', 0, 0, 0, 13, 0x00, 0x91, 0x3C, 0x7F, 0x85, 0x50, 0x81, 0x3C, 0x7F, 0x00, 0xFF, 0x2F, 0x00};
+  ASSERT_EQ(sizeof(second_track), buffer.size() - tracks[1]);
+  ASSERT_EQ(0, memcmp(&buffer[tracks[1]], second_track, sizeof(second_track)));
+
+  //the melody of the first track is loaded
+  MidiFile loaded;
+  ASSERT_TRUE( loaded.loadFromBuffer(&buffer[0], buffer.size()) );
+  ASSERT_EQ(MidiFile::MIDI_TYPE_1, loaded.getMidiType());
+  ASSERT_STREQ("mario1up", loaded.getName());
+  ASSERT_EQ(mario.getNoteCount(), loaded.getNoteCount());
+}
+
+TEST_F(TestMultiTrack, testParallelEncoding)
+{
+  static const std::string outputFile = getTestOutputFilePath("testMultiTrackParallelEncoding.output.mid");
+
+  MultiTrackMidiFile m;
+  m.setBeatsPerMinute(100);
+  for(size_t i=0; i<32; i++)
+  {
+    buildTrack(m.addTrack(), i);
+  }
+
+  //tracks sharing a channel use the same instrument
+  for(size_t i=15; i<32; i++)
+  {
+    m.getTrack(i).setInstrument(m.getTrack(i%15).getInstrument());
+  }
+
+  m.setThreadCount(1);
+  std::vector<uint8_t> serial;
+  ASSERT_TRUE( m.saveToBuffer(serial) );
+
+  m.setThreadCount(8);
+  std::vector<uint8_t> parallel;
+  ASSERT_TRUE( m.saveToBuffer(parallel) );
+
+  ASSERT_TRUE( serial == parallel );
+  ASSERT_EQ(serial.size(), m.computeEncodedSize());
+  ASSERT_EQ(32, findTracks(serial).size());
+
+  ASSERT_TRUE( m.save(outputFile.c_str()) );
+  CharSequence actualFileContent = readFileContentAsArray(outputFile.c_str());
+  ASSERT_TRUE( serial == actualFileContent );
+
+  m.clear();
+  ASSERT_EQ(0, m.getTrackCount());
+}
+
+TEST_F(TestMultiTrack, testTrackChannel)
+{
+  ASSERT_EQ(0, MultiTrackMidiFile::getDefaultTrackChannel(0));
+  ASSERT_EQ(8, MultiTrackMidiFile::getDefaultTrackChannel(8));
+  ASSERT_EQ(10, MultiTrackMidiFile::getDefaultTrackChannel(9)); //percussion channel is skipped
+  ASSERT_EQ(15, MultiTrackMidiFile::getDefaultTrackChannel(14));
+  ASSERT_EQ(0, MultiTrackMidiFile::getDefaultTrackChannel(15));
+
+  MultiTrackMidiFile m;
+  m.addTrack();
+  m.addTrack();
+  ASSERT_EQ(1, m.getTrackChannel(1));
+  ASSERT_TRUE( m.setTrackChannel(1, 9) );
+  ASSERT_EQ(9, m.getTrackChannel(1));
+  ASSERT_FALSE( m.setTrackChannel(2, 0) );
+  ASSERT_FALSE( m.setTrackChannel(0, 16) );
+  ASSERT_EQ(0, m.getTrackChannel(0));
+}
+
+//returns true if a program change event of the given channel and instrument is found
+static bool hasProgramChange(const std::vector<uint8_t> & iBuffer, uint8_t iChannel, int8_t iInstrument)
+{
+  for(size_t i=0; i+1<iBuffer.size(); i++)
+  {
+    if (iBuffer[i] == (0xC0 | iChannel) && iBuffer[i+1] == (uint8_t)iInstrument)
+      return true;
+  }
+  return false;
+}
+
+TEST_F(TestMultiTrack, testSharedChannels)
+{
+  //16 tracks with their own instrument
+  MultiTrackMidiFile m;
+  for(int i=0; i<16; i++)
+  {
+    MidiFile & track = m.addTrack();
+    track.setInstrument((int8_t)(100 + i));
+    track.addNote(440, 100);
+  }
+
+  //the last track shares the channel of the first track
+  ASSERT_EQ(0, m.getTrackChannel(15));
+  ASSERT_TRUE( m.hasInstrumentConflict() );
+  std::vector<uint8_t> buffer;
+  ASSERT_FALSE( m.saveToBuffer(buffer) );
+  MemorySink sink;
+  ASSERT_FALSE( m.save(sink) );
+  ASSERT_EQ(0, sink.getBuffer().size());
+
+  //move the last track to the free channel
+  ASSERT_TRUE( m.setTrackChannel(15, 9) );
+  ASSERT_FALSE( m.hasInstrumentConflict() );
+  ASSERT_TRUE( m.saveToBuffer(buffer) );
+  ASSERT_TRUE( hasProgramChange(buffer, 0, 100) );
+  ASSERT_TRUE( hasProgramChange(buffer, 9, 115) );
+  ASSERT_FALSE( hasProgramChange(buffer, 0, 115) );
+
+  //tracks with the same instrument can share a channel
+  m.getTrack(15).setInstrument(100);
+  ASSERT_TRUE( m.setTrackChannel(15, 0) );
+  ASSERT_FALSE( m.hasInstrumentConflict() );
+  ASSERT_TRUE( m.saveToBuffer(buffer) );
+}
@@ -54,6 +54,24 @@ TEST_F(TestNotes, testFindNoteFrequency)
   ASSERT_EQ(NOTE_GS9, findNoteFrequency("GS9") );
 }
 
+TEST_F(TestNotes, testFindNoteFrequencyLength)
+{
+  ASSERT_EQ(-1, findNoteFrequency(NULL, 0) );  //invalid
+  ASSERT_EQ(-1, findNoteFrequency("C4", 0) );  //empty
+  ASSERT_EQ(-1, findNoteFrequency("ES4", 3) ); //unknown
+  ASSERT_EQ(-1, findNoteFrequency("C10", 3) ); //unknown
+
+  ASSERT_EQ(NOTE_SILENCE, findNoteFrequency("SILENCE", 7) );  //silence
+
+  //names that are not NULL terminated
+  static const char * melody = "C4D4CS4SILENCEGS9";
+  ASSERT_EQ(NOTE_C4 , findNoteFrequency(&melody[0], 2) );
+  ASSERT_EQ(NOTE_D4 , findNoteFrequency(&melody[2], 2) );
+  ASSERT_EQ(NOTE_CS4, findNoteFrequency(&melody[4], 3) );
+  ASSERT_EQ(NOTE_SILENCE, findNoteFrequency(&melody[7], 7) );
+  ASSERT_EQ(NOTE_GS9, findNoteFrequency(&melody[14], 3) );
+}
+
 TEST_F(TestNotes, testGetNoteName)
 {
   ASSERT_EQ(NULL, getNoteName(-5) );  //invalid
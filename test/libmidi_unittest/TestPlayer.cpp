@@ -0,0 +1,208 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#include "libmidi/libmidi.h"
+#include "libmidi/player.h"
+
+#include "TestPlayer.h"
+
+#include <chrono>
+#include <mutex>
+
+using namespace libmidi;
+
+struct RECEIVED_EVENT
+{
+  size_t session;
+  MidiPlayer::EVENT event;
+  std::chrono::steady_clock::time_point time;
+};
+
+struct OUTPUT
+{
+  std::mutex lock;
+  std::vector<RECEIVED_EVENT> events;
+};
+
+static void receiveEvent(size_t iSession, const MidiPlayer::EVENT & iEvent, void * iUserData)
+{
+  OUTPUT * output = (OUTPUT *)iUserData;
+  RECEIVED_EVENT e;
+  e.session = iSession;
+  e.event = iEvent;
+  e.time = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> guard(output->lock);
+  output->events.push_back(e);
+}
+
+void TestPlayer::SetUp()
+{
+}
+
+void TestPlayer::TearDown()
+{
+}
+
+TEST_F(TestPlayer, testGetEvents)
+{
+  MidiFile f;
+  f.addNote(440, 100);
+  f.addDelay(50);
+  f.addNote(880, 200);
+
+  std::vector<MidiPlayer::EVENT> events;
+  ASSERT_TRUE( MidiPlayer::getEvents(f, events) );
+  ASSERT_EQ(4, (int)events.size());
+
+  ASSERT_EQ(0, (int)events[0].timeUs);
+  ASSERT_EQ(0x90, (int)events[0].status);
+  ASSERT_EQ(69, (int)events[0].data1);
+  ASSERT_EQ(127, (int)events[0].data2);
+  ASSERT_EQ(100000, (int)events[1].timeUs);
+  ASSERT_EQ(0x80, (int)events[1].status);
+  ASSERT_EQ(150000, (int)events[2].timeUs);
+  ASSERT_EQ(81, (int)events[2].data1);
+  ASSERT_EQ(350000, (int)events[3].timeUs);
+
+  //tempo changes are applied
+  MidiFile chord;
+  ASSERT_TRUE( chord.addNoteAt(0, 960, 60, 0x40, 0) );
+  ASSERT_TRUE( chord.addNoteAt(0, 960, 64, 0x40, 1) );
+  ASSERT_TRUE( chord.addTempoChange(500, 250000) );
+  ASSERT_TRUE( MidiPlayer::getEvents(chord, events) );
+  ASSERT_EQ(4, (int)events.size());
+  ASSERT_EQ(0x90, (int)events[0].status);
+  ASSERT_EQ(0x91, (int)events[1].status);
+  ASSERT_EQ(0, (int)events[1].timeUs);
+  ASSERT_EQ(750000, (int)events[2].timeUs);
+  ASSERT_EQ(750000, (int)events[3].timeUs);
+}
+
+TEST_F(TestPlayer, testPlayback)
+{
+  MidiFile f;
+  for(int i=0; i<10; i++)
+  {
+    f.addNote((uint16_t)(440 + 10*i), 20);
+  }
+
+  OUTPUT output;
+  MidiPlayer p;
+  ASSERT_EQ(0, (int)p.addSession(f, &receiveEvent, &output));
+  ASSERT_FALSE( p.wait(10) ); //not started
+  ASSERT_EQ(0, (int)output.events.size());
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  ASSERT_TRUE( p.start() );
+  ASSERT_FALSE( p.start() );
+  ASSERT_TRUE( p.isStarted() );
+  ASSERT_TRUE( p.wait(5000) );
+
+  //all events are delivered in order and never early
+  std::vector<MidiPlayer::EVENT> expected;
+  ASSERT_TRUE( MidiPlayer::getEvents(f, expected) );
+  ASSERT_EQ(expected.size(), output.events.size());
+  for(size_t i=0; i<expected.size(); i++)
+  {
+    const RECEIVED_EVENT & e = output.events[i];
+    ASSERT_EQ(0, (int)e.session);
+    ASSERT_EQ(expected[i].timeUs, e.event.timeUs);
+    ASSERT_EQ(expected[i].status, e.event.status);
+    ASSERT_EQ(expected[i].data1, e.event.data1);
+    uint64_t elapsedUs = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(e.time - start).count();
+    ASSERT_GE(elapsedUs, e.event.timeUs);
+  }
+
+  MidiPlayer::STATISTICS s = p.getSessionStatistics(0);
+  ASSERT_EQ(1, (int)s.numSessions);
+  ASSERT_EQ(0, (int)s.numActiveSessions);
+  ASSERT_EQ(expected.size(), s.numEvents);
+  ASSERT_LE(s.p50LatenessUs, s.p99LatenessUs);
+  ASSERT_LE(s.p99LatenessUs, s.maxLatenessUs);
+  ASSERT_LE(s.averageLatenessUs, (double)s.maxLatenessUs);
+
+  s = p.getSessionStatistics(1);
+  ASSERT_EQ(0, (int)s.numSessions);
+
+  p.stop();
+  ASSERT_FALSE( p.isStarted() );
+}
+
+TEST_F(TestPlayer, testManySessions)
+{
+  static const size_t NUM_SESSIONS = 200;
+
+  MidiPlayer p;
+  ASSERT_TRUE( p.start() );
+
+  //sessions start when they are added
+  uint64_t numEvents = 0;
+  for(size_t i=0; i<NUM_SESSIONS; i++)
+  {
+    MidiFile f;
+    f.addNote((uint16_t)(200 + i), (uint16_t)(1 + i%7));
+    f.addNote((uint16_t)(300 + i), (uint16_t)(1 + i%5));
+    f.addDelay((uint16_t)(i%3));
+    f.addNote((uint16_t)(400 + i), (uint16_t)(1 + i%11));
+    ASSERT_EQ(i, p.addSession(f, NULL, NULL)); //virtual output
+
+    std::vector<MidiPlayer::EVENT> events;
+    ASSERT_TRUE( MidiPlayer::getEvents(f, events) );
+    numEvents += events.size();
+  }
+  ASSERT_TRUE( p.wait(10000) );
+  ASSERT_EQ(NUM_SESSIONS, p.getSessionCount());
+
+  MidiPlayer::STATISTICS s = p.getStatistics();
+  ASSERT_EQ(NUM_SESSIONS, s.numSessions);
+  ASSERT_EQ(0, (int)s.numActiveSessions);
+  ASSERT_EQ(numEvents, s.numEvents);
+  ASSERT_LE(s.p50LatenessUs, s.p99LatenessUs);
+  ASSERT_LE(s.p99LatenessUs, s.maxLatenessUs);
+
+  p.clear();
+  ASSERT_EQ(0, (int)p.getSessionCount());
+  ASSERT_FALSE( p.isStarted() );
+}
+
+TEST_F(TestPlayer, testStop)
+{
+  MidiFile f;
+  f.addNote(440, 10);
+  f.addNote(880, 10000);
+  f.addNote(440, 10);
+
+  OUTPUT output;
+  MidiPlayer p;
+  ASSERT_EQ(0, (int)p.addSession(f, &receiveEvent, &output));
+  ASSERT_TRUE( p.start() );
+  ASSERT_FALSE( p.wait(100) ); //timeout
+  ASSERT_EQ(1, (int)p.getStatistics().numActiveSessions);
+
+  //the remaining events are discarded
+  p.stop();
+  ASSERT_EQ(3, (int)output.events.size());
+  ASSERT_EQ(0, (int)p.getStatistics().numActiveSessions);
+  ASSERT_EQ(3, (int)p.getStatistics().numEvents);
+}
@@ -0,0 +1,395 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#include "libmidi/libmidi.h"
+#include "libmidi/renderer.h"
+#include "libmidi/realtimerenderer.h"
+#include "libmidi/ringbuffer.h"
+
+#include "TestRealtimeRenderer.h"
+
+#include <thread>
+#include <chrono>
+#include <cmath>
+
+using namespace libmidi;
+
+//fake audio device calling the audio callback at the rate of a sound card
+struct FAKE_AUDIO_DEVICE
+{
+  std::vector<float> samples;
+  size_t numCallbacks;
+};
+
+static void runFakeAudioDevice(MidiRealtimeRenderer & iRenderer, size_t iPeriodSize, size_t iNumCallbacks, FAKE_AUDIO_DEVICE & oDevice)
+{
+  std::chrono::microseconds period((uint64_t)iPeriodSize * 1000000 / iRenderer.getSampleRate());
+  std::vector<float> buffer(iPeriodSize);
+  oDevice.numCallbacks = 0;
+
+  //absolute deadlines do not drift
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now();
+  for(size_t i=0; i<iNumCallbacks; i++)
+  {
+    deadline += period;
+    std::this_thread::sleep_until(deadline);
+    iRenderer.read(&buffer[0], buffer.size());
+    oDevice.samples.insert(oDevice.samples.end(), buffer.begin(), buffer.end());
+    oDevice.numCallbacks++;
+  }
+}
+
+//reads samples as soon as they are rendered
+static void readRenderedSamples(MidiRealtimeRenderer & iRenderer, size_t iCount, std::vector<float> & oSamples)
+{
+  static const size_t PERIOD_SIZE = 64;
+  float buffer[PERIOD_SIZE];
+  while(oSamples.size() < iCount)
+  {
+    if (iRenderer.getAvailableSamples() < PERIOD_SIZE)
+    {
+      std::this_thread::yield();
+      continue;
+    }
+    ASSERT_EQ(PERIOD_SIZE, iRenderer.read(buffer, PERIOD_SIZE));
+    oSamples.insert(oSamples.end(), buffer, buffer + PERIOD_SIZE);
+  }
+}
+
+void TestRealtimeRenderer::SetUp()
+{
+}
+
+void TestRealtimeRenderer::TearDown()
+{
+}
+
+TEST_F(TestRealtimeRenderer, testRingBuffer)
+{
+  RingBuffer<int> ring(5);
+  ASSERT_EQ(8, (int)ring.getCapacity());
+  ASSERT_EQ(0, (int)ring.getSize());
+  ASSERT_TRUE( ring.front() == NULL );
+
+  int value = 0;
+  ASSERT_FALSE( ring.pop(value) );
+
+  //fill the ring
+  static const int values[] = {1, 2, 3, 4, 5, 6};
+  ASSERT_EQ(6, (int)ring.write(values, 6));
+  ASSERT_EQ(2, (int)ring.write(values, 6));
+  ASSERT_FALSE( ring.push(7) );
+  ASSERT_EQ(8, (int)ring.getSize());
+
+  //wrap around
+  int read[8] = {0};
+  ASSERT_EQ(5, (int)ring.read(read, 5));
+  ASSERT_EQ(5, read[4]);
+  ASSERT_EQ(5, (int)ring.write(values, 6));
+  ASSERT_EQ(8, (int)ring.read(read, 8));
+  ASSERT_EQ(6, read[0]);
+  ASSERT_EQ(1, read[1]);
+  ASSERT_EQ(2, read[2]);
+  ASSERT_EQ(1, read[3]);
+  ASSERT_EQ(5, read[7]);
+  ASSERT_EQ(0, (int)ring.getSize());
+
+  ASSERT_TRUE( ring.push(9) );
+  ASSERT_TRUE( ring.front() != NULL );
+  ASSERT_EQ(9, *ring.front());
+  ASSERT_TRUE( ring.pop(value) );
+  ASSERT_EQ(9, value);
+}
+
+TEST_F(TestRealtimeRenderer, testRingBufferThreads)
+{
+  static const uint32_t NUM_VALUES = 1000000;
+  RingBuffer<uint32_t> ring(64);
+
+  std::thread producer([&ring]()
+  {
+    uint32_t next = 0;
+    while(next < NUM_VALUES)
+    {
+      if (!ring.push(next))
+        std::this_thread::yield();
+      else
+        next++;
+    }
+  });
+
+  //values are received in order
+  uint32_t expected = 0;
+  uint32_t values[16];
+  while(expected < NUM_VALUES)
+  {
+    size_t count = ring.read(values, 16);
+    if (count == 0)
+      std::this_thread::yield();
+    for(size_t i=0; i<count; i++)
+    {
+      ASSERT_EQ(expected, values[i]);
+      expected++;
+    }
+  }
+  producer.join();
+  ASSERT_EQ(0, (int)ring.getSize());
+}
+
+TEST_F(TestRealtimeRenderer, testUnderruns)
+{
+  //the render thread is not started
+  MidiRealtimeRenderer r;
+  float samples[100];
+  samples[99] = 1.0f;
+  ASSERT_EQ(0, (int)r.read(samples, 100));
+  ASSERT_EQ(0.0f, samples[99]);
+
+  MidiRealtimeRenderer::STATISTICS s = r.getStatistics();
+  ASSERT_EQ(1, (int)s.numCallbacks);
+  ASSERT_EQ(1, (int)s.numUnderruns);
+  ASSERT_EQ(100, (int)s.numMissingSamples);
+  ASSERT_FALSE( r.isRunning() );
+
+  //notes cannot be played
+  MidiFile f;
+  f.addNote(440, 100);
+  ASSERT_FALSE( r.play(f) );
+}
+
+TEST_F(TestRealtimeRenderer, testLiveNotes)
+{
+  MidiRealtimeRenderer r(1024);
+  r.setSampleRate(8000);
+  r.setGain(0.5f);
+  r.setEnvelope(1000, 2000);
+  ASSERT_TRUE( r.start() );
+  ASSERT_FALSE( r.start() );
+  ASSERT_TRUE( r.isRunning() );
+
+  //the ring buffer is filled with silence
+  std::vector<float> samples;
+  readRenderedSamples(r, 1024, samples);
+  for(size_t i=0; i<samples.size(); i++)
+  {
+    ASSERT_EQ(0.0f, samples[i]);
+  }
+
+  //play a note
+  ASSERT_TRUE( r.noteOn(69, 0x7f) );
+  samples.clear();
+  readRenderedSamples(r, 4096, samples);
+  float peak = 0.0f;
+  for(size_t i=0; i<samples.size(); i++)
+  {
+    if (fabsf(samples[i]) > peak)
+      peak = fabsf(samples[i]);
+  }
+  ASSERT_NEAR(0.5f, peak, 0.0001f);
+  ASSERT_NE(0.0f, samples.back());
+
+  //stop the note
+  ASSERT_TRUE( r.noteOff(69) );
+  samples.clear();
+  readRenderedSamples(r, 4096, samples);
+  ASSERT_EQ(0.0f, samples.back());
+
+  r.stop();
+  ASSERT_FALSE( r.isRunning() );
+  ASSERT_EQ(0, (int)r.getStatistics().numDroppedEvents);
+}
+
+TEST_F(TestRealtimeRenderer, testLiveNotesDuringPlay)
+{
+  static const size_t BUFFER_SIZE = 1024;
+  static const size_t LATENCY = BUFFER_SIZE + 256; //ring buffer and one block
+
+  //a note of 10 seconds
+  MidiFile f;
+  f.addNote(440, 10000);
+
+  MidiRealtimeRenderer r(BUFFER_SIZE);
+  r.setSampleRate(8000);
+  ASSERT_TRUE( r.start() );
+  ASSERT_TRUE( r.play(f) );
+
+  //the note is playing once the silence rendered before play() is read
+  std::vector<float> samples;
+  readRenderedSamples(r, LATENCY + 1024, samples);
+  ASSERT_NE(0.0f, samples.back());
+
+  //the melody is stopped within the latency of the ring buffer
+  ASSERT_TRUE( r.allNotesOff() );
+  samples.clear();
+  readRenderedSamples(r, 4096, samples);
+  for(size_t i=LATENCY; i<samples.size(); i++)
+  {
+    ASSERT_EQ(0.0f, samples[i]) << "at sample " << i;
+  }
+
+  //another melody does not wait for the end of the first one
+  MidiFile g;
+  g.addNote(880, 100);
+  ASSERT_TRUE( r.play(g) );
+  samples.clear();
+  readRenderedSamples(r, 4096, samples);
+  size_t first = 0;
+  while(first < samples.size() && samples[first] == 0.0f)
+    first++;
+  ASSERT_LT(first, LATENCY);
+
+  r.stop();
+  ASSERT_EQ(0, (int)r.getStatistics().numDroppedEvents);
+}
+
+//returns the peak amplitude of the last samples
+static float getPeak(const std::vector<float> & iSamples, size_t iCount)
+{
+  float peak = 0.0f;
+  for(size_t i=iSamples.size() - iCount; i<iSamples.size(); i++)
+  {
+    if (fabsf(iSamples[i]) > peak)
+      peak = fabsf(iSamples[i]);
+  }
+  return peak;
+}
+
+TEST_F(TestRealtimeRenderer, testMelodyNoteOffs)
+{
+  static const size_t BUFFER_SIZE = 1024;
+  static const size_t LATENCY = BUFFER_SIZE + 256; //ring buffer and one block
+
+  MidiRealtimeRenderer r(BUFFER_SIZE);
+  r.setSampleRate(8000);
+  r.setGain(0.5f);
+  ASSERT_TRUE( r.start() );
+
+  //a held live note and a short melody note of the same pitch at half volume
+  MidiFile f;
+  f.setVolume(0x40);
+  f.addNote(440, 100);
+  ASSERT_TRUE( r.noteOn(69, 0x7f) );
+  ASSERT_TRUE( r.play(f) );
+
+  //the end of the melody does not stop the live note
+  std::vector<float> samples;
+  readRenderedSamples(r, LATENCY + 4096, samples);
+  ASSERT_NEAR(0.5f, getPeak(samples, 1024), 0.0001f);
+
+  //the live note off stops the live note
+  ASSERT_TRUE( r.noteOff(69) );
+  samples.clear();
+  readRenderedSamples(r, LATENCY + 1024, samples);
+  ASSERT_EQ(0.0f, getPeak(samples, 1024));
+
+  //a short melody does not stop a longer melody of the same pitch
+  MidiFile g;
+  g.addNote(440, 2000);
+  ASSERT_TRUE( r.play(g) );
+  ASSERT_TRUE( r.play(f) );
+  samples.clear();
+  readRenderedSamples(r, LATENCY + 4096, samples);
+  ASSERT_NEAR(0.5f, getPeak(samples, 1024), 0.0001f);
+
+  //nor does a live note off
+  ASSERT_TRUE( r.noteOff(69) );
+  samples.clear();
+  readRenderedSamples(r, LATENCY + 1024, samples);
+  ASSERT_NEAR(0.5f, getPeak(samples, 1024), 0.0001f);
+
+  r.stop();
+  ASSERT_EQ(0, (int)r.getStatistics().numDroppedEvents);
+}
+
+TEST_F(TestRealtimeRenderer, testPlayMatchesOfflineRendering)
+{
+  MidiFile f;
+  f.addNote(440, 100);
+  f.addDelay(50);
+  f.addNote(523, 100);
+  f.addNote(659, 250);
+  ASSERT_TRUE( f.addNoteAt(100, 400, 76, 0x50, 1) );
+
+  MidiRenderer offline;
+  offline.setSampleRate(8000);
+  std::vector<float> expected;
+  ASSERT_TRUE( offline.render(f, expected) );
+
+  MidiRealtimeRenderer r;
+  r.setSampleRate(8000);
+  ASSERT_TRUE( r.start() );
+  ASSERT_TRUE( r.play(f) );
+
+  std::vector<float> samples;
+  readRenderedSamples(r, r.getAvailableSamples() + expected.size() + 8000, samples);
+  r.stop();
+
+  //the notes are played at their exact sample
+  size_t first = 0;
+  while(first < samples.size() && samples[first] == 0.0f)
+    first++;
+  ASSERT_LT(first + expected.size(), samples.size());
+  for(size_t i=0; i<expected.size(); i++)
+  {
+    ASSERT_NEAR(expected[i], samples[first + i], 0.00001f);
+  }
+  for(size_t i=first + expected.size(); i<samples.size(); i++)
+  {
+    ASSERT_EQ(0.0f, samples[i]);
+  }
+}
+
+TEST_F(TestRealtimeRenderer, testFakeAudioDevice)
+{
+  //a melody longer than the ring buffer and the queue
+  MidiFile f;
+  for(int i=0; i<600; i++)
+  {
+    f.addNote((uint16_t)(400 + i), 1);
+  }
+
+  MidiRealtimeRenderer r(2048, 256);
+  r.setWaveform(MidiRenderer::WAVEFORM_SINE);
+  ASSERT_TRUE( r.start() );
+
+  FAKE_AUDIO_DEVICE device;
+  std::thread audio([&r, &device]()
+  {
+    runFakeAudioDevice(r, 256, 150, device);
+  });
+  ASSERT_TRUE( r.play(f) );
+  audio.join();
+  r.stop();
+
+  ASSERT_EQ(150, (int)device.numCallbacks);
+  ASSERT_EQ(150*256, (int)device.samples.size());
+
+  MidiRealtimeRenderer::STATISTICS s = r.getStatistics();
+  ASSERT_EQ(150, (int)s.numCallbacks);
+  ASSERT_EQ(0, (int)s.numDroppedEvents);
+  ASSERT_GE(s.worstCallbackSeconds, s.averageCallbackSeconds);
+  ASSERT_LT(s.worstCallbackSeconds, 0.1);
+  ASSERT_LE(s.numUnderruns, s.numCallbacks);
+  ASSERT_LE(s.numMissingSamples, s.numUnderruns*256);
+}
@@ -0,0 +1,212 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#include "libmidi/libmidi.h"
+#include "libmidi/recorder.h"
+#include "libmidi/player.h"
+#include "libmidi/sinks.h"
+#include "libmidi/streamwriter.h"
+
+#include "TestRecorder.h"
+
+#include <thread>
+#include <chrono>
+
+using namespace libmidi;
+
+static void sleepMs(uint32_t iDurationMs)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(iDurationMs));
+}
+
+void TestRecorder::SetUp()
+{
+}
+
+void TestRecorder::TearDown()
+{
+}
+
+TEST_F(TestRecorder, testRecordToMidiFile)
+{
+  MidiRecorder r;
+  ASSERT_EQ(1, (int)r.getInputCount());
+  ASSERT_FALSE( r.isRecording() );
+  ASSERT_FALSE( r.noteOn(60, 0x40) ); //not recording
+  ASSERT_FALSE( r.stop() );
+
+  MidiFile f;
+  ASSERT_TRUE( r.start(f) );
+  ASSERT_TRUE( r.isRecording() );
+  ASSERT_FALSE( r.start(f) );
+
+  //invalid values
+  ASSERT_FALSE( r.noteOn(-1, 0x40) );
+  ASSERT_FALSE( r.noteOn(60, -1) );
+  ASSERT_FALSE( r.noteOn(60, 0x40, 16) );
+  ASSERT_FALSE( r.noteOn(60, 0x40, 0, 1) );
+
+  //a chord and a note held when the recording stops
+  ASSERT_TRUE( r.noteOn(60, 0x40) );
+  ASSERT_TRUE( r.noteOn(64, 0x50, 1) );
+  sleepMs(30);
+  ASSERT_TRUE( r.noteOff(60) );
+  ASSERT_TRUE( r.noteOff(64, 1) );
+  ASSERT_TRUE( r.noteOff(65) ); //not playing
+  ASSERT_TRUE( r.noteOn(67, 0x60) );
+  sleepMs(30);
+  ASSERT_TRUE( r.stop() );
+  ASSERT_FALSE( r.isRecording() );
+
+  MidiRecorder::STATISTICS s = r.getStatistics();
+  ASSERT_EQ(6, (int)s.numEvents);
+  ASSERT_EQ(0, (int)s.numDroppedEvents);
+  ASSERT_EQ(3, (int)s.numNotes);
+
+  std::vector<MidiPlayer::EVENT> events;
+  ASSERT_TRUE( MidiPlayer::getEvents(f, events) );
+  ASSERT_EQ(6, (int)events.size());
+  ASSERT_EQ(0x90, (int)events[0].status);
+  ASSERT_EQ(60, (int)events[0].data1);
+  ASSERT_EQ(0x40, (int)events[0].data2);
+  ASSERT_EQ(0x91, (int)events[1].status);
+  ASSERT_EQ(64, (int)events[1].data1);
+  ASSERT_EQ(0x50, (int)events[1].data2);
+
+  //the third note starts after the end of the chord and lasts until the end
+  const MidiPlayer::EVENT & last = events[5];
+  ASSERT_EQ(0x80, (int)last.status);
+  ASSERT_EQ(67, (int)last.data1);
+  ASSERT_GE(last.timeUs, events[4].timeUs + 25000);
+  ASSERT_GE(events[4].timeUs, 25000);
+}
+
+TEST_F(TestRecorder, testMultipleInputs)
+{
+  static const size_t NUM_INPUTS = 4;
+  static const int NUM_NOTES = 200;
+
+  MidiRecorder r(NUM_INPUTS);
+  ASSERT_EQ(NUM_INPUTS, r.getInputCount());
+
+  MidiFile f;
+  ASSERT_TRUE( r.start(f) );
+
+  //each thread plays on its own channel with its own input
+  std::vector<std::thread> threads;
+  for(size_t i=0; i<NUM_INPUTS; i++)
+  {
+    threads.push_back(std::thread([&r, i]()
+    {
+      for(int n=0; n<NUM_NOTES; n++)
+      {
+        int8_t pitch = (int8_t)(40 + n%40);
+        r.noteOn(pitch, 0x40, (uint8_t)i, i);
+        r.noteOff(pitch, (uint8_t)i, i);
+      }
+    }));
+  }
+  for(size_t i=0; i<threads.size(); i++)
+  {
+    threads[i].join();
+  }
+  ASSERT_TRUE( r.stop() );
+
+  MidiRecorder::STATISTICS s = r.getStatistics();
+  ASSERT_EQ(NUM_INPUTS*NUM_NOTES*2, s.numEvents);
+  ASSERT_EQ(0, (int)s.numDroppedEvents);
+  ASSERT_EQ(NUM_INPUTS*NUM_NOTES, s.numNotes);
+
+  //the events of all inputs are ordered by time
+  std::vector<MidiPlayer::EVENT> events;
+  ASSERT_TRUE( MidiPlayer::getEvents(f, events) );
+  ASSERT_EQ(NUM_INPUTS*NUM_NOTES*2, events.size());
+  size_t numNotesPerChannel[NUM_INPUTS] = {0};
+  for(size_t i=0; i<events.size(); i++)
+  {
+    if (i > 0)
+    {
+      ASSERT_GE(events[i].timeUs, events[i-1].timeUs);
+    }
+    if ((events[i].status & 0xF0) == 0x90)
+      numNotesPerChannel[events[i].status & 0x0F]++;
+  }
+  for(size_t i=0; i<NUM_INPUTS; i++)
+  {
+    ASSERT_EQ(NUM_NOTES, (int)numNotesPerChannel[i]);
+  }
+}
+
+TEST_F(TestRecorder, testDroppedEvents)
+{
+  MidiRecorder r(1, 4);
+  MidiFile f;
+  ASSERT_TRUE( r.start(f) );
+
+  //the queue is full until the next drain
+  size_t numCaptured = 0;
+  for(int i=0; i<100; i++)
+  {
+    if (r.noteOn((int8_t)(i%128), 0x40))
+      numCaptured++;
+  }
+  ASSERT_TRUE( r.stop() );
+
+  MidiRecorder::STATISTICS s = r.getStatistics();
+  ASSERT_EQ(numCaptured, s.numEvents);
+  ASSERT_EQ(100, (int)(s.numEvents + s.numDroppedEvents));
+  ASSERT_GT(s.numDroppedEvents, 0);
+}
+
+TEST_F(TestRecorder, testRecordToStreamWriter)
+{
+  MemorySink sink;
+  MidiStreamWriter w;
+  MidiRecorder r;
+  ASSERT_FALSE( r.start(w) ); //not opened
+  ASSERT_TRUE( w.open(sink) );
+
+  ASSERT_TRUE( r.start(w) );
+  sleepMs(20);
+  ASSERT_TRUE( r.noteOn(69, 0x7f) );
+  sleepMs(30);
+  ASSERT_TRUE( r.noteOn(72, 0x7f) ); //stops the previous note
+  sleepMs(30);
+  ASSERT_TRUE( r.noteOff(72) );
+  ASSERT_TRUE( r.noteOff(69) ); //already stopped
+  ASSERT_TRUE( r.stop() );
+  ASSERT_TRUE( w.close() );
+  ASSERT_EQ(2, (int)r.getStatistics().numNotes);
+
+  //delay, A4, C5
+  MidiFile f;
+  ASSERT_TRUE( f.loadFromBuffer(&sink.getBuffer()[0], sink.getBuffer().size()) );
+  ASSERT_EQ(3, (int)f.getNoteCount());
+  ASSERT_EQ(0, (int)f.getNoteFrequency(0));
+  ASSERT_EQ(440, (int)f.getNoteFrequency(1));
+  ASSERT_EQ(523, (int)f.getNoteFrequency(2));
+  ASSERT_GE(f.getNoteDuration(0), 15);
+  ASSERT_GE(f.getNoteDuration(1), 25);
+  ASSERT_GE(f.getNoteDuration(2), 25);
+}
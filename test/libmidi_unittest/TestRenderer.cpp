@@ -0,0 +1,421 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#include "libmidi/libmidi.h"
+#include "libmidi/renderer.h"
+#include "libmidi/sinks.h"
+
+#include "TestRenderer.h"
+
+#include <cmath>
+#include <cstring> //for memcmp()
+
+using namespace libmidi;
+
+extern std::string getTestOutputFilePath(const char * name);
+
+static const float TOLERANCE = 0.005f;
+
+static float getSawValue(size_t iSample)
+{
+  //saw wave of 1000 Hz rendered at 8000 Hz
+  static const float values[] = {0.0f, 0.25f, 0.5f, 0.75f, -1.0f, -0.75f, -0.5f, -0.25f};
+  return values[iSample % 8];
+}
+
+static uint32_t readLittleEndian32(const std::vector<uint8_t> & iBuffer, size_t iOffset)
+{
+  return (uint32_t)iBuffer[iOffset] | ((uint32_t)iBuffer[iOffset+1] << 8) | ((uint32_t)iBuffer[iOffset+2] << 16) | ((uint32_t)iBuffer[iOffset+3] << 24);
+}
+
+static uint16_t readLittleEndian16(const std::vector<uint8_t> & iBuffer, size_t iOffset)
+{
+  return (uint16_t)(iBuffer[iOffset] | (iBuffer[iOffset+1] << 8));
+}
+
+void TestRenderer::SetUp()
+{
+}
+
+void TestRenderer::TearDown()
+{
+}
+
+TEST_F(TestRenderer, testSampleCount)
+{
+  MidiFile f;
+  f.addNote(440, 250);
+  f.addDelay(250);
+  f.addNote(880, 500);
+
+  MidiRenderer r;
+  ASSERT_EQ(44100, (int)r.getSampleRate());
+  ASSERT_EQ(44100, (int)r.computeSampleCount(f));
+
+  r.setSampleRate(0); //ignored
+  ASSERT_EQ(44100, (int)r.getSampleRate());
+
+  r.setSampleRate(8000);
+  ASSERT_EQ(8000, (int)r.computeSampleCount(f));
+
+  std::vector<float> samples;
+  ASSERT_TRUE( r.render(f, samples) );
+  ASSERT_EQ(8000, (int)samples.size());
+
+  //the delay is silent
+  for(size_t i=2000; i<4000; i++)
+  {
+    ASSERT_EQ(0.0f, samples[i]);
+  }
+
+  //an empty melody has no samples
+  MidiFile empty;
+  ASSERT_TRUE( r.render(empty, samples) );
+  ASSERT_EQ(0, (int)samples.size());
+}
+
+TEST_F(TestRenderer, testWaveforms)
+{
+  MidiFile f;
+  f.addNote(1000, 100);
+
+  MidiRenderer r;
+  r.setSampleRate(8000);
+  r.setGain(0.5f);
+  ASSERT_EQ(MidiRenderer::WAVEFORM_SQUARE, r.getWaveform());
+
+  std::vector<float> samples;
+
+  //square
+  ASSERT_TRUE( r.render(f, samples) );
+  ASSERT_EQ(800, (int)samples.size());
+  for(size_t i=0; i<samples.size(); i++)
+  {
+    ASSERT_EQ(i%8 < 4 ? 0.5f : -0.5f, samples[i]);
+  }
+
+  //saw
+  r.setWaveform(MidiRenderer::WAVEFORM_SAW);
+  ASSERT_TRUE( r.render(f, samples) );
+  for(size_t i=0; i<samples.size(); i++)
+  {
+    ASSERT_NEAR(0.5f*getSawValue(i), samples[i], TOLERANCE);
+  }
+
+  //triangle
+  r.setWaveform(MidiRenderer::WAVEFORM_TRIANGLE);
+  ASSERT_TRUE( r.render(f, samples) );
+  for(size_t i=0; i<samples.size(); i++)
+  {
+    float expected = 2.0f*fabsf(getSawValue(i)) - 1.0f;
+    ASSERT_NEAR(0.5f*expected, samples[i], TOLERANCE);
+  }
+
+  //sine
+  r.setWaveform(MidiRenderer::WAVEFORM_SINE);
+  ASSERT_TRUE( r.render(f, samples) );
+  for(size_t i=0; i<samples.size(); i++)
+  {
+    float expected = (float)sin(2.0*3.14159265358979*(i%8)/8.0);
+    ASSERT_NEAR(0.5f*expected, samples[i], TOLERANCE);
+  }
+}
+
+TEST_F(TestRenderer, testVolume)
+{
+  MidiFile f;
+  f.setVolume(0x40);
+  f.addNote(1000, 10);
+
+  MidiRenderer r;
+  r.setSampleRate(8000);
+  r.setGain(1.0f);
+
+  std::vector<float> samples;
+  ASSERT_TRUE( r.render(f, samples) );
+  ASSERT_EQ(80, (int)samples.size());
+  ASSERT_NEAR(64.0f/127.0f, samples[0], 0.0001f);
+}
+
+TEST_F(TestRenderer, testOverlappingNotes)
+{
+  //two notes an octave apart starting at the same time, the second one is longer
+  MidiFile f;
+  f.setTicksPerQuarterNote(480);
+  f.setTempo(500000); //480 ticks per 500 ms
+  ASSERT_TRUE( f.addNoteAt(0, 480, 84, 0x7f, 0) ); //C6, 1046.5 Hz
+  ASSERT_TRUE( f.addNoteAt(0, 960, 72, 0x7f, 0) ); //C5, 523.25 Hz
+
+  MidiRenderer r;
+  r.setSampleRate(8000);
+  r.setGain(0.25f);
+
+  std::vector<float> samples;
+  ASSERT_TRUE( r.render(f, samples) );
+  ASSERT_EQ(8000, (int)samples.size());
+
+  //both square waves are mixed
+  bool foundSum = false;
+  for(size_t i=0; i<4000; i++)
+  {
+    ASSERT_TRUE( samples[i] == 0.5f || samples[i] == 0.0f || samples[i] == -0.5f );
+    if (samples[i] != 0.0f)
+      foundSum = true;
+  }
+  ASSERT_TRUE( foundSum );
+
+  //then the low note plays alone
+  for(size_t i=4000; i<8000; i++)
+  {
+    ASSERT_TRUE( samples[i] == 0.25f || samples[i] == -0.25f );
+  }
+}
+
+TEST_F(TestRenderer, testEnvelope)
+{
+  MidiFile f;
+  f.addNote(1000, 100);
+
+  MidiRenderer r;
+  r.setSampleRate(8000);
+  r.setGain(1.0f);
+  r.setEnvelope(10000, 20000); //80 samples fade in, 160 samples fade out
+
+  std::vector<float> samples;
+  ASSERT_TRUE( r.render(f, samples) );
+  ASSERT_EQ(800, (int)samples.size());
+
+  //fade in
+  ASSERT_EQ(0.0f, samples[0]);
+  for(size_t i=0; i<80; i++)
+  {
+    float expected = (i%8 < 4 ? 1.0f : -1.0f) * i / 80.0f;
+    ASSERT_NEAR(expected, samples[i], 0.0001f);
+  }
+
+  //sustain
+  for(size_t i=80; i<640; i++)
+  {
+    ASSERT_EQ(i%8 < 4 ? 1.0f : -1.0f, samples[i]);
+  }
+
+  //fade out
+  for(size_t i=640; i<800; i++)
+  {
+    float expected = (i%8 < 4 ? 1.0f : -1.0f) * (800 - i) / 160.0f;
+    ASSERT_NEAR(expected, samples[i], 0.0001f);
+  }
+
+  //the envelope of short notes is shortened
+  MidiFile shortNote;
+  shortNote.addNote(1000, 5); //40 samples
+  ASSERT_TRUE( r.render(shortNote, samples) );
+  ASSERT_EQ(40, (int)samples.size());
+  ASSERT_EQ(0.0f, samples[0]);
+  ASSERT_NEAR(19.0f/20.0f, fabsf(samples[19]), 0.0001f);
+  ASSERT_NEAR(1.0f/20.0f, fabsf(samples[39]), 0.0001f);
+}
+
+TEST_F(TestRenderer, testPcm16)
+{
+  MidiFile f;
+  f.addNote(1000, 100);
+
+  MidiRenderer r;
+  r.setSampleRate(8000);
+  r.setGain(0.5f);
+
+  std::vector<int16_t> pcm;
+  ASSERT_TRUE( r.render(f, pcm) );
+  ASSERT_EQ(800, (int)pcm.size());
+  for(size_t i=0; i<pcm.size(); i++)
+  {
+    ASSERT_EQ(i%8 < 4 ? 16384 : -16384, (int)pcm[i]);
+  }
+
+  //samples out of range are clipped
+  r.setGain(2.0f);
+  ASSERT_TRUE( r.render(f, pcm) );
+  for(size_t i=0; i<pcm.size(); i++)
+  {
+    ASSERT_EQ(i%8 < 4 ? 32767 : -32767, (int)pcm[i]);
+  }
+
+  //samples are rounded half to even like lrintf() on all platforms
+  std::vector<float> samples;
+  size_t numHalves = 0;
+  for(int k=0; k<64; k++)
+  {
+    r.setGain((1000.5f + 2*k) / 32767.0f);
+    ASSERT_TRUE( r.render(f, samples) );
+    ASSERT_TRUE( r.render(f, pcm) );
+    ASSERT_EQ(samples.size(), pcm.size());
+    for(size_t i=0; i<pcm.size(); i++)
+    {
+      float v = samples[i] * 32767.0f;
+      if (fabsf(v - floorf(v)) == 0.5f)
+        numHalves++;
+      ASSERT_EQ((int)lrintf(v), (int)pcm[i]) << "at sample " << i;
+    }
+  }
+  ASSERT_GT(numHalves, (size_t)0);
+}
+
+TEST_F(TestRenderer, testChunkedRendering)
+{
+  //a melody longer than the internal buffers with notes not aligned on blocks
+  MidiFile f;
+  for(int i=0; i<40; i++)
+  {
+    f.addNote((uint16_t)(200 + 37*i), (uint16_t)(13 + i));
+    f.addDelay(7);
+  }
+
+  MidiRenderer r;
+  r.setWaveform(MidiRenderer::WAVEFORM_SINE);
+  r.setEnvelope(2000, 3000);
+
+  std::vector<float> samples;
+  std::vector<int16_t> pcm;
+  ASSERT_TRUE( r.render(f, samples) );
+  ASSERT_TRUE( r.render(f, pcm) );
+  ASSERT_EQ(samples.size(), pcm.size());
+  ASSERT_GT(samples.size(), (size_t)(16*1024));
+  for(size_t i=0; i<samples.size(); i++)
+  {
+    int expected = (int)lrintf(samples[i]*32767.0f);
+    ASSERT_EQ(expected, (int)pcm[i]);
+  }
+}
+
+TEST_F(TestRenderer, testWav)
+{
+  MidiFile f;
+  f.addNote(1000, 10);
+
+  MidiRenderer r;
+  r.setSampleRate(8000);
+  r.setGain(0.5f);
+
+  MemorySink sink;
+  ASSERT_TRUE( r.saveWav(f, sink) );
+  const std::vector<uint8_t> & wav = sink.getBuffer();
+  ASSERT_EQ(44 + 2*80, (int)wav.size());
+
+  //header
+  ASSERT_EQ(0, memcmp(&wav[0], "RIFF", 4));
+  ASSERT_EQ(36 + 2*80, (int)readLittleEndian32(wav, 4));
+  ASSERT_EQ(0, memcmp(&wav[8], "WAVEfmt ", 8));
+  ASSERT_EQ(16, (int)readLittleEndian32(wav, 16));
+  ASSERT_EQ(1, (int)readLittleEndian16(wav, 20)); //PCM
+  ASSERT_EQ(1, (int)readLittleEndian16(wav, 22)); //mono
+  ASSERT_EQ(8000, (int)readLittleEndian32(wav, 24));
+  ASSERT_EQ(16000, (int)readLittleEndian32(wav, 28));
+  ASSERT_EQ(2, (int)readLittleEndian16(wav, 32));
+  ASSERT_EQ(16, (int)readLittleEndian16(wav, 34));
+  ASSERT_EQ(0, memcmp(&wav[36], "data", 4));
+  ASSERT_EQ(2*80, (int)readLittleEndian32(wav, 40));
+
+  //samples
+  ASSERT_EQ(16384, (int)(int16_t)readLittleEndian16(wav, 44));
+  ASSERT_EQ(-16384, (int)(int16_t)readLittleEndian16(wav, 44 + 2*4));
+
+  //save to a file
+  static const std::string path = getTestOutputFilePath("testWav.output.wav");
+  ASSERT_TRUE( r.saveWav(f, path.c_str()) );
+}
+
+TEST_F(TestRenderer, testInstrumentWaveforms)
+{
+  ASSERT_EQ(MidiRenderer::WAVEFORM_TRIANGLE, MidiRenderer::getInstrumentWaveform(0)); //Acoustic Grand Piano
+  ASSERT_EQ(MidiRenderer::WAVEFORM_SINE, MidiRenderer::getInstrumentWaveform(19)); //Church Organ
+  ASSERT_EQ(MidiRenderer::WAVEFORM_SAW, MidiRenderer::getInstrumentWaveform(40)); //Violin
+  ASSERT_EQ(MidiRenderer::WAVEFORM_SQUARE, MidiRenderer::getInstrumentWaveform(80)); //Lead 1 (square)
+  ASSERT_EQ(MidiRenderer::WAVEFORM_SINE, MidiRenderer::getInstrumentWaveform(73)); //Flute
+  ASSERT_EQ(MidiRenderer::WAVEFORM_SQUARE, MidiRenderer::getInstrumentWaveform(127)); //Gunshot
+  ASSERT_EQ(MidiRenderer::WAVEFORM_SQUARE, MidiRenderer::getInstrumentWaveform(-1));
+
+  //the waveform of the melody follows its instrument
+  MidiFile f;
+  f.setInstrument(40); //Violin
+  f.addNote(1000, 10);
+
+  MidiRenderer r;
+  r.setSampleRate(8000);
+  r.setGain(1.0f);
+  r.setWaveform(MidiRenderer::WAVEFORM_INSTRUMENT);
+
+  std::vector<float> samples;
+  ASSERT_TRUE( r.render(f, samples) );
+  ASSERT_NEAR(getSawValue(1), samples[1], TOLERANCE);
+}
+
+TEST_F(TestRenderer, testParallelRendering)
+{
+  //a long melody with overlapping notes, tempo changes and notes across the segment boundaries
+  MidiFile f;
+  f.setTicksPerQuarterNote(480);
+  for(int i=0; i<200; i++)
+  {
+    f.addNote((uint16_t)(300 + 11*i), (uint16_t)(50 + i%37));
+    f.addDelay((uint16_t)(i%5));
+  }
+  for(uint32_t i=0; i<100; i++)
+  {
+    ASSERT_TRUE( f.addNoteAt(i*173, 480 + i*7, (int8_t)(40 + i%40), (int8_t)(0x40 + i%0x3f), (uint8_t)(i%16)) );
+  }
+  ASSERT_TRUE( f.addTempoChange(3000, 350000) );
+  ASSERT_TRUE( f.addTempoChange(7000, 650000) );
+
+  MidiRenderer r;
+  ASSERT_EQ(1, (int)r.getThreadCount());
+  r.setWaveform(MidiRenderer::WAVEFORM_SINE);
+  r.setEnvelope(1500, 4000);
+
+  std::vector<float> expectedSamples;
+  std::vector<int16_t> expectedPcm;
+  MemorySink expectedWav;
+  ASSERT_TRUE( r.render(f, expectedSamples) );
+  ASSERT_TRUE( r.render(f, expectedPcm) );
+  ASSERT_TRUE( r.saveWav(f, expectedWav) );
+  ASSERT_GT(expectedSamples.size(), (size_t)(20*44100));
+
+  static const size_t threadCounts[] = {2, 3, 8, 0};
+  for(size_t i=0; i<sizeof(threadCounts)/sizeof(threadCounts[0]); i++)
+  {
+    r.setThreadCount(threadCounts[i]);
+    ASSERT_GE(r.getThreadCount(), (size_t)1);
+
+    //the rendered samples are identical whatever the number of threads
+    std::vector<float> samples;
+    std::vector<int16_t> pcm;
+    MemorySink wav;
+    ASSERT_TRUE( r.render(f, samples) );
+    ASSERT_TRUE( r.render(f, pcm) );
+    ASSERT_TRUE( r.saveWav(f, wav) );
+    ASSERT_TRUE( samples == expectedSamples );
+    ASSERT_TRUE( pcm == expectedPcm );
+    ASSERT_TRUE( wav.getBuffer() == expectedWav.getBuffer() );
+  }
+}
@@ -0,0 +1,228 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#include "libmidi/libmidi.h"
+#include "libmidi/sinks.h"
+#include "libmidi/streamwriter.h"
+
+#include "TestSinks.h"
+
+#ifdef _WIN32
+#   include <io.h>
+#   include <fcntl.h>
+#else
+#   include <unistd.h>
+#endif
+
+using namespace libmidi;
+
+typedef std::vector<unsigned char> CharSequence;
+
+extern std::string getTestInputFilePath(const char * name);
+extern std::string getTestOutputFilePath(const char * name);
+extern CharSequence readFileContentAsArray(const char * iFilePath);
+
+struct CALLBACK_CALLS
+{
+  CharSequence bytes;
+  std::vector<size_t> sizes;
+};
+
+static bool appendToCalls(const void * iData, size_t iSize, void * iUserData)
+{
+  CALLBACK_CALLS * calls = (CALLBACK_CALLS *)iUserData;
+  const unsigned char * data = (const unsigned char *)iData;
+  calls->bytes.insert(calls->bytes.end(), data, data + iSize);
+  calls->sizes.push_back(iSize);
+  return true;
+}
+
+static bool failCallback(const void * /*iData*/, size_t /*iSize*/, void * /*iUserData*/)
+{
+  return false;
+}
+
+void TestSinks::SetUp()
+{
+}
+
+void TestSinks::TearDown()
+{
+}
+
+TEST_F(TestSinks, testBufferedWrites)
+{
+  CALLBACK_CALLS calls;
+  {
+    CallbackSink sink(&appendToCalls, &calls, 16);
+    ASSERT_FALSE( sink.isSeekable() );
+    ASSERT_FALSE( sink.seek(0) );
+
+    //small writes are buffered
+    ASSERT_TRUE( sink.write("0123", 4) );
+    ASSERT_TRUE( sink.write("4567", 4) );
+    ASSERT_TRUE( sink.write("89ab", 4) );
+    ASSERT_EQ(0, calls.sizes.size());
+
+    //buffer is full
+    ASSERT_TRUE( sink.write("cdefghij", 8) );
+    ASSERT_EQ(1, calls.sizes.size());
+    ASSERT_EQ(12, calls.sizes[0]);
+
+    //big writes are not buffered
+    ASSERT_TRUE( sink.write("klmnopqrstuvwxyz", 16) );
+    ASSERT_EQ(3, calls.sizes.size());
+    ASSERT_EQ(8, calls.sizes[1]);
+    ASSERT_EQ(16, calls.sizes[2]);
+
+    ASSERT_TRUE( sink.write("!", 1) );
+    ASSERT_TRUE( sink.flush() );
+    ASSERT_EQ(4, calls.sizes.size());
+    ASSERT_TRUE( sink.flush() );
+    ASSERT_EQ(4, calls.sizes.size());
+  }
+
+  std::string actual(calls.bytes.begin(), calls.bytes.end());
+  ASSERT_EQ("0123456789abcdefghijklmnopqrstuvwxyz!", actual);
+
+  //errors are reported
+  CallbackSink sink(&failCallback, NULL, 16);
+  ASSERT_TRUE( sink.write("0123", 4) );
+  ASSERT_FALSE( sink.flush() );
+  ASSERT_FALSE( sink.write("0123456789abcdefghij", 20) );
+}
+
+TEST_F(TestSinks, testFileSink)
+{
+  static const std::string outputFile = getTestOutputFilePath("testFileSink.output.bin");
+
+  FileSink sink;
+  ASSERT_FALSE( sink.isOpened() );
+  ASSERT_FALSE( sink.write("0", 1) && sink.flush() );
+  ASSERT_FALSE( sink.open(NULL) );
+
+  ASSERT_TRUE( sink.open(outputFile.c_str()) );
+  ASSERT_TRUE( sink.isSeekable() );
+  ASSERT_TRUE( sink.write("0123456789", 10) );
+  ASSERT_TRUE( sink.seek(2) );
+  ASSERT_TRUE( sink.write("ab", 2) );
+  ASSERT_TRUE( sink.close() );
+
+  CharSequence content = readFileContentAsArray(outputFile.c_str());
+  std::string actual(content.begin(), content.end());
+  ASSERT_EQ("01ab456789", actual);
+
+  //update the existing file
+  uint64_t size = 0;
+  ASSERT_FALSE( sink.getFileSize(size) );
+  ASSERT_FALSE( sink.openExisting(getTestOutputFilePath("testFileSink.missing.bin").c_str()) );
+  ASSERT_TRUE( sink.openExisting(outputFile.c_str()) );
+  ASSERT_TRUE( sink.getFileSize(size) );
+  ASSERT_EQ(10, (int)size);
+  ASSERT_TRUE( sink.seek(8) );
+  ASSERT_TRUE( sink.write("cdef", 4) );
+  ASSERT_TRUE( sink.close() );
+
+  content = readFileContentAsArray(outputFile.c_str());
+  actual.assign(content.begin(), content.end());
+  ASSERT_EQ("01ab4567cdef", actual);
+}
+
+TEST_F(TestSinks, testStreamSink)
+{
+  int fds[2];
+#ifdef _WIN32
+  ASSERT_EQ(0, _pipe(fds, 65536, _O_BINARY));
+#else
+  ASSERT_EQ(0, pipe(fds));
+#endif
+
+  MidiFile f;
+  ASSERT_TRUE( f.load(getTestInputFilePath("mario1up.mid").c_str()) );
+  {
+    StreamSink sink(fds[1]);
+    ASSERT_FALSE( sink.isSeekable() );
+    ASSERT_TRUE( f.save(sink) );
+  }
+#ifdef _WIN32
+  _close(fds[1]);
+#else
+  close(fds[1]);
+#endif
+
+  CharSequence actual;
+  unsigned char buffer[256];
+  for(;;)
+  {
+#ifdef _WIN32
+    int size = _read(fds[0], buffer, sizeof(buffer));
+#else
+    int size = (int)read(fds[0], buffer, sizeof(buffer));
+#endif
+    if (size <= 0)
+      break;
+    actual.insert(actual.end(), buffer, buffer + size);
+  }
+#ifdef _WIN32
+  _close(fds[0]);
+#else
+  close(fds[0]);
+#endif
+
+  //ASSERT content is identical
+  CharSequence expectedFileContent = readFileContentAsArray(getTestInputFilePath("mario1up.mid").c_str());
+  ASSERT_TRUE( expectedFileContent == actual );
+}
+
+TEST_F(TestSinks, testSaveToCallback)
+{
+  MidiFile f;
+  ASSERT_TRUE( f.load(getTestInputFilePath("buzzer.mid").c_str()) );
+
+  CALLBACK_CALLS calls;
+  CallbackSink sink(&appendToCalls, &calls);
+  ASSERT_TRUE( f.save(sink) );
+  ASSERT_EQ(1, calls.sizes.size());
+
+  //ASSERT content is identical
+  CharSequence expectedFileContent = readFileContentAsArray(getTestInputFilePath("buzzer.mid").c_str());
+  ASSERT_TRUE( expectedFileContent == calls.bytes );
+
+  //a stream writer buffers the whole track for sinks that cannot seek
+  calls.bytes.clear();
+  calls.sizes.clear();
+  MidiStreamWriter w;
+  w.setInstrument(0x51);
+  w.setTempo(0x051615);
+  w.setName("buzzer");
+  w.setVolume(0x64);
+  ASSERT_TRUE( w.open(sink) );
+  for(int i=0; i<10; i++)
+  {
+    ASSERT_TRUE( w.addNote(131, 125) );
+    ASSERT_TRUE( w.addDelay(125) );
+  }
+  ASSERT_TRUE( w.close() );
+  ASSERT_TRUE( expectedFileContent == calls.bytes );
+}
@@ -0,0 +1,249 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#include "libmidi/libmidi.h"
+#include "libmidi/streamwriter.h"
+#include "libmidi/pitches.h"
+
+#include "TestStreamWriter.h"
+
+using namespace libmidi;
+
+typedef std::vector<unsigned char> CharSequence;
+
+extern std::string getTestInputFilePath(const char * name);
+extern std::string getTestOutputFilePath(const char * name);
+extern CharSequence readFileContentAsArray(const char * iFilePath);
+
+//a memory sink that cannot seek and remembers the size of the biggest write
+class TestSink : public ByteSink
+{
+public:
+  TestSink(bool iSeekable) : mSeekable(iSeekable), mNumWrites(0), mMaxWriteSize(0) {}
+  virtual bool write(const void * iData, size_t iSize)
+  {
+    mNumWrites++;
+    if (iSize > mMaxWriteSize)
+      mMaxWriteSize = iSize;
+    return mMemory.write(iData, iSize);
+  }
+  virtual bool isSeekable() const { return mSeekable; }
+  virtual bool seek(uint64_t iOffset) { return mSeekable && mMemory.seek(iOffset); }
+  virtual bool flush() { return true; }
+
+  bool mSeekable;
+  size_t mNumWrites;
+  size_t mMaxWriteSize;
+  MemorySink mMemory;
+};
+
+void TestStreamWriter::SetUp()
+{
+}
+
+void TestStreamWriter::TearDown()
+{
+}
+
+TEST_F(TestStreamWriter, testMario1Up)
+{
+  MidiStreamWriter w;
+  w.setInstrument(0x51);
+  w.setMidiType(MidiFile::MIDI_TYPE_0);
+  w.setTempo(0x051615);
+  w.setName("mario1up");
+  w.setVolume(0x64);
+
+  MemorySink sink;
+  ASSERT_TRUE( w.open(sink) );
+  ASSERT_TRUE( w.addNote(659 , 125) );
+  ASSERT_TRUE( w.addNote(784 , 125) );
+  ASSERT_TRUE( w.addNote(1319, 125) );
+  ASSERT_TRUE( w.addNote(1047, 125) );
+  ASSERT_TRUE( w.addNote(1175, 125) );
+  ASSERT_TRUE( w.addNote(1568, 125) );
+  ASSERT_TRUE( w.close() );
+  ASSERT_FALSE( w.isOpened() );
+
+  //ASSERT content is identical
+  CharSequence expectedFileContent = readFileContentAsArray(getTestInputFilePath("mario1up.mid").c_str());
+  ASSERT_TRUE( expectedFileContent == sink.getBuffer() );
+}
+
+TEST_F(TestStreamWriter, testSameAsSave)
+{
+  static const MidiFile::TRACK_ENDING_PREFERENCE preferences[] = {
+    MidiFile::STOP_PREVIOUS_NOTE,
+    MidiFile::STOP_ALL_NOTES,
+  };
+  static const bool seekables[] = {true, false};
+
+  for(size_t i=0; i<2; i++)
+  {
+    for(size_t j=0; j<2; j++)
+    {
+      MidiFile f;
+      f.setName("stream");
+      f.setTempo(400000);
+      f.setTrackEndingPreference(preferences[i]);
+
+      MidiStreamWriter w;
+      w.setName("stream");
+      w.setTempo(400000);
+      w.setTrackEndingPreference(preferences[i]);
+      w.setChunkSize(MidiStreamWriter::MIN_CHUNK_SIZE);
+
+      TestSink sink(seekables[j]);
+      ASSERT_TRUE( w.open(sink) );
+
+      //a lot of notes with delays
+      for(uint16_t k=0; k<5000; k++)
+      {
+        uint16_t frequency = 100 + k%1000;
+        uint16_t duration = 10 + k%300;
+        f.addNote(frequency, duration);
+        ASSERT_TRUE( w.addNote(frequency, duration) );
+        if (k%7 == 0)
+        {
+          f.addDelay(duration);
+          ASSERT_TRUE( w.addDelay(duration) );
+        }
+      }
+
+      //nothing is written to a non seekable sink until the writer is closed
+      if (!seekables[j])
+      {
+        ASSERT_EQ(0, sink.mNumWrites);
+      }
+
+      uint64_t size = w.getSize();
+      ASSERT_TRUE( w.close() );
+
+      std::vector<uint8_t> expected;
+      ASSERT_TRUE( f.saveToBuffer(expected) );
+      ASSERT_TRUE( expected == sink.mMemory.getBuffer() ) << "i=" << i << " j=" << j;
+      ASSERT_GT(expected.size(), size);
+
+      if (seekables[j])
+      {
+        //written by chunks
+        ASSERT_LE(sink.mMaxWriteSize, (size_t)MidiStreamWriter::MIN_CHUNK_SIZE);
+      }
+      else
+      {
+        //written at once
+        ASSERT_EQ(1, sink.mNumWrites);
+      }
+    }
+  }
+}
+
+TEST_F(TestStreamWriter, testMicroseconds)
+{
+  MidiFile f;
+  f.setTicksPerQuarterNote(96);
+
+  MidiStreamWriter w;
+  w.setTicksPerQuarterNote(96);
+  TestSink sink(true);
+  ASSERT_TRUE( w.open(sink) );
+
+  for(uint32_t k=0; k<1000; k++)
+  {
+    uint32_t duration = 1234 + k*17;
+    f.addNoteUs(262 + k%100, duration);
+    ASSERT_TRUE( w.addNoteUs(262 + k%100, duration) );
+    f.addDelayUs(duration/3);
+    ASSERT_TRUE( w.addDelayUs(duration/3) );
+  }
+  ASSERT_TRUE( w.close() );
+
+  std::vector<uint8_t> expected;
+  ASSERT_TRUE( f.saveToBuffer(expected) );
+  ASSERT_TRUE( expected == sink.mMemory.getBuffer() );
+}
+
+TEST_F(TestStreamWriter, testCompactEncoding)
+{
+  MidiFile f;
+  f.setCompactEncoding(true);
+  f.setTrackEndingPreference(MidiFile::STOP_ALL_NOTES);
+
+  MidiStreamWriter w;
+  w.setCompactEncoding(true);
+  w.setTrackEndingPreference(MidiFile::STOP_ALL_NOTES);
+  TestSink sink(true);
+  ASSERT_TRUE( w.open(sink) );
+
+  for(uint16_t k=0; k<500; k++)
+  {
+    f.addNote(262 + k%100, 125);
+    ASSERT_TRUE( w.addNote(262 + k%100, 125) );
+    if (k%3 == 0)
+    {
+      f.addDelay(60);
+      ASSERT_TRUE( w.addDelay(60) );
+    }
+  }
+  ASSERT_TRUE( w.close() );
+
+  std::vector<uint8_t> expected;
+  ASSERT_TRUE( f.saveToBuffer(expected) );
+  ASSERT_TRUE( expected == sink.mMemory.getBuffer() );
+}
+
+TEST_F(TestStreamWriter, testFile)
+{
+  static const std::string outputFile = getTestOutputFilePath("testStreamWriterFile.output.mid");
+
+  MidiStreamWriter w;
+  w.setInstrument(0x51);
+  w.setMidiType(MidiFile::MIDI_TYPE_0);
+  w.setTempo(0x051615);
+  w.setName("buzzer");
+  w.setVolume(0x64);
+  ASSERT_TRUE( w.open(outputFile.c_str()) );
+  for(size_t i=0; i<10; i++)
+  {
+    ASSERT_TRUE( w.addNote(131, 125) ); // C3 instead of C4 which is 262
+    ASSERT_TRUE( w.addDelay(125) );
+  }
+  ASSERT_TRUE( w.close() );
+
+  //ASSERT content is identical
+  CharSequence actualFileContent   = readFileContentAsArray(outputFile.c_str());
+  CharSequence expectedFileContent = readFileContentAsArray(getTestInputFilePath("buzzer.mid").c_str());
+  ASSERT_TRUE( expectedFileContent == actualFileContent );
+}
+
+TEST_F(TestStreamWriter, testNotOpened)
+{
+  MidiStreamWriter w;
+  ASSERT_FALSE( w.isOpened() );
+  ASSERT_FALSE( w.addNote(NOTE_C4, 100) );
+  ASSERT_FALSE( w.addDelay(100) );
+  ASSERT_FALSE( w.close() );
+  ASSERT_FALSE( w.open((const char *)NULL) );
+  ASSERT_FALSE( w.isOpened() );
+}
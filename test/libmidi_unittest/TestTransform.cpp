@@ -0,0 +1,324 @@
+/**********************************************************************************
+ * MIT License
+ * 
+ * Copyright (c) 2018 Antoine Beauchamp
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *********************************************************************************/
+
+#include "libmidi/libmidi.h"
+#include "libmidi/transform.h"
+#include "libmidi/streamwriter.h"
+#include "libmidi/sinks.h"
+
+#include "TestTransform.h"
+
+using namespace libmidi;
+
+extern std::string getTestOutputFilePath(const char * iFilename);
+
+void TestTransform::SetUp()
+{
+}
+
+void TestTransform::TearDown()
+{
+}
+
+TEST_F(TestTransform, testIdentity)
+{
+  MidiFile f;
+  f.setName("identity");
+  f.addNote(440, 100);
+  f.addDelay(50);
+  f.addNote(880, 200);
+
+  MidiTransform t;
+  ASSERT_TRUE( t.isIdentity() );
+  ASSERT_EQ(0, t.getTranspose());
+  ASSERT_EQ(1.0, t.getStretch());
+
+  std::vector<uint8_t> expected;
+  ASSERT_TRUE( f.saveToBuffer(expected) );
+
+  MidiFileView view(f, t);
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( view.saveToBuffer(buffer) );
+  ASSERT_TRUE( buffer == expected );
+  ASSERT_EQ(expected.size(), view.computeEncodedSize());
+  ASSERT_EQ(&f, &view.getFile());
+}
+
+TEST_F(TestTransform, testTranspose)
+{
+  MidiFile f;
+  f.addNote(440, 100); //A4
+  f.addNote(262, 100); //C4
+  f.addDelay(100);
+  f.addNote(220, 100); //A3
+
+  MidiTransform t;
+  ASSERT_FALSE( t.transpose(128) );
+  ASSERT_FALSE( t.transpose(-128) );
+  ASSERT_TRUE( t.transpose(7) );
+  ASSERT_TRUE( t.transpose(5) );
+  ASSERT_EQ(12, t.getTranspose());
+  ASSERT_FALSE( t.isIdentity() );
+
+  //an octave higher
+  MidiFile expected;
+  expected.addNote(880, 100);
+  expected.addNote(523, 100);
+  expected.addDelay(100);
+  expected.addNote(440, 100);
+  std::vector<uint8_t> expectedBuffer;
+  ASSERT_TRUE( expected.saveToBuffer(expectedBuffer) );
+
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( MidiFileView(f, t).saveToBuffer(buffer) );
+  ASSERT_TRUE( buffer == expectedBuffer );
+
+  //the melody is not modified
+  ASSERT_EQ(440, f.getNoteFrequency(0));
+
+  //pitches out of range are clamped
+  ASSERT_EQ(0x7F, (int)t.transformPitch(0x7A));
+  MidiTransform down;
+  ASSERT_TRUE( down.transpose(-100) );
+  ASSERT_EQ(0, (int)down.transformPitch(69));
+}
+
+TEST_F(TestTransform, testStretch)
+{
+  MidiFile f;
+  f.addNote(440, 100);
+  f.addDelay(50);
+  f.addNote(880, 200);
+
+  MidiTransform t;
+  ASSERT_FALSE( t.stretch(0.0) );
+  ASSERT_FALSE( t.stretch(-1.0) );
+  ASSERT_TRUE( t.stretch(4.0) );
+  ASSERT_TRUE( t.stretch(0.5) );
+  ASSERT_EQ(2.0, t.getStretch());
+
+  //twice as slow
+  MidiFile expected;
+  expected.setTempo(2*MidiFile::DEFAULT_TEMPO);
+  expected.addNote(440, 200);
+  expected.addDelay(100);
+  expected.addNote(880, 400);
+  std::vector<uint8_t> expectedBuffer;
+  ASSERT_TRUE( expected.saveToBuffer(expectedBuffer) );
+
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( MidiFileView(f, t).saveToBuffer(buffer) );
+  ASSERT_TRUE( buffer == expectedBuffer );
+
+  MidiFile loaded;
+  ASSERT_TRUE( loaded.loadFromBuffer(&buffer[0], buffer.size()) );
+  ASSERT_EQ(3, (int)loaded.getNoteCount());
+  ASSERT_EQ(200, loaded.getNoteDuration(0));
+  ASSERT_EQ(100, loaded.getNoteDuration(1));
+  ASSERT_EQ(400, loaded.getNoteDuration(2));
+
+  //tempo changes are stretched too
+  MidiFile changes;
+  changes.addTempoChange(100, 250000);
+  changes.addNote(440, 100);
+  changes.addNote(880, 100);
+  std::vector<uint8_t> stretched;
+  ASSERT_TRUE( MidiFileView(changes, t).saveToBuffer(stretched) );
+  ASSERT_TRUE( loaded.loadFromBuffer(&stretched[0], stretched.size()) );
+  ASSERT_EQ(2*MidiFile::DEFAULT_TEMPO, loaded.getTempo());
+  ASSERT_EQ(1, (int)loaded.getTempoChangeCount());
+  ASSERT_EQ(200, loaded.getNoteDuration(0));
+  ASSERT_EQ(200, loaded.getNoteDuration(1));
+
+  //tempos are clamped
+  ASSERT_EQ(MidiTransform::MAX_TEMPO, t.transformTempo(0xF00000));
+}
+
+TEST_F(TestTransform, testVelocityCurve)
+{
+  uint8_t half[MidiTransform::NUM_VELOCITIES];
+  uint8_t invalid[MidiTransform::NUM_VELOCITIES];
+  for(size_t i=0; i<MidiTransform::NUM_VELOCITIES; i++)
+  {
+    half[i] = (uint8_t)(i/2);
+    invalid[i] = 0x80;
+  }
+
+  MidiTransform t;
+  ASSERT_FALSE( t.applyVelocityCurve(NULL) );
+  ASSERT_FALSE( t.applyVelocityCurve(invalid) );
+  ASSERT_TRUE( t.isIdentity() );
+  ASSERT_TRUE( t.applyVelocityCurve(half) );
+  ASSERT_TRUE( t.applyVelocityCurve(half) );
+  ASSERT_EQ(31, (int)t.transformVelocity(127));
+
+  MidiFile f;
+  f.addNote(440, 100);
+  f.setVolume(100);
+  f.addNote(880, 100);
+
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( MidiFileView(f, t).saveToBuffer(buffer) );
+  MidiFile loaded;
+  ASSERT_TRUE( loaded.loadFromBuffer(&buffer[0], buffer.size()) );
+  ASSERT_EQ(2, (int)loaded.getNoteCount());
+  ASSERT_EQ(31, (int)loaded.getNoteVolume(0));
+  ASSERT_EQ(25, (int)loaded.getNoteVolume(1));
+}
+
+TEST_F(TestTransform, testChannelMap)
+{
+  MidiTransform t;
+  ASSERT_FALSE( t.mapChannel(16, 0) );
+  ASSERT_FALSE( t.mapChannel(0, 16) );
+  ASSERT_TRUE( t.mapChannel(0, 2) );
+  ASSERT_TRUE( t.mapChannel(2, 3) );
+  ASSERT_EQ(3, (int)t.transformChannel(0));
+  ASSERT_EQ(1, (int)t.transformChannel(1));
+  ASSERT_EQ(3, (int)t.transformChannel(2));
+
+  MidiFile f;
+  f.addNoteAt(0, 480, 60, 100, 0);
+  f.addNoteAt(240, 480, 64, 100, 1);
+
+  MidiFile expected;
+  expected.addNoteAt(0, 480, 60, 100, 3);
+  expected.addNoteAt(240, 480, 64, 100, 1);
+  std::vector<uint8_t> expectedBuffer;
+  ASSERT_TRUE( expected.saveToBuffer(expectedBuffer) );
+
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( MidiFileView(f, t).saveToBuffer(buffer) );
+  ASSERT_TRUE( buffer == expectedBuffer );
+}
+
+TEST_F(TestTransform, testComposeViews)
+{
+  MidiFile f;
+  f.addNoteAt(0, 480, 60, 100, 0);
+  f.addNoteAt(240, 480, 64, 80, 1);
+  f.addNote(440, 100);
+  f.addNote(660, 300);
+
+  uint8_t curve[MidiTransform::NUM_VELOCITIES];
+  for(size_t i=0; i<MidiTransform::NUM_VELOCITIES; i++)
+    curve[i] = (uint8_t)(127 - i);
+
+  MidiTransform first;
+  first.transpose(-3);
+  first.stretch(1.5);
+  first.mapChannel(1, 4);
+  MidiTransform second;
+  second.transpose(5);
+  second.applyVelocityCurve(curve);
+  second.mapChannel(4, 6);
+
+  MidiTransform combined = first;
+  combined.append(second);
+  ASSERT_EQ(2, combined.getTranspose());
+  ASSERT_EQ(1.5, combined.getStretch());
+  ASSERT_EQ(6, (int)combined.transformChannel(1));
+  ASSERT_EQ(27, (int)combined.transformVelocity(100));
+
+  MidiFileView view(MidiFileView(f, first), second);
+  std::vector<uint8_t> buffer;
+  ASSERT_TRUE( view.saveToBuffer(buffer) );
+  std::vector<uint8_t> expected;
+  ASSERT_TRUE( MidiFileView(f, combined).saveToBuffer(expected) );
+  ASSERT_TRUE( buffer == expected );
+  ASSERT_EQ(buffer.size(), view.computeEncodedSize());
+
+  MemorySink sink;
+  ASSERT_TRUE( view.save(sink) );
+  ASSERT_TRUE( sink.getBuffer() == expected );
+
+  std::string path = getTestOutputFilePath("testTransformComposeViews.mid");
+  ASSERT_TRUE( view.save(path.c_str()) );
+}
+
+TEST_F(TestTransform, testKernels)
+{
+  static const size_t NUM_VALUES = 1000;
+  std::vector<int8_t> values(NUM_VALUES);
+  for(size_t i=0; i<NUM_VALUES; i++)
+    values[i] = (int8_t)((i*37) % 128);
+
+  uint8_t curve[MidiTransform::NUM_VELOCITIES];
+  for(size_t i=0; i<MidiTransform::NUM_VELOCITIES; i++)
+    curve[i] = (uint8_t)((i*i) / 128);
+
+  for(int transpose=-127; transpose<=127; transpose+=9)
+  {
+    MidiTransform t;
+    ASSERT_TRUE( t.transpose(transpose) );
+    ASSERT_TRUE( t.applyVelocityCurve(curve) );
+
+    //odd sizes exercise the scalar tail of the kernels
+    for(size_t count=NUM_VALUES-17; count<=NUM_VALUES; count+=17)
+    {
+      std::vector<int8_t> pitches(count);
+      std::vector<int8_t> velocities(values.begin(), values.begin() + count);
+      t.transformPitches(&values[0], &pitches[0], count);
+      t.transformVelocities(&velocities[0], &velocities[0], count); //in place
+      for(size_t i=0; i<count; i++)
+      {
+        ASSERT_EQ(t.transformPitch(values[i]), pitches[i]) << "at transpose " << transpose << " index " << i;
+        ASSERT_EQ(t.transformVelocity(values[i]), velocities[i]) << "at index " << i;
+      }
+    }
+  }
+}
+
+TEST_F(TestTransform, testStreamWriter)
+{
+  MidiTransform t;
+  t.transpose(-12);
+  t.stretch(0.75);
+  t.mapChannel(0, 5);
+  uint8_t curve[MidiTransform::NUM_VELOCITIES];
+  for(size_t i=0; i<MidiTransform::NUM_VELOCITIES; i++)
+    curve[i] = (uint8_t)(i/3);
+  t.applyVelocityCurve(curve);
+
+  MidiFile f;
+  f.setInstrument(40);
+  MidiStreamWriter writer;
+  writer.setInstrument(40);
+  writer.setTransform(t);
+  MemorySink sink;
+  ASSERT_TRUE( writer.open(sink) );
+  for(uint16_t i=0; i<1000; i++)
+  {
+    uint16_t frequency = (uint16_t)(220 + 20*(i%20));
+    uint16_t duration = (uint16_t)(50 + i%7);
+    f.addNote(frequency, duration);
+    ASSERT_TRUE( writer.addNote(frequency, duration) );
+  }
+  ASSERT_TRUE( writer.close() );
+
+  //the stream writer and the view encode the same melody
+  std::vector<uint8_t> expected;
+  ASSERT_TRUE( MidiFileView(f, t).saveToBuffer(expected) );
+  ASSERT_TRUE( sink.getBuffer() == expected );
+}